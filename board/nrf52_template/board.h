@@ -102,4 +102,18 @@
  */
 #define BOARD_BUTTON_INTERNAL_PULL true
 
+/**
+ * @brief   External SPI NOR flash
+ *
+ * Used by the bootloader when board_hw_ext_flash=spi_nor is set in config.mk.
+ * The flash is on the SPI instance and BOARD_SPI_xxx_PIN pins below, with its
+ * chip select on \ref BOARD_EXT_FLASH_CS_PIN. SPI clock defaults to 8 MHz.
+ */
+//#define USE_SPI0
+//#define BOARD_SPI_SCK_PIN               26
+//#define BOARD_SPI_MOSI_PIN              27
+//#define BOARD_SPI_MISO_PIN              28
+//#define BOARD_EXT_FLASH_CS_PIN          29
+//#define BOARD_EXT_FLASH_SPI_CLOCK       8000000
+
 #endif /* _BOARD_NRF52_TEMPLATE_BOARD_H_ */
@@ -16,3 +16,7 @@ board_hw_crystal_32k=yes
 ## Is DCDC to be enabled on the board? default:yes, possible values:yes, no
 ## (it replaces BOARD_SUPPORT_DCDC define in board.h)
 board_hw_dcdc=yes
+## External flash driver of the bootloader. default:none, possible values:
+## none, spi_nor (generic SPI NOR flash described by SFDP, pins are
+## BOARD_EXT_FLASH_CS_PIN and BOARD_SPI_xxx_PIN in board.h)
+#board_hw_ext_flash=spi_nor
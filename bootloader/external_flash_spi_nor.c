@@ -0,0 +1,741 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/*
+ * Generic JEDEC SPI NOR flash driver, enabled with board_hw_ext_flash=spi_nor
+ * in board/<board_name>/config.mk. It replaces the weak functions of
+ * external_flash.c.
+ *
+ * Geometry, erase opcodes, suspend/resume opcodes and typical timings are
+ * read from the SFDP Basic Flash Parameter Table (JESD216). Flashes without
+ * SFDP are assumed to have 256 bytes pages, 4 kB sectors erased with 0x20
+ * and a size given by the capacity byte of their JEDEC ID.
+ *
+ * Page programs and erases are started and the driver returns: isBusy()
+ * polls the status register and programs the next page of a write. Larger
+ * erase blocks are used when an erase request covers aligned blocks. Reads
+ * use fast read (0x0B) and DMA directly to the destination buffer. A read
+ * during an erase suspends the erase, if the flash supports it, and
+ * resumes it afterwards; reading the sector being erased returns undefined
+ * data.
+ *
+ * Only 3-byte addressing is used: at most 16 MB of the flash is available.
+ *
+ * board.h must define BOARD_EXT_FLASH_CS_PIN, the BOARD_SPI_xxx_PIN pins and
+ * the SPI instance (USE_SPIx). BOARD_EXT_FLASH_SPI_CLOCK may define the SPI
+ * clock.
+ */
+
+#include <string.h>
+
+#include "external_flash.h"
+#include "board.h"
+#include "spi.h"
+#include "mcu.h"
+
+#ifndef BOARD_EXT_FLASH_CS_PIN
+#error BOARD_EXT_FLASH_CS_PIN must be defined in board.h
+#endif
+
+#ifndef BOARD_EXT_FLASH_SPI_CLOCK
+#define BOARD_EXT_FLASH_SPI_CLOCK   8000000
+#endif
+
+/** SPI NOR commands */
+#define CMD_WRITE_ENABLE            0x06
+#define CMD_READ_STATUS             0x05
+#define CMD_PAGE_PROGRAM            0x02
+#define CMD_FAST_READ               0x0B
+#define CMD_READ_JEDEC_ID           0x9F
+#define CMD_READ_SFDP               0x5A
+#define CMD_RELEASE_POWER_DOWN      0xAB
+#define CMD_ERASE_4K                0x20
+#define CMD_ERASE_SUSPEND           0x75
+#define CMD_ERASE_RESUME            0x7A
+
+/** Write in progress bit of status register */
+#define STATUS_WIP                  0x01
+
+/** Size of a command with a 3-byte address */
+#define CMD_ADDR_SIZE               4
+
+/** Maximum size of a SPI transfer */
+#define MAX_XFER_SIZE               255
+
+/** Largest flash accessible with 3-byte addresses */
+#define MAX_FLASH_SIZE              (16UL * 1024 * 1024)
+
+/** Defaults for flashes without SFDP */
+#define DEFAULT_PAGE_SIZE           256
+#define DEFAULT_SECTOR_SIZE         4096
+#define DEFAULT_PAGE_WRITE_TIME     700
+#define DEFAULT_BYTE_WRITE_TIME     30
+#define DEFAULT_SECTOR_ERASE_TIME   45000
+
+/** Status reads after release from deep power-down (tRES1, a few us) */
+#define RELEASE_POLLS               16
+
+/** Status reads before giving up waiting for a suspend (tSUS, tens of us) */
+#define SUSPEND_POLLS               1000
+
+/** Rough software overhead of a SPI transaction, in us */
+#define TRANSACTION_OVERHEAD_US     3
+
+/** SFDP definitions */
+#define SFDP_SIGNATURE              0x50444653
+#define SFDP_HEADER_SIZE            8
+#define SFDP_PARAM_HEADER_SIZE      8
+#define SFDP_BFPT_ID                0xFF00
+#define SFDP_BFPT_MAX_DWORDS        16
+
+/** Number of erase types in BFPT */
+#define NUM_ERASE_TYPES             4
+
+/** An erase instruction */
+typedef struct
+{
+    /** Size erased, 0 if not supported */
+    uint32_t    size;
+    /** Typical erase time in us */
+    uint32_t    time;
+    uint8_t     opcode;
+} erase_type_t;
+
+/** Ongoing operation */
+typedef enum
+{
+    STATE_IDLE,
+    STATE_WRITING,
+    STATE_ERASING,
+} state_e;
+
+/** Was a flash found */
+static bool             m_initialized = false;
+
+/** Flash parameters */
+static flash_info_t     m_info;
+
+/** Erase types, sorted by size, first one is the sector size */
+static erase_type_t     m_erase_types[NUM_ERASE_TYPES];
+
+/** Erase suspend and resume opcodes, suspend is 0 if not supported */
+static uint8_t          m_suspend_opcode;
+static uint8_t          m_resume_opcode;
+
+/** Ongoing operation */
+static state_e          m_state;
+
+/** Rest of a write */
+static uint32_t         m_write_to;
+static const uint8_t *  m_write_from;
+static size_t           m_write_remaining;
+
+static spi_conf_t m_spi_conf =
+{
+    .clock = BOARD_EXT_FLASH_SPI_CLOCK,
+    .mode = SPI_MODE_HIGH_FIRST,    // SPI mode 0
+    .bit_order = SPI_ORDER_MSB,
+};
+
+static void select_chip(bool select)
+{
+    if (select)
+    {
+        nrf_gpio_pin_clear(BOARD_EXT_FLASH_CS_PIN);
+    }
+    else
+    {
+        nrf_gpio_pin_set(BOARD_EXT_FLASH_CS_PIN);
+    }
+}
+
+/**
+ * \brief   Write bytes, chip must be selected
+ */
+static bool spi_write(const uint8_t * data, size_t len)
+{
+    spi_xfer_t xfer =
+    {
+        .read_ptr = NULL,
+        .read_size = 0,
+    };
+
+    while (len > 0)
+    {
+        xfer.write_ptr = (uint8_t *) data;
+        xfer.write_size = len > MAX_XFER_SIZE ? MAX_XFER_SIZE : len;
+        if (SPI_transfer(&xfer, NULL) != SPI_RES_OK)
+        {
+            return false;
+        }
+        data += xfer.write_size;
+        len -= xfer.write_size;
+    }
+    return true;
+}
+
+/**
+ * \brief   Read bytes, chip must be selected
+ */
+static bool spi_read(uint8_t * data, size_t len)
+{
+    spi_xfer_t xfer =
+    {
+        .write_ptr = NULL,
+        .write_size = 0,
+    };
+
+    while (len > 0)
+    {
+        xfer.read_ptr = data;
+        xfer.read_size = len > MAX_XFER_SIZE ? MAX_XFER_SIZE : len;
+        if (SPI_transfer(&xfer, NULL) != SPI_RES_OK)
+        {
+            return false;
+        }
+        data += xfer.read_size;
+        len -= xfer.read_size;
+    }
+    return true;
+}
+
+/**
+ * \brief   Send a command, then write or read data, in one transaction
+ * \param   cmd
+ *          Command and address
+ * \param   data_out
+ *          Data to write after command, or NULL
+ * \param   data_in
+ *          Where to read data after command, or NULL
+ * \param   len
+ *          Size of data_out or data_in
+ */
+static bool transaction(const uint8_t * cmd,
+                        size_t cmd_len,
+                        const uint8_t * data_out,
+                        uint8_t * data_in,
+                        size_t len)
+{
+    bool res;
+
+    select_chip(true);
+    res = spi_write(cmd, cmd_len);
+    if (res && data_out != NULL)
+    {
+        res = spi_write(data_out, len);
+    }
+    if (res && data_in != NULL)
+    {
+        res = spi_read(data_in, len);
+    }
+    select_chip(false);
+
+    return res;
+}
+
+static bool simple_command(uint8_t opcode)
+{
+    return transaction(&opcode, 1, NULL, NULL, 0);
+}
+
+static bool address_command(uint8_t opcode,
+                            uint32_t addr,
+                            const uint8_t * data_out,
+                            uint8_t * data_in,
+                            size_t len)
+{
+    uint8_t cmd[CMD_ADDR_SIZE + 1];
+    size_t cmd_len = CMD_ADDR_SIZE;
+
+    cmd[0] = opcode;
+    cmd[1] = (uint8_t)(addr >> 16);
+    cmd[2] = (uint8_t)(addr >> 8);
+    cmd[3] = (uint8_t)addr;
+    if (opcode == CMD_FAST_READ || opcode == CMD_READ_SFDP)
+    {
+        // One dummy byte
+        cmd[cmd_len++] = 0;
+    }
+
+    return transaction(cmd, cmd_len, data_out, data_in, len);
+}
+
+static uint8_t read_status(void)
+{
+    uint8_t opcode = CMD_READ_STATUS;
+    uint8_t status = 0;
+
+    transaction(&opcode, 1, NULL, &status, 1);
+    return status;
+}
+
+/**
+ * \brief   Send a command that modifies the flash, with write enable
+ */
+static bool modify_command(uint8_t opcode,
+                           uint32_t addr,
+                           const uint8_t * data,
+                           size_t len)
+{
+    return simple_command(CMD_WRITE_ENABLE) &&
+           address_command(opcode, addr, data, NULL, len);
+}
+
+/**
+ * \brief   Start programming the next part of a write, up to end of page
+ */
+static bool program_next_page(void)
+{
+    size_t len = m_info.write_page_size -
+                 (m_write_to % m_info.write_page_size);
+
+    if (len > m_write_remaining)
+    {
+        len = m_write_remaining;
+    }
+
+    if (!modify_command(CMD_PAGE_PROGRAM, m_write_to, m_write_from, len))
+    {
+        return false;
+    }
+
+    m_write_to += len;
+    m_write_from += len;
+    m_write_remaining -= len;
+    return true;
+}
+
+/**
+ * \brief   Time to transfer bytes in a transaction, in us
+ */
+static uint32_t transaction_time(uint32_t num_bytes)
+{
+    return (num_bytes * 8 * 1000000 + BOARD_EXT_FLASH_SPI_CLOCK - 1) /
+           BOARD_EXT_FLASH_SPI_CLOCK + TRANSACTION_OVERHEAD_US;
+}
+
+/**
+ * \brief   Decode a typical erase time of BFPT 10th DWORD, in us
+ */
+static uint32_t erase_time(uint32_t field)
+{
+    static const uint32_t units_ms[] = {1, 16, 128, 1000};
+    return ((field & 0x1f) + 1) * units_ms[(field >> 5) & 0x3] * 1000;
+}
+
+/**
+ * \brief   Read SFDP Basic Flash Parameter Table
+ * \param   bfpt
+ *          Filled with table DWORDs, unread ones are set to 0
+ * \return  Number of DWORDs read, 0 if there is no table
+ */
+static uint8_t read_bfpt(uint32_t * bfpt)
+{
+    uint8_t header[SFDP_HEADER_SIZE];
+    uint8_t param[SFDP_PARAM_HEADER_SIZE];
+    uint32_t signature;
+    uint32_t addr;
+    uint8_t num_dwords;
+
+    memset(bfpt, 0, SFDP_BFPT_MAX_DWORDS * sizeof(uint32_t));
+
+    if (!address_command(CMD_READ_SFDP, 0, NULL, header, sizeof(header)))
+    {
+        return 0;
+    }
+    memcpy(&signature, header, sizeof(signature));
+    if (signature != SFDP_SIGNATURE)
+    {
+        return 0;
+    }
+
+    // First parameter header is always the BFPT
+    if (!address_command(CMD_READ_SFDP,
+                         SFDP_HEADER_SIZE,
+                         NULL,
+                         param,
+                         sizeof(param)))
+    {
+        return 0;
+    }
+    if ((param[0] | (param[7] << 8)) != SFDP_BFPT_ID)
+    {
+        return 0;
+    }
+
+    num_dwords = param[3];
+    if (num_dwords > SFDP_BFPT_MAX_DWORDS)
+    {
+        num_dwords = SFDP_BFPT_MAX_DWORDS;
+    }
+    addr = param[4] | (param[5] << 8) | (param[6] << 16);
+
+    if (!address_command(CMD_READ_SFDP,
+                         addr,
+                         NULL,
+                         (uint8_t *) bfpt,
+                         num_dwords * sizeof(uint32_t)))
+    {
+        return 0;
+    }
+    return num_dwords;
+}
+
+/**
+ * \brief   Set flash parameters from SFDP
+ * \return  True if flash has a usable BFPT
+ */
+static bool parse_bfpt(void)
+{
+    uint32_t bfpt[SFDP_BFPT_MAX_DWORDS];
+    uint8_t num_dwords = read_bfpt(bfpt);
+    uint32_t density;
+
+    // JESD216 defines 9 DWORDs, sizes and erase types are all there
+    if (num_dwords < 9)
+    {
+        return false;
+    }
+
+    density = bfpt[1];
+    if (density & 0x80000000)
+    {
+        m_info.flash_size = (density & 0x7fffffff) >= 27 ?
+                                MAX_FLASH_SIZE :
+                                (1UL << ((density & 0x7fffffff) - 3));
+    }
+    else
+    {
+        m_info.flash_size = density / 8 + 1;
+    }
+
+    for (uint8_t i = 0; i < NUM_ERASE_TYPES; i++)
+    {
+        uint16_t type = bfpt[7 + i / 2] >> (16 * (i % 2));
+        uint8_t size_exp = type & 0xff;
+        if (size_exp != 0 && size_exp < 32)
+        {
+            m_erase_types[i].size = 1UL << size_exp;
+            m_erase_types[i].opcode = type >> 8;
+        }
+    }
+
+    if (num_dwords >= 11)
+    {
+        // JESD216A: typical times and page size
+        uint32_t times = bfpt[10];
+
+        for (uint8_t i = 0; i < NUM_ERASE_TYPES; i++)
+        {
+            m_erase_types[i].time = erase_time(bfpt[9] >> (4 + 7 * i));
+        }
+        m_info.write_page_size = 1UL << ((times >> 4) & 0xf);
+        m_info.page_write_time = (((times >> 8) & 0x1f) + 1) *
+                                 ((times & (1 << 13)) ? 64 : 8);
+        m_info.byte_write_time = (((times >> 14) & 0xf) + 1) *
+                                 ((times & (1 << 18)) ? 8 : 1);
+    }
+
+    if (num_dwords >= 13 && !(bfpt[11] & 0x80000000))
+    {
+        // JESD216B: erase suspend and resume supported
+        m_suspend_opcode = bfpt[12] >> 24;
+        m_resume_opcode = bfpt[12] >> 16;
+    }
+
+    return true;
+}
+
+/**
+ * \brief   Sort erase types by size, unsupported ones last
+ */
+static void sort_erase_types(void)
+{
+    for (uint8_t i = 1; i < NUM_ERASE_TYPES; i++)
+    {
+        for (uint8_t j = i; j > 0; j--)
+        {
+            erase_type_t * a = &m_erase_types[j - 1];
+            erase_type_t * b = &m_erase_types[j];
+            if (b->size == 0 || (a->size != 0 && a->size <= b->size))
+            {
+                break;
+            }
+            erase_type_t tmp = *a;
+            *a = *b;
+            *b = tmp;
+        }
+    }
+}
+
+/**
+ * \brief   Wait until a suspend command is effective
+ * \return  True if flash is ready for reads
+ */
+static bool wait_suspended(void)
+{
+    for (uint32_t i = 0; i < SUSPEND_POLLS; i++)
+    {
+        if (!(read_status() & STATUS_WIP))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+extFlash_res_e externalFlash_init(void)
+{
+    uint8_t id[3];
+    uint8_t opcode = CMD_READ_JEDEC_ID;
+
+    nrf_gpio_pin_set(BOARD_EXT_FLASH_CS_PIN);
+    nrf_gpio_cfg_output(BOARD_EXT_FLASH_CS_PIN);
+
+    if (SPI_init(&m_spi_conf) != SPI_RES_OK)
+    {
+        return EXTFLASH_RES_ERROR;
+    }
+
+    // Flash may have been left in deep power-down by the application
+    simple_command(CMD_RELEASE_POWER_DOWN);
+    for (uint8_t i = 0; i < RELEASE_POLLS; i++)
+    {
+        read_status();
+    }
+
+    if (!transaction(&opcode, 1, NULL, id, sizeof(id)) ||
+        id[0] == 0x00 || id[0] == 0xff)
+    {
+        // No flash answering
+        return EXTFLASH_RES_ERROR;
+    }
+
+    memset(&m_info, 0, sizeof(m_info));
+    memset(m_erase_types, 0, sizeof(m_erase_types));
+    m_info.write_page_size = DEFAULT_PAGE_SIZE;
+    m_info.page_write_time = DEFAULT_PAGE_WRITE_TIME;
+    m_info.byte_write_time = DEFAULT_BYTE_WRITE_TIME;
+    m_suspend_opcode = 0;
+    m_resume_opcode = 0;
+
+    if (!parse_bfpt() || m_erase_types[0].size == 0)
+    {
+        // Most vendors encode size as a power of two in capacity byte
+        m_info.flash_size = (id[2] < 32) ? (1UL << id[2]) : 0;
+        m_erase_types[0].size = DEFAULT_SECTOR_SIZE;
+        m_erase_types[0].opcode = CMD_ERASE_4K;
+        m_erase_types[0].time = DEFAULT_SECTOR_ERASE_TIME;
+    }
+    sort_erase_types();
+
+    if (m_info.flash_size > MAX_FLASH_SIZE)
+    {
+        m_info.flash_size = MAX_FLASH_SIZE;
+    }
+    if (m_erase_types[0].time == 0)
+    {
+        m_erase_types[0].time = DEFAULT_SECTOR_ERASE_TIME;
+    }
+
+    m_info.erase_sector_size = m_erase_types[0].size;
+    m_info.sector_erase_time = m_erase_types[0].time;
+    m_info.write_alignment = 1;
+    m_info.byte_write_call_time = transaction_time(1) +
+                                  transaction_time(CMD_ADDR_SIZE + 1);
+    m_info.page_write_call_time = transaction_time(1) +
+                                  transaction_time(CMD_ADDR_SIZE +
+                                                   m_info.write_page_size);
+    m_info.sector_erase_call_time = transaction_time(1) +
+                                    transaction_time(CMD_ADDR_SIZE);
+    m_info.is_busy_call_time = transaction_time(2);
+
+    if (m_suspend_opcode != 0)
+    {
+        // An erase may have been left suspended before reset
+        simple_command(m_resume_opcode);
+    }
+
+    // Finish an erase started before reset, if any
+    m_state = (read_status() & STATUS_WIP) ? STATE_ERASING : STATE_IDLE;
+
+    m_initialized = true;
+    return EXTFLASH_RES_OK;
+}
+
+extFlash_res_e externalFlash_startRead(void * to, const void * from,
+                                       size_t amount)
+{
+    uint32_t addr = (uint32_t) from;
+    bool suspended = false;
+    bool res;
+
+    if (!m_initialized)
+    {
+        return EXTFLASH_RES_NODRIVER;
+    }
+
+    if (addr > m_info.flash_size || amount > m_info.flash_size - addr)
+    {
+        return EXTFLASH_RES_PARAM;
+    }
+
+    if (externalFlash_isBusy())
+    {
+        if (m_state != STATE_ERASING || m_suspend_opcode == 0)
+        {
+            return EXTFLASH_RES_BUSY;
+        }
+
+        simple_command(m_suspend_opcode);
+        suspended = true;
+        if (!wait_suspended())
+        {
+            simple_command(m_resume_opcode);
+            return EXTFLASH_RES_BUSY;
+        }
+    }
+
+    res = address_command(CMD_FAST_READ, addr, NULL, to, amount);
+
+    if (suspended)
+    {
+        simple_command(m_resume_opcode);
+    }
+
+    return res ? EXTFLASH_RES_OK : EXTFLASH_RES_ERROR;
+}
+
+extFlash_res_e externalFlash_startWrite(void * to, const void * from,
+                                        size_t amount)
+{
+    uint32_t addr = (uint32_t) to;
+
+    if (!m_initialized)
+    {
+        return EXTFLASH_RES_NODRIVER;
+    }
+
+    if (addr > m_info.flash_size || amount > m_info.flash_size - addr)
+    {
+        return EXTFLASH_RES_PARAM;
+    }
+
+    if (externalFlash_isBusy())
+    {
+        return EXTFLASH_RES_BUSY;
+    }
+
+    if (amount == 0)
+    {
+        return EXTFLASH_RES_OK;
+    }
+
+    m_write_to = addr;
+    m_write_from = from;
+    m_write_remaining = amount;
+
+    // First page now, next ones from isBusy()
+    if (!program_next_page())
+    {
+        return EXTFLASH_RES_ERROR;
+    }
+    m_state = STATE_WRITING;
+
+    return EXTFLASH_RES_OK;
+}
+
+extFlash_res_e externalFlash_startErase(size_t * sector_base,
+                                        size_t * number_of_sector)
+{
+    size_t base = *sector_base;
+    size_t remaining;
+    const erase_type_t * type = &m_erase_types[0];
+
+    if (!m_initialized)
+    {
+        return EXTFLASH_RES_NODRIVER;
+    }
+
+    if ((base % m_info.erase_sector_size) != 0 ||
+        base > m_info.flash_size ||
+        *number_of_sector > (m_info.flash_size - base) /
+                                                m_info.erase_sector_size)
+    {
+        return EXTFLASH_RES_PARAM;
+    }
+
+    if (externalFlash_isBusy())
+    {
+        return EXTFLASH_RES_BUSY;
+    }
+
+    if (*number_of_sector == 0)
+    {
+        return EXTFLASH_RES_OK;
+    }
+
+    // Largest block that is aligned and fully requested
+    remaining = *number_of_sector * m_info.erase_sector_size;
+    for (uint8_t i = 1; i < NUM_ERASE_TYPES; i++)
+    {
+        const erase_type_t * larger = &m_erase_types[i];
+        if (larger->size != 0 &&
+            (base % larger->size) == 0 &&
+            larger->size <= remaining)
+        {
+            type = larger;
+        }
+    }
+
+    if (!modify_command(type->opcode, base, NULL, 0))
+    {
+        return EXTFLASH_RES_ERROR;
+    }
+    m_state = STATE_ERASING;
+
+    *sector_base = base + type->size;
+    *number_of_sector -= type->size / m_info.erase_sector_size;
+
+    return EXTFLASH_RES_OK;
+}
+
+bool externalFlash_isBusy(void)
+{
+    if (!m_initialized || m_state == STATE_IDLE)
+    {
+        return false;
+    }
+
+    if (read_status() & STATUS_WIP)
+    {
+        return true;
+    }
+
+    if (m_state == STATE_WRITING && m_write_remaining > 0)
+    {
+        if (program_next_page())
+        {
+            return true;
+        }
+        // Write failed: nothing more can be done
+        m_write_remaining = 0;
+    }
+
+    m_state = STATE_IDLE;
+    return false;
+}
+
+extFlash_res_e externalFlash_getInfo(flash_info_t * info)
+{
+    if (!m_initialized)
+    {
+        return EXTFLASH_RES_NODRIVER;
+    }
+
+    memcpy(info, &m_info, sizeof(flash_info_t));
+    return EXTFLASH_RES_OK;
+}
@@ -58,6 +58,7 @@ void bootloader_test(bl_interface_t * interface)
     final_res &= Tests_info(interface);
     final_res &= Tests_areas(interface);
     final_res &= Tests_timings(interface);
+    final_res &= Tests_benchmark(interface);
 
     Print_printf("\n\n #######################################\n");
     Print_printf(    " #                                     #\n");
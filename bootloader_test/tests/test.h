@@ -32,6 +32,11 @@ bool Tests_areas(bl_interface_t * interface);
  */
 bool Tests_timings(bl_interface_t * interface);
 
+/**
+ * \brief   Flash and scratchpad benchmarks, printed as CSV records.
+ */
+bool Tests_benchmark(bl_interface_t * interface);
+
 /**
  * \brief   Tests scratchpad library.
  */
@@ -0,0 +1,670 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/*
+ * Flash and scratchpad benchmarks.
+ *
+ * Results are printed as CSV records, one per line, that can be extracted
+ * from the test log and compared across runs and boards with
+ * tools/flash_bench_compare.py:
+ *
+ *   BENCH,hdr,<format version>,<board>,<bootloader version>,<cpu MHz>
+ *   BENCH,area,<area id>,<int|ext>,<bench size>,<page>,<sector>,<alignment>
+ *   BENCH,res,<area id>,<bench>,<param>,<count>,<min us>,<avg us>,<max us>,
+ *             <bytes/s>
+ *   BENCH,err,<area id>,<bench>,<param>,<result code>
+ *
+ * Scratchpad results use area id "scrat". Random offsets come from a fixed
+ * seed so that runs are comparable.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "print.h"
+#include "test.h"
+#include "timing.h"
+
+/** Version of the record format, increase if records change */
+#define BENCH_FORMAT_VERSION    1
+
+/** Maximum number of bytes of an area used for benchmarks */
+#define BENCH_MAX_SIZE          (64 * 1024)
+
+/** Number of random reads per read size */
+#define RANDOM_READ_COUNT       256
+
+/** Seed of random offsets */
+#define RANDOM_SEED             0x1234abcd
+
+/** Number of isBusy() calls for idle overhead */
+#define IDLE_BUSY_COUNT         1000
+
+/** Maximum number of bytes written to scratchpad, including header */
+#define SCRAT_MAX_SIZE          (32 * 1024)
+
+/** Scratchpad tag and header */
+#define SCRAT_TAG_SIZE          16
+#define SCRAT_HEADER_SIZE       (SCRAT_TAG_SIZE + 16)
+
+/** Sequence number of benchmark scratchpads */
+#define SCRAT_SEQ               1
+
+/** Largest read or write */
+#define BUFFER_SIZE             1024
+
+#define STR(x)  #x
+#define XSTR(x) STR(x)
+
+#ifdef TARGET_BOARD
+#define BOARD_NAME XSTR(TARGET_BOARD)
+#else
+#define BOARD_NAME "unknown"
+#endif
+
+/** Scratchpad tag, see tools/genscratchpad.py */
+static const uint8_t m_scrat_tag[SCRAT_TAG_SIZE] =
+{
+    'S', 'C', 'R', '1', 0x9a, 0x93, 0x30, 0x82,
+    0xd9, 0xeb, 0x0a, 0xfc, 0x31, 0x21, 0xe3, 0x37
+};
+
+/** Read sizes */
+static const uint16_t m_read_sizes[] = {16, 256, BUFFER_SIZE};
+
+/** Scratchpad write block sizes */
+static const uint16_t m_scrat_block_sizes[] = {16, 64, 256, BUFFER_SIZE};
+
+static const memory_area_services_t * m_mem_services_p;
+
+static uint8_t m_buffer[BUFFER_SIZE] __attribute__((aligned(4)));
+
+static uint32_t m_random;
+
+/** isBusy() calls while a write or erase is ongoing */
+static timing_handle_t m_busy_active;
+
+static uint32_t next_random(void)
+{
+    /* Numerical Recipes LCG */
+    m_random = m_random * 1664525 + 1013904223;
+    return m_random;
+}
+
+static uint16_t crc16_add_byte(uint16_t crc, uint8_t byte)
+{
+    /* Same CRC16-CCITT as scratchpad tools */
+    crc = (crc >> 8) | (crc << 8);
+    crc ^= byte;
+    crc ^= (crc & 0xf0) >> 4;
+    crc ^= (crc & 0x0f) << 12;
+    crc ^= (crc & 0xff) << 5;
+    return crc;
+}
+
+static void print_result(const char * area,
+                         const char * bench,
+                         uint32_t param,
+                         timing_handle_t * h,
+                         uint32_t bytes)
+{
+    uint32_t total_us = h->sum / MCU_FREQ_MHZ;
+    uint32_t rate = 0;
+
+    if (h->cnt == 0)
+    {
+        return;
+    }
+
+    if (bytes > 0 && total_us > 0)
+    {
+        rate = (uint32_t)(((uint64_t) bytes * 1000000) / total_us);
+    }
+
+    Print_printf("BENCH,res,%s,%s,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                 area,
+                 bench,
+                 (unsigned long) param,
+                 (unsigned long) h->cnt,
+                 (unsigned long) (h->min / MCU_FREQ_MHZ),
+                 (unsigned long) (h->avg / MCU_FREQ_MHZ),
+                 (unsigned long) (h->max / MCU_FREQ_MHZ),
+                 (unsigned long) rate);
+}
+
+static void print_error(const char * area,
+                        const char * bench,
+                        uint32_t param,
+                        int code)
+{
+    Print_printf("BENCH,err,%s,%s,%lu,%d\n",
+                 area, bench, (unsigned long) param, code);
+}
+
+static void wait_idle(bl_memory_area_id_t id)
+{
+    bool busy = true;
+
+    while (busy)
+    {
+        Timing_start(&m_busy_active);
+        busy = m_mem_services_p->isBusy(id);
+        Timing_stop(&m_busy_active);
+    }
+}
+
+static bool erase(const char * area,
+                  bl_memory_area_id_t id,
+                  bl_memory_area_info_t * info_p,
+                  size_t size)
+{
+    uint32_t sector_base = 0;
+    size_t number_of_sector = size / info_p->flash.erase_sector_size;
+    bl_interface_res_e res;
+
+    while (number_of_sector > 0)
+    {
+        res = m_mem_services_p->startErase(id, &sector_base, &number_of_sector);
+        if (res != BL_RES_OK)
+        {
+            print_error(area, "erase", size, res);
+            return false;
+        }
+        wait_idle(id);
+    }
+    return true;
+}
+
+/**
+ * \brief   Time a read, until driver is idle
+ */
+static bl_interface_res_e timed_read(bl_memory_area_id_t id,
+                                     timing_handle_t * h,
+                                     uint32_t from,
+                                     size_t amount)
+{
+    bl_interface_res_e res;
+
+    Timing_start(h);
+    res = m_mem_services_p->startRead(id, m_buffer, from, amount);
+    while (m_mem_services_p->isBusy(id))
+    {
+    }
+    Timing_stop(h);
+
+    return res;
+}
+
+/**
+ * \brief   Time a write, until flash is idle
+ */
+static bl_interface_res_e timed_write(bl_memory_area_id_t id,
+                                      timing_handle_t * h,
+                                      uint32_t to,
+                                      size_t amount)
+{
+    bl_interface_res_e res;
+
+    Timing_start(h);
+    res = m_mem_services_p->startWrite(id, to, m_buffer, amount);
+    wait_idle(id);
+    Timing_stop(h);
+
+    return res;
+}
+
+static bool bench_sequential_read(const char * area,
+                                  bl_memory_area_id_t id,
+                                  size_t size)
+{
+    timing_handle_t timing;
+    bl_interface_res_e res;
+
+    for (uint8_t i = 0; i < sizeof(m_read_sizes) / sizeof(m_read_sizes[0]);
+         i++)
+    {
+        uint16_t chunk = m_read_sizes[i];
+
+        Timing_reset(&timing);
+        for (uint32_t pos = 0; pos + chunk <= size; pos += chunk)
+        {
+            res = timed_read(id, &timing, pos, chunk);
+            if (res != BL_RES_OK)
+            {
+                print_error(area, "seq_read", chunk, res);
+                return false;
+            }
+        }
+        print_result(area, "seq_read", chunk, &timing,
+                     timing.cnt * chunk);
+    }
+    return true;
+}
+
+static bool bench_random_read(const char * area,
+                              bl_memory_area_id_t id,
+                              size_t size)
+{
+    timing_handle_t timing;
+    bl_interface_res_e res;
+
+    /* Largest read size is for sequential reads only */
+    for (uint8_t i = 0;
+         i < sizeof(m_read_sizes) / sizeof(m_read_sizes[0]) - 1;
+         i++)
+    {
+        uint16_t chunk = m_read_sizes[i];
+
+        Timing_reset(&timing);
+        m_random = RANDOM_SEED;
+        for (uint16_t n = 0; n < RANDOM_READ_COUNT; n++)
+        {
+            uint32_t pos = next_random() % (size - chunk + 1);
+
+            res = timed_read(id, &timing, pos, chunk);
+            if (res != BL_RES_OK)
+            {
+                print_error(area, "rand_read", chunk, res);
+                return false;
+            }
+        }
+        print_result(area, "rand_read", chunk, &timing,
+                     timing.cnt * chunk);
+    }
+    return true;
+}
+
+/**
+ * \brief   Write the benchmark size with writes of chunk bytes
+ * \param   offset
+ *          Offset of first write, a multiple of the write alignment
+ */
+static bool bench_write(const char * area,
+                        const char * bench,
+                        bl_memory_area_id_t id,
+                        bl_memory_area_info_t * info_p,
+                        size_t size,
+                        uint32_t offset,
+                        size_t chunk)
+{
+    timing_handle_t timing;
+    bl_interface_res_e res;
+
+    if (!erase(area, id, info_p, size))
+    {
+        return false;
+    }
+
+    Timing_reset(&timing);
+    for (uint32_t pos = offset; pos + chunk <= size; pos += chunk)
+    {
+        res = timed_write(id, &timing, pos, chunk);
+        if (res != BL_RES_OK)
+        {
+            print_error(area, bench, chunk, res);
+            return false;
+        }
+    }
+    print_result(area, bench, chunk, &timing, timing.cnt * chunk);
+    return true;
+}
+
+/**
+ * \brief   Erase sectors one by one and read another sector meanwhile
+ */
+static bool bench_erase_read(const char * area,
+                             bl_memory_area_id_t id,
+                             bl_memory_area_info_t * info_p,
+                             size_t size)
+{
+    timing_handle_t timing_erase;
+    timing_handle_t timing_read;
+    timing_handle_t timing_rejected;
+    size_t sector = info_p->flash.erase_sector_size;
+    bl_interface_res_e res;
+
+    if (size < 2 * sector)
+    {
+        return true;
+    }
+
+    Timing_reset(&timing_erase);
+    Timing_reset(&timing_read);
+    Timing_reset(&timing_rejected);
+
+    for (uint32_t base = sector; base + sector <= size; base += sector)
+    {
+        uint32_t sector_base = base;
+        size_t number_of_sector = 1;
+        bool busy = true;
+
+        Timing_start(&timing_erase);
+        res = m_mem_services_p->startErase(id, &sector_base, &number_of_sector);
+        if (res != BL_RES_OK)
+        {
+            print_error(area, "erase_read", sector, res);
+            return false;
+        }
+
+        /* Read first sector while erasing */
+        do
+        {
+            Timing_start(&timing_read);
+            timing_rejected.start = timing_read.start;
+            res = m_mem_services_p->startRead(id, m_buffer, 0, 16);
+            if (res == BL_RES_BUSY)
+            {
+                Timing_stop(&timing_rejected);
+                busy = m_mem_services_p->isBusy(id);
+            }
+            else
+            {
+                while (m_mem_services_p->isBusy(id))
+                {
+                }
+                Timing_stop(&timing_read);
+                busy = false;
+            }
+        } while (res == BL_RES_BUSY && busy);
+
+        if (res != BL_RES_OK && res != BL_RES_BUSY)
+        {
+            print_error(area, "erase_read", sector, res);
+            return false;
+        }
+
+        wait_idle(id);
+        Timing_stop(&timing_erase);
+    }
+
+    print_result(area, "erase_read", sector, &timing_erase,
+                 timing_erase.cnt * sector);
+    print_result(area, "read_in_erase", 16, &timing_read,
+                 timing_read.cnt * 16);
+    print_result(area, "read_rejected", 16, &timing_rejected, 0);
+    return true;
+}
+
+static void bench_idle_busy(const char * area, bl_memory_area_id_t id)
+{
+    timing_handle_t timing;
+
+    Timing_reset(&timing);
+    for (uint16_t i = 0; i < IDLE_BUSY_COUNT; i++)
+    {
+        Timing_start(&timing);
+        m_mem_services_p->isBusy(id);
+        Timing_stop(&timing);
+    }
+    print_result(area, "busy_idle", 0, &timing, 0);
+}
+
+static bool bench_area(bl_memory_area_id_t id, bl_memory_area_info_t * info_p)
+{
+    char area[11];
+    size_t size = info_p->area_size;
+    size_t page = info_p->flash.write_page_size;
+    size_t align = info_p->flash.write_alignment;
+    bool res;
+
+    if (size > BENCH_MAX_SIZE)
+    {
+        size = BENCH_MAX_SIZE;
+    }
+    /* Only full sectors are erased */
+    size -= size % info_p->flash.erase_sector_size;
+    if (size == 0)
+    {
+        Print_printf("INFO: Area too small for benchmarks.\n");
+        return true;
+    }
+
+    if (page > BUFFER_SIZE)
+    {
+        page = BUFFER_SIZE;
+    }
+
+    /* Source of writes */
+    for (uint16_t i = 0; i < BUFFER_SIZE; i++)
+    {
+        m_buffer[i] = (uint8_t) i;
+    }
+
+    snprintf(area, sizeof(area), "0x%08lx", (unsigned long) id);
+    Print_printf("BENCH,area,%s,%s,%lu,%lu,%lu,%lu\n",
+                 area,
+                 info_p->external_flash ? "ext" : "int",
+                 (unsigned long) size,
+                 (unsigned long) info_p->flash.write_page_size,
+                 (unsigned long) info_p->flash.erase_sector_size,
+                 (unsigned long) align);
+
+    Timing_reset(&m_busy_active);
+
+    res = bench_write(area, "write_aligned", id, info_p, size, 0, page);
+    if (res)
+    {
+        /* Writes crossing page boundaries, aligned on write alignment */
+        res = bench_write(area, "write_unaligned", id, info_p, size,
+                          (page / 2 / align + 1) * align, page);
+    }
+    if (res)
+    {
+        res = bench_write(area, "write_small", id, info_p, size,
+                          align, 3 * align);
+    }
+    res = res && bench_sequential_read(area, id, size);
+    res = res && bench_random_read(area, id, size);
+    res = res && bench_erase_read(area, id, info_p, size);
+
+    print_result(area, "busy_active", 0, &m_busy_active, 0);
+    bench_idle_busy(area, id);
+
+    return res;
+}
+
+static void clear_wdt(void)
+{
+}
+
+/**
+ * \brief   Fill buffer with scratchpad bytes from an offset
+ */
+static void fill_scratchpad(uint32_t offset, size_t amount)
+{
+    for (uint16_t i = 0; i < amount; i++)
+    {
+        m_buffer[i] = (uint8_t)(offset + i);
+    }
+}
+
+static bool bench_scratchpad_block(const scratchpad_services_t * scrat_p,
+                                   uint32_t total,
+                                   uint16_t block)
+{
+    timing_handle_t timing_begin;
+    timing_handle_t timing_write;
+    bl_scrat_write_status_e status = BL_SCRAT_WRITE_STATUS_NOT_ONGOING;
+    bl_interface_res_e res;
+    uint16_t crc = 0xffff;
+    uint32_t data_size;
+
+    total -= total % block;
+    data_size = total - SCRAT_HEADER_SIZE;
+
+    for (uint32_t i = SCRAT_HEADER_SIZE; i < total; i++)
+    {
+        crc = crc16_add_byte(crc, (uint8_t) i);
+    }
+
+    Timing_reset(&timing_begin);
+    Timing_reset(&timing_write);
+
+    Timing_start(&timing_begin);
+    res = scrat_p->begin(total, SCRAT_SEQ, clear_wdt);
+    Timing_stop(&timing_begin);
+    if (res != BL_RES_OK)
+    {
+        print_error("scrat", "scrat_begin", total, res);
+        return false;
+    }
+
+    for (uint32_t pos = 0; pos < total; pos += block)
+    {
+        fill_scratchpad(pos, block);
+        if (pos < SCRAT_HEADER_SIZE)
+        {
+            /* Header, may span several blocks */
+            uint8_t header[SCRAT_HEADER_SIZE];
+            uint32_t type = 0;
+            uint32_t header_status = 0xffffffff;
+
+            memcpy(header, m_scrat_tag, SCRAT_TAG_SIZE);
+            memcpy(&header[16], &data_size, 4);
+            memcpy(&header[20], &crc, 2);
+            header[22] = SCRAT_SEQ;
+            header[23] = 0;
+            memcpy(&header[24], &type, 4);
+            memcpy(&header[28], &header_status, 4);
+
+            for (uint32_t i = pos; i < SCRAT_HEADER_SIZE && i < pos + block;
+                 i++)
+            {
+                m_buffer[i - pos] = header[i];
+            }
+        }
+
+        Timing_start(&timing_write);
+        res = scrat_p->write(pos, m_buffer, block, &status);
+        Timing_stop(&timing_write);
+        if (res != BL_RES_OK)
+        {
+            print_error("scrat", "scrat_write", block, res);
+            return false;
+        }
+    }
+
+    print_result("scrat", "scrat_begin", total, &timing_begin, 0);
+    print_result("scrat", "scrat_write", block, &timing_write, total);
+
+    if (status != BL_SCRAT_WRITE_STATUS_COMPLETED_OK)
+    {
+        print_error("scrat", "scrat_status", block, status);
+        return false;
+    }
+    return true;
+}
+
+static bool bench_scratchpad(const scratchpad_services_t * scrat_p)
+{
+    bl_scrat_info_t info;
+    uint32_t total;
+    bool res = true;
+
+    if (scrat_p->getInfo(&info) != BL_RES_OK)
+    {
+        Print_printf("ERROR: can't get scratchpad info.\n");
+        return false;
+    }
+
+    total = info.area_length;
+    if (total > SCRAT_MAX_SIZE)
+    {
+        total = SCRAT_MAX_SIZE;
+    }
+
+    if (total < SCRAT_HEADER_SIZE + BUFFER_SIZE)
+    {
+        Print_printf("INFO: Scratchpad too small for benchmarks.\n");
+        return true;
+    }
+
+    for (uint8_t i = 0;
+         i < sizeof(m_scrat_block_sizes) / sizeof(m_scrat_block_sizes[0]);
+         i++)
+    {
+        res &= bench_scratchpad_block(scrat_p, total, m_scrat_block_sizes[i]);
+    }
+
+    /* Don't leave a benchmark scratchpad behind */
+    scrat_p->clear(clear_wdt);
+
+    return res;
+}
+
+bool Tests_benchmark(bl_interface_t * interface)
+{
+    bool res = true;
+    bl_interface_res_e bl_res;
+    bl_memory_area_info_t info;
+    bl_memory_area_id_t areas[BL_MEMORY_AREA_MAX_AREAS];
+    uint8_t num_areas = BL_MEMORY_AREA_MAX_AREAS;
+    bl_memory_area_id_t id;
+
+    m_mem_services_p = interface->memory_area_services_p;
+
+    Print_printf("BENCH,hdr,%d,%s,%lu,%d\n",
+                 BENCH_FORMAT_VERSION,
+                 BOARD_NAME,
+                 (unsigned long) interface->version,
+                 MCU_FREQ_MHZ);
+
+    START_TEST(BENCHMARK, Benchmark internal flash);
+
+    m_mem_services_p->getIdfromType(&id, BL_MEM_AREA_TYPE_APPLICATION);
+
+    if(id == BL_MEMORY_AREA_UNDEFINED)
+    {
+        res = false;
+        Print_printf("ERROR: can't get Application area id.\n");
+    }
+    else if (m_mem_services_p->getAreaInfo(id, &info) != BL_RES_OK)
+    {
+        res = false;
+        Print_printf("ERROR: can't get internal flash info.\n");
+    }
+    else
+    {
+        res &= bench_area(id, &info);
+    }
+    END_TEST(BENCHMARK, res);
+
+    START_TEST(BENCHMARK, Benchmark external flash);
+
+    id = BL_MEMORY_AREA_UNDEFINED;
+
+    /* Search an area in external flash */
+    m_mem_services_p->getAreaList(areas, &num_areas);
+    for (uint8_t i = 0; i < num_areas; i++)
+    {
+        bl_res = m_mem_services_p->getAreaInfo(areas[i], &info);
+        if (bl_res != BL_RES_OK)
+        {
+            res = false;
+            Print_printf("ERROR: can't get external flash info.\n");
+        }
+        else if(info.external_flash == true)
+        {
+            id = areas[i];
+            break;
+        }
+    }
+
+    if(id == BL_MEMORY_AREA_UNDEFINED)
+    {
+        Print_printf("INFO: There is no areas located in external flash.\n");
+    }
+    else
+    {
+        res &= bench_area(id, &info);
+    }
+    END_TEST(BENCHMARK, res);
+
+    START_TEST(BENCHMARK, Benchmark scratchpad writes);
+    res &= bench_scratchpad(interface->scratchpad_services_p);
+    END_TEST(BENCHMARK, res);
+
+    return res;
+}
@@ -9,13 +9,6 @@
 #include "test.h"
 #include "timing.h"
 
-/* MCU Clock frequency for tick to uS conversion */
-#ifdef NRF52
-    #define MCU_FREQ_MHZ 64
-#else //EFR32
-    #define MCU_FREQ_MHZ 38
-#endif
-
 static const memory_area_services_t * m_mem_services_p;
 
 static bool test_timings(bl_memory_area_id_t id,
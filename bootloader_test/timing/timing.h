@@ -9,6 +9,13 @@
 
 #include "stdint.h"
 
+/* MCU Clock frequency for tick to uS conversion */
+#ifdef NRF52
+    #define MCU_FREQ_MHZ 64
+#else //EFR32
+    #define MCU_FREQ_MHZ 38
+#endif
+
 /** \brief  Handle containing timing informations */
 typedef struct
 {
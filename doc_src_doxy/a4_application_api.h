@@ -354,7 +354,10 @@ modified later with remote API.</td></tr>
 <tr><td>@ref pack.h "pack.h"</td><td>Little Endian bytes to native integers
 packing and unpacking</td></tr>
 <tr><td>@ref random.h "random.h"</td><td>Random number generator</td></tr>
-<tr><td>@ref ringbuffer.h "ringbuffer.h"</td><td>Ring buffers</td></tr>
+<tr><td>@ref ring.h "ring.h"</td><td>Single producer, single consumer ring
+buffers</td></tr>
+<tr><td>@ref ringbuffer.h "ringbuffer.h"</td><td>Ring buffers (deprecated, use
+@ref ring.h "ring.h")</td></tr>
 <tr><td>@ref sl_list.h "sl_list.h"</td><td>Single Linked List</td></tr>
 <tr><td>@ref tlv.h "tlv.h"</td><td>Encoding/decoding of TLV (Type Length Value)
 format</td></tr>
@@ -0,0 +1,151 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+#define DEBUG_LOG_MODULE_NAME "APP HEAP"
+#ifdef DEBUG_APP_HEAP_LOG_MAX_LEVEL
+#define DEBUG_LOG_MAX_LEVEL DEBUG_APP_HEAP_LOG_MAX_LEVEL
+#else
+#define DEBUG_LOG_MAX_LEVEL LVL_NOLOG
+#endif
+#include "debug_log.h"
+#include <string.h>
+#include "app_heap.h"
+#include "api.h"
+
+/** Round up to a multiple of 4 bytes */
+#define ALIGN4(size)    (((size) + 3) & ~((size_t)3))
+
+// Addresses determined by the linker
+extern uint32_t                 __bss_end__;
+extern uint32_t                 __ram_end__;
+
+// Arena top, reported to the stack as ram_top by _start()
+extern uint32_t *               m_used_app_ram_end;
+// Set by _start() once ram_top is reported
+extern bool                     m_app_ram_top_reported;
+
+void * App_Heap_alloc(size_t size)
+{
+    uint8_t * block = (uint8_t *) m_used_app_ram_end;
+
+    if (m_app_ram_top_reported)
+    {
+        LOG(LVL_ERROR, "Alloc of %u bytes after init", size);
+        return NULL;
+    }
+
+    size = ALIGN4(size);
+    if (size > App_Heap_getFree())
+    {
+        LOG(LVL_ERROR, "Alloc of %u bytes, only %u left",
+            size, App_Heap_getFree());
+        return NULL;
+    }
+
+    memset(block, 0, size);
+    m_used_app_ram_end = (uint32_t *) (block + size);
+
+    LOG(LVL_DEBUG, "Alloc of %u bytes at 0x%x", size, (uint32_t) block);
+    return block;
+}
+
+size_t App_Heap_getFree(void)
+{
+    if (m_app_ram_top_reported)
+    {
+        return 0;
+    }
+
+    return (size_t)((uint8_t *) &__ram_end__ - (uint8_t *) m_used_app_ram_end);
+}
+
+app_heap_res_e App_Heap_poolInit(app_heap_pool_t * pool,
+                                 size_t block_size,
+                                 uint16_t num_blocks)
+{
+    uint8_t * blocks;
+
+    if (pool == NULL || block_size == 0 || num_blocks == 0)
+    {
+        return APP_HEAP_RES_INVALID_PARAM;
+    }
+
+    if (m_app_ram_top_reported)
+    {
+        return APP_HEAP_RES_SEALED;
+    }
+
+    /* Free blocks store the address of next free block */
+    block_size = ALIGN4(block_size < sizeof(void *) ?
+                            sizeof(void *) : block_size);
+    if (block_size > UINT16_MAX)
+    {
+        return APP_HEAP_RES_INVALID_PARAM;
+    }
+
+    blocks = App_Heap_alloc(block_size * num_blocks);
+    if (blocks == NULL)
+    {
+        return APP_HEAP_RES_NO_MEMORY;
+    }
+
+    pool->block_size = block_size;
+    pool->num_blocks = num_blocks;
+    pool->used = 0;
+    pool->max_used = 0;
+    pool->free = NULL;
+
+    /* Chain blocks, first block first */
+    for (uint16_t i = num_blocks; i > 0; i--)
+    {
+        void ** block = (void **) &blocks[(i - 1) * block_size];
+        *block = pool->free;
+        pool->free = block;
+    }
+
+    return APP_HEAP_RES_OK;
+}
+
+void * App_Heap_poolAlloc(app_heap_pool_t * pool)
+{
+    void ** block;
+
+    lib_system->enterCriticalSection();
+    block = pool->free;
+    if (block != NULL)
+    {
+        pool->free = *block;
+        pool->used++;
+        if (pool->used > pool->max_used)
+        {
+            pool->max_used = pool->used;
+        }
+    }
+    lib_system->exitCriticalSection();
+
+    return block;
+}
+
+void App_Heap_poolFree(app_heap_pool_t * pool, void * block)
+{
+    if (block == NULL)
+    {
+        return;
+    }
+
+    lib_system->enterCriticalSection();
+    *(void **) block = pool->free;
+    pool->free = block;
+    pool->used--;
+    lib_system->exitCriticalSection();
+}
+
+void App_Heap_getStats(app_heap_stats_t * stats)
+{
+    stats->used_bytes = (uint32_t)((uint8_t *) m_used_app_ram_end -
+                                   (uint8_t *) &__bss_end__);
+    stats->free_bytes = App_Heap_getFree();
+    stats->sealed = m_app_ram_top_reported;
+}
@@ -0,0 +1,134 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * @file app_heap.h
+ *
+ * Application heap library. It lets the application and libraries size their
+ * buffers at initialization, instead of reserving worst case static arrays,
+ * and gives all the RAM they don't use back to the stack.
+ *
+ * RAM after the application .bss section is used as an arena:
+ *  - Memory can only be allocated from the arena during initialization, i.e.
+ *    until App_init() returns. The arena top is then reported to the stack
+ *    as the last RAM address used by the application (ram_top of _start())
+ *    and RAM above it is owned by the stack.
+ *  - Arena memory is never freed.
+ *  - Fixed-block pools are carved from the arena at initialization. Their
+ *    blocks can be allocated and freed at any time, from any context.
+ */
+
+#ifndef _APP_HEAP_H_
+#define _APP_HEAP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * \brief   List of return code
+ */
+typedef enum
+{
+    /** Operation is successful */
+    APP_HEAP_RES_OK = 0,
+    /** Not enough RAM left in arena */
+    APP_HEAP_RES_NO_MEMORY = 1,
+    /** RAM top already reported to the stack, arena is closed */
+    APP_HEAP_RES_SEALED = 2,
+    /** Given parameter(s) invalid */
+    APP_HEAP_RES_INVALID_PARAM = 3,
+} app_heap_res_e;
+
+/**
+ * \brief   Fixed-block pool, to be allocated by the user and initialized
+ *          with \ref App_Heap_poolInit
+ * \note    Fields are private to the library
+ */
+typedef struct
+{
+    /** First free block */
+    void * free;
+    /** Size of one block, in bytes */
+    uint16_t block_size;
+    /** Number of blocks */
+    uint16_t num_blocks;
+    /** Number of blocks in use */
+    uint16_t used;
+    /** Maximum number of blocks in use since initialization */
+    uint16_t max_used;
+} app_heap_pool_t;
+
+/**
+ * \brief   Arena statistics
+ */
+typedef struct
+{
+    /** Bytes allocated from arena, pools included */
+    uint32_t used_bytes;
+    /** Bytes still available in arena, given back to the stack if unused */
+    uint32_t free_bytes;
+    /** Arena is closed, RAM top reported to the stack */
+    bool sealed;
+} app_heap_stats_t;
+
+/**
+ * \brief   Allocate memory from arena
+ * \param   size
+ *          Number of bytes, rounded up to 4 bytes
+ * \return  Pointer to zeroed memory, aligned on 4 bytes, or NULL if arena
+ *          is closed or not big enough
+ * \note    Only possible until App_init() returns
+ */
+void * App_Heap_alloc(size_t size);
+
+/**
+ * \brief   Get the number of bytes that can still be allocated from arena
+ * \return  Number of bytes, 0 if arena is closed
+ */
+size_t App_Heap_getFree(void);
+
+/**
+ * \brief   Initialize a fixed-block pool, with blocks allocated from arena
+ * \param   pool
+ *          Pool to initialize
+ * \param   block_size
+ *          Size of one block in bytes, rounded up to 4 bytes
+ * \param   num_blocks
+ *          Number of blocks
+ * \return  Result code, \ref APP_HEAP_RES_OK if successful
+ * \note    Only possible until App_init() returns
+ */
+app_heap_res_e App_Heap_poolInit(app_heap_pool_t * pool,
+                                 size_t block_size,
+                                 uint16_t num_blocks);
+
+/**
+ * \brief   Allocate a block from a pool
+ * \param   pool
+ *          Pool initialized with \ref App_Heap_poolInit
+ * \return  Pointer to block, aligned on 4 bytes, or NULL if no block left
+ * \note    Content of block is undefined
+ */
+void * App_Heap_poolAlloc(app_heap_pool_t * pool);
+
+/**
+ * \brief   Give a block back to its pool
+ * \param   pool
+ *          Pool the block was allocated from
+ * \param   block
+ *          Block to free
+ */
+void App_Heap_poolFree(app_heap_pool_t * pool, void * block);
+
+/**
+ * \brief   Get arena statistics
+ * \param   stats
+ *          Pointer to store the statistics
+ */
+void App_Heap_getStats(app_heap_stats_t * stats);
+
+#endif //_APP_HEAP_H_
@@ -9,6 +9,7 @@
 #define DEBUG_LOG_MODULE_NAME "APP_PER_LIB"
 #define DEBUG_LOG_MAX_LEVEL LVL_DEBUG
 #include "debug_log.h"
+#include "libraries_init.h"
 
 #define APP_PERSISTENT_MEMORY_AREA_ID 0x8AE573BA
 
@@ -104,7 +105,7 @@ app_persistent_res_e App_Persistent_read(uint8_t * data, size_t len)
 {
     uint32_t magic;
 
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, App_Persistent_init))
     {
         return APP_PERSISTENT_RES_UNINITIALIZED;
     }
@@ -144,7 +145,7 @@ app_persistent_res_e App_Persistent_write(uint8_t * data, size_t len)
     size_t write_alignement = m_memory_area.flash.write_alignment;
     uint32_t magic = APP_PERSISTENT_MAGIC;
 
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, App_Persistent_init))
     {
         return APP_PERSISTENT_RES_UNINITIALIZED;
     }
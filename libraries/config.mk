@@ -32,6 +32,11 @@ shared_offline_modules=0
 # shared_neighbors_cbs+= + n
 shared_neighbors_cbs=0
 
+# Any library needing neighbor cache change callbacks must increment this
+# variable this way:
+# neighbor_cache_cbs+= + n
+neighbor_cache_cbs=0
+
 ifeq ($(LOCAL_PROVISIONING), yes)
 $(info LOCAL_PROVISIONING automatically enable PROVISIONING and PROVISIONING_PROXY)
 PROVISIONING=yes
@@ -60,21 +65,33 @@ scheduler_tasks+= + 3
 SHARED_DATA=yes
 endif
 
+ifeq ($(OTAP_DELTA), yes)
+SW_AES=yes
+endif
+
 ifeq ($(POSITIONING), yes)
 scheduler_tasks+= + 7
 SHARED_DATA=yes
 app_config_filters+= + 2
-shared_neighbors_cbs+= + 2
+shared_neighbors_cbs+= + 1
 # 2 state event cb
 # - one in measurement for end of scan
 # - one if route cb is implemented in poslib_contol
 stack_state_cbs+= + 2
+# DA tag router ranking
+neighbor_cache_cbs+= + 1
 SHARED_BEACON=yes
 shared_offline_modules+= + 2
 endif
 
+ifeq ($(SHARED_BEACON), yes)
+# Task to multiplex beacons with different intervals
+scheduler_tasks+= + 1
+endif
+
 ifeq ($(SHARED_OFFLINE), yes)
-scheduler_tasks+= + 2
+# Task to wake up the stack
+scheduler_tasks+= + 1
 endif
 
 ifeq ($(DUALMCU_LIB), yes)
@@ -104,6 +121,25 @@ SHARED_APP_CONFIG=yes
 endif
 endif
 
+# Neighbor cache, before the libraries it needs
+ifeq ($(NEIGHBOR_CACHE), yes)
+ifdef NEIGHBOR_CACHE_CBS
+neighbor_cache_cbs+= + $(NEIGHBOR_CACHE_CBS)
+endif
+else
+ifneq ($(neighbor_cache_cbs), 0)
+$(info Enabling NEIGHBOR_CACHE as libraries need it)
+NEIGHBOR_CACHE=yes
+endif
+endif
+
+ifeq ($(NEIGHBOR_CACHE), yes)
+# Refresh and notification tasks, scan end and beacon callbacks
+scheduler_tasks+= + 2
+stack_state_cbs+= + 1
+shared_neighbors_cbs+= + 1
+endif
+
 # Shared neighbors
 ifeq ($(SHARED_NEIGHBORS), yes)
 ifndef SHARED_NEIGHBORS_CBS
@@ -118,6 +154,13 @@ SHARED_NEIGHBORS=yes
 endif
 endif
 
+# Shared neighbors deferred beacons: optional ring size set by application
+ifeq ($(SHARED_NEIGHBORS), yes)
+ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+scheduler_tasks+= + 1
+endif
+endif
+
 # Stack state
 ifeq ($(STACK_STATE_LIB), yes)
 ifdef STACK_STATE_CBS
@@ -132,6 +175,15 @@ STACK_STATE_LIB=yes
 endif
 endif
 
+# Stack state deferred delivery: optional, set by application with
+# STACK_STATE_DEFERRED=yes. Reserves a task to deliver events outside of
+# stack context
+ifeq ($(STACK_STATE_LIB), yes)
+ifeq ($(STACK_STATE_DEFERRED), yes)
+scheduler_tasks+= + 1
+endif
+endif
+
 # Shared offline library
 ifeq ($(SHARED_OFFLINE), yes)
 ifndef SHARED_OFFLINE_MODULES
@@ -11,6 +11,11 @@
 #include "time.h"
 #include "app_scheduler.h"
 #include "shared_data.h"
+#if __has_include("neighbor_cache.h")
+/* Neighbor cache library is enabled: read neighbors from it */
+#include "neighbor_cache.h"
+#define USE_NEIGHBOR_CACHE
+#endif
 #include "tlv.h"
 
 #define DEBUG_LOG_MODULE_NAME "CTR NODE"
@@ -34,6 +39,23 @@
 /** \brief Returned by \ref get_da_router_address when no route is found. */
 #define NO_ROUTE_FOUND_ADDRESS 0
 
+/** \brief Number of routers for which ACK latency is tracked. Least recently
+ *         used router is replaced when full. Sized so that their statistics
+ *         fit in a DIAG packet.
+ */
+#define MAX_RTT_ROUTERS 4
+
+/** \brief Minimum time before sending to backup route, in ms. Keeps some
+ *         margin over jitter when RTT is very stable.
+ */
+#define MIN_BACKUP_TIMEOUT_MS 10
+
+/** \brief Maximum RTT variation after timeouts, in us. */
+#define MAX_RTTVAR_US 1000000
+
+/** \brief Duration of a coarse timestamp tick in us (1 / 128 s). */
+#define COARSE_TICK_US 7812
+
 /** \brief Control node state machine states. */
 typedef enum
 {
@@ -59,8 +81,31 @@ static struct
     bool end;
     /** Router address used to send the packet. */
     app_addr_t address;
+    /** Time the packet was sent to this router. */
+    app_lib_time_timestamp_hp_t time_sent;
 } m_send_handle[2];
 
+/** ACK latency estimator of a router (as TCP retransmission timer, RFC 6298). */
+typedef struct
+{
+    /** Router address, NO_ROUTE_FOUND_ADDRESS if entry is free. */
+    app_addr_t address;
+    /** Smoothed round trip time, in us. */
+    uint32_t srtt_us;
+    /** Round trip time variation, in us. */
+    uint32_t rttvar_us;
+    /** Last time router was used. */
+    app_lib_time_timestamp_coarse_t last_used;
+    /** Latency histogram, reported in DIAG. */
+    uint8_t histogram[CONTROL_DIAG_LATENCY_BINS];
+} router_rtt_t;
+
+/** ACK latency of recently used routers. */
+static router_rtt_t m_rtt[MAX_RTT_ROUTERS];
+
+/** Longest RTT that can be measured with HP timestamps, in coarse ticks. */
+static uint32_t m_max_rtt_ticks;
+
 
 /** Local copy of packet sent header. (needed by retry mechanism). */
 static app_lib_data_to_send_t m_data;
@@ -113,6 +158,95 @@ static shared_data_item_t m_ack_received_item = {
  *              Exclude this address from selectable routers. 0 if not used.
  * \return      The address of the router. 0 if none found.
  */
+#ifdef USE_NEIGHBOR_CACHE
+static app_addr_t get_da_router_address(app_addr_t exclude)
+{
+    neighbor_cache_view_t view;
+    neighbor_cache_entry_t best;
+    neighbor_cache_entry_t best_within_window;
+    uint32_t nb_da_nbors;
+    int8_t max_rssi;
+    int8_t max_rssi_within_window;
+    bool found;
+    bool found_within_window;
+
+    if (Neighbor_Cache_getVersion() == 0)
+    {
+        /* No scan ended yet, fill the cache from stack now. */
+        Neighbor_Cache_refresh();
+    }
+
+    /* Table may change if a beacon is received while reading it. */
+    do
+    {
+        nb_da_nbors = 0;
+        max_rssi = INT8_MIN;
+        max_rssi_within_window = INT8_MIN;
+        found = false;
+        found_within_window = false;
+
+        Neighbor_Cache_getView(&view);
+
+        for (uint32_t i = 0; i < view.count; i++)
+        {
+            const neighbor_cache_entry_t * entry = &view.entries[i];
+
+            /* Router is DA capable. */
+            if (entry->info.address != exclude &&
+                entry->info.diradv_support == APP_LIB_STATE_DIRADV_SUPPORTED)
+            {
+                /* Find router with best RSSI with last_update in time
+                 * window.
+                 */
+                if (Neighbor_Cache_getAge(entry) < NBOR_MAX_TIME_LAST_SEEN &&
+                    entry->info.norm_rssi > max_rssi_within_window)
+                {
+                    max_rssi_within_window = entry->info.norm_rssi;
+                    best_within_window = *entry;
+                    found_within_window = true;
+                }
+
+                /* Fall back: Find router with best RSSI. */
+                if (entry->info.norm_rssi > max_rssi)
+                {
+                    max_rssi = entry->info.norm_rssi;
+                    best = *entry;
+                    found = true;
+                }
+                nb_da_nbors++;
+            }
+        }
+    } while (!Neighbor_Cache_isViewValid(&view));
+
+    if (found_within_window)
+    {
+        LOG(LVL_DEBUG, "Found up to date DA router "
+                       "(@:%u, rssi:%d, last_up:%d, da_nbors:%d/%d).",
+                       best_within_window.info.address,
+                       best_within_window.info.norm_rssi,
+                       Neighbor_Cache_getAge(&best_within_window),
+                       nb_da_nbors,
+                       view.count);
+        return best_within_window.info.address;
+    }
+    else if (found)
+    {
+        LOG(LVL_WARNING, "Fall back to best Rssi DA Router "
+                         "(@:%u, rssi:%d, last_up:%d, da_nbors:%d/%d).",
+                         best.info.address,
+                         best.info.norm_rssi,
+                         Neighbor_Cache_getAge(&best),
+                         nb_da_nbors,
+                         view.count);
+        return best.info.address;
+    }
+    else
+    {
+        LOG(LVL_ERROR, "No DA router found. (nb_nbors:%d)", view.count);
+        return NO_ROUTE_FOUND_ADDRESS;
+    }
+}
+#else
 static app_addr_t get_da_router_address(app_addr_t exclude)
 {
     #define MAX_NBORS   10
@@ -190,6 +324,201 @@ static app_addr_t get_da_router_address(app_addr_t exclude)
         return NO_ROUTE_FOUND_ADDRESS;
     }
 }
+#endif
+
+/**
+ * \brief       Get latency estimator of a router.
+ * \param       address
+ *              Router address
+ * \param       create
+ *              Create entry if router is unknown, replacing the least
+ *              recently used one
+ * \return      Estimator, NULL if not found and not created.
+ */
+static router_rtt_t * get_router_rtt(app_addr_t address, bool create)
+{
+    app_lib_time_timestamp_coarse_t now = lib_time->getTimestampCoarse();
+    router_rtt_t * oldest = &m_rtt[0];
+
+    if (address == NO_ROUTE_FOUND_ADDRESS)
+    {
+        return NULL;
+    }
+
+    for (uint8_t i = 0; i < MAX_RTT_ROUTERS; i++)
+    {
+        if (m_rtt[i].address == address)
+        {
+            return &m_rtt[i];
+        }
+        if (m_rtt[i].address == NO_ROUTE_FOUND_ADDRESS ||
+            (oldest->address != NO_ROUTE_FOUND_ADDRESS &&
+             now - m_rtt[i].last_used > now - oldest->last_used))
+        {
+            oldest = &m_rtt[i];
+        }
+    }
+
+    if (!create)
+    {
+        return NULL;
+    }
+
+    LOG(LVL_DEBUG, "Track RTT of router %u (replace %u)", address,
+                                                          oldest->address);
+    memset(oldest, 0, sizeof(router_rtt_t));
+    oldest->address = address;
+    oldest->last_used = now;
+    return oldest;
+}
+
+/**
+ * \brief       Update latency estimator of a router with a new measure.
+ * \param       rtt
+ *              Router estimator
+ * \param       rtt_us
+ *              Time from packet sent to ACK received, in us
+ */
+static void add_rtt_sample(router_rtt_t * rtt, uint32_t rtt_us)
+{
+    uint32_t delta;
+    uint8_t bin = 0;
+
+    if (rtt->srtt_us == 0)
+    {
+        /* First measure. */
+        rtt->srtt_us = rtt_us;
+        rtt->rttvar_us = rtt_us / 2;
+    }
+    else
+    {
+        /* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R */
+        delta = rtt->srtt_us > rtt_us ? rtt->srtt_us - rtt_us :
+                                        rtt_us - rtt->srtt_us;
+        rtt->rttvar_us = rtt->rttvar_us - rtt->rttvar_us / 4 + delta / 4;
+        rtt->srtt_us = rtt->srtt_us - rtt->srtt_us / 8 + rtt_us / 8;
+    }
+    /* Zero means no measure. */
+    if (rtt->srtt_us == 0)
+    {
+        rtt->srtt_us = 1;
+    }
+
+    while (bin < CONTROL_DIAG_LATENCY_BINS - 1 &&
+           rtt_us >= (CONTROL_DIAG_LATENCY_BIN0_MS * 1000ul) << bin)
+    {
+        bin++;
+    }
+    if (rtt->histogram[bin] < UINT8_MAX)
+    {
+        rtt->histogram[bin]++;
+    }
+
+    LOG(LVL_DEBUG, "RTT of %u: %u us (srtt:%u, rttvar:%u)", rtt->address,
+                                                            rtt_us,
+                                                            rtt->srtt_us,
+                                                            rtt->rttvar_us);
+}
+
+/**
+ * \brief       Get time to wait for primary router before sending to backup
+ *              route: SRTT + 4 * RTTVAR, or TTL/2 when router latency is not
+ *              known yet.
+ * \param       address
+ *              Primary router address
+ * \return      Timeout in ms.
+ */
+static uint32_t get_backup_timeout_ms(app_addr_t address)
+{
+    uint32_t max_ms = m_conf.packet_ttl_ms / 2;
+    router_rtt_t * rtt = get_router_rtt(address, false);
+    uint32_t timeout_ms;
+
+    if (rtt == NULL || rtt->srtt_us == 0)
+    {
+        return max_ms;
+    }
+
+    timeout_ms = (rtt->srtt_us + 4 * rtt->rttvar_us + 999) / 1000;
+    if (timeout_ms < MIN_BACKUP_TIMEOUT_MS)
+    {
+        timeout_ms = MIN_BACKUP_TIMEOUT_MS;
+    }
+    if (timeout_ms > max_ms)
+    {
+        timeout_ms = max_ms;
+    }
+    return timeout_ms;
+}
+
+/**
+ * \brief       Convert us to ms, saturated to 16 bits.
+ */
+static uint16_t saturate_ms(uint32_t us)
+{
+    return us / 1000 > UINT16_MAX ? UINT16_MAX : us / 1000;
+}
+
+/**
+ * \brief       Add latency statistics of routers after DIAG packet.
+ * \param       buffer
+ *              Where to write, one byte and MAX_RTT_ROUTERS
+ *              \ref control_diag_latency_t max
+ * \return      Number of bytes written, 0 if no router was measured yet so
+ *              that DIAG keeps its original size.
+ */
+static uint8_t write_diag_latency(uint8_t * buffer)
+{
+    uint8_t * count = buffer;
+    control_diag_latency_t latency;
+
+    *count = 0;
+    buffer++;
+    for (uint8_t i = 0; i < MAX_RTT_ROUTERS; i++)
+    {
+        if (m_rtt[i].srtt_us == 0)
+        {
+            continue;
+        }
+        latency.address = m_rtt[i].address;
+        latency.srtt_ms = saturate_ms(m_rtt[i].srtt_us);
+        latency.rttvar_ms = saturate_ms(m_rtt[i].rttvar_us);
+        memcpy(latency.histogram, m_rtt[i].histogram,
+               sizeof(latency.histogram));
+        memcpy(buffer, &latency, sizeof(latency));
+        buffer += sizeof(latency);
+        (*count)++;
+    }
+
+    if (*count == 0)
+    {
+        return 0;
+    }
+    return (uint8_t)(buffer - count);
+}
+
+/**
+ * \brief       Send packet to a router.
+ * \param       handle
+ *              Index of route in m_send_handle
+ * \return      Result code of Shared_Data_sendData.
+ */
+static app_lib_data_send_res_e send_to_route(uint8_t handle)
+{
+    router_rtt_t * rtt = get_router_rtt(m_send_handle[handle].address, true);
+
+    if (rtt != NULL)
+    {
+        rtt->last_used = lib_time->getTimestampCoarse();
+    }
+
+    m_data.dest_address = m_send_handle[handle].address;
+    /* Add eleasped time since first try to travel time. */
+    m_data.delay = lib_time->getTimestampCoarse() - m_time_sent;
+    m_send_handle[handle].sent = true;
+    m_send_handle[handle].time_sent = lib_time->getTimestampHp();
+    return Shared_Data_sendData(&m_data, packet_sent_cb);
+}
 
 /**
  * \brief Safety timer is called. Reset send state machine.
@@ -236,13 +565,17 @@ static uint32_t reset_task(void)
 static uint32_t backup_route_task(void)
 {
     app_lib_data_send_res_e res;
+    router_rtt_t * rtt = get_router_rtt(m_send_handle[0].address, false);
     LOG(LVL_WARNING, "Timeout, send packet to backup router.");
 
-    m_send_handle[1].sent = true;
-    m_data.dest_address = m_send_handle[1].address;
-    /* Add eleasped time since first try to travel time. */
-    m_data.delay = lib_time->getTimestampCoarse() - m_time_sent;
-    res = Shared_Data_sendData(&m_data, packet_sent_cb);
+    /* Primary router is slower than expected: back off its timeout. */
+    if (rtt != NULL && rtt->srtt_us != 0)
+    {
+        rtt->rttvar_us = rtt->rttvar_us > MAX_RTTVAR_US / 2 ?
+                                        MAX_RTTVAR_US : rtt->rttvar_us * 2;
+    }
+
+    res = send_to_route(1);
     if (res != APP_LIB_DATA_SEND_RES_SUCCESS)
     {
         m_send_handle[1].end = true;
@@ -303,11 +636,7 @@ static void packet_sent_cb(const app_lib_data_sent_status_t * status)
            else  // First packet failed, Send to backup route imediatelly.
            {
                 app_lib_data_send_res_e res;
-                m_data.dest_address = m_send_handle[1].address;
-                /* Add eleasped time since first try to travel time. */
-                m_data.delay = lib_time->getTimestampCoarse() - m_time_sent;
-                res = Shared_Data_sendData(&m_data, packet_sent_cb);
-                m_send_handle[1].sent = true;
+                res = send_to_route(1);
                 LOG(LVL_WARNING, "Sending to primary router failed, try backup");
                 if (res != APP_LIB_DATA_SEND_RES_SUCCESS)
                 {
@@ -395,10 +724,13 @@ void diag_sent_cb(const app_lib_data_sent_status_t * status)
 static uint32_t diagnostic_task(void)
 {
     app_lib_data_send_res_e res;
+    /* Diag followed by router latency statistics. */
+    uint8_t diag_buff[sizeof(control_diag_t) + 1 +
+                      MAX_RTT_ROUTERS * sizeof(control_diag_latency_t)];
     control_diag_t diag;
     app_lib_data_to_send_t tx_diag_def =
     {
-        .bytes = (const uint8_t *)&diag,
+        .bytes = diag_buff,
         .num_bytes = sizeof(control_diag_t),
         .delay = 0,
         .tracking_id = APP_LIB_DATA_NO_TRACKING_ID,
@@ -429,6 +761,9 @@ static uint32_t diagnostic_task(void)
     LOG(LVL_DEBUG, " - diag_error %d", diag.error);
     LOG(LVL_DEBUG, " - diag_timing_us %u", diag.timing_us);
 
+    memcpy(diag_buff, &diag, sizeof(control_diag_t));
+    tx_diag_def.num_bytes += write_diag_latency(&diag_buff[sizeof(diag)]);
+
     /* This is put there to have easier logs to read. */
     tx_diag_def.dest_address = get_da_router_address(0);
 
@@ -470,11 +805,28 @@ static app_lib_data_receive_res_e ack_received (
     {
         if (m_send_handle[0].ack == false && m_send_handle[1].ack == false)
         {
+            uint8_t handle = data->src_address == m_send_handle[0].address ?
+                                                                        0 : 1;
+            router_rtt_t * rtt = get_router_rtt(data->src_address, false);
+
             m_send_handle[0].ack = true;
             m_send_handle[1].ack = true;
             LOG(LVL_INFO, "ACK received from %u (len:%d).",
                            data->src_address,
                            data->num_bytes);
+
+            /* Each route has its own send time, so the measure is not
+             * ambiguous even if both routers were used. Ignore it if too
+             * old to be measured with HP timestamps.
+             */
+            if (rtt != NULL &&
+                lib_time->getTimestampCoarse() - m_time_sent <=
+                                                            m_max_rtt_ticks)
+            {
+                add_rtt_sample(rtt, lib_time->getTimeDiffUs(
+                                        lib_time->getTimestampHp(),
+                                        m_send_handle[handle].time_sent));
+            }
         }
         else
         {
@@ -570,14 +922,30 @@ control_node_ret_e Control_Node_init(control_node_conf_t * conf)
     /* Check m_state and update accordingly */
     if (m_state == CTRL_STATE_UNINIT)
     {
+        /* Router latencies are kept when library is re-initialized. */
+        memset(m_rtt, 0, sizeof(m_rtt));
+        m_max_rtt_ticks = lib_time->getMaxHpDelay() / 2 / COARSE_TICK_US;
         m_state = CTRL_STATE_IDLE;
     }
 
     return CONTROL_RET_OK;
 }
 
-control_node_ret_e Control_Node_send(app_lib_data_to_send_t * data,
-                                     app_lib_data_data_sent_cb_f sent_cb)
+/**
+ * \brief       Send a data packet to best router, and to second best router
+ *              on timeout or error.
+ * \param[in]   data
+ *              Data to send
+ * \param[in]   sent_cb
+ *              DA packet sent callback.
+ * \param[in]   parallel
+ *              Send to second best router immediately, without waiting for
+ *              the backup route timeout
+ * \return      Result code, see \ref lib_control_node_ret_e.
+ */
+static control_node_ret_e send_packet(app_lib_data_to_send_t * data,
+                                      app_lib_data_data_sent_cb_f sent_cb,
+                                      bool parallel)
 {
     app_lib_data_send_res_e res;
 
@@ -617,9 +985,7 @@ control_node_ret_e Control_Node_send(app_lib_data_to_send_t * data,
     m_sent_cb = sent_cb;
 
     /* Send packet with primary route. */
-    m_data.dest_address = m_send_handle[0].address;
-    m_send_handle[0].sent = true;
-    res = Shared_Data_sendData(&m_data, packet_sent_cb);
+    res = send_to_route(0);
 
     if (res != APP_LIB_DATA_SEND_RES_SUCCESS)
     {
@@ -636,9 +1002,7 @@ control_node_ret_e Control_Node_send(app_lib_data_to_send_t * data,
 
         /* Retry immediately with backup router address. */
         LOG(LVL_WARNING, "Error sending data (res:%d), try backup route.", res);
-        m_data.dest_address = m_send_handle[1].address;
-        m_send_handle[1].sent = true;
-        res = Shared_Data_sendData(&m_data, packet_sent_cb);
+        res = send_to_route(1);
         if (res != APP_LIB_DATA_SEND_RES_SUCCESS)
         {
             m_state = CTRL_STATE_IDLE;
@@ -646,6 +1010,17 @@ control_node_ret_e Control_Node_send(app_lib_data_to_send_t * data,
             return CONTROL_RET_SEND_ERROR;
         }
     }
+    else if (parallel && m_send_handle[1].address != NO_ROUTE_FOUND_ADDRESS)
+    {
+        /* Send to backup route too, first ACK wins. */
+        LOG(LVL_DEBUG, "Send to backup route in parallel.");
+        res = send_to_route(1);
+        if (res != APP_LIB_DATA_SEND_RES_SUCCESS)
+        {
+            m_send_handle[1].end = true;
+            LOG(LVL_WARNING, "Error sending to backup route (res:%d).", res);
+        }
+    }
 
     if (App_Scheduler_addTask_execTime(reset_task,
                                        m_conf.packet_ttl_ms*2,
@@ -655,18 +1030,24 @@ control_node_ret_e Control_Node_send(app_lib_data_to_send_t * data,
         LOG(LVL_WARNING, "Error adding safety reset task.");
     }
 
-    /* Check if there is a backup route or backup packet already sent. */
-    if (m_send_handle[1].address == NO_ROUTE_FOUND_ADDRESS ||
-        m_send_handle[1].sent == true)
+    /* Check if there is a backup route. */
+    if (m_send_handle[1].address == NO_ROUTE_FOUND_ADDRESS)
     {
         /* No need to start the timer. */
         m_send_handle[1].end = true;
         return CONTROL_RET_OK;
     }
 
-    /* Start backup route timer. */
+    /* Backup packet already sent, wait for its sent callback. */
+    if (m_send_handle[1].sent == true)
+    {
+        return CONTROL_RET_OK;
+    }
+
+    /* Start backup route timer, from primary router latency. */
     if (App_Scheduler_addTask_execTime(backup_route_task,
-                                       m_conf.packet_ttl_ms/2,
+                                       get_backup_timeout_ms(
+                                                m_send_handle[0].address),
                                        TIMEOUT_TASK_EXEC_TIME_US) !=
                                                         APP_SCHEDULER_RES_OK)
     {
@@ -677,3 +1058,16 @@ control_node_ret_e Control_Node_send(app_lib_data_to_send_t * data,
 
     return CONTROL_RET_OK;
 }
+
+control_node_ret_e Control_Node_send(app_lib_data_to_send_t * data,
+                                     app_lib_data_data_sent_cb_f sent_cb)
+{
+    return send_packet(data, sent_cb, false);
+}
+
+control_node_ret_e Control_Node_sendParallel(
+                                     app_lib_data_to_send_t * data,
+                                     app_lib_data_data_sent_cb_f sent_cb)
+{
+    return send_packet(data, sent_cb, true);
+}
@@ -60,4 +60,21 @@ control_node_ret_e Control_Node_init(control_node_conf_t * conf);
 control_node_ret_e Control_Node_send(app_lib_data_to_send_t * data,
                                      app_lib_data_data_sent_cb_f sent_cb);
 
+/**
+ * \brief       Send a data packet to the two best routers at the same time.
+ *              For commands where latency matters more than radio usage: no
+ *              need to wait for the backup route timeout if the first router
+ *              is slow.
+ * \param[in]   data
+ *              Data to send
+ * \param[in]   sent_cb
+ *              DA packet sent callback.
+ * \return      Result code, normally \ref CONTROL_RET_OK. See
+ *              \ref lib_control_node_ret_e for other return code.
+ * \note        Packet is received by two routers.
+ */
+control_node_ret_e Control_Node_sendParallel(
+                                     app_lib_data_to_send_t * data,
+                                     app_lib_data_data_sent_cb_f sent_cb);
+
 #endif //_CONTROL_NODE_H_
\ No newline at end of file
@@ -51,6 +51,29 @@ typedef struct __attribute__ ((packed))
     uint32_t timing_us;
 } control_diag_t;
 
+/** Number of bins of router latency histograms. */
+#define CONTROL_DIAG_LATENCY_BINS 8
+
+/** Upper bound of the first latency histogram bin, in ms. Each following
+ *  bin is twice wider, last bin has no upper bound.
+ */
+#define CONTROL_DIAG_LATENCY_BIN0_MS 4
+
+/** \brief Latency statistics of a router, appended to \ref control_diag_t. */
+typedef struct __attribute__ ((packed))
+{
+    /** Router address. */
+    app_addr_t address;
+    /** Smoothed round trip time from packet sent to ACK received, in ms. */
+    uint16_t srtt_ms;
+    /** Round trip time variation, in ms. */
+    uint16_t rttvar_ms;
+    /** Number of ACKs per latency range, saturated at 255. Bin n counts
+     *  latencies under \ref CONTROL_DIAG_LATENCY_BIN0_MS << n ms.
+     */
+    uint8_t histogram[CONTROL_DIAG_LATENCY_BINS];
+} control_diag_latency_t;
+
 /** \brief Forwarded (by router to Sink) Diagnostic packet. */
 typedef struct __attribute__ ((packed))
 {
@@ -58,6 +81,11 @@ typedef struct __attribute__ ((packed))
     app_addr_t address;
     /** Diag packet sent by control node. */
     control_diag_t diag;
+    /** Optional latency statistics: number of routers (1 byte, not 0)
+     *  followed by one \ref control_diag_latency_t per router. Absent until
+     *  a router latency is measured.
+     */
+    uint8_t latency[MAX_PAYLOAD - sizeof(app_addr_t) - sizeof(control_diag_t)];
 } control_fwd_diag_t;
 
 #endif //_CONTROL_NODE_INT_H_
\ No newline at end of file
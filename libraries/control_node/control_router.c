@@ -46,6 +46,7 @@ app_lib_data_receive_res_e data_received (const shared_data_item_t * item,
 {
     control_fwd_diag_t diag;
     app_lib_data_send_res_e res;
+    size_t diag_size = data->num_bytes;
 
     LOG(LVL_DEBUG, "Received DA diagnostic packet.");
 
@@ -55,18 +56,23 @@ app_lib_data_receive_res_e data_received (const shared_data_item_t * item,
         return APP_LIB_DATA_RECEIVE_RES_NOT_FOR_APP;
     }
 
-    if (data->num_bytes != sizeof(control_diag_t))
+    /* Diag may be followed by latency statistics, forward them too. */
+    if (diag_size < sizeof(control_diag_t) ||
+        diag_size > sizeof(control_fwd_diag_t) - sizeof(app_addr_t))
     {
         LOG(LVL_ERROR, "    Invalid DIAG length (len:%d).", data->num_bytes);
+        diag_size = sizeof(control_diag_t);
     }
 
+    memset(&diag, 0, sizeof(diag));
     diag.address = data->src_address;
-    memcpy(&diag.diag, data->bytes, sizeof(control_diag_t));
+    memcpy((uint8_t *) &diag + sizeof(app_addr_t), data->bytes,
+           data->num_bytes < diag_size ? data->num_bytes : diag_size);
 
     app_lib_data_to_send_t send_data =
     {
         .bytes = (const uint8_t *) &diag,
-        .num_bytes = sizeof(control_fwd_diag_t),
+        .num_bytes = sizeof(app_addr_t) + diag_size,
         .delay = 0,
         .tracking_id = APP_LIB_DATA_NO_TRACKING_ID,
         .qos = APP_LIB_DATA_QOS_NORMAL,
@@ -0,0 +1,232 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#include "waps/comm/usb/waps_usb.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "io.h"
+#include "usart.h"
+#include "usb_wrapper.h"
+#include "waps/waps_frames.h" // For frame min/max length constants
+
+/** RX callback for USB */
+static void waps_usb_receive(uint8_t * chars, size_t n);
+
+/** Host opened or closed the port */
+static void waps_usb_connection(bool connected);
+
+/** Buffer for frames received in several USB transfers */
+static uint8_t *        m_rx_buffer;
+
+/** Header bytes received for current frame */
+static uint32_t         m_rx_header_idx;
+static uint8_t          m_rx_header[WAPS_USB_HEADER_SIZE];
+
+/** Frame bytes received for current frame, and expected frame length */
+static uint32_t         m_rx_buffer_idx;
+static uint32_t         m_rx_length;
+
+#if defined WAPS_DIAGNOSTICS
+/* Waps diagnostics */
+typedef struct {
+    uint32_t    successful_frame;
+    uint32_t    frame_size_out_of_bounds_error;
+    uint32_t    sync_error;
+    uint32_t    tx_full_error;
+} waps_diagnostics_t;
+static volatile waps_diagnostics_t m_waps_diagnostics;
+#endif /* WAPS_DIAGNOSTICS */
+
+/** Valid frame received callback */
+static new_frame_cb_f   m_frame_cb;
+
+bool Waps_usb_init(new_frame_cb_f frame_cb, void * rx_buffer)
+{
+    bool res;
+    m_frame_cb = frame_cb;
+    m_rx_buffer = rx_buffer;
+    Waps_usb_clean();
+#if defined WAPS_DIAGNOSTICS
+    memset((void *)&m_waps_diagnostics, 0x00, sizeof(m_waps_diagnostics));
+#endif /* WAPS_DIAGNOSTICS */
+    // Baudrate and flow control are meaningless for USB
+    res = Usart_init(0, UART_FLOW_CONTROL_NONE);
+    Usart_enableReceiver(waps_usb_receive);
+    Usb_wrapper_setConnectionCallback(waps_usb_connection);
+
+    // Always powered through USB, no auto-powering
+    Usart_setEnabled(true);
+    Usart_receiverOn();
+
+    // Initialize UART IRQ pin
+    Io_enableUartIrq();
+    Io_clearUartIrq();
+
+    return res;
+}
+
+bool Waps_usb_send(const void * buffer, uint32_t size)
+{
+    uint8_t header[WAPS_USB_HEADER_SIZE];
+
+    if (size > WAPS_MAX_FRAME_LENGTH)
+    {
+        return false;
+    }
+
+    header[0] = WAPS_USB_SYNC;
+    header[1] = (uint8_t)size;
+    header[2] = (uint8_t)(size >> 8);
+
+    // Frame goes directly from the item to the USB stack, no staging buffer
+    if (!Usb_wrapper_sendFrame(header, sizeof(header), buffer, size))
+    {
+#if defined WAPS_DIAGNOSTICS
+        m_waps_diagnostics.tx_full_error++;
+#endif /* WAPS_DIAGNOSTICS */
+        return false;
+    }
+    return true;
+}
+
+void Waps_usb_flush(void)
+{
+    Usart_flush();
+}
+
+void Waps_usb_setIrq(bool state)
+{
+   if(state)
+   {
+       // Assert IRQ pin
+       Io_setUartIrq();
+   }
+   else
+   {
+       // De-assert IRQ pin
+       Io_clearUartIrq();
+   }
+}
+
+void Waps_usb_clean(void)
+{
+    m_rx_header_idx = 0;
+    m_rx_buffer_idx = 0;
+    m_rx_length = 0;
+}
+
+/**
+ * \brief   Give a complete frame to upper layer
+ * \param   frame
+ *          Frame, in USB transfer or in m_rx_buffer
+ */
+static void frame_completed(void * frame)
+{
+#if defined WAPS_DIAGNOSTICS
+    m_waps_diagnostics.successful_frame++;
+#endif /* WAPS_DIAGNOSTICS */
+    if(m_frame_cb != NULL)
+    {
+        (void)m_frame_cb(frame, m_rx_length);
+    }
+    Waps_usb_clean();
+}
+
+/**
+ * \brief   Drop the first byte of an invalid header and keep the following
+ *          ones from the next sync byte, if any
+ */
+static void header_resync(void)
+{
+    uint32_t i;
+
+    for (i = 1; i < m_rx_header_idx; i++)
+    {
+        if (m_rx_header[i] == WAPS_USB_SYNC)
+        {
+            break;
+        }
+    }
+    m_rx_header_idx -= i;
+    memmove(m_rx_header, &m_rx_header[i], m_rx_header_idx);
+}
+
+static void waps_usb_receive(uint8_t * chars, size_t n)
+{
+    uint32_t count;
+
+    while (n > 0)
+    {
+        if (m_rx_header_idx < WAPS_USB_HEADER_SIZE)
+        {
+            // Header, possibly split across transfers
+            m_rx_header[m_rx_header_idx++] = *chars++;
+            n--;
+            if (m_rx_header[0] != WAPS_USB_SYNC)
+            {
+#if defined WAPS_DIAGNOSTICS
+                m_waps_diagnostics.sync_error++;
+#endif /* WAPS_DIAGNOSTICS */
+                m_rx_header_idx = 0;
+                continue;
+            }
+            if (m_rx_header_idx < WAPS_USB_HEADER_SIZE)
+            {
+                continue;
+            }
+
+            m_rx_length = m_rx_header[1] | (m_rx_header[2] << 8);
+            if ((m_rx_length < WAPS_MIN_FRAME_LENGTH) ||
+                (m_rx_length > WAPS_MAX_FRAME_LENGTH))
+            {
+                // Not a frame start: look for the next sync byte, from the
+                // length bytes already received
+#if defined WAPS_DIAGNOSTICS
+                m_waps_diagnostics.frame_size_out_of_bounds_error++;
+#endif /* WAPS_DIAGNOSTICS */
+                header_resync();
+                m_rx_length = 0;
+                continue;
+            }
+
+            if ((m_rx_buffer_idx == 0) && (n >= m_rx_length))
+            {
+                // Whole frame in this transfer: no need to copy it
+                count = m_rx_length;
+                frame_completed(chars);
+                chars += count;
+                n -= count;
+            }
+            continue;
+        }
+
+        // Rest of a frame split across transfers
+        count = m_rx_length - m_rx_buffer_idx;
+        if (count > n)
+        {
+            count = n;
+        }
+        memcpy(&m_rx_buffer[m_rx_buffer_idx], chars, count);
+        m_rx_buffer_idx += count;
+        chars += count;
+        n -= count;
+
+        if (m_rx_buffer_idx == m_rx_length)
+        {
+            frame_completed(m_rx_buffer);
+        }
+    }
+}
+
+static void waps_usb_connection(bool connected)
+{
+    (void) connected;
+    // New session: forget partially received frame
+    Waps_usb_clean();
+}
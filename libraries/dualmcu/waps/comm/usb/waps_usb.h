@@ -0,0 +1,87 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#ifndef APP_WAPSUSB_H__
+#define APP_WAPSUSB_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "waps/comm/waps_comm.h"
+
+/**
+ * \file    waps_usb.h
+ *          Low level interface for WAPS over USB, used instead of the
+ *          SLIP UART one when waps_usb_framing=yes (with uart_use_usb=yes).
+ *
+ *          Frames are not SLIP encoded. Each frame is preceded by a sync
+ *          byte and its length, as a 16-bit little endian value, and has no
+ *          CRC as USB bulk transfers are already CRC protected and
+ *          acknowledged:
+ *
+ *          | 0xA5 | length (2 bytes) | WAPS frame (length bytes) |
+ *
+ *          If the sync byte or the length is wrong, e.g. after the host
+ *          was restarted in the middle of a frame, the receiver looks for
+ *          the next sync byte one byte at a time, wherever USB transfers
+ *          start.
+ *
+ *          Each frame is written in one go from its \ref waps_item_t to
+ *          the USB stack and flushed, so that it is sent in as few bulk
+ *          packets as possible. Several frames can be waiting for the host
+ *          at the same time, up to the size of the USB TX FIFO.
+ */
+
+/** First byte of a frame header */
+#define WAPS_USB_SYNC           0xA5
+
+/** Size of the header of a frame: sync byte and length */
+#define WAPS_USB_HEADER_SIZE    3
+
+/**
+ * \brief   WAPS USB initialize, after this, WAPS USB is ready to transmit
+ *          and receive frames
+ * \param   frame_cb
+ *          Mandatory callback for upper layer notification about a valid
+ *          looking frame
+ * \param   rx_buffer
+ *          Memory block for receptions of frames split across several USB
+ *          transfers, at least WAPS_MAX_FRAME_LENGTH bytes
+ * \return  True if successful, false otherwise
+ */
+bool Waps_usb_init(new_frame_cb_f frame_cb, void * rx_buffer);
+
+/**
+ * \brief   WAPS USB send, send a frame to the host
+ *          Adds the header. The frame is copied only once, to the
+ *          USB stack FIFO
+ * \param   buffer
+ *          Pointer to frame to send
+ * \param   size
+ *          Size of the frame in bytes
+ * \return  True if frame was queued entirely, false if there is not enough
+ *          room for it yet (nothing is queued then)
+ */
+bool Waps_usb_send(const void * buffer, uint32_t size);
+
+/**
+ * \brief   Flush USB TX FIFO.
+ *          Waits for operation (pend) to complete before returning.
+ */
+void Waps_usb_flush(void);
+
+/**
+ * \brief   Set indication that something is pending
+ * \param   state
+ *          True means that something is pending, false that queues are empty
+ */
+void Waps_usb_setIrq(bool state);
+
+/**
+ * \brief   Clean waps from old data (partially received frame).
+ */
+void Waps_usb_clean(void);
+
+#endif
@@ -13,6 +13,10 @@
 /** Callback for a valid looking frame */
 typedef bool(*new_frame_cb_f)(void *, uint32_t);
 
+#ifdef WAPS_USB_FRAMING
+#include "usb/waps_usb.h"
+#else
 #include "uart/waps_uart.h"
+#endif
 
 #endif /* WAPS_COMM_H_ */
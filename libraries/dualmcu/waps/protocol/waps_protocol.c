@@ -21,8 +21,13 @@
 waps_prot_t                         waps_prot;
 
 /** Buffers for WAPS protocol */
+#ifdef WAPS_USB_FRAMING
+/* Frames are sent from their item, only split receptions are buffered */
+static uint8_t                      m_waps_rx_buffer[WAPS_MAX_FRAME_LENGTH];
+#else
 static uint8_t                      m_waps_tx_buffer[WAPS_TX_BUFFER_SIZE];
 static uint8_t                      m_waps_rx_buffer[WAPS_RX_BUFFER_SIZE];
+#endif
 
 /** Current reply frame */
 waps_item_t *                       prot_reply;
@@ -52,15 +57,25 @@ bool Waps_prot_init(waps_request_receive_f cb, uint32_t baudrate, bool flow_ctrl
     bool res = false;
     m_upper_cb = cb;
 
+#ifdef WAPS_USB_FRAMING
+    (void) baudrate;
+    (void) flow_ctrl;
+    res = Waps_usb_init(frame_receive, m_waps_rx_buffer);
+    waps_prot.write_hw = Waps_usb_send;
+    waps_prot.update_irq = Waps_usb_setIrq;
+    waps_prot.flush_hw = Waps_usb_flush;
+#else
     res = Waps_uart_init(frame_receive,
                          baudrate,
                          flow_ctrl,
                          m_waps_tx_buffer,
                          m_waps_rx_buffer);
-    waps_prot.send_reply = Waps_protUart_sendReply;
     waps_prot.write_hw = Waps_uart_send;
     waps_prot.update_irq = Waps_uart_setIrq;
     waps_prot.flush_hw = Waps_uart_flush;
+#endif
+    /* Request/response logic is the same for both transports */
+    waps_prot.send_reply = Waps_protUart_sendReply;
     waps_prot.frame_removed = Waps_protUart_frameRemoved;
     waps_prot.process_response = Waps_protUart_processResponse;
 
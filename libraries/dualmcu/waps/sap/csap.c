@@ -13,6 +13,8 @@
 #include "api.h"
 #include "comm/uart/waps_uart.h"
 #include "sap/persistent.h"
+#include "sap/dsap_compact.h"
+#include "sap/multicast.h"
 
 /** Key for reset command ("DoIt" in ASCII) */
 #define RESET_KEY 0x74496f44
@@ -61,6 +63,7 @@ static const uint8_t m_attr_size_lut[] =
     CSAP_ATTR_FEATURE_LOCK_KEY_SIZE,
     CSAP_ATTR_RESERVED_2_SIZE,
     CSAP_ATTR_RESERVED_CHANNELS_SIZE,
+    CSAP_ATTR_COMPACT_INDICATIONS_SIZE,
 };
 
 static bool attrReadReq(waps_item_t * item);
@@ -358,6 +361,9 @@ static attribute_result_e readAttr(attr_t attr_id,
             *attr_size_p = attr_size;
             attr_size = 0;
             break;
+        case CSAP_ATTR_COMPACT_INDICATIONS:
+            tmp = Dsap_compact_isEnabled() ? 1 : 0;
+            break;
         case CSAP_ATTR_RESERVED_1:
         case CSAP_ATTR_RESERVED_2:
         case CSAP_ATTR_RESERVED_3:
@@ -505,7 +511,9 @@ static attribute_result_e writeAttr(attr_t attr_id,
 
                 if (result == APP_RES_OK)
                 {
+#ifndef WAPS_USB_FRAMING
                     Waps_uart_powerReset();
+#endif
 #ifdef OTAP_FORCE_LEGACY
                     bool firstboot = false;
 
@@ -547,6 +555,13 @@ static attribute_result_e writeAttr(attr_t attr_id,
         case CSAP_ATTR_RESERVED_CHANNELS:
             result = lib_settings->setReservedChannels(value, attr_size);
             break;
+        case CSAP_ATTR_COMPACT_INDICATIONS:
+            if (tmp > 1)
+            {
+                return ATTR_INV_VALUE;
+            }
+            Dsap_compact_setEnabled(tmp == 1);
+            break;
         case CSAP_ATTR_RESERVED_1:
         case CSAP_ATTR_RESERVED_2:
         case CSAP_ATTR_RESERVED_3:
@@ -590,6 +605,8 @@ static bool resetReq(waps_item_t * item)
         {
             // Need to re-init as flash content is modified by the stack.
             Persistent_init();
+            // Groups were erased too
+            Multicast_reloadGroups();
         }
     }
 create_response:
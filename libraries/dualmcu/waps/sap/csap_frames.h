@@ -37,6 +37,7 @@ typedef enum
     CSAP_ATTR_FEATURE_LOCK_KEY = 23,
     CSAP_ATTR_RESERVED_2 = 24,
     CSAP_ATTR_RESERVED_CHANNELS = 25,
+    CSAP_ATTR_COMPACT_INDICATIONS = 26,
     /* Read only */
     CSAP_ATTR_APP_MAXT_TRANS_UNIT = 5,
     CSAP_ATTR_PDU_BUFF_SIZE = 6,
@@ -79,6 +80,7 @@ typedef enum
     CSAP_ATTR_FEATURE_LOCK_BITS_SIZE = 4,
     CSAP_ATTR_FEATURE_LOCK_KEY_SIZE = 16,
     CSAP_ATTR_RESERVED_CHANNELS_SIZE = 0,   /* Variable size */
+    CSAP_ATTR_COMPACT_INDICATIONS_SIZE = 1,
     CSAP_ATTR_RESERVED_1_SIZE = 0,
     CSAP_ATTR_RESERVED_2_SIZE = 0,
 } csap_attr_size_e;
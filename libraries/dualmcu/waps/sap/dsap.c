@@ -6,6 +6,7 @@
 
 #include "dsap.h"
 #include "dsap_frames.h"
+#include "dsap_compact.h"
 #include "function_codes.h"
 #include "waps_private.h"
 #include "waddr.h"
@@ -296,8 +297,18 @@ static void update_packet_delay(waps_item_t * item)
         if (item->frame.sfunc == WAPS_FUNC_DSAP_DATA_RX_IND)
         {
             item->frame.dsap.data_rx_ind.delay += local_delay;
+            if (Dsap_compact_isEnabled())
+            {
+                // First time sent: slot is updated in host reception order
+                Dsap_compact_encode(item);
+            }
+        }
+        else if (item->frame.sfunc == WAPS_FUNC_DSAP_DATA_RX_COMPACT_IND)
+        {
+            // Sent again
+            Dsap_compact_addDelay(item, local_delay);
         }
-        else if (item->frame.sfunc == WAPS_FUNC_DSAP_DATA_RX_IND)
+        else if (item->frame.sfunc == WAPS_FUNC_DSAP_DATA_RX_FRAG_IND)
         {
             item->frame.dsap.data_rx_frag_ind.delay += local_delay;
         }
@@ -0,0 +1,254 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#include <string.h>
+
+#include "dsap_compact.h"
+#include "dsap_frames.h"
+#include "function_codes.h"
+#include "waps_private.h"
+#include "waddr.h"
+#include "api.h"
+
+/** Context of a source address, mirrored by host */
+typedef struct
+{
+    w_addr_t    addr;
+    ep_t        src_endpoint;
+    ep_t        dst_endpoint;
+    uint8_t     info;
+    /** Slot holds an address */
+    bool        used;
+} context_t;
+
+/** Context table */
+static context_t    m_context[DSAP_COMPACT_CONTEXT_SIZE];
+
+/** Next slot to replace, round robin */
+static uint8_t      m_next_slot;
+
+/** Are compact indications enabled */
+static bool         m_enabled = false;
+
+/**
+ * \brief   Encode a value as a varint
+ * \param   value
+ *          Value to encode
+ * \param   out
+ *          Where to encode, at least DSAP_COMPACT_VARINT_MAX_SIZE bytes
+ * \return  Number of bytes written
+ */
+static uint8_t encode_varint(uint32_t value, uint8_t * out)
+{
+    uint8_t len = 0;
+
+    while (value >= 0x80)
+    {
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+
+    return len;
+}
+
+/**
+ * \brief   Decode a varint written by \ref encode_varint
+ * \return  Number of bytes read
+ */
+static uint8_t decode_varint(const uint8_t * in, uint32_t * value_p)
+{
+    uint32_t value = 0;
+    uint8_t len = 0;
+
+    do
+    {
+        value |= (uint32_t)(in[len] & 0x7f) << (7 * len);
+    }
+    while (in[len++] & 0x80);
+
+    *value_p = value;
+    return len;
+}
+
+/**
+ * \brief   Write a little endian address
+ * \return  Number of bytes written
+ */
+static uint8_t encode_addr(w_addr_t addr, uint8_t * out)
+{
+    for (uint8_t i = 0; i < sizeof(w_addr_t); i++)
+    {
+        out[i] = (uint8_t)(addr >> (8 * i));
+    }
+    return sizeof(w_addr_t);
+}
+
+/**
+ * \brief   Size of the fields before delay, from flags
+ */
+static uint8_t get_delay_offset(uint8_t flags)
+{
+    uint8_t offset = 0;
+
+    if (flags & DSAP_COMPACT_NEW_ADDR_FLAG)
+    {
+        offset += sizeof(w_addr_t);
+    }
+    if (((flags & DSAP_COMPACT_DST_MASK) >> DSAP_COMPACT_DST_OFFSET) ==
+        DSAP_COMPACT_DST_EXPLICIT)
+    {
+        offset += sizeof(w_addr_t);
+    }
+    if (flags & DSAP_COMPACT_ENDPOINTS_FLAG)
+    {
+        offset += 2 * sizeof(ep_t);
+    }
+    if (flags & DSAP_COMPACT_INFO_FLAG)
+    {
+        offset += sizeof(uint8_t);
+    }
+    return offset;
+}
+
+/**
+ * \brief   Find the slot of an address, or replace the oldest one
+ * \param   addr
+ *          Source address
+ * \param   new_p
+ *          Set to true if address was not in the table
+ * \return  Slot index
+ */
+static uint8_t get_slot(w_addr_t addr, bool * new_p)
+{
+    uint8_t slot;
+
+    for (slot = 0; slot < DSAP_COMPACT_CONTEXT_SIZE; slot++)
+    {
+        if (m_context[slot].used && m_context[slot].addr == addr)
+        {
+            *new_p = false;
+            return slot;
+        }
+    }
+
+    slot = m_next_slot;
+    m_next_slot = (m_next_slot + 1) % DSAP_COMPACT_CONTEXT_SIZE;
+
+    m_context[slot].addr = addr;
+    m_context[slot].used = true;
+    *new_p = true;
+    return slot;
+}
+
+void Dsap_compact_setEnabled(bool enabled)
+{
+    memset(m_context, 0, sizeof(m_context));
+    m_next_slot = 0;
+    m_enabled = enabled;
+}
+
+bool Dsap_compact_isEnabled(void)
+{
+    return m_enabled;
+}
+
+void Dsap_compact_encode(waps_item_t * item)
+{
+    dsap_data_rx_ind_t * ind = &item->frame.dsap.data_rx_ind;
+    dsap_data_rx_compact_ind_t * compact =
+                                    &item->frame.dsap.data_rx_compact_ind;
+    uint8_t fields[DSAP_COMPACT_MAX_FIELDS_SIZE];
+    uint8_t len = 0;
+    uint8_t flags;
+    uint8_t apdu_len = ind->apdu_len;
+    context_t * ctx;
+    app_addr_t node_addr;
+    bool new_addr;
+
+    flags = get_slot(ind->src_addr, &new_addr);
+    ctx = &m_context[flags];
+
+    if (new_addr)
+    {
+        flags |= DSAP_COMPACT_NEW_ADDR_FLAG;
+        len += encode_addr(ind->src_addr, &fields[len]);
+    }
+
+    lib_settings->getNodeAddress(&node_addr);
+    if (ind->dst_addr == Addr_to_Waddr(node_addr))
+    {
+        flags |= DSAP_COMPACT_DST_OWN << DSAP_COMPACT_DST_OFFSET;
+    }
+    else if (ind->dst_addr == WADDR_BCAST)
+    {
+        flags |= DSAP_COMPACT_DST_BCAST << DSAP_COMPACT_DST_OFFSET;
+    }
+    else
+    {
+        flags |= DSAP_COMPACT_DST_EXPLICIT << DSAP_COMPACT_DST_OFFSET;
+        len += encode_addr(ind->dst_addr, &fields[len]);
+    }
+
+    // A new slot has no previous values: send them
+    if (new_addr ||
+        ind->src_endpoint != ctx->src_endpoint ||
+        ind->dst_endpoint != ctx->dst_endpoint)
+    {
+        flags |= DSAP_COMPACT_ENDPOINTS_FLAG;
+        fields[len++] = ind->src_endpoint;
+        fields[len++] = ind->dst_endpoint;
+        ctx->src_endpoint = ind->src_endpoint;
+        ctx->dst_endpoint = ind->dst_endpoint;
+    }
+
+    if (new_addr || ind->info != ctx->info)
+    {
+        flags |= DSAP_COMPACT_INFO_FLAG;
+        fields[len++] = ind->info;
+        ctx->info = ind->info;
+    }
+
+    len += encode_varint(ind->delay, &fields[len]);
+
+    // Header may be one byte longer than the original one
+    memmove(&compact->fields[len], ind->apdu, apdu_len);
+    memcpy(compact->fields, fields, len);
+    compact->flags = flags;
+
+    item->frame.sfunc = WAPS_FUNC_DSAP_DATA_RX_COMPACT_IND;
+    item->frame.splen = FRAME_DSAP_DATA_RX_COMPACT_IND_HEADER_SIZE +
+                        len + apdu_len;
+}
+
+void Dsap_compact_addDelay(waps_item_t * item, uint32_t delay)
+{
+    dsap_data_rx_compact_ind_t * compact =
+                                    &item->frame.dsap.data_rx_compact_ind;
+    uint8_t * delay_p = &compact->fields[get_delay_offset(compact->flags)];
+    uint8_t varint[DSAP_COMPACT_VARINT_MAX_SIZE];
+    uint8_t old_len;
+    uint8_t new_len;
+    uint32_t value;
+
+    if (delay == 0)
+    {
+        return;
+    }
+
+    old_len = decode_varint(delay_p, &value);
+    new_len = encode_varint(value + delay, varint);
+
+    if (new_len != old_len)
+    {
+        uint8_t apdu_len = item->frame.splen -
+                           FRAME_DSAP_DATA_RX_COMPACT_IND_HEADER_SIZE -
+                           (delay_p - compact->fields) - old_len;
+        memmove(&delay_p[new_len], &delay_p[old_len], apdu_len);
+        item->frame.splen += new_len - old_len;
+    }
+    memcpy(delay_p, varint, new_len);
+}
@@ -0,0 +1,69 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#ifndef WAPS_DSAP_COMPACT_H_
+#define WAPS_DSAP_COMPACT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "waps_item.h"
+
+/**
+ * \file    dsap_compact.h
+ *          Compact DSAP-DATA_RX indications.
+ *
+ *          Hosts that write 1 to CSAP attribute
+ *          \ref CSAP_ATTR_COMPACT_INDICATIONS receive
+ *          DSAP-DATA_RX_COMPACT indications instead of DSAP-DATA_RX
+ *          indications. Hosts that do not know the attribute keep
+ *          receiving the format of \ref dsap_data_rx_ind_t.
+ *
+ *          Source addresses are kept in a context table of
+ *          \ref DSAP_COMPACT_CONTEXT_SIZE slots that the host mirrors: a
+ *          source address is only sent when it is stored to a slot, with
+ *          \ref DSAP_COMPACT_NEW_ADDR_FLAG. Endpoints and info of the last
+ *          packet from the slot are stored too and only sent when they
+ *          change. Destination address is omitted when it is the node
+ *          address or broadcast, and delay is varint encoded.
+ *
+ *          Indications are converted when they are sent the first time, so
+ *          slots are updated in the order the host receives them. Writing
+ *          the attribute clears the table on both sides: host should write
+ *          it before polling indications, e.g. at start-up. The table is
+ *          also cleared when the node reboots, as compact indications are
+ *          then disabled until host enables them again.
+ */
+
+/**
+ * \brief   Enable or disable compact indications, clears the context table
+ * \param   enabled
+ *          True to send DSAP-DATA_RX_COMPACT indications
+ */
+void Dsap_compact_setEnabled(bool enabled);
+
+/**
+ * \brief   Check if compact indications are enabled
+ * \return  True if DSAP-DATA_RX indications are sent in compact format
+ */
+bool Dsap_compact_isEnabled(void);
+
+/**
+ * \brief   Convert a DSAP-DATA_RX indication to compact format, in place
+ * \param   item
+ *          Item holding a DSAP-DATA_RX indication, about to be sent
+ */
+void Dsap_compact_encode(waps_item_t * item);
+
+/**
+ * \brief   Add time to the delay of a compact indication
+ * \param   item
+ *          Item holding a DSAP-DATA_RX_COMPACT indication
+ * \param   delay
+ *          Time to add, in 1/128 seconds
+ */
+void Dsap_compact_addDelay(waps_item_t * item, uint32_t delay);
+
+#endif /* WAPS_DSAP_COMPACT_H_ */
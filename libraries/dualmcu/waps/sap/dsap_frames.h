@@ -143,6 +143,57 @@ typedef struct __attribute__ ((__packed__))
 #define FRAME_DSAP_DATA_RX_IND_HEADER_SIZE  \
     (sizeof(dsap_data_rx_ind_t) - APDU_MAX_SIZE)
 
+/* WAPS-DSAP-DATA_RX_COMPACT-INDICATION */
+
+/** Context table slot of source address */
+#define DSAP_COMPACT_SLOT_MASK          0x07
+/** Source address follows, and is stored to the slot */
+#define DSAP_COMPACT_NEW_ADDR_FLAG      0x08
+/** Destination address mode */
+#define DSAP_COMPACT_DST_MASK           0x30
+#define DSAP_COMPACT_DST_OFFSET         4
+/** Endpoints follow, and are stored to the slot */
+#define DSAP_COMPACT_ENDPOINTS_FLAG     0x40
+/** Info follows, and is stored to the slot */
+#define DSAP_COMPACT_INFO_FLAG          0x80
+
+/** Number of slots in context table */
+#define DSAP_COMPACT_CONTEXT_SIZE       (DSAP_COMPACT_SLOT_MASK + 1)
+
+/** Maximum size of a varint encoded 32-bit value */
+#define DSAP_COMPACT_VARINT_MAX_SIZE    5
+
+/** Maximum size of optional fields and delay */
+#define DSAP_COMPACT_MAX_FIELDS_SIZE                            \
+    (2 * sizeof(w_addr_t) + 2 * sizeof(ep_t) + sizeof(uint8_t) + \
+     DSAP_COMPACT_VARINT_MAX_SIZE)
+
+typedef enum
+{
+    /** Destination is the node address, omitted */
+    DSAP_COMPACT_DST_OWN = 0,
+    /** Destination is broadcast, omitted */
+    DSAP_COMPACT_DST_BCAST = 1,
+    /** Destination address follows */
+    DSAP_COMPACT_DST_EXPLICIT = 2,
+} dsap_compact_dst_e;
+
+typedef struct __attribute__ ((__packed__))
+{
+    uint8_t     queued_indications;
+    // Context slot + which fields follow
+    uint8_t     flags;
+    // In order, if present: src_addr, dst_addr, src_endpoint and
+    // dst_endpoint, info. Then delay as a varint (7 bits per byte, least
+    // significant first, highest bit set if more bytes follow) and APDU up
+    // to the end of frame
+    uint8_t     fields[DSAP_COMPACT_MAX_FIELDS_SIZE + APDU_MAX_SIZE];
+} dsap_data_rx_compact_ind_t;
+
+#define FRAME_DSAP_DATA_RX_COMPACT_IND_HEADER_SIZE  \
+    (sizeof(dsap_data_rx_compact_ind_t) -           \
+     DSAP_COMPACT_MAX_FIELDS_SIZE - APDU_MAX_SIZE)
+
 
 /* WAPS-DSAP-DATA_RX_FRAG-INDICATION */
 
@@ -197,6 +248,7 @@ typedef union
     dsap_data_tx_cnf_t          data_tx_cnf;
     dsap_data_rx_ind_t          data_rx_ind;
     dsap_data_rx_frag_ind_t     data_rx_frag_ind;
+    dsap_data_rx_compact_ind_t  data_rx_compact_ind;
 } frame_dsap;
 
 
@@ -0,0 +1,348 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#include <string.h>
+
+#include "dsap_reassembly.h"
+#include "dsap.h"
+#include "dsap_frames.h"
+#include "function_codes.h"
+#include "app_scheduler.h"
+#include "api.h"
+
+/** Period of timeout checks */
+#define TIMEOUT_TASK_PERIOD_MS          1000
+
+/** Max execution time of timeout task */
+#define TIMEOUT_TASK_EXEC_TIME_US       100
+
+/** Coarse timestamp ticks per second */
+#define COARSE_TICKS_PER_S              128
+
+/** State of a reassembly slot */
+typedef enum
+{
+    /** Slot is not used */
+    SLOT_FREE,
+    /** Fragments are held until packet is complete */
+    SLOT_REASSEMBLING,
+    /** Out of memory: fragments are forwarded as they are received */
+    SLOT_FORWARDING
+} slot_state_e;
+
+/** Packet being reassembled */
+typedef struct
+{
+    slot_state_e                    state;
+    /** Source address of packet */
+    app_addr_t                      src_addr;
+    /** Full packet id */
+    uint16_t                        packet_id;
+    /** Time first fragment was received */
+    app_lib_time_timestamp_coarse_t start;
+    /** Number of bytes received */
+    uint16_t                        received;
+    /** Packet size, 0 until last fragment is received */
+    uint16_t                        total;
+    /** Number of items in chunks */
+    uint8_t                         num_chunks;
+    /** DSAP-DATA_RX_FRAG indications, sorted by offset */
+    waps_item_t *                   chunks[DSAP_REASSEMBLY_MAX_CHUNKS];
+} packet_t;
+
+/** Packets being reassembled */
+static packet_t                     m_packets[DSAP_REASSEMBLY_MAX_PACKETS];
+
+/** Number of items held by all packets */
+static uint8_t                      m_held_items;
+
+/** Where to send indications */
+static dsap_reassembly_output_f     m_output_cb;
+
+__STATIC_INLINE dsap_data_rx_frag_ind_t * get_ind(waps_item_t * item)
+{
+    return &item->frame.dsap.data_rx_frag_ind;
+}
+
+__STATIC_INLINE uint16_t get_offset(waps_item_t * item)
+{
+    return get_ind(item)->fragment_offset_flag & DSAP_FRAG_LENGTH_MASK;
+}
+
+__STATIC_INLINE uint16_t get_end(waps_item_t * item)
+{
+    return get_offset(item) + get_ind(item)->apdu_len;
+}
+
+/**
+ * \brief   Forward a fragment to host as it is
+ */
+static app_lib_data_receive_res_e forward_fragment(
+                                    const app_lib_data_received_t * data,
+                                    w_addr_t dst_addr)
+{
+    waps_item_t * item = Waps_itemReserve(WAPS_ITEM_TYPE_INDICATION);
+
+    if (item == NULL)
+    {
+        return APP_LIB_DATA_RECEIVE_RES_NO_SPACE;
+    }
+
+    Dsap_packetReceived(data, dst_addr, item);
+    m_output_cb(item);
+    return APP_LIB_DATA_RECEIVE_RES_HANDLED;
+}
+
+/**
+ * \brief   Send held fragments to host, in offset order
+ * \param   packet
+ *          Packet to flush
+ */
+static void flush_packet(packet_t * packet)
+{
+    for (uint8_t i = 0; i < packet->num_chunks; i++)
+    {
+        waps_item_t * item = packet->chunks[i];
+        if (packet->total != 0 && get_end(item) == packet->total)
+        {
+            get_ind(item)->fragment_offset_flag |= DSAP_FRAG_LAST_FLAG_MASK;
+        }
+        m_output_cb(item);
+    }
+    m_held_items -= packet->num_chunks;
+    packet->num_chunks = 0;
+}
+
+/**
+ * \brief   Drop held fragments and free slot
+ * \param   packet
+ *          Packet to drop
+ */
+static void release_packet(packet_t * packet)
+{
+    for (uint8_t i = 0; i < packet->num_chunks; i++)
+    {
+        Waps_itemFree(packet->chunks[i]);
+    }
+    m_held_items -= packet->num_chunks;
+    packet->num_chunks = 0;
+    packet->state = SLOT_FREE;
+}
+
+/**
+ * \brief   Drop packets that are not complete in time
+ */
+static uint32_t timeout_task(void)
+{
+    app_lib_time_timestamp_coarse_t now = lib_time->getTimestampCoarse();
+    bool active = false;
+
+    for (uint8_t i = 0; i < DSAP_REASSEMBLY_MAX_PACKETS; i++)
+    {
+        packet_t * packet = &m_packets[i];
+        if (packet->state == SLOT_FREE)
+        {
+            continue;
+        }
+        if (now - packet->start >
+                            DSAP_REASSEMBLY_TIMEOUT_S * COARSE_TICKS_PER_S)
+        {
+            // Missing fragments will not come anymore, host would drop the
+            // packet too
+            release_packet(packet);
+        }
+        else
+        {
+            active = true;
+        }
+    }
+
+    return active ? TIMEOUT_TASK_PERIOD_MS : APP_SCHEDULER_STOP_TASK;
+}
+
+/**
+ * \brief   Find packet of a fragment, or allocate a slot for it
+ * \return  Packet, or NULL if all slots are used
+ */
+static packet_t * get_packet(app_addr_t src_addr, uint16_t packet_id)
+{
+    packet_t * free_slot = NULL;
+
+    for (uint8_t i = 0; i < DSAP_REASSEMBLY_MAX_PACKETS; i++)
+    {
+        packet_t * packet = &m_packets[i];
+        if (packet->state == SLOT_FREE)
+        {
+            if (free_slot == NULL)
+            {
+                free_slot = packet;
+            }
+        }
+        else if (packet->src_addr == src_addr &&
+                 packet->packet_id == packet_id)
+        {
+            return packet;
+        }
+    }
+
+    if (free_slot != NULL)
+    {
+        memset(free_slot, 0, sizeof(packet_t));
+        free_slot->state = SLOT_REASSEMBLING;
+        free_slot->src_addr = src_addr;
+        free_slot->packet_id = packet_id;
+        free_slot->start = lib_time->getTimestampCoarse();
+        // Restarts period if already running, that is not an issue
+        App_Scheduler_addTask_execTime(timeout_task,
+                                       TIMEOUT_TASK_PERIOD_MS,
+                                       TIMEOUT_TASK_EXEC_TIME_US);
+    }
+
+    return free_slot;
+}
+
+/**
+ * \brief   Stop reassembly of a packet after an allocation failure
+ */
+static app_lib_data_receive_res_e fall_back(packet_t * packet,
+                                            const app_lib_data_received_t * data,
+                                            w_addr_t dst_addr)
+{
+    app_lib_data_receive_res_e res;
+
+    flush_packet(packet);
+    packet->state = SLOT_FORWARDING;
+
+    res = forward_fragment(data, dst_addr);
+    if (res == APP_LIB_DATA_RECEIVE_RES_HANDLED)
+    {
+        // Keep slot until all fragments are forwarded, for fragments
+        // received out of order
+        packet->received += data->num_bytes;
+        if (data->fragment_info->last_fragment)
+        {
+            packet->total = data->fragment_info->fragment_offset +
+                            data->num_bytes;
+        }
+        if (packet->total != 0 && packet->received >= packet->total)
+        {
+            packet->state = SLOT_FREE;
+        }
+    }
+    return res;
+}
+
+void Dsap_reassembly_init(dsap_reassembly_output_f output_cb)
+{
+    m_output_cb = output_cb;
+    m_held_items = 0;
+    memset(m_packets, 0, sizeof(m_packets));
+}
+
+app_lib_data_receive_res_e Dsap_reassembly_packetReceived(
+                                    const app_lib_data_received_t * data,
+                                    w_addr_t dst_addr)
+{
+    uint16_t offset = data->fragment_info->fragment_offset;
+    uint16_t len = data->num_bytes;
+    packet_t * packet;
+    waps_item_t * prev = NULL;
+    waps_item_t * item = NULL;
+    uint16_t merged = 0;
+    uint8_t pos;
+
+    packet = get_packet(data->src_address, data->fragment_info->packet_id);
+    if (packet == NULL)
+    {
+        // No slot: forward as without reassembly
+        return forward_fragment(data, dst_addr);
+    }
+
+    if (packet->state == SLOT_FORWARDING)
+    {
+        return fall_back(packet, data, dst_addr);
+    }
+
+    // Find where the fragment goes, and the chunk just before it
+    for (pos = 0; pos < packet->num_chunks; pos++)
+    {
+        waps_item_t * chunk = packet->chunks[pos];
+        if (offset >= get_offset(chunk) && offset < get_end(chunk))
+        {
+            // Already received
+            return APP_LIB_DATA_RECEIVE_RES_HANDLED;
+        }
+        if (get_offset(chunk) > offset)
+        {
+            break;
+        }
+        prev = chunk;
+    }
+
+    // Fill previous chunk if fragment follows it
+    if (prev != NULL && get_end(prev) == offset)
+    {
+        merged = APDU_MAX_SIZE - get_ind(prev)->apdu_len;
+        if (merged > len)
+        {
+            merged = len;
+        }
+    }
+
+    // Reserve item for the rest before modifying anything, so that
+    // fragment can be processed again if this fails
+    if (merged < len)
+    {
+        if (packet->num_chunks == DSAP_REASSEMBLY_MAX_CHUNKS ||
+            m_held_items >= DSAP_REASSEMBLY_MAX_ITEMS ||
+            (item = Waps_itemReserve(WAPS_ITEM_TYPE_INDICATION)) == NULL)
+        {
+            return fall_back(packet, data, dst_addr);
+        }
+    }
+
+    if (merged > 0)
+    {
+        dsap_data_rx_frag_ind_t * ind = get_ind(prev);
+        memcpy(&ind->apdu[ind->apdu_len], data->bytes, merged);
+        ind->apdu_len += merged;
+        prev->frame.splen += merged;
+    }
+
+    if (item != NULL)
+    {
+        dsap_data_rx_frag_ind_t * ind = get_ind(item);
+
+        Dsap_packetReceived(data, dst_addr, item);
+        // Only keep bytes not merged to previous chunk
+        memmove(ind->apdu, &ind->apdu[merged], len - merged);
+        ind->apdu_len = len - merged;
+        ind->fragment_offset_flag = (offset + merged) & DSAP_FRAG_LENGTH_MASK;
+        item->frame.splen -= merged;
+
+        memmove(&packet->chunks[pos + 1],
+                &packet->chunks[pos],
+                (packet->num_chunks - pos) * sizeof(waps_item_t *));
+        packet->chunks[pos] = item;
+        packet->num_chunks++;
+        m_held_items++;
+    }
+
+    packet->received += len;
+    if (data->fragment_info->last_fragment)
+    {
+        packet->total = offset + len;
+    }
+
+    if (packet->total != 0 && packet->received >= packet->total)
+    {
+        // Complete: give whole packet to host
+        flush_packet(packet);
+        packet->state = SLOT_FREE;
+    }
+
+    return APP_LIB_DATA_RECEIVE_RES_HANDLED;
+}
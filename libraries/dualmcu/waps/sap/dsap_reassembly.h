@@ -0,0 +1,83 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#ifndef WAPS_DSAP_REASSEMBLY_H_
+#define WAPS_DSAP_REASSEMBLY_H_
+
+#include "waps_private.h"
+#include "waps_item.h"
+#include "waddr.h"
+
+/**
+ * \file    dsap_reassembly.h
+ *          Reassembly of fragmented packets on the sink, enabled with
+ *          dsap_reassembly=yes in application makefile.
+ *
+ *          Fragments of a packet, identified by source address and full
+ *          packet id, are held in WAPS items until the packet is complete.
+ *          Consecutive fragments are merged, so that each item carries a
+ *          full APDU. The complete packet is then given to the host as a
+ *          stream of DSAP-DATA_RX_FRAG indications, in offset order, that
+ *          the host reassembles as before but with less frames and no
+ *          incomplete packets.
+ *
+ *          If no reassembly slot or item is available, the fragments of the
+ *          packet are forwarded as they are received, as without reassembly.
+ *          Incomplete packets are dropped after
+ *          \ref DSAP_REASSEMBLY_TIMEOUT_S.
+ */
+
+/** Number of packets reassembled at the same time */
+#ifndef DSAP_REASSEMBLY_MAX_PACKETS
+#define DSAP_REASSEMBLY_MAX_PACKETS     4
+#endif
+
+/** Maximum number of items held by a packet: a 1500 bytes packet needs 15
+ *  items if fragments are received in order
+ */
+#ifndef DSAP_REASSEMBLY_MAX_CHUNKS
+#define DSAP_REASSEMBLY_MAX_CHUNKS      16
+#endif
+
+/** Maximum number of items held by all packets */
+#ifndef DSAP_REASSEMBLY_MAX_ITEMS
+#define DSAP_REASSEMBLY_MAX_ITEMS       24
+#endif
+
+/** Time to receive all fragments of a packet, in seconds */
+#ifndef DSAP_REASSEMBLY_TIMEOUT_S
+#define DSAP_REASSEMBLY_TIMEOUT_S       30
+#endif
+
+/**
+ * \brief   Callback to give an indication to WAPS
+ * \param   item
+ *          Indication, ownership is transferred
+ */
+typedef void (*dsap_reassembly_output_f)(waps_item_t * item);
+
+/**
+ * \brief   Initialize reassembly
+ * \param   output_cb
+ *          Called for each indication to send to host
+ */
+void Dsap_reassembly_init(dsap_reassembly_output_f output_cb);
+
+/**
+ * \brief   Handle a received fragment
+ * \param   data
+ *          Received fragment, data->fragment_info must not be NULL
+ * \param   dst_addr
+ *          Destination address of packet, either unicast address or broadcast
+ * \return  APP_LIB_DATA_RECEIVE_RES_HANDLED, or
+ *          APP_LIB_DATA_RECEIVE_RES_NO_SPACE if there was no item to store
+ *          the fragment
+ */
+app_lib_data_receive_res_e Dsap_reassembly_packetReceived(
+                                    const app_lib_data_received_t * data,
+                                    w_addr_t dst_addr);
+
+#endif /* WAPS_DSAP_REASSEMBLY_H_ */
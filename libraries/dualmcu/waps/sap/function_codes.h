@@ -22,6 +22,9 @@ typedef enum
     /* DSAP-DATA_RX */
     WAPS_FUNC_DSAP_DATA_RX_IND = 0x03,
     WAPS_FUNC_DSAP_DATA_RX_RSP = 0x83,
+    /* DSAP-DATA_RX_COMPACT */
+    WAPS_FUNC_DSAP_DATA_RX_COMPACT_IND = 0x11,
+    WAPS_FUNC_DSAP_DATA_RX_COMPACT_RSP = 0x91,
     /* MSAP-INDICATION_POLL */
     WAPS_FUNC_MSAP_INDICATION_POLL_REQ = 0x04,
     WAPS_FUNC_MSAP_INDICATION_POLL_CNF = 0x84,
@@ -234,6 +237,7 @@ typedef enum
     WAPS_FUNC_DSAP_DATA_TX_IND,                     \
     WAPS_FUNC_DSAP_DATA_RX_FRAG_IND,                \
     WAPS_FUNC_DSAP_DATA_RX_IND,                     \
+    WAPS_FUNC_DSAP_DATA_RX_COMPACT_IND,             \
     WAPS_FUNC_MSAP_STACK_STATE_IND,                 \
     WAPS_FUNC_MSAP_APP_CONFIG_RX_IND,               \
     WAPS_FUNC_MSAP_REMOTE_STATUS_IND,               \
@@ -245,6 +249,7 @@ typedef enum
     WAPS_FUNC_DSAP_DATA_TX_RSP,                     \
     WAPS_FUNC_DSAP_DATA_RX_FRAG_RSP,                \
     WAPS_FUNC_DSAP_DATA_RX_RSP,                     \
+    WAPS_FUNC_DSAP_DATA_RX_COMPACT_RSP,             \
     WAPS_FUNC_MSAP_STACK_STATE_RSP,                 \
     WAPS_FUNC_MSAP_APP_CONFIG_RX_RSP,               \
     WAPS_FUNC_MSAP_REMOTE_STATUS_RSP,               \
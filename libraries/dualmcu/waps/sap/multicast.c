@@ -8,6 +8,16 @@
 #include "waddr.h"
 #include <string.h>
 #include "persistent.h"
+#include "shared_data.h"
+
+/** Groups of the node, sorted, as loaded from persistent storage */
+static app_addr_t   m_groups[MULTICAST_ADDRESS_AMOUNT];
+
+/** Number of groups in m_groups */
+static uint8_t      m_groups_count;
+
+/** Is m_groups up to date with persistent storage */
+static bool         m_groups_loaded = false;
 
 /**
  * \brief   Convert packed multicast address to app addr structure
@@ -51,24 +61,70 @@ static void mcast_group_addr_to_waddr(const multicast_group_addr_t * from,
     memcpy(to, &addr, sizeof(w_addr_t));
 }
 
+/**
+ * \brief   Cache groups in RAM, sorted for binary search
+ * \param   addresses
+ *          Groups, as in persistent storage
+ */
+static void load_groups(multicast_group_addr_t * addresses)
+{
+    m_groups_count = 0;
+    for (uint_fast8_t i=0; i < MULTICAST_ADDRESS_AMOUNT; i++)
+    {
+        app_addr_t groupaddr = mcast_group_addr_to_app_addr(&addresses[i]);
+        uint_fast8_t j = m_groups_count;
+
+        // Insertion sort, skipping duplicates (unused entries)
+        while (j > 0 && m_groups[j - 1] > groupaddr)
+        {
+            j--;
+        }
+        if (j > 0 && m_groups[j - 1] == groupaddr)
+        {
+            continue;
+        }
+        memmove(&m_groups[j + 1],
+                &m_groups[j],
+                (m_groups_count - j) * sizeof(app_addr_t));
+        m_groups[j] = groupaddr;
+        m_groups_count++;
+    }
+    m_groups_loaded = true;
+}
+
 bool Multicast_isGroupCb(app_addr_t group_addr)
 {
     multicast_group_addr_t addresses[MULTICAST_ADDRESS_AMOUNT];
+    uint_fast8_t low = 0;
+    uint_fast8_t high;
 
-    if (Persistent_getGroups(&addresses[0]) != APP_RES_OK)
+    // Only read persistent storage after a change
+    if (!m_groups_loaded)
     {
-        // Failure, not a member of the group
-        return false;
+        if (Persistent_getGroups(&addresses[0]) != APP_RES_OK)
+        {
+            // Failure, not a member of the group
+            return false;
+        }
+        load_groups(&addresses[0]);
     }
 
-    for (uint_fast8_t i=0; i < MULTICAST_ADDRESS_AMOUNT; i++)
+    high = m_groups_count;
+    while (low < high)
     {
-        // Check if group address matches
-        app_addr_t groupaddr = mcast_group_addr_to_app_addr(&addresses[i]);
-        if (groupaddr == group_addr)
+        uint_fast8_t mid = (low + high) / 2;
+        if (m_groups[mid] == group_addr)
         {
             return true;
         }
+        else if (m_groups[mid] < group_addr)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
     }
 
     return false;
@@ -86,7 +142,19 @@ app_res_e Multicast_setGroups(const uint8_t * groups)
     }
 
     // Set to storage
-    return Persistent_setGroups(&stgroups[0]);
+    app_res_e retval = Persistent_setGroups(&stgroups[0]);
+
+    // Reload cache on next query, even if storage failed
+    Multicast_reloadGroups();
+
+    return retval;
+}
+
+void Multicast_reloadGroups(void)
+{
+    m_groups_loaded = false;
+    // Answers of Multicast_isGroupCb() are also cached by Shared_Data
+    Shared_Data_groupsChanged();
 }
 
 app_res_e Multicast_getGroups(uint8_t * groups)
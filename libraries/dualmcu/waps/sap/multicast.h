@@ -19,6 +19,8 @@ typedef struct __attribute__ ((__packed__))
 
 /**
  * \brief   Callback for querying group callback
+ *          Groups are cached in RAM, persistent storage is only read again
+ *          after \ref Multicast_setGroups or \ref Multicast_reloadGroups
  * \param   group_addr
  *          Address of the group
  * \return  true: Is part of this group, false: Is not part of this group
@@ -33,6 +35,14 @@ bool Multicast_isGroupCb(app_addr_t group_addr);
  */
 app_res_e Multicast_setGroups(const uint8_t * groups);
 
+/**
+ * \brief   Forget groups cached in RAM, they are read again from persistent
+ *          storage on next query
+ * \note    To be called when persistent storage is modified without
+ *          \ref Multicast_setGroups, e.g. on factory reset
+ */
+void Multicast_reloadGroups(void);
+
 /**
  * \brief   Get multicast groups
  * \param   groups
@@ -12,6 +12,9 @@
 #include "protocol/waps_protocol.h"
 #include "waps_frames.h"
 #include "sap/dsap.h"
+#ifdef DSAP_REASSEMBLY
+#include "sap/dsap_reassembly.h"
+#endif
 #include "sap/csap.h"
 #include "sap/msap.h"
 #include "sap/function_codes.h"
@@ -129,24 +132,35 @@ static app_lib_data_receive_res_e data_cb(
 {
     w_addr_t dst;
 
-    waps_item_t * item = Waps_itemReserve(WAPS_ITEM_TYPE_INDICATION);
+    waps_item_t * item;
+
+    if (data->dest_address == APP_ADDR_BROADCAST)
+    {
+        dst = WADDR_BCAST;
+    }
+    else if ((data->dest_address & 0xff000000) == APP_ADDR_MULTICAST)
+    {
+        dst = data->dest_address;
+    }
+    else
+    {
+        // Destination is obviously self
+        app_addr_t addr;
+        lib_settings->getNodeAddress(&addr);
+        dst = Addr_to_Waddr(addr);
+    }
+
+#ifdef DSAP_REASSEMBLY
+    if (data->fragment_info != NULL)
+    {
+        // Fragments are held until packet is complete
+        return Dsap_reassembly_packetReceived(data, dst);
+    }
+#endif
+
+    item = Waps_itemReserve(WAPS_ITEM_TYPE_INDICATION);
     if(item)
     {
-        if (data->dest_address == APP_ADDR_BROADCAST)
-        {
-            dst = WADDR_BCAST;
-        }
-        else if ((data->dest_address & 0xff000000) == APP_ADDR_MULTICAST)
-        {
-            dst = data->dest_address;
-        }
-        else
-        {
-            // Destination is obviously self
-            app_addr_t addr;
-            lib_settings->getNodeAddress(&addr);
-            dst = Addr_to_Waddr(addr);
-        }
         Dsap_packetReceived(data, dst, item);
         add_indication(item);
         return APP_LIB_DATA_RECEIVE_RES_HANDLED;
@@ -195,6 +209,9 @@ bool Waps_init(uint32_t baudrate, bool flow_ctrl)
     sl_list_init(&waps_request_queue);
     sl_list_init(&waps_ind_queue);
     sl_list_init(&waps_reply_queue);
+#ifdef DSAP_REASSEMBLY
+    Dsap_reassembly_init(add_indication);
+#endif
     // Cache number of channels. For the purposes of
     // lib_settings->setReservedChannels(), minimum channel is always 1
     uint16_t tmp1, tmp2;
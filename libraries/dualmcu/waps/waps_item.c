@@ -19,7 +19,6 @@
 #define WAPS_MIN_ITEMS          6
 
 // Addresses determined by the linker
-extern uint32_t                 __bss_end__;
 extern uint32_t                 __ram_end__;
 extern uint32_t *               m_used_app_ram_end;
 
@@ -44,7 +43,8 @@ static waps_free_item_threshold_cb_t m_threshold_cb;
 void Waps_itemInit(waps_free_item_threshold_cb_t thresold_cb,
                    uint8_t thresold_percent)
 {
-    uint32_t * free_ram_start = &__bss_end__;
+    // Use RAM left after other memory allocated at initialization
+    uint32_t * free_ram_start = m_used_app_ram_end;
     uint32_t * free_ram_ends = &__ram_end__;
 
     uint32_t i = 0;
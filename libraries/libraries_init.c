@@ -4,6 +4,7 @@
  *
  */
 #include "libraries_init.h"
+#include "startup_profile.h"
 
 // Libraries are considered in use if their associated interface (.h)
 // file is in the include list. It could be done with a dedicated C flag
@@ -41,38 +42,58 @@
 #include "shared_offline.h"
 #endif
 
+#if __has_include("neighbor_cache.h")
+#include "neighbor_cache.h"
+#endif
+
+#ifdef LIBRARIES_LAZY_INIT
+// Libraries are initialized on first use, see LIBRARIES_INIT_ON_USE
+#define INIT_LIBRARY(init, phase)
+#else
+#define INIT_LIBRARY(init, phase) \
+    do \
+    { \
+        init(); \
+        STARTUP_PROFILE_MARK(phase); \
+    } while (0)
+#endif
+
 void Libraries_init(void)
 {
 #if __has_include("app_scheduler.h")
-    App_Scheduler_init();
+    INIT_LIBRARY(App_Scheduler_init, STARTUP_PHASE_APP_SCHEDULER_INIT);
 #endif
 
 #if __has_include("shared_appconfig.h")
-    Shared_Appconfig_init();
+    INIT_LIBRARY(Shared_Appconfig_init, STARTUP_PHASE_SHARED_APPCONFIG_INIT);
 #endif
 
 #if __has_include("shared_data.h")
-    Shared_Data_init();
+    INIT_LIBRARY(Shared_Data_init, STARTUP_PHASE_SHARED_DATA_INIT);
 #endif
 
 #if __has_include("stack_state.h")
-    Stack_State_init();
+    INIT_LIBRARY(Stack_State_init, STARTUP_PHASE_STACK_STATE_INIT);
 #endif
 
 #if __has_include("app_persistent.h")
-    App_Persistent_init();
+    INIT_LIBRARY(App_Persistent_init, STARTUP_PHASE_APP_PERSISTENT_INIT);
 #endif
 
 #if __has_include("shared_beacon.h")
-    Shared_Beacon_init();
+    INIT_LIBRARY(Shared_Beacon_init, STARTUP_PHASE_SHARED_BEACON_INIT);
 #endif
 
 #if __has_include("shared_neighbors.h")
-    Shared_Neighbors_init();
+    INIT_LIBRARY(Shared_Neighbors_init, STARTUP_PHASE_SHARED_NEIGHBORS_INIT);
 #endif
 
 #if __has_include("shared_offline.h")
-    Shared_Offline_init();
+    INIT_LIBRARY(Shared_Offline_init, STARTUP_PHASE_SHARED_OFFLINE_INIT);
 #endif
 
+#if __has_include("neighbor_cache.h")
+    // Needs Stack_State and Shared_Neighbors
+    INIT_LIBRARY(Neighbor_Cache_init, STARTUP_PHASE_NEIGHBOR_CACHE_INIT);
+#endif
 }
@@ -15,4 +15,26 @@
  */
 void Libraries_init(void);
 
+/**
+ * \brief   Check that a library is initialized, before using it from one of
+ *          its public functions
+ *
+ * With LIBRARIES_LAZY_INIT=yes in application makefile, \ref Libraries_init
+ * does not initialize libraries: each library is initialized by the first
+ * call to one of its public functions. Libraries that are included but never
+ * used then register no stack callback and no task, and startup is shorter.
+ *
+ * \param   initialized
+ *          Initialization flag of the library
+ * \param   init
+ *          Initialization function of the library
+ * \return  True if library is initialized
+ */
+#ifdef LIBRARIES_LAZY_INIT
+#define LIBRARIES_INIT_ON_USE(initialized, init) \
+    ((initialized) || ((void)(init)(), (initialized)))
+#else
+#define LIBRARIES_INIT_ON_USE(initialized, init) (initialized)
+#endif
+
 #endif /* LIBRARIES_INIT_H_ */
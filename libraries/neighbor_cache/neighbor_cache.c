@@ -0,0 +1,621 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+#define DEBUG_LOG_MODULE_NAME "NBOR_CACHE"
+#ifdef DEBUG_NEIGHBOR_CACHE_LOG_MAX_LEVEL
+#define DEBUG_LOG_MAX_LEVEL DEBUG_NEIGHBOR_CACHE_LOG_MAX_LEVEL
+#else
+#define DEBUG_LOG_MAX_LEVEL LVL_NOLOG
+#endif
+#include "debug_log.h"
+#include <string.h>
+#include "neighbor_cache.h"
+#include "app_scheduler.h"
+#include "shared_neighbors.h"
+#include "stack_state.h"
+#include "libraries_init.h"
+
+#if NEIGHBOR_CACHE_SIZE > 254
+#error NEIGHBOR_CACHE_SIZE must be less than 255
+#endif
+
+/** No pending notification for an entry */
+#define NO_EVENT                    0xff
+
+/** Maximum execution time of refresh task, in us */
+#define REFRESH_TASK_EXEC_TIME_US   1000
+
+/** Maximum execution time of notification task, in us */
+#define NOTIFY_TASK_EXEC_TIME_US    500
+
+/** Notifications per notification task run, to let other tasks run */
+#define NOTIFY_MAX_PER_RUN          NEIGHBOR_CACHE_SIZE
+
+/** Neighbor table, sorted */
+static neighbor_cache_entry_t m_entries[NEIGHBOR_CACHE_SIZE];
+
+/** Change of each entry not notified yet, \ref NO_EVENT if none. Moved
+ *  together with entries */
+static uint8_t m_pending[NEIGHBOR_CACHE_SIZE];
+
+/** Number of entries in table */
+static uint8_t m_count;
+
+/** Incremented each time table is modified, in critical section */
+static volatile uint32_t m_version;
+
+/** Stack neighbors list, read at refresh */
+static app_lib_state_nbor_info_t m_stack_nbors[NEIGHBOR_CACHE_SIZE];
+
+/** Is stack neighbors list in use */
+static bool m_refreshing;
+
+/** Id of beacon callback in Shared_Neighbors */
+static uint16_t m_beacon_cb_id;
+
+static bool m_initialized = false;
+
+#if NEIGHBOR_CACHE_MAX_CB > 0
+
+typedef struct
+{
+    neighbor_cache_change_cb_f cb;
+    uint32_t bitfield;
+} change_cb_t;
+
+/** List of change callbacks */
+static change_cb_t m_change_cbs[NEIGHBOR_CACHE_MAX_CB];
+
+#endif
+
+/**
+ * \brief   Calls change callbacks registered for an event
+ */
+static void call_cbs(neighbor_cache_event_e event,
+                     const neighbor_cache_entry_t * entry)
+{
+#if NEIGHBOR_CACHE_MAX_CB > 0
+    for (uint8_t i = 0; i < NEIGHBOR_CACHE_MAX_CB; i++)
+    {
+        neighbor_cache_change_cb_f cb = m_change_cbs[i].cb;
+
+        if (cb != NULL && (m_change_cbs[i].bitfield & (1 << event)))
+        {
+            cb(event, entry);
+        }
+    }
+#endif
+}
+
+/**
+ * \brief   Are there callbacks to notify
+ */
+static bool has_cbs(void)
+{
+#if NEIGHBOR_CACHE_MAX_CB > 0
+    for (uint8_t i = 0; i < NEIGHBOR_CACHE_MAX_CB; i++)
+    {
+        if (m_change_cbs[i].cb != NULL)
+        {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+/**
+ * \brief   Sort order: type first (next hop, member, cluster), then RSSI
+ * \return  True if a comes before b
+ */
+static bool is_before(const neighbor_cache_entry_t * a,
+                      const neighbor_cache_entry_t * b)
+{
+    if (a->info.type != b->info.type)
+    {
+        return a->info.type < b->info.type;
+    }
+    return a->info.norm_rssi > b->info.norm_rssi;
+}
+
+/**
+ * \brief   Moves an entry to its sorted position.
+ *          Must be called in critical section.
+ * \param   index
+ *          Index of modified entry
+ */
+static void sort_entry(uint8_t index)
+{
+    neighbor_cache_entry_t entry = m_entries[index];
+    uint8_t pending = m_pending[index];
+
+    while (index > 0 && is_before(&entry, &m_entries[index - 1]))
+    {
+        m_entries[index] = m_entries[index - 1];
+        m_pending[index] = m_pending[index - 1];
+        index--;
+    }
+
+    while (index + 1 < m_count && is_before(&m_entries[index + 1], &entry))
+    {
+        m_entries[index] = m_entries[index + 1];
+        m_pending[index] = m_pending[index + 1];
+        index++;
+    }
+
+    m_entries[index] = entry;
+    m_pending[index] = pending;
+}
+
+/**
+ * \brief   Removes an entry. Must be called in critical section.
+ */
+static void remove_entry(uint8_t index)
+{
+    m_count--;
+    memmove(&m_entries[index], &m_entries[index + 1],
+            (m_count - index) * sizeof(m_entries[0]));
+    memmove(&m_pending[index], &m_pending[index + 1],
+            (m_count - index) * sizeof(m_pending[0]));
+    m_version++;
+}
+
+/**
+ * \brief   Index of a neighbor, m_count if not found
+ */
+static uint8_t find_index(app_addr_t address)
+{
+    uint8_t i;
+
+    for (i = 0; i < m_count; i++)
+    {
+        if (m_entries[i].info.address == address)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * \brief   Compares neighbor information, except last update
+ * \return  True if information differs
+ */
+static bool info_changed(const app_lib_state_nbor_info_t * a,
+                         const app_lib_state_nbor_info_t * b)
+{
+    return a->link_reliability != b->link_reliability ||
+           a->norm_rssi != b->norm_rssi ||
+           a->cost != b->cost ||
+           a->channel != b->channel ||
+           a->type != b->type ||
+           a->tx_power != b->tx_power ||
+           a->rx_power != b->rx_power ||
+           a->diradv_support != b->diradv_support;
+}
+
+/**
+ * \brief   Adds or updates a neighbor. Must be called in critical section.
+ * \param   info
+ *          Neighbor information
+ * \param   last_seen_s
+ *          Time neighbor was last updated
+ * \param   evicted
+ *          If not NULL, the worst entry may be evicted to add a better one
+ *          to a full table, and is copied here
+ * \return  True if an entry was evicted
+ */
+static bool update_entry(const app_lib_state_nbor_info_t * info,
+                         uint32_t last_seen_s,
+                         neighbor_cache_entry_t * evicted)
+{
+    uint8_t i = find_index(info->address);
+    neighbor_cache_event_e event;
+    bool evict = false;
+
+    if (i < m_count)
+    {
+        event = info_changed(&m_entries[i].info, info) ?
+                        NEIGHBOR_CACHE_EVENT_UPDATED :
+                        NEIGHBOR_CACHE_EVENT_SEEN;
+    }
+    else
+    {
+        if (m_count == NEIGHBOR_CACHE_SIZE)
+        {
+            neighbor_cache_entry_t new_entry = {
+                .info = *info,
+                .last_seen_s = last_seen_s,
+            };
+
+            if (evicted == NULL ||
+                !is_before(&new_entry, &m_entries[m_count - 1]))
+            {
+                return false;
+            }
+            *evicted = m_entries[m_count - 1];
+            m_count--;
+            evict = true;
+        }
+        i = m_count++;
+        m_pending[i] = NO_EVENT;
+        event = NEIGHBOR_CACHE_EVENT_ADDED;
+    }
+
+    m_entries[i].info = *info;
+    m_entries[i].last_seen_s = last_seen_s;
+
+    // Keep the most important change: added, then updated, then seen
+    if (m_pending[i] == NO_EVENT || event < m_pending[i])
+    {
+        m_pending[i] = event;
+    }
+
+    sort_entry(i);
+    m_version++;
+
+    return evict;
+}
+
+/**
+ * \brief   Calls callbacks for pending changes
+ * \return  True if all pending changes were notified
+ */
+static bool notify(void)
+{
+    neighbor_cache_entry_t entry;
+    uint8_t event;
+
+    for (uint8_t n = 0; n < NOTIFY_MAX_PER_RUN; n++)
+    {
+        event = NO_EVENT;
+
+        Sys_enterCriticalSection();
+        for (uint8_t i = 0; i < m_count; i++)
+        {
+            if (m_pending[i] != NO_EVENT)
+            {
+                entry = m_entries[i];
+                event = m_pending[i];
+                m_pending[i] = NO_EVENT;
+                break;
+            }
+        }
+        Sys_exitCriticalSection();
+
+        if (event == NO_EVENT)
+        {
+            return true;
+        }
+
+        call_cbs(event, &entry);
+    }
+
+    return false;
+}
+
+static uint32_t notify_task(void)
+{
+    return notify() ? APP_SCHEDULER_STOP_TASK : APP_SCHEDULER_SCHEDULE_ASAP;
+}
+
+static uint32_t refresh_task(void)
+{
+    if (Neighbor_Cache_refresh() == APP_RES_RESOURCE_UNAVAILABLE)
+    {
+        // Refresh ongoing from application, try again
+        return APP_SCHEDULER_SCHEDULE_ASAP;
+    }
+    return APP_SCHEDULER_STOP_TASK;
+}
+
+/**
+ * \brief   Scan end callback, called in critical section
+ */
+static void scan_end_cb(app_lib_stack_event_e event, void * param)
+{
+    App_Scheduler_addTask_execTime(refresh_task,
+                                   APP_SCHEDULER_SCHEDULE_ASAP,
+                                   REFRESH_TASK_EXEC_TIME_US);
+}
+
+static void beacon_cb(const app_lib_state_beacon_rx_t * beacon)
+{
+    app_lib_state_nbor_info_t info;
+    uint8_t i;
+
+    Sys_enterCriticalSection();
+    i = find_index(beacon->address);
+    if (i < m_count)
+    {
+        info = m_entries[i].info;
+    }
+    else
+    {
+        memset(&info, 0, sizeof(info));
+        info.address = beacon->address;
+        info.link_reliability = APP_LIB_STATE_LINKREL_UNKNOWN;
+        info.type = APP_LIB_STATE_NEIGHBOR_IS_CLUSTER;
+    }
+
+    // Beacons are sent with maximum power, so RSSI is already normalized
+    info.norm_rssi = beacon->rssi;
+    info.cost = beacon->cost;
+    info.diradv_support = beacon->is_da_support ?
+                                APP_LIB_STATE_DIRADV_SUPPORTED :
+                                APP_LIB_STATE_DIRADV_NOT_SUPPORTED;
+    info.last_update = 0;
+
+    // Table is full: wait for next refresh to replace an entry, as removals
+    // cannot be notified from here
+    update_entry(&info, lib_time->getTimestampS(), NULL);
+    Sys_exitCriticalSection();
+
+    if (has_cbs())
+    {
+        App_Scheduler_addTask_execTime(notify_task,
+                                       APP_SCHEDULER_SCHEDULE_ASAP,
+                                       NOTIFY_TASK_EXEC_TIME_US);
+    }
+}
+
+/**
+ * \brief   Is an address in stack neighbors list
+ */
+static bool in_stack_list(app_addr_t address, uint32_t number_nbors)
+{
+    for (uint32_t i = 0; i < number_nbors; i++)
+    {
+        if (m_stack_nbors[i].address == address)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+app_res_e Neighbor_Cache_init(void)
+{
+    app_res_e res;
+
+    if (m_initialized)
+    {
+        // Library already initialized
+        return APP_RES_OK;
+    }
+
+    m_count = 0;
+    m_version = 0;
+    m_refreshing = false;
+#if NEIGHBOR_CACHE_MAX_CB > 0
+    memset(m_change_cbs, 0, sizeof(m_change_cbs));
+#endif
+
+    res = Stack_State_addEventCb(scan_end_cb,
+                                 1 << APP_LIB_STATE_STACK_EVENT_SCAN_STOPPED);
+    if (res != APP_RES_OK)
+    {
+        LOG(LVL_ERROR, "Cannot register scan end cb. res %u", res);
+        return res;
+    }
+
+    res = Shared_Neighbors_addOnBeaconCb(beacon_cb, &m_beacon_cb_id);
+    if (res != APP_RES_OK)
+    {
+        LOG(LVL_ERROR, "Cannot register beacon cb. res %u", res);
+        Stack_State_removeEventCb(scan_end_cb);
+        return res;
+    }
+
+    m_initialized = true;
+    return APP_RES_OK;
+}
+
+void Neighbor_Cache_getView(neighbor_cache_view_t * view)
+{
+    // Empty table is returned if library could not be initialized
+    (void)LIBRARIES_INIT_ON_USE(m_initialized, Neighbor_Cache_init);
+
+    view->entries = m_entries;
+    Sys_enterCriticalSection();
+    view->count = m_count;
+    view->version = m_version;
+    Sys_exitCriticalSection();
+}
+
+bool Neighbor_Cache_isViewValid(const neighbor_cache_view_t * view)
+{
+    return view->version == m_version;
+}
+
+uint32_t Neighbor_Cache_getVersion(void)
+{
+    return m_version;
+}
+
+bool Neighbor_Cache_find(app_addr_t address, neighbor_cache_entry_t * entry)
+{
+    bool found = false;
+    uint8_t i;
+
+    Sys_enterCriticalSection();
+    i = find_index(address);
+    if (i < m_count)
+    {
+        *entry = m_entries[i];
+        found = true;
+    }
+    Sys_exitCriticalSection();
+
+    return found;
+}
+
+uint32_t Neighbor_Cache_getAge(const neighbor_cache_entry_t * entry)
+{
+    return lib_time->getTimestampS() - entry->last_seen_s;
+}
+
+app_res_e Neighbor_Cache_refresh(void)
+{
+    app_lib_state_nbor_list_t nbors_list =
+    {
+        .number_nbors = NEIGHBOR_CACHE_SIZE,
+        .nbors = m_stack_nbors,
+    };
+    neighbor_cache_entry_t removed;
+    bool has_removed;
+    uint32_t now_s;
+    app_res_e res;
+    uint8_t i;
+
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Neighbor_Cache_init))
+    {
+        return APP_RES_INVALID_CONFIGURATION;
+    }
+
+    if (m_refreshing)
+    {
+        return APP_RES_RESOURCE_UNAVAILABLE;
+    }
+    m_refreshing = true;
+
+    res = lib_state->getNbors(&nbors_list);
+    now_s = lib_time->getTimestampS();
+
+    if (res == APP_RES_OK)
+    {
+        for (uint32_t n = 0; n < nbors_list.number_nbors; n++)
+        {
+            Sys_enterCriticalSection();
+            has_removed = update_entry(&m_stack_nbors[n],
+                                       now_s - m_stack_nbors[n].last_update,
+                                       &removed);
+            Sys_exitCriticalSection();
+
+            if (has_removed)
+            {
+                call_cbs(NEIGHBOR_CACHE_EVENT_REMOVED, &removed);
+            }
+        }
+
+        // Remove neighbors dropped by the stack and not heard since
+        i = 0;
+        do
+        {
+            has_removed = false;
+
+            Sys_enterCriticalSection();
+            for (; i < m_count; i++)
+            {
+                if (now_s - m_entries[i].last_seen_s >
+                                                NEIGHBOR_CACHE_MAX_AGE_S &&
+                    !in_stack_list(m_entries[i].info.address,
+                                   nbors_list.number_nbors))
+                {
+                    removed = m_entries[i];
+                    remove_entry(i);
+                    has_removed = true;
+                    break;
+                }
+            }
+            Sys_exitCriticalSection();
+
+            if (has_removed)
+            {
+                call_cbs(NEIGHBOR_CACHE_EVENT_REMOVED, &removed);
+            }
+        } while (has_removed);
+
+        LOG(LVL_DEBUG, "Refreshed: %u stack nbors, %u entries",
+            nbors_list.number_nbors, m_count);
+    }
+
+    m_refreshing = false;
+
+    if (!notify())
+    {
+        App_Scheduler_addTask_execTime(notify_task,
+                                       APP_SCHEDULER_SCHEDULE_ASAP,
+                                       NOTIFY_TASK_EXEC_TIME_US);
+    }
+
+    return res;
+}
+
+app_res_e Neighbor_Cache_addChangeCb(neighbor_cache_change_cb_f callback,
+                                     uint32_t event_bitfield)
+{
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Neighbor_Cache_init))
+    {
+        return APP_RES_INVALID_CONFIGURATION;
+    }
+#if NEIGHBOR_CACHE_MAX_CB > 0
+    app_res_e res = APP_RES_RESOURCE_UNAVAILABLE;
+    int free_slot = -1;
+
+    if (callback == NULL)
+    {
+        return APP_RES_INVALID_NULL_POINTER;
+    }
+
+    if (event_bitfield == 0)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    Sys_enterCriticalSection();
+    for (uint8_t i = 0; i < NEIGHBOR_CACHE_MAX_CB; i++)
+    {
+        if (m_change_cbs[i].cb == NULL)
+        {
+            free_slot = i;
+        }
+        else if (m_change_cbs[i].cb == callback)
+        {
+            m_change_cbs[i].bitfield = event_bitfield;
+            res = APP_RES_OK;
+            break;
+        }
+    }
+
+    if (res != APP_RES_OK && free_slot >= 0)
+    {
+        m_change_cbs[free_slot].bitfield = event_bitfield;
+        m_change_cbs[free_slot].cb = callback;
+        res = APP_RES_OK;
+    }
+    Sys_exitCriticalSection();
+
+    if (res != APP_RES_OK)
+    {
+        LOG(LVL_ERROR, "Cannot add change cb (0x%x)", callback);
+    }
+    return res;
+#else
+    return APP_RES_RESOURCE_UNAVAILABLE;
+#endif
+}
+
+app_res_e Neighbor_Cache_removeChangeCb(neighbor_cache_change_cb_f callback)
+{
+#if NEIGHBOR_CACHE_MAX_CB > 0
+    app_res_e res = APP_RES_INVALID_VALUE;
+
+    Sys_enterCriticalSection();
+    for (uint8_t i = 0; i < NEIGHBOR_CACHE_MAX_CB; i++)
+    {
+        if (m_change_cbs[i].cb == callback)
+        {
+            m_change_cbs[i].cb = NULL;
+            res = APP_RES_OK;
+        }
+    }
+    Sys_exitCriticalSection();
+
+    return res;
+#else
+    return APP_RES_INVALID_VALUE;
+#endif
+}
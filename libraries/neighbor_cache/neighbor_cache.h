@@ -0,0 +1,167 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+#ifndef _NEIGHBOR_CACHE_H_
+#define _NEIGHBOR_CACHE_H_
+
+#include "api.h"
+
+/**
+ * @file    neighbor_cache.h
+ * @brief   One neighbor table shared by all modules of the application.
+ *
+ * The table is refreshed from @ref app_lib_state_get_nbors_f
+ * "lib_state->getNbors()" at the end of each neighbor scan and updated from
+ * received beacons. Modules read it through a view, without copying it, and
+ * can be notified of the entries that changed only.
+ *
+ * Entries are sorted by type (next hop, members, then other clusters) and by
+ * normalized RSSI, best first.
+ */
+
+#ifndef NEIGHBOR_CACHE_SIZE
+/** Maximum number of neighbors in the table */
+#define NEIGHBOR_CACHE_SIZE     20
+#endif
+
+#ifndef NEIGHBOR_CACHE_MAX_AGE_S
+/** Neighbors not in stack list and not heard for longer than this are
+ *  removed, in seconds */
+#define NEIGHBOR_CACHE_MAX_AGE_S    120
+#endif
+
+/**
+ * @brief   Neighbor table entry
+ */
+typedef struct
+{
+    /** Neighbor information. Use @ref Neighbor_Cache_getAge instead of
+     *  last_update, that is only valid when the entry is updated */
+    app_lib_state_nbor_info_t info;
+    /** Time neighbor was last updated, from lib_time->getTimestampS() */
+    uint32_t last_seen_s;
+} neighbor_cache_entry_t;
+
+/**
+ * @brief   View of the neighbor table
+ */
+typedef struct
+{
+    /** Entries, sorted */
+    const neighbor_cache_entry_t * entries;
+    /** Number of entries */
+    uint8_t count;
+    /** Table version when view was taken */
+    uint32_t version;
+} neighbor_cache_view_t;
+
+/**
+ * @brief   Changes of an entry, notified to callbacks
+ */
+typedef enum
+{
+    /** Neighbor added to the table */
+    NEIGHBOR_CACHE_EVENT_ADDED = 0,
+    /** Neighbor information changed */
+    NEIGHBOR_CACHE_EVENT_UPDATED = 1,
+    /** Neighbor removed from the table */
+    NEIGHBOR_CACHE_EVENT_REMOVED = 2,
+    /** Neighbor heard again, without other changes */
+    NEIGHBOR_CACHE_EVENT_SEEN = 3,
+} neighbor_cache_event_e;
+
+/**
+ * @brief   Callback of entry changes.
+ *          Called from an application task or from
+ *          @ref Neighbor_Cache_refresh caller, never from beacon reception.
+ * @param   event
+ *          Change of the entry
+ * @param   entry
+ *          Copy of the entry, after the change
+ */
+typedef void (*neighbor_cache_change_cb_f)(neighbor_cache_event_e event,
+                                           const neighbor_cache_entry_t * entry);
+
+/**
+ * @brief   Initialize the neighbor cache library.
+ *          Subscribes to scan end and beacon events.
+ * @return  APP_RES_OK if ok. See \ref app_res_e for other result codes.
+ */
+app_res_e Neighbor_Cache_init(void);
+
+/**
+ * @brief   Get a view of the neighbor table.
+ *          Entries may change while the view is read, if the reader can be
+ *          interrupted by beacon reception or scan end: check the view with
+ *          @ref Neighbor_Cache_isViewValid after reading it and read it again
+ *          if it changed.
+ * @param   view
+ *          Filled with current table
+ */
+void Neighbor_Cache_getView(neighbor_cache_view_t * view);
+
+/**
+ * @brief   Check that table did not change since view was taken
+ * @param   view
+ *          View from @ref Neighbor_Cache_getView
+ * @return  True if view is still valid
+ */
+bool Neighbor_Cache_isViewValid(const neighbor_cache_view_t * view);
+
+/**
+ * @brief   Get current table version.
+ *          Version changes each time an entry is added, updated or removed.
+ * @return  Table version
+ */
+uint32_t Neighbor_Cache_getVersion(void);
+
+/**
+ * @brief   Copy the entry of a neighbor
+ * @param   address
+ *          Neighbor address
+ * @param   entry
+ *          Filled with entry if found
+ * @return  True if neighbor is in the table
+ */
+bool Neighbor_Cache_find(app_addr_t address, neighbor_cache_entry_t * entry);
+
+/**
+ * @brief   Time since an entry was last updated
+ * @param   entry
+ *          Entry of the table
+ * @return  Age in seconds
+ */
+uint32_t Neighbor_Cache_getAge(const neighbor_cache_entry_t * entry);
+
+/**
+ * @brief   Refresh table from stack neighbors list now, instead of waiting
+ *          for the next scan end.
+ *          Change callbacks are called before returning.
+ * @note    Must not be called from a change callback.
+ * @return  APP_RES_OK if ok. See \ref app_res_e for other result codes.
+ */
+app_res_e Neighbor_Cache_refresh(void);
+
+/**
+ * @brief   Add a callback of entry changes.
+ * @param   callback
+ *          New callback, its events are updated if already added
+ * @param   event_bitfield
+ *          Bitfield of events to register. To be notified of event n, bit n
+ *          must be set, see @ref neighbor_cache_event_e
+ * @return  APP_RES_OK if ok. See \ref app_res_e for other result codes.
+ */
+app_res_e Neighbor_Cache_addChangeCb(neighbor_cache_change_cb_f callback,
+                                     uint32_t event_bitfield);
+
+/**
+ * @brief   Remove a callback of entry changes.
+ * @param   callback
+ *          Callback to remove
+ * @return  APP_RES_OK if ok. See \ref app_res_e for other result codes.
+ */
+app_res_e Neighbor_Cache_removeChangeCb(neighbor_cache_change_cb_f callback);
+
+#endif //_NEIGHBOR_CACHE_H_
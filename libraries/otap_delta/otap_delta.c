@@ -0,0 +1,466 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+#define DEBUG_LOG_MODULE_NAME "OTAP_DELTA"
+#ifdef DEBUG_OTAP_DELTA_LOG_MAX_LEVEL
+#define DEBUG_LOG_MAX_LEVEL DEBUG_OTAP_DELTA_LOG_MAX_LEVEL
+#else
+#define DEBUG_LOG_MAX_LEVEL LVL_NOLOG
+#endif
+#include "debug_log.h"
+#include <string.h>
+#include "otap_delta.h"
+#include "aessw.h"
+#include "crc.h"
+#include "pack.h"
+
+/** Version of delta format supported */
+#define DELTA_VERSION               1
+
+/** Delta operations */
+#define DELTA_OP_COPY               0
+#define DELTA_OP_INSERT             1
+
+/** Offset of scratchpad header CRC in prefix (after the 16 bytes tag) */
+#define PREFIX_CRC_OFFSET           20
+/** Scratchpad CRC covers everything after tag and scratchpad header */
+#define PREFIX_CRC_START            32
+/** Offset of secure header (AES initial counter block) in prefix */
+#define PREFIX_IV_OFFSET            48
+
+/** Size of a deflate stored block header once byte aligned */
+#define STORED_BLOCK_HEADER_SIZE    5
+
+/** Size of the buffer used to write scratchpad. Must be a multiple of
+ *  AES block size so that the CTR stream can be split on it. */
+#define OUT_BUFFER_SIZE             256
+
+/** Size of the buffer used to read base image and delta inserts */
+#define CHUNK_SIZE                  64
+
+/** Timeout for a read in external flash, should never be reached */
+#define EXT_FLASH_READ_TIMEOUT_US   100000
+
+/** Context of an on-going delta application */
+typedef struct
+{
+    /** Delta area id */
+    app_lib_mem_area_id_t delta_area;
+    /** Base area id */
+    app_lib_mem_area_id_t base_area;
+    /** Current read offset in delta area */
+    uint32_t delta_offset;
+    /** Target bytes still to be generated */
+    uint32_t target_left;
+    /** Bytes left in current stored block */
+    uint32_t block_left;
+    /** Maximum size of a stored block */
+    uint16_t block_len;
+    /** Scratchpad bytes already written with lib_otap */
+    uint32_t written;
+    /** Number of bytes in out buffer */
+    size_t out_len;
+    /** Number of bytes given to lib_otap->write at once */
+    size_t flush_size;
+    /** Running CRC of written scratchpad */
+    uint16_t crc;
+    /** AES CTR stream used to encrypt file data */
+    aes_data_stream_t aes;
+    /** Buffer for data to write in scratchpad */
+    uint8_t out[OUT_BUFFER_SIZE];
+} delta_ctx_t;
+
+/** Only one delta can be applied at a time, keep context out of stack */
+static delta_ctx_t m_ctx;
+
+static bool wait_for_area(app_lib_mem_area_id_t id)
+{
+    app_lib_mem_area_info_t info;
+    app_lib_time_timestamp_hp_t timeout_end;
+    bool busy, timeout_reached;
+    uint32_t timeout_us = 0;
+
+    if (lib_memory_area->getAreaInfo(id, &info) != APP_LIB_MEM_AREA_RES_OK)
+    {
+        return false;
+    }
+
+    // Read access in internal flash are synchronous
+    if (info.external_flash)
+    {
+        timeout_us = EXT_FLASH_READ_TIMEOUT_US;
+    }
+
+    timeout_end = lib_time->addUsToHpTimestamp(lib_time->getTimestampHp(),
+                                               timeout_us);
+    do
+    {
+        busy = lib_memory_area->isBusy(id);
+        timeout_reached = lib_time->isHpTimestampBefore(timeout_end,
+                                                   lib_time->getTimestampHp());
+    } while (busy && !timeout_reached);
+
+    return !busy;
+}
+
+static bool read_area(app_lib_mem_area_id_t id,
+                      void * to,
+                      uint32_t from,
+                      size_t amount)
+{
+    if (lib_memory_area->startRead(id, to, from, amount)
+        != APP_LIB_MEM_AREA_RES_OK)
+    {
+        return false;
+    }
+
+    return wait_for_area(id);
+}
+
+static bool read_delta(void * to, size_t amount)
+{
+    if (!read_area(m_ctx.delta_area, to, m_ctx.delta_offset, amount))
+    {
+        return false;
+    }
+    m_ctx.delta_offset += amount;
+    return true;
+}
+
+static uint16_t crc_add(uint16_t crc, const uint8_t * buf, size_t len)
+{
+    while (len--)
+    {
+        crc = Crc_addByte(crc, *buf++);
+    }
+    return crc;
+}
+
+/**
+ * \brief   Encrypt and write the content of out buffer to scratchpad
+ */
+static bool flush_out(void)
+{
+    if (m_ctx.out_len == 0)
+    {
+        return true;
+    }
+
+    aes_crypto128Ctr(&m_ctx.aes, m_ctx.out, m_ctx.out, m_ctx.out_len);
+    m_ctx.crc = crc_add(m_ctx.crc, m_ctx.out, m_ctx.out_len);
+
+    if (lib_otap->write(m_ctx.written, m_ctx.out_len, m_ctx.out)
+        != APP_LIB_OTAP_WRITE_RES_OK)
+    {
+        LOG(LVL_ERROR, "Cannot write scratchpad at %u\n", m_ctx.written);
+        return false;
+    }
+
+    m_ctx.written += m_ctx.out_len;
+    m_ctx.out_len = 0;
+    return true;
+}
+
+/**
+ * \brief   Add plain file data bytes to scratchpad
+ */
+static bool push_out(const uint8_t * bytes, size_t len)
+{
+    while (len > 0)
+    {
+        size_t amount = m_ctx.flush_size - m_ctx.out_len;
+        if (amount > len)
+        {
+            amount = len;
+        }
+
+        memcpy(&m_ctx.out[m_ctx.out_len], bytes, amount);
+        m_ctx.out_len += amount;
+        bytes += amount;
+        len -= amount;
+
+        if (m_ctx.out_len == m_ctx.flush_size && !flush_out())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief   Add target image bytes to scratchpad, framed in deflate stored
+ *          blocks
+ */
+static bool push_target(const uint8_t * bytes, size_t len)
+{
+    if (len > m_ctx.target_left)
+    {
+        return false;
+    }
+
+    while (len > 0)
+    {
+        size_t amount;
+
+        if (m_ctx.block_left == 0)
+        {
+            uint8_t header[STORED_BLOCK_HEADER_SIZE];
+            uint16_t block = m_ctx.target_left > m_ctx.block_len ?
+                                m_ctx.block_len : m_ctx.target_left;
+
+            // BFINAL on last block, BTYPE = 00 (stored), then padding to
+            // byte boundary, LEN and NLEN
+            header[0] = (block == m_ctx.target_left) ? 0x01 : 0x00;
+            Pack_packLe(&header[1], block, 2);
+            Pack_packLe(&header[3], (uint16_t) ~block, 2);
+            if (!push_out(header, sizeof(header)))
+            {
+                return false;
+            }
+            m_ctx.block_left = block;
+        }
+
+        amount = m_ctx.block_left < len ? m_ctx.block_left : len;
+        if (!push_out(bytes, amount))
+        {
+            return false;
+        }
+
+        bytes += amount;
+        len -= amount;
+        m_ctx.block_left -= amount;
+        m_ctx.target_left -= amount;
+    }
+    return true;
+}
+
+static otap_delta_res_e check_base(uint32_t base_len, uint16_t base_crc)
+{
+    uint8_t chunk[CHUNK_SIZE];
+    uint16_t crc = Crc_initValue();
+    uint32_t offset = 0;
+
+    while (offset < base_len)
+    {
+        size_t amount = base_len - offset;
+        if (amount > sizeof(chunk))
+        {
+            amount = sizeof(chunk);
+        }
+
+        if (!read_area(m_ctx.base_area, chunk, offset, amount))
+        {
+            return OTAP_DELTA_RES_FLASH_ERROR;
+        }
+        crc = crc_add(crc, chunk, amount);
+        offset += amount;
+    }
+
+    return crc == base_crc ? OTAP_DELTA_RES_OK : OTAP_DELTA_RES_WRONG_BASE;
+}
+
+static otap_delta_res_e apply_op(uint32_t base_len)
+{
+    uint8_t chunk[CHUNK_SIZE];
+    uint8_t op[9];
+    uint32_t src, len;
+    bool copy;
+
+    if (!read_delta(op, 1))
+    {
+        return OTAP_DELTA_RES_FLASH_ERROR;
+    }
+
+    if (op[0] == DELTA_OP_COPY)
+    {
+        if (!read_delta(&op[1], 8))
+        {
+            return OTAP_DELTA_RES_FLASH_ERROR;
+        }
+        src = Pack_unpackLe(&op[1], 4);
+        len = Pack_unpackLe(&op[5], 4);
+        if (src > base_len || len > base_len - src)
+        {
+            return OTAP_DELTA_RES_INVALID_DELTA;
+        }
+        copy = true;
+    }
+    else if (op[0] == DELTA_OP_INSERT)
+    {
+        if (!read_delta(&op[1], 4))
+        {
+            return OTAP_DELTA_RES_FLASH_ERROR;
+        }
+        src = 0;
+        len = Pack_unpackLe(&op[1], 4);
+        copy = false;
+    }
+    else
+    {
+        return OTAP_DELTA_RES_INVALID_DELTA;
+    }
+
+    while (len > 0)
+    {
+        size_t amount = len > sizeof(chunk) ? sizeof(chunk) : len;
+        bool read_ok;
+
+        if (copy)
+        {
+            read_ok = read_area(m_ctx.base_area, chunk, src, amount);
+            src += amount;
+        }
+        else
+        {
+            read_ok = read_delta(chunk, amount);
+        }
+
+        if (!read_ok)
+        {
+            return OTAP_DELTA_RES_FLASH_ERROR;
+        }
+
+        if (!push_target(chunk, amount))
+        {
+            return OTAP_DELTA_RES_INVALID_DELTA;
+        }
+        len -= amount;
+    }
+
+    return OTAP_DELTA_RES_OK;
+}
+
+otap_delta_res_e Otap_Delta_apply(app_lib_mem_area_id_t delta_area,
+                                  app_lib_mem_area_id_t base_area,
+                                  const uint8_t * enc_key,
+                                  app_lib_otap_seq_t seq)
+{
+    uint8_t header[OTAP_DELTA_HEADER_SIZE];
+    uint8_t * prefix = m_ctx.out;
+    uint32_t base_len, target_len, out_len, num_ops;
+    uint16_t base_crc, expected_crc;
+    size_t max_block;
+    otap_delta_res_e res;
+
+    if (enc_key == NULL)
+    {
+        return OTAP_DELTA_RES_INVALID_PARAM;
+    }
+
+    memset(&m_ctx, 0, sizeof(m_ctx));
+    m_ctx.delta_area = delta_area;
+    m_ctx.base_area = base_area;
+
+    if (!read_delta(header, sizeof(header)))
+    {
+        return OTAP_DELTA_RES_NO_AREA;
+    }
+
+    if (Pack_unpackLe(&header[0], 4) != OTAP_DELTA_MAGIC
+        || header[4] != DELTA_VERSION)
+    {
+        LOG(LVL_ERROR, "Not a supported delta\n");
+        return OTAP_DELTA_RES_INVALID_DELTA;
+    }
+
+    m_ctx.block_len = Pack_unpackLe(&header[6], 2);
+    base_len = Pack_unpackLe(&header[8], 4);
+    base_crc = Pack_unpackLe(&header[12], 2);
+    target_len = Pack_unpackLe(&header[16], 4);
+    out_len = Pack_unpackLe(&header[20], 4);
+    num_ops = Pack_unpackLe(&header[24], 4);
+
+    // Everything written after prefix is a multiple of AES block size
+    if (m_ctx.block_len == 0
+        || out_len <= OTAP_DELTA_PREFIX_SIZE
+        || (out_len % AES_128_KEY_BLOCK_SIZE) != 0
+        || out_len > lib_otap->getMaxNumBytes())
+    {
+        return OTAP_DELTA_RES_INVALID_DELTA;
+    }
+
+    // Write as big blocks as possible, on AES block boundaries
+    max_block = lib_otap->getMaxBlockNumBytes();
+    m_ctx.flush_size = max_block < OUT_BUFFER_SIZE ? max_block : OUT_BUFFER_SIZE;
+    m_ctx.flush_size -= m_ctx.flush_size % AES_128_KEY_BLOCK_SIZE;
+    if (m_ctx.flush_size == 0)
+    {
+        return OTAP_DELTA_RES_OTAP_ERROR;
+    }
+
+    res = check_base(base_len, base_crc);
+    if (res != OTAP_DELTA_RES_OK)
+    {
+        LOG(LVL_ERROR, "Base image check failed: %d\n", res);
+        return res;
+    }
+
+    // Prefix is written as is, it is made of plain headers and the CMAC
+    if (!read_delta(prefix, OTAP_DELTA_PREFIX_SIZE))
+    {
+        return OTAP_DELTA_RES_FLASH_ERROR;
+    }
+
+    expected_crc = Pack_unpackLe(&prefix[PREFIX_CRC_OFFSET], 2);
+    m_ctx.crc = crc_add(Crc_initValue(),
+                        &prefix[PREFIX_CRC_START],
+                        OTAP_DELTA_PREFIX_SIZE - PREFIX_CRC_START);
+    aes_setupStream(&m_ctx.aes, enc_key, &prefix[PREFIX_IV_OFFSET]);
+
+    if (lib_otap->begin(out_len, seq) != APP_RES_OK
+        || lib_otap->write(0, OTAP_DELTA_PREFIX_SIZE, prefix)
+            != APP_LIB_OTAP_WRITE_RES_OK)
+    {
+        LOG(LVL_ERROR, "Cannot start scratchpad\n");
+        return OTAP_DELTA_RES_OTAP_ERROR;
+    }
+    m_ctx.written = OTAP_DELTA_PREFIX_SIZE;
+    m_ctx.target_left = target_len;
+
+    while (num_ops--)
+    {
+        res = apply_op(base_len);
+        if (res != OTAP_DELTA_RES_OK)
+        {
+            LOG(LVL_ERROR, "Delta operation failed: %d\n", res);
+            lib_otap->clear();
+            return res;
+        }
+    }
+
+    if (m_ctx.target_left != 0)
+    {
+        lib_otap->clear();
+        return OTAP_DELTA_RES_INVALID_DELTA;
+    }
+
+    // File data is padded with zeros up to the announced scratchpad size
+    while (m_ctx.written + m_ctx.out_len < out_len)
+    {
+        m_ctx.out[m_ctx.out_len++] = 0;
+        if (m_ctx.out_len == m_ctx.flush_size && !flush_out())
+        {
+            lib_otap->clear();
+            return OTAP_DELTA_RES_OTAP_ERROR;
+        }
+    }
+
+    if (!flush_out() || m_ctx.written != out_len)
+    {
+        lib_otap->clear();
+        return OTAP_DELTA_RES_OTAP_ERROR;
+    }
+
+    if (m_ctx.crc != expected_crc)
+    {
+        LOG(LVL_ERROR, "Scratchpad crc mismatch 0x%04x != 0x%04x\n",
+            m_ctx.crc, expected_crc);
+        lib_otap->clear();
+        return OTAP_DELTA_RES_CRC_MISMATCH;
+    }
+
+    LOG(LVL_INFO, "Scratchpad of %u bytes rebuilt\n", out_len);
+    return OTAP_DELTA_RES_OK;
+}
@@ -0,0 +1,94 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * @file otap_delta.h
+ *
+ * Delta OTAP library. It rebuilds a full scratchpad on the node from a delta
+ * file generated by tools/gendelta.py and the application currently running.
+ *
+ * The delta only carries the differences between a known base application
+ * image and the new one, so it is much smaller than a full scratchpad to
+ * distribute. How the delta reaches the node is up to the application: it must
+ * be stored at the beginning of a user memory area before calling
+ * @ref Otap_Delta_apply.
+ *
+ * Here are some implementations points:
+ *  - The rebuilt scratchpad is a normal scratchpad for the bootloader. Its
+ *    file data is a deflate stream made of stored (uncompressed) blocks as
+ *    there is no compressor on the node. It is thus bigger than the full
+ *    scratchpad generated for the same image but it only consumes local flash
+ *  - Scratchpad header and CMAC are computed on host side and are part of the
+ *    delta, only the AES-128 encryption key is needed on the node
+ *  - Base image is checked with a CRC before anything is written and written
+ *    scratchpad is checked against its header CRC at the end
+ *  - All accesses are synchronous and scratchpad can only be written when the
+ *    stack is stopped, so @ref Otap_Delta_apply is meant to be called from
+ *    App_init() before starting the stack. It may take several seconds.
+ */
+
+#ifndef _OTAP_DELTA_H_
+#define _OTAP_DELTA_H_
+
+#include <stdint.h>
+#include "api.h"
+
+/** Magic at the beginning of a delta file ("WPD1" in little endian) */
+#define OTAP_DELTA_MAGIC    0x31445057
+
+/** Size of the delta file header, before the scratchpad prefix */
+#define OTAP_DELTA_HEADER_SIZE      32
+
+/** Size of the scratchpad prefix carried in delta file: tag, scratchpad
+ *  header, CMAC, secure header and file header (5 * 16 bytes) */
+#define OTAP_DELTA_PREFIX_SIZE      80
+
+/**
+ * \brief   List of return code
+ */
+typedef enum
+{
+    /** Operation is successful */
+    OTAP_DELTA_RES_OK = 0,
+    /** Given parameter(s) invalid */
+    OTAP_DELTA_RES_INVALID_PARAM = 1,
+    /** Delta or base memory area not found */
+    OTAP_DELTA_RES_NO_AREA = 2,
+    /** Flash driver reported an error or access timeouted */
+    OTAP_DELTA_RES_FLASH_ERROR = 3,
+    /** Delta file is malformed or of an unsupported version */
+    OTAP_DELTA_RES_INVALID_DELTA = 4,
+    /** Running image is not the one the delta was generated against */
+    OTAP_DELTA_RES_WRONG_BASE = 5,
+    /** lib_otap refused to begin or write the scratchpad */
+    OTAP_DELTA_RES_OTAP_ERROR = 6,
+    /** Rebuilt scratchpad doesn't match its header CRC, it is cleared */
+    OTAP_DELTA_RES_CRC_MISMATCH = 7,
+} otap_delta_res_e;
+
+/**
+ * \brief   Rebuild a full scratchpad from a delta and the running image
+ * \param   delta_area
+ *          Memory area where the delta file is stored (at offset 0)
+ * \param   base_area
+ *          Memory area holding the image the delta was generated against,
+ *          usually the application area
+ * \param   enc_key
+ *          AES-128 encryption key of the bootloader key used to generate
+ *          the delta (16 bytes)
+ * \param   seq
+ *          Sequence number to give to the rebuilt scratchpad
+ * \return  Return code of the operation
+ * \note    Previous scratchpad is erased as soon as base image is validated
+ * \note    On success, scratchpad is not marked as to be processed, it is up
+ *          to application to call lib_otap->setToBeProcessed()
+ */
+otap_delta_res_e Otap_Delta_apply(app_lib_mem_area_id_t delta_area,
+                                  app_lib_mem_area_id_t base_area,
+                                  const uint8_t * enc_key,
+                                  app_lib_otap_seq_t seq);
+
+#endif //_OTAP_DELTA_H_
@@ -332,6 +332,8 @@ typedef void (*poslib_events_callback_f) (poslib_events_listen_info_f callback);
  * @brief   Sets PosLib configuration.
  * @param   poslib_settings_t type pointer
  * @return  See \ref poslib_ret_e
+ * @note    If app_heap library is enabled, the measurement table is
+ *          allocated on first call, which must then be done from App_init()
  */
 poslib_ret_e PosLib_setConfig(poslib_settings_t * settings);
 
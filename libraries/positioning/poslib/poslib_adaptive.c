@@ -0,0 +1,169 @@
+/**
+ * @file       poslib_adaptive.c
+ * @brief      Adapts update period and sending to measurement changes.
+ * @copyright  Wirepas Ltd 2023
+ */
+
+#define DEBUG_LOG_MODULE_NAME "POSLIB_ADAPT"
+#ifdef DEBUG_POSLIB_LOG_MAX_LEVEL
+#define DEBUG_LOG_MAX_LEVEL DEBUG_POSLIB_LOG_MAX_LEVEL
+#else
+#define DEBUG_LOG_MAX_LEVEL LVL_NOLOG
+#endif
+#include "debug_log.h"
+#include <string.h>
+#include "api.h"
+#include "poslib_adaptive.h"
+#include "poslib_measurement.h"
+
+/** Measurements kept of a scan: strongest anchors of other scans are looked
+ *  up among them */
+#define SNAPSHOT_SIZE (2 * POSLIB_ADAPT_NUM_ANCHORS)
+
+#define NOT_FOUND 0xFF
+
+/** Largest shift of update period, with or without motion */
+#define MAX_SHIFT ((POSLIB_ADAPT_MAX_SHIFT_STATIC > POSLIB_ADAPT_MAX_SHIFT) ? \
+                   POSLIB_ADAPT_MAX_SHIFT_STATIC : POSLIB_ADAPT_MAX_SHIFT)
+
+/**
+ * @brief   Strongest measurements of a scan
+ */
+typedef struct
+{
+    poslib_meas_rss_data_t meas[SNAPSHOT_SIZE];
+    uint8_t num;
+} snapshot_t;
+
+/** Measurements of last scan */
+static snapshot_t m_last;
+/** Measurements of previous scan */
+static snapshot_t m_prev;
+/** Last measurements sent */
+static snapshot_t m_sent;
+/** Time last measurements were sent [s] */
+static uint32_t m_sent_s;
+/** Update period is multiplied by 2^m_shift */
+static uint8_t m_shift;
+
+static uint8_t find_address(const snapshot_t * snap, uint32_t address)
+{
+    for (uint8_t i = 0; i < snap->num; i++)
+    {
+        if (snap->meas[i].address == address)
+        {
+            return i;
+        }
+    }
+    return NOT_FOUND;
+}
+
+/**
+ * @brief   Compares strongest anchors of two scans
+ * @return  true if measurements are similar
+ */
+static bool is_similar(const snapshot_t * ref, const snapshot_t * snap)
+{
+    uint8_t changes = 0;
+    uint8_t common = 0;
+    uint16_t rss_diff = 0;
+
+    if (ref->num == 0 || snap->num == 0)
+    {
+        return false;
+    }
+
+    // Strongest anchors heard now, compared to reference
+    for (uint8_t i = 0; i < snap->num && i < POSLIB_ADAPT_NUM_ANCHORS; i++)
+    {
+        uint8_t j = find_address(ref, snap->meas[i].address);
+
+        if (j == NOT_FOUND)
+        {
+            changes++;
+        }
+        else
+        {
+            int16_t diff = snap->meas[i].norm_rss - ref->meas[j].norm_rss;
+            rss_diff += (diff < 0) ? -diff : diff;
+            common++;
+        }
+    }
+
+    // Strongest reference anchors not heard anymore
+    for (uint8_t i = 0; i < ref->num && i < POSLIB_ADAPT_NUM_ANCHORS; i++)
+    {
+        if (find_address(snap, ref->meas[i].address) == NOT_FOUND)
+        {
+            changes++;
+        }
+    }
+
+    LOG(LVL_DEBUG, "Compare: changes: %u common: %u rss diff: %u",
+        changes, common, rss_diff);
+
+    // RSS is in -0.5 dBm unit
+    return (changes <= POSLIB_ADAPT_MAX_SET_CHANGES && common > 0 &&
+            rss_diff <= common * POSLIB_ADAPT_RSS_THRESHOLD_DB * 2);
+}
+
+void PosLibAdapt_reset(void)
+{
+    m_last.num = 0;
+    m_prev.num = 0;
+    m_sent.num = 0;
+    m_shift = 0;
+}
+
+bool PosLibAdapt_scanEnd(bool force)
+{
+    uint32_t now_s = lib_time->getTimestampS();
+    bool send;
+
+    m_prev = m_last;
+    m_last.num = PosLibMeas_getRss(m_last.meas, SNAPSHOT_SIZE);
+
+    // Stable anchors: stretch update period
+    if (is_similar(&m_prev, &m_last))
+    {
+        if (m_shift < MAX_SHIFT)
+        {
+            m_shift++;
+        }
+    }
+    else
+    {
+        m_shift = 0;
+    }
+
+    send = force ||
+           !is_similar(&m_sent, &m_last) ||
+           (now_s - m_sent_s) >= POSLIB_ADAPT_MAX_SILENCE_S;
+
+    LOG(LVL_INFO, "Scan end: bcn: %u shift: %u send: %u",
+        m_last.num, m_shift, send);
+    return send;
+}
+
+void PosLibAdapt_setSent(void)
+{
+    m_sent = m_last;
+    m_sent_s = lib_time->getTimestampS();
+}
+
+uint32_t PosLibAdapt_getPeriod(uint32_t period_s, bool is_static)
+{
+    uint8_t max_shift = is_static ? POSLIB_ADAPT_MAX_SHIFT_STATIC :
+                                    POSLIB_ADAPT_MAX_SHIFT;
+    uint8_t shift = (m_shift < max_shift) ? m_shift : max_shift;
+
+    if (period_s >= POSLIB_ADAPT_MAX_PERIOD_S)
+    {
+        return period_s;
+    }
+    if (period_s > ((uint32_t) POSLIB_ADAPT_MAX_PERIOD_S >> shift))
+    {
+        return POSLIB_ADAPT_MAX_PERIOD_S;
+    }
+    return period_s << shift;
+}
@@ -0,0 +1,98 @@
+/**
+* @file         poslib_adaptive.h
+* @brief        Header file for the poslib adaptive update module
+* @copyright    Wirepas Ltd. 2023
+*/
+
+#ifndef _POSLIB_ADAPTIVE_H_
+#define _POSLIB_ADAPTIVE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Used by PosLib control when POSLIB_ADAPTIVE_UPDATE is defined.
+ *
+ * Measurements of each scan are compared with the ones of the previous scan
+ * and with the last ones sent:
+ * - when consecutive scans hear the same anchors with similar RSS, the
+ *   static update period is doubled, up to 2^POSLIB_ADAPT_MAX_SHIFT times
+ *   (2^POSLIB_ADAPT_MAX_SHIFT_STATIC times if motion sensor reports the
+ *   node static) and at most POSLIB_ADAPT_MAX_PERIOD_S
+ * - measurements are sent only if they differ from the last ones sent, or
+ *   if nothing was sent for POSLIB_ADAPT_MAX_SILENCE_S
+ *
+ * Measurements differ when more than POSLIB_ADAPT_MAX_SET_CHANGES of the
+ * POSLIB_ADAPT_NUM_ANCHORS strongest anchors of either scan are missing from
+ * the other one, or when the average RSS change of common anchors is more
+ * than POSLIB_ADAPT_RSS_THRESHOLD_DB.
+ */
+
+#ifndef POSLIB_ADAPT_MAX_SHIFT
+/** Static update period is multiplied by up to 2^POSLIB_ADAPT_MAX_SHIFT */
+#define POSLIB_ADAPT_MAX_SHIFT          2
+#endif
+
+#ifndef POSLIB_ADAPT_MAX_SHIFT_STATIC
+/** Same, when motion is enabled and node is static */
+#define POSLIB_ADAPT_MAX_SHIFT_STATIC   3
+#endif
+
+#ifndef POSLIB_ADAPT_MAX_PERIOD_S
+/** Longest update period, unless static update period is longer [s] */
+#define POSLIB_ADAPT_MAX_PERIOD_S       600
+#endif
+
+#ifndef POSLIB_ADAPT_MAX_SILENCE_S
+/** Measurements are sent at least this often, even if unchanged [s] */
+#define POSLIB_ADAPT_MAX_SILENCE_S      900
+#endif
+
+#ifndef POSLIB_ADAPT_NUM_ANCHORS
+/** Number of strongest anchors compared */
+#define POSLIB_ADAPT_NUM_ANCHORS        6
+#endif
+
+#ifndef POSLIB_ADAPT_MAX_SET_CHANGES
+/** Anchors that may appear or disappear without measurements differing */
+#define POSLIB_ADAPT_MAX_SET_CHANGES    1
+#endif
+
+#ifndef POSLIB_ADAPT_RSS_THRESHOLD_DB
+/** Average RSS change of common anchors above which measurements differ */
+#define POSLIB_ADAPT_RSS_THRESHOLD_DB   4
+#endif
+
+/**
+ * @brief   Forgets measurements of previous scans: update period is reset to
+ *          static update period and next measurements are sent.
+ *          To be called when node starts moving, configuration changes or
+ *          no beacons are heard.
+ */
+void PosLibAdapt_reset(void);
+
+/**
+ * @brief   Processes measurements of a scan. Must be called at scan end,
+ *          before the measurements are sent.
+ * @param   force
+ *          true if measurements must be sent anyway
+ * @return  true if measurements must be sent
+ */
+bool PosLibAdapt_scanEnd(bool force);
+
+/**
+ * @brief   Notifies that measurements of last scan were sent
+ */
+void PosLibAdapt_setSent(void);
+
+/**
+ * @brief   Gets the adapted update period
+ * @param   period_s
+ *          static update period [s]
+ * @param   is_static
+ *          true if motion is enabled and node is static
+ * @return  update period to use [s]
+ */
+uint32_t PosLibAdapt_getPeriod(uint32_t period_s, bool is_static);
+
+#endif /* _POSLIB_ADAPTIVE_H_ */
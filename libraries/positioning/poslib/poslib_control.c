@@ -26,6 +26,9 @@
 #include "shared_appconfig.h"
 #include "shared_offline.h"
 #include "poslib_mbcn.h"
+#ifdef POSLIB_ADAPTIVE_UPDATE
+#include "poslib_adaptive.h"
+#endif
 #ifdef ROUTE_CHECK
 #include "stack_state.h"
 #endif
@@ -47,6 +50,7 @@ typedef struct {
     bool connected;
     bool scan_fail;
     bool is_static;
+    bool send_skipped;
 } control_events_t;
 
 /* Scheduled state */
@@ -300,10 +304,16 @@ static bool register_callbacks(void)
     }
 
     #ifdef ROUTE_CHECK
-    /** Route change callback */
+    /** Route change callback, once per burst of route changes if deferred
+     *  delivery is enabled */
     {
-        app_res_e res = Stack_State_addEventCb(route_cb,
-                                               1 << APP_LIB_STATE_STACK_EVENT_ROUTE_CHANGED);
+        app_res_e res = Stack_State_addEventCbWithDelivery(route_cb,
+                                1 << APP_LIB_STATE_STACK_EVENT_ROUTE_CHANGED,
+#ifdef STACK_STATE_DEFERRED
+                                STACK_STATE_DELIVERY_DEFERRED);
+#else
+                                STACK_STATE_DELIVERY_SYNC);
+#endif
         if (res != APP_RES_OK)
         {
             ret = false;
@@ -615,6 +625,12 @@ poslib_ret_e PosLibCtrl_setConfig(poslib_settings_t * settings)
         return ret;
     }
 
+    /* Measurement table may be allocated on first configuration */
+    if (!PosLibMeas_init())
+    {
+        return POS_RET_INTERNAL_ERROR;
+    }
+
     if (!m_poslib_configured || 
         memcmp(&m_pos_settings , settings, sizeof(m_pos_settings)) != 0)
     {
@@ -711,6 +727,9 @@ poslib_ret_e PosLibCtrl_stopPeriodic(void)
     PosLibBle_stop();
     PosLibMbcn_stop();
     PosLibDa_stop();
+#ifdef POSLIB_ADAPTIVE_UPDATE
+    PosLibAdapt_reset();
+#endif
     return POS_RET_OK;
 }
 
@@ -884,6 +903,9 @@ static uint8_t send_measurement_message()
         if (rc == APP_LIB_DATA_SEND_RES_SUCCESS)
         {
            m_ctrl.events.data_sent = true;
+#ifdef POSLIB_ADAPTIVE_UPDATE
+           PosLibAdapt_setSent();
+#endif
         }
         else
         {
@@ -952,7 +974,6 @@ static uint32_t trigger_update_task()
 static uint32_t timeout_task()
 {
     static poslib_internal_event_t timeout_event = {
-        .list = {NULL},
         .type = POSLIB_CTRL_EVENT_TIMEOUT,
     };
 
@@ -1016,6 +1037,12 @@ static bool update_nrls(uint32_t delta_s)
     return true;
 }
 
+static bool is_dynamic(void)
+{
+    return m_pos_settings.motion.enabled &&
+           m_motion_mode == POSLIB_MOTION_DYNAMIC;
+}
+
 static uint32_t get_update_period()
 {
     
@@ -1025,16 +1052,37 @@ static uint32_t get_update_period()
         return  m_pos_settings.update_period_offline_s;
     }
 
-    if (m_pos_settings.motion.enabled &&
-        m_motion_mode == POSLIB_MOTION_DYNAMIC &&
+    if (is_dynamic() &&
         m_pos_settings.update_period_dynamic_s != 0)
     {
         return m_pos_settings.update_period_dynamic_s;
     }
+
+#ifdef POSLIB_ADAPTIVE_UPDATE
+    if (!is_dynamic())
+    {
+        return PosLibAdapt_getPeriod(m_pos_settings.update_period_static_s,
+                                     m_pos_settings.motion.enabled);
+    }
+#endif
     
     return m_pos_settings.update_period_static_s;
 }
 
+/**
+ * @brief   Checks if measurements of the scan must be sent
+ * @return  true if measurements must be sent
+ */
+static bool is_send_needed(void)
+{
+#ifdef POSLIB_ADAPTIVE_UPDATE
+    /* Oneshot and moving node updates are always sent */
+    return PosLibAdapt_scanEnd(m_ctrl.events.oneshot || is_dynamic());
+#else
+    return true;
+#endif
+}
+
 static void schedule_next(bool update_now)
 {
     uint32_t now_s = lib_time->getTimestampS();
@@ -1137,8 +1185,9 @@ static void handle_stopped_state(poslib_internal_event_t * event)
 {
     if (!m_poslib_started && m_poslib_configured && event->type == POSLIB_CTRL_EVENT_ONESHOT)
     {        
-        m_ctrl.events.oneshot = true;
         schedule_next(true);
+        /* Set after schedule, that clears events of a new update */
+        m_ctrl.events.oneshot = true;
     }
 }
 
@@ -1203,6 +1252,9 @@ static void handle_idle_state(poslib_internal_event_t * event)
             {
                 m_motion_mode = MOTION_DEFAULT;
             }
+#ifdef POSLIB_ADAPTIVE_UPDATE
+            PosLibAdapt_reset();
+#endif
             PosLibBle_start(&m_pos_settings.ble);
             /* Configuration changed, re-schedule*/
             schedule_next(false);
@@ -1217,8 +1269,8 @@ static void handle_idle_state(poslib_internal_event_t * event)
         }
         case POSLIB_CTRL_EVENT_ONESHOT:
         {
-            m_ctrl.events.oneshot = true;
             schedule_next(true);
+            m_ctrl.events.oneshot = true;
             break;
         }
 
@@ -1235,6 +1287,9 @@ static void handle_idle_state(poslib_internal_event_t * event)
             if (m_motion_mode == POSLIB_MOTION_DYNAMIC)
             {
                 m_ctrl.events.is_static = false;
+#ifdef POSLIB_ADAPTIVE_UPDATE
+                PosLibAdapt_reset();
+#endif
             }
             schedule_next(false);
             break;
@@ -1253,11 +1308,13 @@ static bool is_update_completed()
 {
     bool ret = m_ctrl.events.data_sent;
 
-    /* Complete if: scan failed | timeout occured */ 
-    if (m_ctrl.events.scan_fail || m_ctrl.events.timeout)
+    /* Complete if: scan failed | timeout occured | nothing to send */ 
+    if (m_ctrl.events.scan_fail || m_ctrl.events.timeout ||
+        m_ctrl.events.send_skipped)
     {
-        LOG(LVL_DEBUG, "<state> Update completed: scan fail: %u,timeout: %u",
-                        m_ctrl.events.scan_fail, m_ctrl.events.timeout);
+        LOG(LVL_DEBUG, "<state> Update completed: scan fail: %u,timeout: %u skipped: %u",
+                        m_ctrl.events.scan_fail, m_ctrl.events.timeout,
+                        m_ctrl.events.send_skipped);
         return true;
     }
 
@@ -1305,14 +1362,25 @@ static void handle_update_state(poslib_internal_event_t * event)
 
             if (is_scan_valid())
             {
-                send_measurement_message();
                 m_ctrl.events.scan_fail = false;
-                set_timeout(POSLIB_CTRL_EVENT_APPCFG, TIMEOUT_APPCFG_MS);
+                if (is_send_needed())
+                {
+                    send_measurement_message();
+                    set_timeout(POSLIB_CTRL_EVENT_APPCFG, TIMEOUT_APPCFG_MS);
+                }
+                else
+                {
+                    m_ctrl.events.send_skipped = true;
+                    LOG(LVL_INFO, "<state> Measurements unchanged, not sent");
+                }
             }
             else
             {
                 m_ctrl.events.scan_fail = true;
                 LOG(LVL_DEBUG, "<state> Scan detected 0 beacons");
+#ifdef POSLIB_ADAPTIVE_UPDATE
+                PosLibAdapt_reset();
+#endif
             }
             break;
         }
@@ -1340,6 +1408,9 @@ static void handle_update_state(poslib_internal_event_t * event)
             if (m_motion_mode == POSLIB_MOTION_DYNAMIC)
             {
                 m_ctrl.events.is_static = false;
+#ifdef POSLIB_ADAPTIVE_UPDATE
+                PosLibAdapt_reset();
+#endif
             }
             break;
         }
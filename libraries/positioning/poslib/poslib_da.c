@@ -15,6 +15,7 @@
 #include "poslib.h"
 #include "poslib_da.h"
 #include "shared_data.h"
+#include "neighbor_cache.h"
 #include "poslib_measurement.h"
 #include "poslib_control.h"
 #include <string.h>
@@ -36,16 +37,67 @@ static uint16_t m_sequence = 0;  // the sequence of the rising packets
 #define IS_NOT_DA_ROUTER(x) (x == APP_LIB_STATE_DIRADV_NOT_SUPPORTED)
 #define ROUTER_COST_INVALID(x) (x == APP_LIB_STATE_INVALID_ROUTE_COST || x == APP_LIB_STATE_COST_UNKNOWN)
 
-#define MAX_NBORS 20 
 #define NBOR_LAST_SEEN_WINDOW 2
 #define NO_ROUTE_FOUND_ADDRESS 0
 
-app_lib_state_nbor_info_t m_nbors[MAX_NBORS];
-app_lib_state_nbor_list_t m_nbors_list =
+/** Number of best DA routers kept in ranking */
+#ifndef POSLIB_DA_MAX_ROUTERS
+#define POSLIB_DA_MAX_ROUTERS 4
+#endif
+
+/** Routers not heard for longer than this are removed from ranking */
+#ifndef POSLIB_DA_ROUTER_MAX_AGE_S
+#define POSLIB_DA_ROUTER_MAX_AGE_S 120
+#endif
+
+/** Initial link history score of a router, 0 .. 255 */
+#define LINK_SCORE_INIT 128
+
+/** Number of DA packets waiting for their sent status, for link history */
+#ifndef POSLIB_DA_MAX_SENT_PENDING
+#define POSLIB_DA_MAX_SENT_PENDING 4
+#endif
+
+/** Router candidate for DA tag */
+typedef struct
+{
+    /** Router address */
+    app_addr_t address;
+    /** Time router was last heard, in seconds */
+    uint32_t last_seen_s;
+    /** Normalized RSSI */
+    int8_t rssi;
+    /** Route cost */
+    uint8_t cost;
+    /** DA support, \ref app_lib_state_diradv_support_e */
+    uint8_t diradv_support;
+    /** Link history: average of send successes, 0 .. 255 */
+    uint8_t link_score;
+} da_router_t;
+
+/** Best routers, best first. Updated from neighbor cache changes, so
+ *  that selecting a router when sending does not need sorting */
+static da_router_t m_routers[POSLIB_DA_MAX_ROUTERS];
+static uint8_t m_num_routers = 0;
+
+/** Ranking callback registered to neighbor cache */
+static bool m_rank_cbs_reg = false;
+
+#ifdef POSLIB_DA_LINK_HISTORY
+/** DA packet waiting for its sent status. Its index is the tracking id
+ *  given to Shared_Data */
+typedef struct
 {
-    .number_nbors = MAX_NBORS,
-    .nbors = m_nbors,
-};
+    /** Data sent callback given with the packet, NULL if none */
+    app_lib_data_data_sent_cb_f cb;
+    /** Tracking id given with the packet */
+    app_lib_data_tracking_id_t tracking_id;
+    /** Is the entry used */
+    bool used;
+} da_sent_t;
+
+static da_sent_t m_sent[POSLIB_DA_MAX_SENT_PENDING];
+#endif
 
 
 /**
@@ -210,67 +262,250 @@ static void stop_router()
 
 
 /**
- * \brief       Compares two neigbours based on DA router status, latest update, RSSI
- * \param       pa, pb pointer to the a & b data structures
- *              Exclude this address from selectable routers. 0 if not used.
- * \return      -1 if a is selected, 1 is b is selected, 0 if equal
+ * \brief       Rank of directed advertiser support, higher is better
  */
+static inline uint8_t da_class(uint8_t diradv_support)
+{
+    if (IS_DA_ROUTER(diradv_support))
+    {
+        return 2;
+    }
+    return IS_UNKNOWN_DA_ROUTER(diradv_support) ? 1 : 0;
+}
 
-
-static int compare_neighbours(const void * pa, const void *pb)
+/**
+ * \brief       Compares two routers based on DA router status, latest update, RSSI
+ * \param       a, b pointer to the routers to compare
+ * \return      true if a is better than b
+ */
+static bool router_is_better(const da_router_t * a, const da_router_t * b)
 {
-    app_lib_state_nbor_info_t * a = (app_lib_state_nbor_info_t* ) pa;
-    app_lib_state_nbor_info_t * b = (app_lib_state_nbor_info_t* ) pb;
     int32_t dt;
 
-    // compare using last update/RSSI if A and B are both valid or both unknown
-    if ((IS_DA_ROUTER(a->diradv_support) && IS_DA_ROUTER(b->diradv_support)) ||
-        (IS_UNKNOWN_DA_ROUTER(a->diradv_support) && IS_UNKNOWN_DA_ROUTER(b->diradv_support)))
+    if (da_class(a->diradv_support) != da_class(b->diradv_support))
+    {
+        return da_class(a->diradv_support) > da_class(b->diradv_support);
+    }
+
+    dt = (int32_t) (a->last_seen_s - b->last_seen_s);
+    if (abs(dt) > NBOR_LAST_SEEN_WINDOW)
+    {
+        // select latest updated
+        return dt > 0;
+    }
+    // Select strongest RSSI
+    return a->rssi > b->rssi;
+}
+
+/**
+ * \brief       Removes a router from ranking
+ * \param       index router index in ranking
+ */
+static void rank_remove(uint8_t index)
+{
+    m_num_routers--;
+    memmove(&m_routers[index], &m_routers[index + 1],
+            (m_num_routers - index) * sizeof(m_routers[0]));
+}
+
+/**
+ * \brief       Updates a router in ranking, or inserts it if it is among
+ *              the best \ref POSLIB_DA_MAX_ROUTERS routers. Routers without
+ *              a route or not supporting DA are removed.
+ * \param       router router information
+ */
+static void rank_update(const da_router_t * router)
+{
+    da_router_t new_router = *router;
+    uint8_t i;
+
+    lib_system->enterCriticalSection();
+
+    for (i = 0; i < m_num_routers; i++)
+    {
+        if (m_routers[i].address == router->address)
+        {
+            // Keep link history of router
+            new_router.link_score = m_routers[i].link_score;
+            rank_remove(i);
+            break;
+        }
+    }
+
+    if (!ROUTER_COST_INVALID(router->cost) &&
+        !IS_NOT_DA_ROUTER(router->diradv_support))
+    {
+        for (i = 0; i < m_num_routers; i++)
+        {
+            if (router_is_better(&new_router, &m_routers[i]))
+            {
+                break;
+            }
+        }
+
+        if (i < POSLIB_DA_MAX_ROUTERS)
+        {
+            if (m_num_routers == POSLIB_DA_MAX_ROUTERS)
+            {
+                // Worst router is pushed out
+                m_num_routers--;
+            }
+            memmove(&m_routers[i + 1], &m_routers[i],
+                    (m_num_routers - i) * sizeof(m_routers[0]));
+            m_routers[i] = new_router;
+            m_num_routers++;
+        }
+    }
+
+    lib_system->exitCriticalSection();
+}
+
+/**
+ * \brief       Neighbor cache callback, updates neighbor in ranking
+ * \param       event change of the neighbor
+ * \param       entry neighbor cache entry
+ */
+static void nbor_change_cb(neighbor_cache_event_e event,
+                           const neighbor_cache_entry_t * entry)
+{
+    da_router_t router = {
+        .address = entry->info.address,
+        .last_seen_s = entry->last_seen_s,
+        .rssi = entry->info.norm_rssi,
+        .cost = entry->info.cost,
+        .diradv_support = entry->info.diradv_support,
+        .link_score = LINK_SCORE_INIT,
+    };
+
+    LOG(LVL_DEBUG, "neigh address: %u da: %u type: %u rssi: %i cost: %u",
+        entry->info.address, entry->info.diradv_support, entry->info.type,
+        entry->info.norm_rssi, entry->info.cost);
+    rank_update(&router);
+}
+
+/**
+ * \brief       Removes routers not heard for \ref POSLIB_DA_ROUTER_MAX_AGE_S
+ */
+static void rank_remove_stale(void)
+{
+    uint32_t now_s = lib_time->getTimestampS();
+
+    lib_system->enterCriticalSection();
+    for (uint8_t i = m_num_routers; i > 0; i--)
     {
-        dt = a->last_update - b->last_update; 
-        if (abs(dt) > NBOR_LAST_SEEN_WINDOW)
+        if (now_s - m_routers[i - 1].last_seen_s > POSLIB_DA_ROUTER_MAX_AGE_S)
         {
-            // select latest updated
-            return dt;
+            rank_remove(i - 1);
         }
-        // Select strongest RSSI
-        return (b->norm_rssi - a->norm_rssi); 
-    } 
-    else if (IS_DA_ROUTER(a->diradv_support) ||
-            (IS_UNKNOWN_DA_ROUTER(a->diradv_support) && IS_NOT_DA_ROUTER(b->diradv_support)))
+    }
+    lib_system->exitCriticalSection();
+}
+
+#ifdef POSLIB_DA_LINK_HISTORY
+/**
+ * \brief       Data sent callback, updates link history of router
+ * \param       status status of sent packet
+ */
+static void da_sent_cb(const app_lib_data_sent_status_t * status)
+{
+    app_lib_data_data_sent_cb_f cb;
+
+    lib_system->enterCriticalSection();
+    for (uint8_t i = 0; i < m_num_routers; i++)
     {
-        // A valid, B uknown/invalid -> select A
-        return -1;
+        if (m_routers[i].address == status->dest_address)
+        {
+            // Exponential average of successes, weight 1/4
+            uint8_t target = status->success ? 255 : 0;
+            m_routers[i].link_score = m_routers[i].link_score -
+                                      (m_routers[i].link_score >> 2) +
+                                      (target >> 2);
+            break;
+        }
     }
-    else if (IS_DA_ROUTER(b->diradv_support) ||
-            (IS_UNKNOWN_DA_ROUTER(b->diradv_support) && IS_NOT_DA_ROUTER(a->diradv_support)))
+    lib_system->exitCriticalSection();
+
+    if (status->tracking_id >= POSLIB_DA_MAX_SENT_PENDING)
     {
-        // B valid, A uknown/invalid -> select B
-        return 1;
+        return;
+    }
+
+    // Give back the callback and tracking id of the packet
+    lib_system->enterCriticalSection();
+    cb = m_sent[status->tracking_id].cb;
+    m_sent[status->tracking_id].used = false;
+    ((app_lib_data_sent_status_t *) status)->tracking_id =
+                                        m_sent[status->tracking_id].tracking_id;
+    lib_system->exitCriticalSection();
+
+    if (cb != NULL)
+    {
+        cb(status);
     }
-    // A & B invalid -> equal
-    return 0;    
 }
 
 /**
- * \brief  Updates neiggbours list stored in m_nbors_list
- *         sorted based on criteria implemented in 
- * \return  number of neigbours valid for DA communication
+ * \brief       Reserves an entry for a packet waiting for its sent status
+ * \param       cb data sent callback given with the packet
+ * \param       tracking_id tracking id given with the packet
+ * \return      entry index, POSLIB_DA_MAX_SENT_PENDING if none left
  */
-static void update_neigbours()
+static uint8_t sent_alloc(app_lib_data_data_sent_cb_f cb,
+                          app_lib_data_tracking_id_t tracking_id)
 {
-    m_nbors_list.number_nbors = MAX_NBORS;
-    lib_state->getNbors(&m_nbors_list);
+    uint8_t i;
 
-    qsort(m_nbors_list.nbors, m_nbors_list.number_nbors, 
-            sizeof(m_nbors_list.nbors[0]), compare_neighbours);
+    lib_system->enterCriticalSection();
+    for (i = 0; i < POSLIB_DA_MAX_SENT_PENDING; i++)
+    {
+        if (!m_sent[i].used)
+        {
+            m_sent[i].used = true;
+            m_sent[i].cb = cb;
+            m_sent[i].tracking_id = tracking_id;
+            break;
+        }
+    }
+    lib_system->exitCriticalSection();
 
-    for (uint8_t i = 0; i < m_nbors_list.number_nbors; i++)
+    return i;
+}
+
+/**
+ * \brief       Selects the router to try after failed ones
+ * \param       tried bitmask of routers already tried
+ * \return      router index, m_num_routers if none left
+ */
+static uint8_t next_router(uint32_t tried)
+{
+    uint8_t best = m_num_routers;
+
+    // Best link history first, ranking order for equal history
+    for (uint8_t i = 0; i < m_num_routers; i++)
     {
-        LOG(LVL_DEBUG,"neigh address: %u da: %u type: %u rssi: %i cost: %u last: %u", m_nbors[i].address, 
-                m_nbors[i].diradv_support, m_nbors[i].type, m_nbors[i].norm_rssi,  m_nbors[i].cost,  m_nbors[i].last_update); 
+        if (!(tried & (1UL << i)) &&
+            (best == m_num_routers ||
+             m_routers[i].link_score > m_routers[best].link_score))
+        {
+            best = i;
+        }
     }
+    return best;
 }
+#else
+static uint8_t next_router(uint32_t tried)
+{
+    // Ranking order
+    for (uint8_t i = 0; i < m_num_routers; i++)
+    {
+        if (!(tried & (1UL << i)))
+        {
+            return i;
+        }
+    }
+    return m_num_routers;
+}
+#endif
 
 static app_lib_data_receive_res_e tag_ack_cb(const shared_data_item_t * item,
                         const app_lib_data_received_t * data)
@@ -306,12 +541,22 @@ static bool start_tag(poslib_da_settings_t * da_settings)
 {
     app_res_e res;
     adv_option_t option;
-    bool ret; 
+    bool ret = true;
 
     option.follow_network = da_settings->follow_network;
     lib_advertiser->setOptions(&option);
     LOG(LVL_DEBUG, "DA tag - follow network: %u", option.follow_network);
 
+    // Keep router ranking up to date. Removed neighbors age out of ranking
+    if (!m_rank_cbs_reg)
+    {
+        Neighbor_Cache_addChangeCb(nbor_change_cb,
+                                   1 << NEIGHBOR_CACHE_EVENT_ADDED |
+                                   1 << NEIGHBOR_CACHE_EVENT_UPDATED |
+                                   1 << NEIGHBOR_CACHE_EVENT_SEEN);
+        m_rank_cbs_reg = true;
+    }
+
     init_tag_ack_item();
     res = Shared_Data_addDataReceivedCb(&m_tag_ack_item);
 
@@ -335,6 +580,13 @@ static void stop_tag()
     {
        Shared_Data_removeDataReceivedCb(&m_tag_ack_item); 
     }
+
+    if (m_rank_cbs_reg)
+    {
+        Neighbor_Cache_removeChangeCb(nbor_change_cb);
+        m_rank_cbs_reg = false;
+    }
+    m_num_routers = 0;
 }
 
 void PosLibDa_stop()
@@ -388,24 +640,55 @@ app_lib_data_send_res_e PosLibDa_sendData(app_lib_data_to_send_t * data,
         return Shared_Data_sendData(data, sent_cb);
     }
 
-    /* DA data sending - loop on updated neigbours until a DA cluster is found */
-    update_neigbours();
+    /* DA data sending - loop on ranked routers until a DA cluster is found */
+    rank_remove_stale();
+    if (m_num_routers == 0)
+    {
+        // No beacon received recently: refresh from stack neighbours, ranking
+        // is updated from change callback
+        Neighbor_Cache_refresh();
+    }
 
-    for (uint8_t i = 0; i < m_nbors_list.number_nbors; i++)
+#ifdef POSLIB_DA_LINK_HISTORY
+    // Every packet is tracked to update link history. The callback and
+    // tracking id given with it are kept in an entry, given back on sent.
+    app_lib_data_tracking_id_t tracking_id = data->tracking_id;
+    uint8_t sent = sent_alloc(sent_cb, tracking_id);
+    if (sent < POSLIB_DA_MAX_SENT_PENDING)
     {
-       
-       if (ROUTER_COST_INVALID(m_nbors[i].cost))
-       {
-           continue;
-       }
-       data->dest_address = m_nbors[i].address;
-       res =  Shared_Data_sendData(data, sent_cb);
-       if (res != APP_LIB_DATA_SEND_RES_INVALID_DEST_ADDRESS)
-       {
-           LOG(LVL_INFO, "DA data send. router: %u", m_nbors[i].address, res);
-           break;
-       }
-        LOG(LVL_WARNING, "Fail DA data send. router: %u, res: %u", m_nbors[i].address, res);
+        sent_cb = da_sent_cb;
     }
+#endif
+
+    uint32_t tried = 0;
+    // Best router first, then fallback order
+    for (uint8_t i = 0; i < m_num_routers; i = next_router(tried))
+    {
+        tried |= 1UL << i;
+        data->dest_address = m_routers[i].address;
+#ifdef POSLIB_DA_LINK_HISTORY
+        // Shared_Data replaces tracking id, set again for each try
+        data->tracking_id = (sent < POSLIB_DA_MAX_SENT_PENDING) ?
+                            sent : tracking_id;
+#endif
+        res =  Shared_Data_sendData(data, sent_cb);
+        if (res != APP_LIB_DATA_SEND_RES_INVALID_DEST_ADDRESS)
+        {
+            LOG(LVL_INFO, "DA data send. router: %u", data->dest_address, res);
+            break;
+        }
+        LOG(LVL_WARNING, "Fail DA data send. router: %u, res: %u", data->dest_address, res);
+    }
+
+#ifdef POSLIB_DA_LINK_HISTORY
+    if (sent < POSLIB_DA_MAX_SENT_PENDING && res != APP_LIB_DATA_SEND_RES_SUCCESS)
+    {
+        // No sent status will come
+        lib_system->enterCriticalSection();
+        m_sent[sent].used = false;
+        lib_system->exitCriticalSection();
+    }
+    data->tracking_id = tracking_id;
+#endif
     return res;
-}
\ No newline at end of file
+}
@@ -15,93 +15,199 @@
 #include "poslib.h"
 #include "poslib_control.h"
 #include "poslib_event.h"
-#include "sl_list.h"
 #include "app_scheduler.h"
 #include "poslib_ble_beacon.h"
 
+#if ((MAX_INTERNAL_EVENTS & (MAX_INTERNAL_EVENTS - 1)) != 0) || \
+    (MAX_INTERNAL_EVENTS > 64)
+#error MAX_INTERNAL_EVENTS must be a power of 2, 64 at most
+#endif
+
+#define EVENT_RING_MASK (MAX_INTERNAL_EVENTS - 1)
+
+/** Event bit in event masks */
+#define EVENT_BIT(type) (1UL << (type))
+
+/** Normal priority events: notifications only turned into public events.
+ *  All other events are inputs of the control and BLE state machines, and
+ *  are kept in a single ring so that they are processed in order. */
+#define NORMAL_PRIORITY_EVENTS (EVENT_BIT(POSLIB_CTRL_EVENT_UPDATE_START) | \
+                                EVENT_BIT(POSLIB_CTRL_EVENT_UPDATE_END) | \
+                                EVENT_BIT(POSLIB_CTRL_EVENT_BLE_START) | \
+                                EVENT_BIT(POSLIB_CTRL_EVENT_BLE_STOP) | \
+                                EVENT_BIT(POSLIB_CTRL_EVENT_LED_ON) | \
+                                EVENT_BIT(POSLIB_CTRL_EVENT_LED_OFF))
+
+/** Idempotent events: their processing only reads the latest state (app
+ *  config, settings, route, motion mode) or requests an update, so a pending
+ *  one already covers a new identical event. They are merged, other events
+ *  (e.g. data sent, timeout) are never merged. */
+#define MERGEABLE_EVENTS (EVENT_BIT(POSLIB_CTRL_EVENT_APPCFG) | \
+                          EVENT_BIT(POSLIB_CTRL_EVENT_CONFIG_CHANGE) | \
+                          EVENT_BIT(POSLIB_CTRL_EVENT_ROUTE_CHANGE) | \
+                          EVENT_BIT(POSLIB_CTRL_EVENT_MOTION) | \
+                          EVENT_BIT(POSLIB_CTRL_EVENT_ONESHOT))
+
+/** Priority classes, highest first */
+typedef enum
+{
+    EVENT_CLASS_HIGH = 0,
+    EVENT_CLASS_NORMAL = 1,
+    EVENT_CLASS_NUM = 2
+} event_class_e;
+
 /** Module private data structures */
 typedef struct{
 poslib_events_e event;
 poslib_events_listen_info_f cb;
 } POSLIB_FLAG_EVENT_public_sub_t;
 
+/** Ring of pending event types, single consumer (scheduler task) */
+typedef struct
+{
+    /** Next write index, free running */
+    uint8_t in;
+    /** Next read index, free running */
+    uint8_t out;
+    /** Pending event types */
+    uint8_t types[MAX_INTERNAL_EVENTS];
+} event_ring_t;
+
 /** Module private function definitions */
 void generate_public_events(poslib_internal_event_t * i_event);
 
 /** Variables: internal control events */
-bool m_internal_init = false;
-static sl_list_head_t m_events_head;
-static poslib_internal_event_t m_internal_events[MAX_INTERNAL_EVENTS];
+static event_ring_t m_rings[EVENT_CLASS_NUM];
+/** Bit set for each mergeable event type in rings */
+static uint32_t m_pending_mask;
+static poslib_event_stats_t m_stats;
 
 /** Variables: PosLib public events */
 bool m_public_init = false;
 POSLIB_FLAG_EVENT_public_sub_t m_public_event_db[POSLIB_FLAG_EVENT_SUBSCRIBERS_MAX];
 
+static inline uint8_t ring_usage(const event_ring_t * ring)
+{
+    return (uint8_t) (ring->in - ring->out);
+}
 
-static uint32_t handle_events()
+/**
+ * @brief   Pop the next event, highest priority class first
+ * @return  Event type, POSLIB_CTRL_EVENT_NONE if no event pending
+ */
+static poslib_internal_event_type_e pop_event(void)
 {
-    poslib_internal_event_t * event;
+    poslib_internal_event_type_e type = POSLIB_CTRL_EVENT_NONE;
 
-    if (sl_list_size(&m_events_head) == 0)
+    lib_system->enterCriticalSection();
+    for (uint8_t c = 0; c < EVENT_CLASS_NUM; c++)
     {
-        return APP_SCHEDULER_STOP_TASK; 
+        event_ring_t * ring = &m_rings[c];
+        if (ring_usage(ring) > 0)
+        {
+            type = ring->types[ring->out & EVENT_RING_MASK];
+            ring->out++;
+            // A new identical event can be queued from now on
+            m_pending_mask &= ~EVENT_BIT(type);
+            break;
+        }
     }
-
-    lib_system->enterCriticalSection();
-    event = (poslib_internal_event_t *) sl_list_pop_front(&m_events_head);
     lib_system->exitCriticalSection();
 
-    LOG(LVL_DEBUG, "Event %u (left %u)", event->type, sl_list_size(&m_events_head));
+    return type;
+}
+
+static uint32_t handle_events()
+{
+    poslib_internal_event_t event;
+
+    for (uint8_t n = 0; n < POSLIB_EVENT_BATCH_SIZE; n++)
+    {
+        event.type = pop_event();
+        if (event.type == POSLIB_CTRL_EVENT_NONE)
+        {
+            return APP_SCHEDULER_STOP_TASK;
+        }
 
-    // Event processing call for all modules
-    PosLibCtrl_processEvent(event);
-    PosLibBle_processEvent(event);
-    generate_public_events(event);
+        LOG(LVL_DEBUG, "Event %u", event.type);
 
-    // Free event slot
-    event->type = POSLIB_CTRL_EVENT_NONE;
+        // Event processing call for all modules
+        PosLibCtrl_processEvent(&event);
+        PosLibBle_processEvent(&event);
+        generate_public_events(&event);
+    }
 
-    return (sl_list_size(&m_events_head) == 0) ? APP_SCHEDULER_STOP_TASK : 
-                                                APP_SCHEDULER_SCHEDULE_ASAP;
+    return (ring_usage(&m_rings[EVENT_CLASS_HIGH]) == 0 &&
+            ring_usage(&m_rings[EVENT_CLASS_NORMAL]) == 0) ?
+                APP_SCHEDULER_STOP_TASK : APP_SCHEDULER_SCHEDULE_ASAP;
 }
 
 bool PosLibEvent_add(poslib_internal_event_type_e type)
 {
-    poslib_internal_event_t * event = NULL;
-    uint8_t i;
-    
-    lib_system->enterCriticalSection();
-    if (!m_internal_init)
+    event_class_e c = (NORMAL_PRIORITY_EVENTS & EVENT_BIT(type)) ?
+                        EVENT_CLASS_NORMAL : EVENT_CLASS_HIGH;
+    event_ring_t * ring = &m_rings[c];
+    bool queued = false;
+    bool merged = false;
+    uint8_t usage;
+
+    if (type == POSLIB_CTRL_EVENT_NONE)
     {
-        sl_list_init(&m_events_head);
-        memset(m_internal_events, 0, sizeof(m_internal_events));
-        m_internal_init = true;
+        return false;
     }
 
-    for (i = 0; i < MAX_INTERNAL_EVENTS; i++)
+    lib_system->enterCriticalSection();
+    usage = ring_usage(ring);
+    if ((m_pending_mask & MERGEABLE_EVENTS & EVENT_BIT(type)) != 0)
+    {
+        // Identical idempotent event pending
+        m_stats.coalesced++;
+        merged = true;
+    }
+    else if (usage < MAX_INTERNAL_EVENTS)
     {
-        if (m_internal_events[i].type == POSLIB_CTRL_EVENT_NONE)
+        ring->types[ring->in & EVENT_RING_MASK] = type;
+        ring->in++;
+        m_pending_mask |= (MERGEABLE_EVENTS & EVENT_BIT(type));
+        m_stats.queued++;
+        usage = ring_usage(&m_rings[EVENT_CLASS_HIGH]) +
+                ring_usage(&m_rings[EVENT_CLASS_NORMAL]);
+        if (usage > m_stats.max_pending)
         {
-            event = &m_internal_events[i];
-            event->type = type;
-            sl_list_push_back(&m_events_head, (sl_list_t *) event);
-            break; 
+            m_stats.max_pending = usage;
         }
+        queued = true;
+    }
+    else
+    {
+        m_stats.dropped++;
     }
     lib_system->exitCriticalSection();
 
-    if (event == NULL)
+    if (merged)
+    {
+        LOG(LVL_DEBUG, "Event %u merged", type);
+        return true;
+    }
+    else if (!queued)
     {
         LOG(LVL_ERROR, "Cannot add event %u", type);
         return false;
     }
 
-    LOG(LVL_DEBUG, "Event %u added slot %u (left %u)", event->type, i, sl_list_size(&m_events_head));
+    LOG(LVL_DEBUG, "Event %u added (pending %u)", type, usage);
 
     App_Scheduler_addTask_execTime(handle_events, APP_SCHEDULER_SCHEDULE_ASAP, 500);
     return true;
 }
 
+void PosLibEvent_getStats(poslib_event_stats_t * stats)
+{
+    lib_system->enterCriticalSection();
+    *stats = m_stats;
+    lib_system->exitCriticalSection();
+}
+
 
 poslib_ret_e PosLibEvent_register(poslib_events_e event,
                             poslib_events_listen_info_f cb, 
@@ -7,9 +7,18 @@
 #ifndef _POSLIB_EVENT_H_
 #define _POSLIB_EVENT_H_
 
-#include "sl_list.h"
+#include <stdint.h>
+#include <stdbool.h>
 
+/** Size of each internal event ring, must be a power of 2 */
+#ifndef MAX_INTERNAL_EVENTS
 #define MAX_INTERNAL_EVENTS 16
+#endif
+
+/** Maximum number of events processed per scheduler run */
+#ifndef POSLIB_EVENT_BATCH_SIZE
+#define POSLIB_EVENT_BATCH_SIZE 4
+#endif
 
 typedef enum {
     /**< No event */
@@ -55,12 +64,42 @@ typedef enum {
 } poslib_internal_event_type_e;
 
 typedef struct {
-    sl_list_t list;
     poslib_internal_event_type_e type;
 } poslib_internal_event_t;
 
+/** Internal event queue statistics */
+typedef struct {
+    /**< Number of events queued */
+    uint32_t queued;
+    /**< Number of events merged with an identical pending event */
+    uint32_t coalesced;
+    /**< Number of events dropped because queue was full */
+    uint32_t dropped;
+    /**< Maximum number of pending events seen */
+    uint8_t max_pending;
+} poslib_event_stats_t;
+
+/**
+ * @brief   Queue an internal event
+ *          Events are processed in batches from the application scheduler.
+ *          Inputs of the PosLib state machines are processed first, in the
+ *          order they were queued. Notifications only turned into public
+ *          events (update end, BLE start / stop, LED) come after them.
+ *          Idempotent events (app config, configuration, route change,
+ *          motion, oneshot) are merged with an identical pending event,
+ *          other events are never merged.
+ * @param   type the event type
+ * @return  true if event is queued or merged, false if queue is full
+ */
 bool PosLibEvent_add(poslib_internal_event_type_e type);
 
+/**
+ * @brief   Get internal event queue statistics
+ * @param   stats Returned statistics
+ * @return  void
+ */
+void PosLibEvent_getStats(poslib_event_stats_t * stats);
+
 /**
  * @brief   Register an PosLib event subscriber for 
  * @param   event Events of interest (type of poslib_events_e)
@@ -23,6 +23,12 @@
 #include "api.h"
 #include "voltage.h"
 
+#if __has_include("app_heap.h")
+/* App heap library is enabled: measurement table is allocated from it */
+#include "app_heap.h"
+#define MEAS_TABLE_FROM_HEAP
+#endif
+
 
 /** Internal module structures */
 
@@ -47,7 +53,12 @@ typedef struct
 
 typedef struct
 {
+#ifdef MEAS_TABLE_FROM_HEAP
+    poslib_meas_wm_beacon_t * beacons;
+#else
     poslib_meas_wm_beacon_t beacons[MAX_BEACONS];
+#endif
+    uint8_t max_beacons;
     uint8_t num_beacons;
     uint8_t min_index;
     int16_t min_rss;
@@ -63,7 +74,12 @@ typedef struct
     uint8_t * cursor;
 } poslib_meas_payload_buffer_t;
 
+#ifdef MEAS_TABLE_FROM_HEAP
+/** Beacons are stored once PosLibMeas_init() allocates the table */
 static poslib_meas_table_t m_meas_table;
+#else
+static poslib_meas_table_t m_meas_table = {.max_beacons = MAX_BEACONS};
+#endif
 
 
 /** Callbacks state variables */
@@ -187,7 +203,11 @@ static void beacon_cb(const app_lib_state_beacon_rx_t * beacon)
         LOG(LVL_INFO, "DA router: %u", beacon->address);
     }
 
-    insert_beacon(&bcn); 
+    // Beacon callbacks are not called in critical section: protect table
+    // against readers in application context
+    lib_system->enterCriticalSection();
+    insert_beacon(&bcn);
+    lib_system->exitCriticalSection();
 }
 
 static app_lib_data_receive_res_e mbcn_cb(const shared_data_item_t * item,
@@ -279,15 +299,53 @@ static void deregister_callbacks(void)
     }
 }
 
+static void clear_measurement_table()
+{
+    m_meas_table.num_beacons = 0;
+    m_meas_table.min_index = 0;
+    m_meas_table.min_rss = 0;
+    if (m_meas_table.max_beacons > 0)
+    {
+        memset(m_meas_table.beacons, 0,
+               m_meas_table.max_beacons * sizeof(poslib_meas_wm_beacon_t));
+    }
+}
+
 static void init_module(void)
 {
-    memset(&m_meas_table, 0, sizeof(m_meas_table));
+    clear_measurement_table();
 }
 
-static void clear_measurement_table()
+bool PosLibMeas_init(void)
 {
-    m_meas_table.num_beacons = 0;
-    memset(&m_meas_table.beacons, 0, sizeof(m_meas_table.beacons));
+#ifdef MEAS_TABLE_FROM_HEAP
+    size_t max_bytes;
+    uint8_t max_beacons = MAX_BEACONS;
+
+    if (m_meas_table.beacons != NULL)
+    {
+        // Already allocated
+        return true;
+    }
+
+    /* MAX_BEACONS fit in MAX_PAYLOAD, less if stack sends shorter packets */
+    max_bytes = lib_data->getDataMaxNumBytes().max_fragment_size;
+    if (max_bytes < MAX_PAYLOAD)
+    {
+        max_beacons = (MAX_BEACONS * max_bytes) / MAX_PAYLOAD;
+    }
+
+    m_meas_table.beacons = App_Heap_alloc(max_beacons *
+                                          sizeof(poslib_meas_wm_beacon_t));
+    if (m_meas_table.beacons == NULL)
+    {
+        LOG(LVL_ERROR, "Cannot allocate table of %u beacons", max_beacons);
+        return false;
+    }
+    m_meas_table.max_beacons = max_beacons;
+    LOG(LVL_INFO, "Table of %u beacons allocated", max_beacons);
+#endif
+    return true;
 }
 
 /**
@@ -389,7 +447,7 @@ static void clean_beacon(uint32_t older_than, uint8_t max_beacons)
 
     app_lib_time_timestamp_hp_t now = lib_time->getTimestampHp();
 
-    for (i = 0; i < max_beacons && i < MAX_BEACONS
+    for (i = 0; i < max_beacons && i < m_meas_table.max_beacons
             && m_meas_table.num_beacons > 0; i++)
     {
         if (m_meas_table.beacons[i].address != 0)
@@ -444,7 +502,7 @@ static void update_min(void)
 static void insert_beacon(const poslib_meas_wm_beacon_t * beacon)
 {
     uint8_t i = 0;
-    uint8_t insert_idx = MAX_BEACONS;
+    uint8_t insert_idx = m_meas_table.max_beacons;
     bool match = false;
     poslib_meas_wm_beacon_t * bcn = NULL;
 
@@ -464,7 +522,7 @@ static void insert_beacon(const poslib_meas_wm_beacon_t * beacon)
     // append the beacon, otherwise replace the entry with the lowest minimum
     if (!match)
     {
-        if(m_meas_table.num_beacons == MAX_BEACONS) // no space
+        if(m_meas_table.num_beacons == m_meas_table.max_beacons) // no space
         {
             update_min();
 
@@ -481,7 +539,7 @@ static void insert_beacon(const poslib_meas_wm_beacon_t * beacon)
     }
 
     // update the table
-    if (insert_idx < MAX_BEACONS)
+    if (insert_idx < m_meas_table.max_beacons)
     {
         bcn = &m_meas_table.beacons[insert_idx];
         if (bcn->samples < MAX_FLT_SAMPLES)
@@ -523,6 +581,51 @@ uint8_t PosLibMeas_getBeaconNum(void)
     return m_meas_table.num_beacons;
 }
 
+/**
+ * @brief   RSS of a beacon in RSS record unit (-0.5 dBm)
+ */
+static uint8_t get_rss_unit(const poslib_meas_wm_beacon_t * bcn)
+{
+    int16_t rss = bcn->norm_rss * -2;
+
+    if (rss < 0)
+    {
+        return 0;
+    }
+    return (rss >= 0xFF) ? 0xFF : rss;
+}
+
+uint8_t PosLibMeas_getRss(poslib_meas_rss_data_t * meas, uint8_t max)
+{
+    uint8_t num = 0;
+
+    lib_system->enterCriticalSection();
+    for (uint8_t i = 0; i < m_meas_table.num_beacons; i++)
+    {
+        uint8_t rss = get_rss_unit(&m_meas_table.beacons[i]);
+        uint8_t j = num;
+
+        // Insert sorted, strongest first, and keep max strongest ones
+        while (j > 0 && meas[j - 1].norm_rss > rss)
+        {
+            if (j < max)
+            {
+                meas[j] = meas[j - 1];
+            }
+            j--;
+        }
+        if (j < max)
+        {
+            meas[j].address = m_meas_table.beacons[i].address;
+            meas[j].norm_rss = rss;
+            num = (num < max) ? num + 1 : num;
+        }
+    }
+    lib_system->exitCriticalSection();
+
+    return num;
+}
+
 uint8_t get_payload_len(poslib_meas_payload_buffer_t * buf)
 {
     return ((uint8_t*) buf->cursor - (uint8_t*) buf->dest);
@@ -616,6 +719,264 @@ static uint8_t add_rss_record(poslib_meas_payload_buffer_t * buf, poslib_measure
     }
 }
 
+#ifdef POSLIB_COMPACT_MEAS
+/** Smallest compact RSS quantization step, 1 dB */
+#define COMPACT_MIN_STEP 2
+/** Largest compact RSS quantization step, 4 dB. Weaker beacons are clamped */
+#define COMPACT_MAX_STEP 8
+/** Largest 4-bit compact RSS value */
+#define COMPACT_MAX_VALUE 15
+
+static uint8_t varint_len(uint32_t value)
+{
+    uint8_t len = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static uint8_t put_varint(uint8_t * dst, uint32_t value)
+{
+    uint8_t len = 0;
+
+    while (value >= 0x80)
+    {
+        dst[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    dst[len++] = value;
+    return len;
+}
+
+/**
+ * @brief   Encodes compact RSS record payload.
+ * @param   addr_order  table indexes sorted by address
+ * @param   rank        rank of each table index by RSS, strongest first
+ * @param   num_meas    number of measurements to encode, strongest ones
+ * @param   anchor      true if this node is an anchor
+ * @param   out         output buffer
+ * @param   max_len     size of output buffer
+ * @return  encoded length, 0 if it does not fit
+ */
+static uint8_t encode_compact(const uint8_t * addr_order,
+                              const uint8_t * rank,
+                              uint8_t num_meas,
+                              bool anchor,
+                              uint8_t * out,
+                              uint8_t max_len)
+{
+    const uint8_t fields = POSLIB_COMPACT_MEAS_FIELDS & 0x0F;
+    uint8_t base = 0xFF;
+    uint8_t max = 0;
+    uint8_t step;
+    uint8_t len = 0;
+    uint8_t tail_len;
+    uint32_t prev_address = 0;
+    uint8_t n;
+
+    // Size of RSS and optional fields, after addresses
+    tail_len = (num_meas + 1) / 2;
+    if (fields & POSLIB_MEAS_COMPACT_FIELD_TYPE)
+    {
+        tail_len += (num_meas + 3) / 4;
+    }
+    if (fields & POSLIB_MEAS_COMPACT_FIELD_SAMPLES)
+    {
+        tail_len += (num_meas + 1) / 2;
+    }
+    if (fields & POSLIB_MEAS_COMPACT_FIELD_TXPOWER)
+    {
+        tail_len += num_meas;
+    }
+    if (1 + varint_len(num_meas) + 2 + tail_len > max_len)
+    {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < m_meas_table.num_beacons; i++)
+    {
+        uint8_t rss = get_rss_unit(&m_meas_table.beacons[i]);
+
+        if (rank[i] >= num_meas)
+        {
+            continue;
+        }
+        base = (rss < base) ? rss : base;
+        max = (rss > max) ? rss : max;
+    }
+    step = (max - base + COMPACT_MAX_VALUE - 1) / COMPACT_MAX_VALUE;
+    step = (step < COMPACT_MIN_STEP) ? COMPACT_MIN_STEP : step;
+    step = (step > COMPACT_MAX_STEP) ? COMPACT_MAX_STEP : step;
+
+    out[len++] = POSLIB_MEAS_COMPACT_VERSION
+                 | (anchor ? POSLIB_MEAS_COMPACT_ANCHOR : 0)
+                 | (fields << POSLIB_MEAS_COMPACT_FIELDS_OFFSET);
+    len += put_varint(&out[len], num_meas);
+    out[len++] = base;
+    out[len++] = step;
+
+    // Addresses, delta encoded
+    for (uint8_t i = 0; i < m_meas_table.num_beacons; i++)
+    {
+        uint32_t address = m_meas_table.beacons[addr_order[i]].address;
+
+        if (rank[addr_order[i]] >= num_meas)
+        {
+            continue;
+        }
+        if (len + varint_len(address - prev_address) + tail_len > max_len)
+        {
+            return 0;
+        }
+        len += put_varint(&out[len], address - prev_address);
+        prev_address = address;
+    }
+
+    // RSS and optional fields, in address order
+    memset(&out[len], 0, tail_len);
+    n = 0;
+    for (uint8_t i = 0; i < m_meas_table.num_beacons; i++)
+    {
+        const poslib_meas_wm_beacon_t * bcn =
+                                    &m_meas_table.beacons[addr_order[i]];
+        uint8_t pos = len;
+        uint8_t value;
+
+        if (rank[addr_order[i]] >= num_meas)
+        {
+            continue;
+        }
+
+        value = (get_rss_unit(bcn) - base + step / 2) / step;
+        value = (value > COMPACT_MAX_VALUE) ? COMPACT_MAX_VALUE : value;
+        out[pos + n / 2] |= value << ((n & 1) * 4);
+        pos += (num_meas + 1) / 2;
+
+        if (fields & POSLIB_MEAS_COMPACT_FIELD_TYPE)
+        {
+            value = (bcn->type > POSLIB_MEAS_BEACON_TYPE_FLT) ?
+                        POSLIB_MEAS_BEACON_TYPE_FLT : bcn->type;
+            out[pos + n / 4] |= value << ((n & 3) * 2);
+            pos += (num_meas + 3) / 4;
+        }
+        if (fields & POSLIB_MEAS_COMPACT_FIELD_SAMPLES)
+        {
+            value = (bcn->samples > 0x0F) ? 0x0F : bcn->samples;
+            out[pos + n / 2] |= value << ((n & 1) * 4);
+            pos += (num_meas + 1) / 2;
+        }
+        if (fields & POSLIB_MEAS_COMPACT_FIELD_TXPOWER)
+        {
+            out[pos + n] = (uint8_t) bcn->txpower;
+        }
+        n++;
+    }
+
+    return len + tail_len;
+}
+
+/**
+ * @brief   Adds compact RSS record. If all measurements do not fit, the
+ *          weakest ones are left out. RSS record is added instead if it is
+ *          not longer.
+ * @return  number of measurements added
+ */
+static uint8_t add_compact_rss_record(poslib_meas_payload_buffer_t * buf,
+                                      poslib_measurements_e meas_type)
+{
+    uint8_t num_beacons = m_meas_table.num_beacons;
+    uint8_t num_meas = num_beacons;
+    uint8_t rss_order[MAX_BEACONS];
+    uint8_t addr_order[MAX_BEACONS];
+    uint8_t rank[MAX_BEACONS];
+    uint8_t record[MAX_PAYLOAD];
+    uint8_t available = buf->max_len - get_payload_len(buf);
+    poslib_meas_record_header_t header;
+    uint8_t len = 0;
+    bool anchor = (meas_type == POSLIB_MEAS_RSS_SR_ANCHOR ||
+                   meas_type == POSLIB_MEAS_RSS_SR_ANCHOR_4BYTE_ADDR);
+
+    if (num_meas == 0)
+    {
+        LOG(LVL_WARNING, "No measurements available");
+        return 0;
+    }
+
+    if (available <= sizeof(header))
+    {
+        LOG(LVL_ERROR, "Not enough space for measurements");
+        return 0;
+    }
+    available -= sizeof(header);
+    available = (available > sizeof(record)) ? sizeof(record) : available;
+
+    // Sort by RSS, strongest first, and by address
+    for (uint8_t i = 0; i < num_beacons; i++)
+    {
+        uint8_t j = i;
+
+        while (j > 0 && m_meas_table.beacons[rss_order[j - 1]].norm_rss <
+                        m_meas_table.beacons[i].norm_rss)
+        {
+            rss_order[j] = rss_order[j - 1];
+            j--;
+        }
+        rss_order[j] = i;
+
+        j = i;
+        while (j > 0 && m_meas_table.beacons[addr_order[j - 1]].address >
+                        m_meas_table.beacons[i].address)
+        {
+            addr_order[j] = addr_order[j - 1];
+            j--;
+        }
+        addr_order[j] = i;
+    }
+    for (uint8_t i = 0; i < num_beacons; i++)
+    {
+        rank[rss_order[i]] = i;
+    }
+
+    while (num_meas > 0)
+    {
+        len = encode_compact(addr_order, rank, num_meas, anchor,
+                             record, available);
+        if (len > 0)
+        {
+            break;
+        }
+        num_meas--;
+    }
+
+    if (num_meas == 0)
+    {
+        LOG(LVL_ERROR, "Not enough space for measurements");
+        return 0;
+    }
+
+    if (num_meas == num_beacons &&
+        len >= num_beacons * sizeof(poslib_meas_rss_data_t))
+    {
+        // Addresses too far apart to be compressed, RSS record is not
+        // longer and fits
+        return add_rss_record(buf, meas_type);
+    }
+
+    header.type = POSLIB_MEAS_RSS_COMPACT;
+    header.length = len;
+    meas_copy_payload(buf, (void*) &header, sizeof(header));
+    meas_copy_payload(buf, (void*) record, len);
+
+    LOG(LVL_DEBUG, "Compact measurements added %u/%u, %u bytes",
+        num_meas, num_beacons, len);
+    return num_meas;
+}
+#endif
+
 
 static uint16_t get_voltage(void)
 #ifdef CONF_VOLTAGE_REPORT
@@ -696,7 +1057,11 @@ bool PosLibMeas_getPayload(uint8_t * bytes, uint8_t max_len, uint8_t sequence,
     // add RSS measurements
     if (ret)
     {
+#ifdef POSLIB_COMPACT_MEAS
+        *num_meas = add_compact_rss_record(&buf, meas_type);
+#else
         *num_meas = add_rss_record(&buf, meas_type);
+#endif
         ret = (*num_meas == 0) ? false : true;
     }
     // add voltage
@@ -718,5 +1083,5 @@ bool PosLibMeas_getPayload(uint8_t * bytes, uint8_t max_len, uint8_t sequence,
 
 void PosLibMeas_clearMeas(void)
 {
-    memset(&m_meas_table, 0, sizeof(m_meas_table));
+    clear_measurement_table();
 }
\ No newline at end of file
@@ -23,6 +23,7 @@ typedef enum
     POSLIB_MEAS_RSS_SR_4BYTE_ADDR = 0x05,
     POSLIB_MEAS_NODE_INFO = 0x06,
     POSLIB_MEAS_DA = 0x07,
+    POSLIB_MEAS_RSS_COMPACT = 0x08,
     /** 0x70 - 0xEF : range reserved for customer
      *  Please notify Wirepas if a custom record ID is used by
      * your customised positoning app
@@ -34,8 +35,15 @@ typedef enum
 /** 2.4 profile - limited by internal memory */
 #define MAX_PAYLOAD         102
 
+#ifndef MAX_BEACONS
+#ifdef POSLIB_COMPACT_MEAS
+/** limited by maximum payload size, with typical address deltas */
+#define MAX_BEACONS         32
+#else
 /** limited by maximum payload size */
 #define MAX_BEACONS         14
+#endif
+#endif
 /** node address length in bytes */
 #define NODE_ADDRESS_LENGTH 4
 #define DEFAULT_MEASUREMENT_TYPE_TAG POSLIB_MEAS_RSS_SR_4BYTE_ADDR
@@ -83,6 +91,61 @@ typedef PACKED_STRUCT
     uint16_t voltage;
 } poslib_meas_record_voltage_t;
 
+/** Version of compact RSS record format */
+#define POSLIB_MEAS_COMPACT_VERSION 1
+
+/**
+    @brief Compact RSS record (type POSLIB_MEAS_RSS_COMPACT), sent instead of
+           the RSS record when POSLIB_COMPACT_MEAS is defined.
+
+    Payload, after the record header:
+    - info byte: version (bits 0-2), sender is an anchor (bit 3) and
+      bitmap of optional fields present (bits 4-7, see
+      @ref poslib_meas_compact_field_e)
+    - number of measurements n, varint
+    - base: strongest RSS, in RSS record unit (-0.5 dBm)
+    - step: quantization step, in RSS record unit
+    - n addresses in ascending order, varint: first one as is, others as
+      difference to previous one
+    - n RSS, 4 bits each, low nibble first: RSS = base + value * step.
+      Value 15 also means weaker than base + 15 * step
+    - optional fields, in bit order, n values each
+
+    Varints are 7 bits per byte, least significant first, with bit 7 set
+    when more bytes follow. Decoders stop at the first optional field they
+    do not know: next ones are ignored with it.
+*/
+typedef PACKED_STRUCT
+{
+    uint8_t info;
+} poslib_meas_compact_header_t;
+
+/** Compact record version mask */
+#define POSLIB_MEAS_COMPACT_VERSION_MASK    0x07
+/** Compact record sender is an anchor */
+#define POSLIB_MEAS_COMPACT_ANCHOR          0x08
+/** Compact record optional fields offset in info byte */
+#define POSLIB_MEAS_COMPACT_FIELDS_OFFSET   4
+
+/**
+    @brief Optional fields of compact RSS record
+*/
+typedef enum
+{
+    /**< Beacon type, 2 bits each, lowest bits first: cluster beacon 0,
+     *   network beacon 1, mini-beacon 2, filtered from several beacons 3 */
+    POSLIB_MEAS_COMPACT_FIELD_TYPE = 0x01,
+    /**< Number of RSS samples averaged, 4 bits each, low nibble first */
+    POSLIB_MEAS_COMPACT_FIELD_SAMPLES = 0x02,
+    /**< Beacon TX power, int8_t each, in dBm */
+    POSLIB_MEAS_COMPACT_FIELD_TXPOWER = 0x04,
+} poslib_meas_compact_field_e;
+
+#ifndef POSLIB_COMPACT_MEAS_FIELDS
+/** Optional fields sent in compact RSS record */
+#define POSLIB_COMPACT_MEAS_FIELDS  0
+#endif
+
 /** Defines the feature flags version, to be incremented when new flags are added */
 #define  POSLIB_NODE_INFO_FEATURES_VERSION 1
 /**
@@ -131,6 +194,16 @@ typedef struct poslib_measurement
 } poslib_scan_ctrl_t;
 
 
+/**
+ * @brief   Allocates the measurement table if app_heap library is enabled.
+ *          Table holds MAX_BEACONS beacons, or less if the stack sends
+ *          packets shorter than MAX_PAYLOAD. Without app_heap library, a
+ *          static table of MAX_BEACONS is used.
+ * @note    Allocation is only possible until App_init() returns
+ * @return  True if measurement table is available
+ */
+bool PosLibMeas_init(void);
+
 /**
  * @brief   Starts new scan
  *
@@ -146,6 +219,17 @@ bool PosLibMeas_opportunisticScan(bool enable);
  */
 uint8_t PosLibMeas_getBeaconNum(void);
 
+/**
+ * @brief   Copies the strongest measurements of the table.
+ * @param   meas
+ *          Filled with measurements, strongest first, RSS in RSS record unit
+ *          (-0.5 dBm)
+ * @param   max
+ *          Maximum number of measurements to copy
+ * @return  Number of measurements copied
+ */
+uint8_t PosLibMeas_getRss(poslib_meas_rss_data_t * meas, uint8_t max);
+
 /**
  * @brief   Stops the measurement module. Callbacks are removed.
  */
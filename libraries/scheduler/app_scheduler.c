@@ -7,6 +7,11 @@
 #include "util.h"
 
 #include <string.h>
+#include "libraries_init.h"
+#ifdef APP_SCHEDULER_TASK_STATS
+#include "pack.h"
+#include "tlv.h"
+#endif
 
 /**
  * Maximum time in ms for periodic work  to be scheduled due to internal
@@ -42,6 +47,9 @@ typedef struct
     uint32_t                            exec_time_us; /* Time needed for execution */
     bool                                updated; /* Updated in IRQ context? */
     bool                                removed; /* Task removed, to be released */
+#ifdef APP_SCHEDULER_TASK_STATS
+    app_scheduler_task_stats_t          stats; /* Execution statistics */
+#endif
 } task_t;
 
 /**  List of tasks */
@@ -190,6 +198,79 @@ static bool is_timestamp_before(timestamp_t * ts1_p, timestamp_t * ts2_p)
     }
 }
 
+#ifdef APP_SCHEDULER_TASK_STATS
+/**
+ * \brief   Get how late a task starts compared to its timestamp
+ * \param   ts_p
+ *          Pointer to timestamp of the task
+ * \param   now_hp
+ *          Current hp timestamp
+ * \return  Lateness in us, 0 if not late
+ */
+static uint32_t get_lateness_us(timestamp_t * ts_p,
+                                app_lib_time_timestamp_hp_t now_hp)
+{
+    if (ts_p->is_hp)
+    {
+        if (!lib_time->isHpTimestampBefore(ts_p->hp, now_hp))
+        {
+            return 0;
+        }
+        return lib_time->getTimeDiffUs(now_hp, ts_p->hp);
+    }
+    else
+    {
+        app_lib_time_timestamp_coarse_t now_coarse =
+                                            lib_time->getTimestampCoarse();
+        if (!Util_isLtUint32(ts_p->coarse, now_coarse))
+        {
+            return 0;
+        }
+        // Lateness is small compared to coarse range, no overflow
+        return ((now_coarse - ts_p->coarse) * 1000 / 128) * 1000;
+    }
+}
+
+/**
+ * \brief   Update statistics of a task after its execution
+ * \param   stats
+ *          Statistics to update
+ * \param   exec_us
+ *          Measured execution time
+ * \param   late_us
+ *          Measured start lateness
+ * \param   budget_us
+ *          Execution time declared for the task
+ */
+static void update_stats(app_scheduler_task_stats_t * stats,
+                         uint32_t exec_us,
+                         uint32_t late_us,
+                         uint32_t budget_us)
+{
+    stats->runs++;
+    if (stats->runs == 1 || exec_us < stats->min_exec_us)
+    {
+        stats->min_exec_us = exec_us;
+    }
+    if (exec_us > stats->max_exec_us)
+    {
+        stats->max_exec_us = exec_us;
+    }
+    // Running average, without 64-bit sum
+    stats->avg_exec_us = (int32_t) stats->avg_exec_us
+                         + ((int32_t) (exec_us - stats->avg_exec_us)
+                            / (int32_t) stats->runs);
+    if (late_us > stats->max_late_us)
+    {
+        stats->max_late_us = late_us;
+    }
+    if (exec_us > budget_us)
+    {
+        stats->overruns++;
+    }
+}
+#endif
+
 /**
  * \brief   Execute the selected task if time to do it
  */
@@ -197,6 +278,11 @@ static void perform_task(task_t * task)
 {
     task_cb_f task_cb = NULL;
     uint32_t next = APP_SCHEDULER_STOP_TASK;
+#ifdef APP_SCHEDULER_TASK_STATS
+    app_lib_time_timestamp_hp_t start_hp;
+    uint32_t exec_us;
+    uint32_t late_us;
+#endif
 
     if (task == NULL)
     {
@@ -209,12 +295,27 @@ static void perform_task(task_t * task)
     {
         return;
     }
+#ifdef APP_SCHEDULER_TASK_STATS
+    start_hp = lib_time->getTimestampHp();
+    late_us = get_lateness_us(&task->next_ts, start_hp);
+#endif
+
     // Execute the task selected
     next = task_cb();
 
+#ifdef APP_SCHEDULER_TASK_STATS
+    exec_us = lib_time->getTimeDiffUs(lib_time->getTimestampHp(), start_hp);
+#endif
+
     // Update its next execution time under critical section
     // to avoid overriding new value set by IRQ
     Sys_enterCriticalSection();
+#ifdef APP_SCHEDULER_TASK_STATS
+    if (task->func == task_cb)
+    {
+        update_stats(&task->stats, exec_us, late_us, task->exec_time_us);
+    }
+#endif
     if (!task->updated && !task->removed)
     {
         // Task was not modified from IRQ or task itself during execution
@@ -444,7 +545,7 @@ app_scheduler_res_e App_Scheduler_addTask_execTime(task_cb_f cb,
     app_scheduler_res_e res;
     get_timestamp(&new_task.next_ts, delay_ms);
 
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, App_Scheduler_init))
     {
         return APP_SCHEDULER_RES_UNINITIALIZED;
     }
@@ -492,7 +593,7 @@ app_scheduler_res_e App_Scheduler_cancelTask(task_cb_f cb)
 {
     app_scheduler_res_e res;
 
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, App_Scheduler_init))
     {
         return APP_SCHEDULER_RES_UNINITIALIZED;
     }
@@ -520,3 +621,88 @@ app_scheduler_res_e App_Scheduler_cancelTask(task_cb_f cb)
 
     return res;
 }
+
+#ifdef APP_SCHEDULER_TASK_STATS
+app_scheduler_res_e App_Scheduler_getTaskStats(task_cb_f cb,
+                                               app_scheduler_task_stats_t * stats)
+{
+    app_scheduler_res_e res = APP_SCHEDULER_RES_UNKNOWN_TASK;
+
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, App_Scheduler_init))
+    {
+        return APP_SCHEDULER_RES_UNINITIALIZED;
+    }
+
+    Sys_enterCriticalSection();
+    for (uint8_t i = 0; i < APP_SCHEDULER_ALL_TASKS; i++)
+    {
+        if (m_tasks[i].func == cb && !m_tasks[i].removed)
+        {
+            *stats = m_tasks[i].stats;
+            res = APP_SCHEDULER_RES_OK;
+            break;
+        }
+    }
+    Sys_exitCriticalSection();
+
+    return res;
+}
+
+uint8_t App_Scheduler_encodeStatsTlv(uint8_t * buffer, uint8_t length)
+{
+    tlv_record rcd;
+    uint8_t value[APP_SCHEDULER_STATS_TLV_LENGTH];
+    tlv_item_t item = {
+        .value = value,
+        .length = APP_SCHEDULER_STATS_TLV_LENGTH,
+    };
+
+    if (!m_initialized)
+    {
+        return 0;
+    }
+
+    Tlv_init(&rcd, buffer, length);
+
+    for (uint8_t i = 0; i < APP_SCHEDULER_ALL_TASKS; i++)
+    {
+        app_scheduler_task_stats_t stats;
+        uint32_t func;
+        uint32_t budget;
+
+        Sys_enterCriticalSection();
+        func = (uint32_t) (uintptr_t) m_tasks[i].func;
+        budget = m_tasks[i].exec_time_us;
+        stats = m_tasks[i].stats;
+        Sys_exitCriticalSection();
+
+        if (func == 0 || stats.runs == 0)
+        {
+            continue;
+        }
+
+        // Saturate 16-bit fields
+        Pack_packLe(&value[0], func, 4);
+        Pack_packLe(&value[4], stats.runs, 4);
+        Pack_packLe(&value[8], stats.min_exec_us > UINT16_MAX ?
+                                    UINT16_MAX : stats.min_exec_us, 2);
+        Pack_packLe(&value[10], stats.avg_exec_us > UINT16_MAX ?
+                                    UINT16_MAX : stats.avg_exec_us, 2);
+        Pack_packLe(&value[12], stats.max_exec_us, 4);
+        Pack_packLe(&value[16], stats.max_late_us, 4);
+        Pack_packLe(&value[20], budget > UINT16_MAX ?
+                                    UINT16_MAX : budget, 2);
+        Pack_packLe(&value[22], stats.overruns > UINT16_MAX ?
+                                    UINT16_MAX : stats.overruns, 2);
+
+        item.type = APP_SCHEDULER_STATS_TLV_TYPE;
+        if (Tlv_Encode_addItem(&rcd, &item) != TLV_RES_OK)
+        {
+            // Buffer full
+            break;
+        }
+    }
+
+    return Tlv_Encode_getBufferSize(&rcd);
+}
+#endif
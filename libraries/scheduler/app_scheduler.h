@@ -41,6 +41,47 @@ typedef uint32_t (*task_cb_f)();
  */
 #define APP_SCHEDULER_SCHEDULE_ASAP (0)
 
+#ifdef APP_SCHEDULER_TASK_STATS
+/**
+ * \brief   Execution statistics of a task, collected when
+ *          APP_SCHEDULER_TASK_STATS is defined (APP_SCHEDULER_STATS=yes in
+ *          application makefile)
+ * \note    Statistics are reset when a task is added, but kept when an
+ *          existing task is updated
+ */
+typedef struct
+{
+    /** Number of executions */
+    uint32_t runs;
+    /** Shortest execution time, in us */
+    uint32_t min_exec_us;
+    /** Average execution time, in us */
+    uint32_t avg_exec_us;
+    /** Longest execution time, in us */
+    uint32_t max_exec_us;
+    /** Maximum delay between planned and real start of execution, in us */
+    uint32_t max_late_us;
+    /** Number of executions longer than requested exec_time_us */
+    uint32_t overruns;
+} app_scheduler_task_stats_t;
+
+/** TLV type of task statistics in \ref App_Scheduler_encodeStatsTlv */
+#define APP_SCHEDULER_STATS_TLV_TYPE    1
+
+/**
+ * \brief   Length of TLV value of task statistics, little endian:
+ *          - task callback address (4 bytes)
+ *          - runs (4 bytes)
+ *          - min execution time in us (2 bytes, saturated)
+ *          - average execution time in us (2 bytes, saturated)
+ *          - max execution time in us (4 bytes)
+ *          - max start lateness in us (4 bytes)
+ *          - requested execution time in us (2 bytes, saturated)
+ *          - budget overruns (2 bytes, saturated)
+ */
+#define APP_SCHEDULER_STATS_TLV_LENGTH  24
+#endif
+
 /**
  * \brief   List of return code
  */
@@ -137,4 +178,32 @@ static inline app_scheduler_res_e App_Scheduler_addTask(task_cb_f cb, uint32_t d
  */
 app_scheduler_res_e App_Scheduler_cancelTask(task_cb_f cb);
 
+#ifdef APP_SCHEDULER_TASK_STATS
+/**
+ * \brief   Get execution statistics of a task
+ * \param   cb
+ *          Callback registered from App_Scheduler_addTask
+ * \param   stats
+ *          Pointer to store the statistics
+ * \return  APP_SCHEDULER_RES_OK, or APP_SCHEDULER_RES_UNKNOWN_TASK if task
+ *          is not registered
+ */
+app_scheduler_res_e App_Scheduler_getTaskStats(task_cb_f cb,
+                                               app_scheduler_task_stats_t * stats);
+
+/**
+ * \brief   Encode statistics of all tasks executed at least once, as a TLV
+ *          diagnostic payload
+ * \param   buffer
+ *          Buffer to encode to
+ * \param   length
+ *          Size of buffer in bytes, tasks not fitting are skipped
+ * \return  Number of bytes written
+ * \note    One item of type \ref APP_SCHEDULER_STATS_TLV_TYPE and length
+ *          \ref APP_SCHEDULER_STATS_TLV_LENGTH per task, task callback
+ *          addresses can be matched with the application map file
+ */
+uint8_t App_Scheduler_encodeStatsTlv(uint8_t * buffer, uint8_t length);
+#endif
+
 #endif //_APP_SCHEDULER_H_
@@ -9,6 +9,7 @@
 #define DEBUG_LOG_MAX_LEVEL LVL_NOLOG
 #include "debug_log.h"
 #include "tlv.h"
+#include "libraries_init.h"
 
 /** Tag that must be present at the beginning of app config */
 #define APP_CONFIG_V1_TLV   0x7EF6
@@ -190,7 +191,7 @@ shared_app_config_res_e Shared_Appconfig_addFilter(
 {
     shared_app_config_res_e res = SHARED_APP_CONFIG_RES_OK;
 
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Appconfig_init))
     {
         return SHARED_APP_CONFIG_RES_UNINITIALIZED;
     }
@@ -255,7 +256,7 @@ shared_app_config_res_e Shared_Appconfig_addFilter(
 
 shared_app_config_res_e Shared_Appconfig_removeFilter(uint16_t filter_id)
 {
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Appconfig_init))
     {
         return SHARED_APP_CONFIG_RES_UNINITIALIZED;
     }
@@ -286,7 +287,7 @@ shared_app_config_res_e Shared_Appconfig_removeFilter(uint16_t filter_id)
 shared_app_config_res_e Shared_Appconfig_setAppConfig(const uint8_t * bytes)
 {
     app_lib_data_app_config_res_e res;
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Appconfig_init))
     {
         return SHARED_APP_CONFIG_RES_UNINITIALIZED;
     }
@@ -319,7 +320,7 @@ shared_app_config_res_e Shared_Appconfig_setAppConfig(const uint8_t * bytes)
 
 shared_app_config_res_e Shared_Appconfig_notifyAppConfig(const uint8_t * bytes)
 {
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Appconfig_init))
     {
         return SHARED_APP_CONFIG_RES_UNINITIALIZED;
     }
@@ -13,12 +13,36 @@
 #include <stdio.h>
 #include <string.h>
 #include "shared_beacon.h"
+#include "app_scheduler.h"
+#include "libraries_init.h"
+
+/** lib_beacon_tx index used to send all shared beacons, one after another */
+#define HW_INDEX                0
+/** No shared beacon loaded in lib_beacon_tx, or no beacon found */
+#define NO_BEACON               0xff
+/** Maximum execution time of the multiplexing task, in us */
+#define MUX_TASK_EXEC_TIME_US   500
+/** Fixed point scale used to sum transmission rates of beacons */
+#define LOAD_SCALE              1024
+
+#ifndef SHARED_BEACON_MIN_SLOT_MS
+/** Shortest slot derived from the common divisor of intervals, in ms.
+ *  Intervals with a smaller common divisor (e.g. 1000 and 1100 ms) are served
+ *  from the nearest slot instead of waking up every few tens of ms */
+#define SHARED_BEACON_MIN_SLOT_MS   250
+#endif
 
 /** Internal structure of a shared beacon */
 typedef struct
 {
     uint16_t                    interval_ms; /* Requested interval in ms */
     bool                        in_use;      /* Is the shared beacon used */
+    int8_t                      power;       /* Rounded power in dBm */
+    app_lib_beacon_tx_channels_mask_e channels; /* Channels for the beacon */
+    uint8_t                     length;      /* Length of content */
+    uint8_t                     content[APP_LIB_BEACON_TX_MAX_NUM_BYTES];
+    uint32_t                    next_tx_ms;  /* Deadline of next transmission */
+    uint32_t                    load_count;  /* Slots the beacon was loaded */
 } shared_beacon_t;
 
 /** check that initialization is done */
@@ -29,8 +53,265 @@ static bool m_beacons_enabled;
  * No need to make it configurable at build time as it will be max 8*3
  */
 static shared_beacon_t m_beacon_index[APP_LIB_BEACON_TX_MAX_INDEX+1];
-/** used common beacon tx sending interval for all enabled beacons */
+/** shortest requested interval */
 static uint32_t m_min_interval_used_ms;
+/** lib_beacon_tx interval: one transmission slot, shared by all beacons */
+static uint32_t m_slot_ms;
+/** Time of current slot, in ms since first beacon started */
+static uint32_t m_now_ms;
+/** Shared beacon currently loaded in lib_beacon_tx */
+static uint8_t m_loaded;
+/** Number of slots where nothing was due and last beacon was kept loaded */
+static uint32_t m_idle_slots;
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/**
+ * @brief   Selects the smallest requested interval among active beacons.
+ * @return  interval in ms
+ */
+static uint32_t smallest_interval(void)
+{
+    uint8_t n;
+    uint32_t interval_ms = APP_LIB_BEACON_TX_MAX_INTERVAL;
+
+    for (n = 0; n <= APP_LIB_BEACON_TX_MAX_INDEX; n++)
+    {
+        if (m_beacon_index[n].in_use &&
+           (m_beacon_index[n].interval_ms < interval_ms))
+        {
+            interval_ms = m_beacon_index[n].interval_ms;
+        }
+    }
+
+    return interval_ms;
+}
+
+/**
+ * @brief   Computes the slot length able to serve all active beacons at their
+ *          own interval.
+ *          Slot is the greatest common divisor of the intervals, divided until
+ *          there is enough slots per period for every beacon. The common
+ *          divisor is raised to \ref SHARED_BEACON_MIN_SLOT_MS (or to the
+ *          shortest interval if smaller), beacons are then sent on the nearest
+ *          slot. Slot is never shorter than \ref APP_LIB_BEACON_TX_MIN_INTERVAL,
+ *          beacons are then sent as early as possible in earliest deadline
+ *          order.
+ * @return  slot length in ms, 0 if no beacon is active
+ */
+static uint32_t slot_interval(void)
+{
+    uint32_t div = 0;
+    uint32_t load = 0;
+    uint32_t slots;
+    uint8_t n;
+
+    for (n = 0; n <= APP_LIB_BEACON_TX_MAX_INDEX; n++)
+    {
+        if (m_beacon_index[n].in_use)
+        {
+            div = gcd(m_beacon_index[n].interval_ms, div);
+        }
+    }
+
+    if (div == 0)
+    {
+        return 0;
+    }
+
+    if (div < SHARED_BEACON_MIN_SLOT_MS)
+    {
+        uint32_t shortest_ms = smallest_interval();
+        div = (shortest_ms < SHARED_BEACON_MIN_SLOT_MS) ?
+              shortest_ms : SHARED_BEACON_MIN_SLOT_MS;
+    }
+
+    /* Number of transmissions needed in div ms, in LOAD_SCALE units */
+    for (n = 0; n <= APP_LIB_BEACON_TX_MAX_INDEX; n++)
+    {
+        if (m_beacon_index[n].in_use)
+        {
+            load += (div * LOAD_SCALE + m_beacon_index[n].interval_ms - 1)
+                    / m_beacon_index[n].interval_ms;
+        }
+    }
+    slots = (load + LOAD_SCALE - 1) / LOAD_SCALE;
+
+    div /= slots;
+    if (div < APP_LIB_BEACON_TX_MIN_INTERVAL)
+    {
+        div = APP_LIB_BEACON_TX_MIN_INTERVAL;
+    }
+    return div;
+}
+
+/**
+ * @brief   Selects the active beacon with the earliest deadline.
+ * @param   due_only
+ *          Only consider beacons due in current slot (half a slot of jitter
+ *          allowed)
+ * @return  Shared beacon index, NO_BEACON if none
+ */
+static uint8_t earliest_beacon(bool due_only)
+{
+    uint8_t next = NO_BEACON;
+    uint8_t n;
+
+    for (n = 0; n <= APP_LIB_BEACON_TX_MAX_INDEX; n++)
+    {
+        shared_beacon_t * beacon = &m_beacon_index[n];
+        if (!beacon->in_use)
+        {
+            continue;
+        }
+
+        if (due_only &&
+            (int32_t)(beacon->next_tx_ms - m_now_ms) > (int32_t)(m_slot_ms / 2))
+        {
+            continue;
+        }
+
+        if (next == NO_BEACON
+            || (int32_t)(beacon->next_tx_ms
+                         - m_beacon_index[next].next_tx_ms) < 0)
+        {
+            next = n;
+        }
+    }
+
+    return next;
+}
+
+/**
+ * @brief   Loads a shared beacon in lib_beacon_tx.
+ * @param   n
+ *          Shared beacon index, or NO_BEACON to stop beacon tx when no
+ *          beacon is active anymore
+ */
+static void load_beacon(uint8_t n)
+{
+    if (n == m_loaded)
+    {
+        return;
+    }
+
+    if (n == NO_BEACON)
+    {
+        lib_beacon_tx->setBeaconContents(HW_INDEX, NULL, 0);
+    }
+    else
+    {
+        shared_beacon_t * beacon = &m_beacon_index[n];
+        lib_beacon_tx->setBeaconPower(HW_INDEX, &beacon->power);
+        lib_beacon_tx->setBeaconChannels(HW_INDEX, beacon->channels);
+        lib_beacon_tx->setBeaconContents(HW_INDEX,
+                                         beacon->content,
+                                         beacon->length);
+    }
+    m_loaded = n;
+}
+
+/**
+ * @brief   Multiplexing task, executed once per slot.
+ *          Loads the beacon with the earliest expired deadline for the next
+ *          transmission. If nothing is due, last beacon is kept loaded, so
+ *          beacon tx is never turned off while a beacon is active.
+ * @note    lib_beacon_tx gives no event on transmission, so the task is not
+ *          phase-locked to its timer: a beacon loaded for a single slot may
+ *          be sent twice or not at all when both drift relative to each
+ *          other. Intervals are best effort, and slots are counted instead
+ *          of transmissions.
+ * @return  delay before next execution, in ms
+ */
+static uint32_t mux_task(void)
+{
+    uint8_t next;
+
+    Sys_enterCriticalSection();
+
+    if (m_slot_ms == 0)
+    {
+        /* All beacons stopped */
+        Sys_exitCriticalSection();
+        return APP_SCHEDULER_STOP_TASK;
+    }
+
+    next = earliest_beacon(true);
+    if (next != NO_BEACON)
+    {
+        shared_beacon_t * beacon = &m_beacon_index[next];
+        beacon->next_tx_ms += beacon->interval_ms;
+        if ((int32_t)(beacon->next_tx_ms - m_now_ms) < 0)
+        {
+            /* Too late for a whole period, do not send bursts to catch up */
+            beacon->next_tx_ms = m_now_ms + beacon->interval_ms;
+        }
+    }
+    else if (m_loaded != NO_BEACON)
+    {
+        /* Nothing due: sending last beacon again is better than a gap */
+        next = m_loaded;
+        m_idle_slots++;
+    }
+    else
+    {
+        /* Loaded beacon stopped or power changed: load earliest one */
+        next = earliest_beacon(false);
+        m_idle_slots++;
+    }
+
+    load_beacon(next);
+    if (m_loaded != NO_BEACON)
+    {
+        m_beacon_index[m_loaded].load_count++;
+    }
+    m_now_ms += m_slot_ms;
+
+    Sys_exitCriticalSection();
+    return m_slot_ms;
+}
+
+/**
+ * @brief   Updates slot length and multiplexing task after a beacon is started
+ *          or stopped. Must be called in critical section.
+ */
+static void update_schedule(void)
+{
+    uint32_t slot_ms = slot_interval();
+
+    m_min_interval_used_ms = smallest_interval();
+
+    if (slot_ms != 0 && slot_ms != m_slot_ms)
+    {
+        lib_beacon_tx->setBeaconInterval(slot_ms);
+    }
+    m_slot_ms = slot_ms;
+
+    if (slot_ms == 0)
+    {
+        load_beacon(NO_BEACON);
+        App_Scheduler_cancelTask(mux_task);
+    }
+    else
+    {
+        /* Restart slots from now, updating task if already running */
+        App_Scheduler_addTask_execTime(mux_task,
+                                       APP_SCHEDULER_SCHEDULE_ASAP,
+                                       MUX_TASK_EXEC_TIME_US);
+    }
+
+    LOG(LVL_INFO, "Shared_Beacon slot ms: %u, shortest interval ms: %u\n",
+        m_slot_ms, m_min_interval_used_ms);
+}
 
 shared_beacon_res_e Shared_Beacon_init(void)
 {
@@ -44,6 +325,10 @@ shared_beacon_res_e Shared_Beacon_init(void)
     m_init_done = true;
     m_beacons_enabled = false;
     m_min_interval_used_ms = APP_LIB_BEACON_TX_MAX_INTERVAL;
+    m_slot_ms = 0;
+    m_now_ms = 0;
+    m_loaded = NO_BEACON;
+    m_idle_slots = 0;
     /** clearBeacon returns always APP_RES_OK */
     lib_beacon_tx->clearBeacons();
     return SHARED_BEACON_RES_OK;
@@ -59,14 +344,26 @@ shared_beacon_res_e Shared_Beacon_startBeacon(uint16_t interval_ms,
 {
     bool found = false;
     uint8_t n;
+    uint8_t loaded;
     app_res_e res = APP_RES_OK;
+    shared_beacon_t * beacon;
 
-    if (!m_init_done)
+    if (!LIBRARIES_INIT_ON_USE(m_init_done, Shared_Beacon_init))
     {
         LOG(LVL_ERROR, "Shared_Beacon_startBeacon error !m_init_done \n");
         return SHARED_BEACON_INIT_NOT_DONE;
     }
 
+    if (interval_ms < APP_LIB_BEACON_TX_MIN_INTERVAL
+        || interval_ms > APP_LIB_BEACON_TX_MAX_INTERVAL
+        || channels_mask > APP_LIB_BEACON_TX_CHANNELS_ALL
+        || content == NULL || length == 0
+        || length > APP_LIB_BEACON_TX_MAX_NUM_BYTES)
+    {
+        LOG(LVL_ERROR, "Shared_Beacon_startBeacon error wrong parameter\n");
+        return SHARED_BEACON_INVALID_PARAM;
+    }
+
     Sys_enterCriticalSection();
 
     for (n = 0; n <= APP_LIB_BEACON_TX_MAX_INDEX; n++)
@@ -74,7 +371,6 @@ shared_beacon_res_e Shared_Beacon_startBeacon(uint16_t interval_ms,
         if (!m_beacon_index[n].in_use)
         {
             found = true;
-            m_beacon_index[n].in_use = true;
             break;
         }
     }
@@ -86,70 +382,51 @@ shared_beacon_res_e Shared_Beacon_startBeacon(uint16_t interval_ms,
         return SHARED_BEACON_INDEX_NOT_AVAILABLE;
     }
 
-    res |= lib_beacon_tx->setBeaconPower(n, power);
-    res |= lib_beacon_tx->setBeaconChannels(n, channels_mask);
-    res |= lib_beacon_tx->setBeaconContents(n, content, length);
+    /** Power is rounded by lib_beacon_tx, loaded beacon is reloaded right
+     *  after to restore its own power
+     */
+    loaded = m_loaded;
+    res = lib_beacon_tx->setBeaconPower(HW_INDEX, power);
+    m_loaded = NO_BEACON;
+    load_beacon(loaded);
 
     if (res != APP_RES_OK)
     {
         LOG(LVL_ERROR, "Shared_Beacon_startBeacon-lib_beacon_tx error: %d\n",
             res);
-        m_beacon_index[n].in_use = false;
         Sys_exitCriticalSection();
         return SHARED_BEACON_INVALID_PARAM;
     }
 
-   /** If multiple beacon tx instances - there is selected shortest interval */
-    if (interval_ms < m_min_interval_used_ms)
-    {
-        m_min_interval_used_ms = interval_ms;
-    }
-
-    /** Save requested interval for later check if beacons are stopped */
-    m_beacon_index[n].interval_ms = interval_ms;
+    beacon = &m_beacon_index[n];
+    memset(beacon, 0, sizeof(shared_beacon_t));
+    beacon->in_use = true;
+    beacon->interval_ms = interval_ms;
+    beacon->power = *power;
+    beacon->channels = channels_mask;
+    beacon->length = length;
+    memcpy(beacon->content, content, length);
+    /** Sent on first free slot */
+    beacon->next_tx_ms = m_now_ms;
 
-    res |=
-        lib_beacon_tx->setBeaconInterval(m_min_interval_used_ms);
+    update_schedule();
     *shared_beacon_index = n;
 
     if (!m_beacons_enabled)
     {
         m_beacons_enabled = true;
-        res |= lib_beacon_tx->enableBeacons(true);
+        lib_beacon_tx->enableBeacons(true);
     }
 
     LOG(LVL_INFO, "Shared_Beacon_startBeacon, interval ms: %d, index %d\n",
-        m_min_interval_used_ms, n);
+        interval_ms, n);
     Sys_exitCriticalSection();
     return SHARED_BEACON_RES_OK;
 }
 
-/**
- * @brief   Selects the smallest requested interval among active beacons.
- * @return  interval in ms
- */
-static uint32_t smallest_interval(void)
-{
-    uint8_t n;
-    uint32_t interval_ms = APP_LIB_BEACON_TX_MAX_INTERVAL;
-
-    for (n = 0; n <= APP_LIB_BEACON_TX_MAX_INDEX; n++)
-    {
-        if (m_beacon_index[n].in_use &&
-           (m_beacon_index[n].interval_ms < interval_ms))
-        {
-            interval_ms = m_beacon_index[n].interval_ms;
-        }
-    }
-
-    return interval_ms;
-}
-
 shared_beacon_res_e Shared_Beacon_stopBeacon(uint8_t shared_beacon_index)
 {
-    app_res_e res;
-
-    if (!m_init_done)
+    if (!LIBRARIES_INIT_ON_USE(m_init_done, Shared_Beacon_init))
     {
         LOG(LVL_ERROR, "Shared_Beacon_stopBeacon - init not done");
         return SHARED_BEACON_INIT_NOT_DONE;
@@ -170,30 +447,60 @@ shared_beacon_res_e Shared_Beacon_stopBeacon(uint8_t shared_beacon_index)
         return SHARED_BEACON_INDEX_NOT_AVAILABLE;
     }
 
-    /** Writing NULL, 0 to index disables beacon tx for that given index as
-     *  no lib_beacon_tx interface to disable specially only one instance
-     *  if multiple instances configured
-     */
     LOG(LVL_INFO, "Shared_Beacon_stopBeacon, shared_beacontx_index: %d\n",
             shared_beacon_index);
-    res =
-        lib_beacon_tx->setBeaconContents(shared_beacon_index, NULL, 0);
     m_beacon_index[shared_beacon_index].in_use = false;
 
-    /** Selects new interval from active beacons  */
-    m_min_interval_used_ms = smallest_interval();
-    lib_beacon_tx->setBeaconInterval(m_min_interval_used_ms);
-    LOG(LVL_INFO, "Shared_Beacon_stopBeacon, m_min_interval_used_ms: %u\n",
-            m_min_interval_used_ms);
+    /** Replace stopped beacon with the next one, or disable beacon tx with
+     *  NULL, 0 if it was the last one
+     */
+    if (m_loaded == shared_beacon_index)
+    {
+        m_loaded = NO_BEACON;
+        load_beacon(earliest_beacon(false));
+        if (m_loaded == NO_BEACON)
+        {
+            lib_beacon_tx->setBeaconContents(HW_INDEX, NULL, 0);
+        }
+    }
+
+    /** Selects new slot from active beacons  */
+    update_schedule();
 
     Sys_exitCriticalSection();
 
-    if (res != APP_RES_OK)
+    return SHARED_BEACON_RES_OK;
+}
+
+shared_beacon_res_e Shared_Beacon_getStats(uint8_t shared_beacon_index,
+                                           shared_beacon_stats_t * stats)
+{
+    shared_beacon_t * beacon;
+
+    if (!LIBRARIES_INIT_ON_USE(m_init_done, Shared_Beacon_init))
     {
-        LOG(LVL_ERROR, "Shared_Beacon_stopBeacon - error index: %d\n",
-            shared_beacon_index);
+        return SHARED_BEACON_INIT_NOT_DONE;
+    }
+
+    if (shared_beacon_index > APP_LIB_BEACON_TX_MAX_INDEX || stats == NULL)
+    {
+        return SHARED_BEACON_INVALID_PARAM;
+    }
+
+    Sys_enterCriticalSection();
+
+    beacon = &m_beacon_index[shared_beacon_index];
+    if (!beacon->in_use)
+    {
+        Sys_exitCriticalSection();
         return SHARED_BEACON_INDEX_NOT_ACTIVE;
     }
 
+    stats->load_count = beacon->load_count;
+    stats->slot_ms = m_slot_ms;
+    stats->idle_slots = m_idle_slots;
+
+    Sys_exitCriticalSection();
+
     return SHARED_BEACON_RES_OK;
 }
@@ -26,6 +26,23 @@ typedef enum
     SHARED_BEACON_INVALID_PARAM = 4,
 } shared_beacon_res_e;
 
+/**
+ * \brief   Transmission statistics of a shared beacon
+ */
+typedef struct
+{
+    /** Number of slots the beacon was loaded in lib_beacon_tx, idle slots
+     *  where it stayed loaded included. lib_beacon_tx sends once per slot,
+     *  so it is the expected number of transmissions, but transmissions
+     *  themselves are not reported by lib_beacon_tx */
+    uint32_t load_count;
+    /** Current transmission slot shared by all beacons, in ms */
+    uint32_t slot_ms;
+    /** Number of slots without any beacon due, all beacons included. Last
+     *  beacon loaded is sent again in these slots */
+    uint32_t idle_slots;
+} shared_beacon_stats_t;
+
 /**
  * @brief   Initialize the Shared_Beacon library.
  * @note    If Shared_Beacon library is used in application, functions offered
@@ -37,9 +54,19 @@ shared_beacon_res_e Shared_Beacon_init(void);
 /**
  * @brief   Starts sending of beacon content defined in the parameters.
  *          There is possibility to start multiple beacons after another beacons
- *          started. The limitation is that there cannot be set individual beacon
- *          sending interval for each beacons. The smallest interval defined
- *          for beacons is selected as common interval for all beacons.
+ *          started. Each beacon is sent at its own interval: beacons are
+ *          multiplexed on a single lib_beacon_tx index, with a common
+ *          transmission slot shorter or equal to all intervals. A scheduler
+ *          task loads the content, power and channels of the beacon due in
+ *          each slot. In slots where no beacon is due, the last beacon is
+ *          sent again, so beacon tx is never off while a beacon is active.
+ * @note    Intervals are best effort: the task is not synchronized with the
+ *          lib_beacon_tx timer, and a beacon may be sent up to half a slot
+ *          early or late. When intervals have a small common divisor, slot is
+ *          kept at least SHARED_BEACON_MIN_SLOT_MS long and beacons are sent
+ *          on the nearest slot. If beacons need more slots than available
+ *          with the minimum interval of lib_beacon_tx, they are sent in
+ *          earliest deadline order.
  * @param   interval_ms
  *          beacon sending interval in ms
  * @param   power
@@ -54,6 +81,8 @@ shared_beacon_res_e Shared_Beacon_init(void);
  *          returns index which is used when Shared_Beacon_stopBeacon used,
  *          used indexes: (0 .. \ref APP_LIB_BEACONTX_MAX_INDEX)
  * @return  \ref shared_beacon_res_e.
+ *          \ref SHARED_BEACON_INVALID_PARAM if interval, channels or length
+ *          are out of range of lib_beacon_tx
  */
 shared_beacon_res_e Shared_Beacon_startBeacon(uint16_t interval_ms,
                                               int8_t * power,
@@ -64,13 +93,25 @@ shared_beacon_res_e Shared_Beacon_startBeacon(uint16_t interval_ms,
                                               uint8_t * shared_beacon_index);
 
 /**
- * @brief   Stops beacon with the given index. Shared beacon used interval is
- *          checked and selected smaller interval from active beacons after
- *          shared_beacon_index is set as not active.
+ * @brief   Stops beacon with the given index. Transmission slot is
+ *          recomputed from the intervals of the remaining active beacons.
  * @param   shared_beacon_index
  *          The index received in Shared_Beacon_startBeacon
  * @return  \ref shared_beacon_res_e.
  */
 shared_beacon_res_e Shared_Beacon_stopBeacon(uint8_t shared_beacon_index);
 
+/**
+ * @brief   Gets transmission statistics of an active beacon.
+ * @param   shared_beacon_index
+ *          The index received in Shared_Beacon_startBeacon
+ * @param   stats
+ *          Pointer to store the statistics
+ * @return  \ref shared_beacon_res_e.
+ *          \ref SHARED_BEACON_INDEX_NOT_ACTIVE if beacon is not started
+ * @note    Statistics are reset when the beacon is started.
+ */
+shared_beacon_res_e Shared_Beacon_getStats(uint8_t shared_beacon_index,
+                                           shared_beacon_stats_t * stats);
+
 #endif //_SHARED_BEACON_H_
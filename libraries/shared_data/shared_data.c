@@ -8,6 +8,15 @@
 #define DEBUG_LOG_MODULE_NAME "SHARED D"
 #define DEBUG_LOG_MAX_LEVEL LVL_NOLOG
 #include "debug_log.h"
+#include "libraries_init.h"
+
+#if __has_include("app_heap.h") && !defined(LIBRARIES_LAZY_INIT)
+/* App heap library is enabled: tracked packet table is allocated from it.
+ * Not with lazy initialization, as first use may come after App_init(),
+ * once heap is sealed: static table is then used. */
+#include "app_heap.h"
+#define TRACKED_PACKETS_FROM_HEAP
+#endif
 
 /** Some helpers macros for packet filtering. */
 #define IS_UNICAST(mode) (mode == SHARED_DATA_NET_MODE_UNICAST)
@@ -32,6 +41,16 @@
 #define SHARED_DATA_MAX_TRACKED_PACKET 16
 #endif
 
+/** Number of multicast groups whose membership is cached, power of two. */
+#ifndef SHARED_DATA_GROUP_CACHE_SIZE
+#define SHARED_DATA_GROUP_CACHE_SIZE 16
+#endif
+
+/** Cached membership: group address, with this bit set if not member
+ *  (multicast addresses always have it cleared). 0 is a free entry.
+ */
+#define GROUP_CACHE_NOT_MEMBER_BIT 0x40000000
+
 /** Head of data callbacks / filters linked list. */
 static sl_list_head_t m_shared_data_head;
 
@@ -45,13 +64,60 @@ typedef struct {
 } tracked_packet_item_t;
 
 /** Callbacks for packets being tracked. */
+#ifdef TRACKED_PACKETS_FROM_HEAP
+static tracked_packet_item_t * m_tracked_packets;
+#else
 static tracked_packet_item_t m_tracked_packets[SHARED_DATA_MAX_TRACKED_PACKET];
+#endif
+
+/** Number of packets that can be tracked at the same time. */
+static size_t m_num_tracked_packets;
 
 /**
  * Is library initialized
  */
 static bool m_initialized = false;
 
+/** Membership of all registered items for recently queried groups, as an
+ *  open addressing hash table with linear probing.
+ */
+static app_addr_t m_group_cache[SHARED_DATA_GROUP_CACHE_SIZE];
+
+/** Number of used entries in m_group_cache. */
+static uint8_t m_group_cache_count;
+
+/**
+ * @brief   Forget all cached group memberships.
+ */
+static void clear_group_cache(void)
+{
+    lib_system->enterCriticalSection();
+    memset(m_group_cache, 0, sizeof(m_group_cache));
+    m_group_cache_count = 0;
+    lib_system->exitCriticalSection();
+}
+
+/**
+ * @brief   Find group in membership cache.
+ * @param   group_addr
+ *          Group address.
+ * @return  Index of group entry, or of free entry where to add it.
+ */
+static uint8_t find_group_entry(app_addr_t group_addr)
+{
+    /* Fibonacci hashing of group address. */
+    uint8_t idx = (uint8_t)((group_addr * 2654435761u) >> 24) &
+                                        (SHARED_DATA_GROUP_CACHE_SIZE - 1);
+
+    while (m_group_cache[idx] != 0 &&
+           (m_group_cache[idx] & ~GROUP_CACHE_NOT_MEMBER_BIT) != group_addr)
+    {
+        idx = (idx + 1) & (SHARED_DATA_GROUP_CACHE_SIZE - 1);
+    }
+
+    return idx;
+}
+
 
 /**
  * @brief   Delete marked items from linked list.
@@ -180,13 +246,12 @@ static bool filter_received_packet(const shared_data_filter_t * filter,
 
 /**
  * @brief   Determine if the received packet belong to at least one of the
- *          multicast group of the registered filters.
- * @note    Limitation : The multicast_cb will be called again in received_cb().
+ *          multicast group of the registered filters, without cache.
  * @param   group_addr
  *          Group address.
  * @return  True if one of the filter belong to the group. False otherwise.
  */
-static bool group_query_cb(app_addr_t group_addr)
+static bool is_group_member(app_addr_t group_addr)
 {
     shared_data_item_t * item;
     sl_list_t * i = sl_list_begin((sl_list_t *)&m_shared_data_head);
@@ -219,6 +284,47 @@ static bool group_query_cb(app_addr_t group_addr)
     return false;
 }
 
+/**
+ * @brief   Determine if the received packet belong to at least one of the
+ *          multicast group of the registered filters.
+ *          Answer is cached, so that registered multicast_cb are only called
+ *          again for this group after items or groups change.
+ * @note    Limitation : The multicast_cb will be called again in received_cb().
+ * @param   group_addr
+ *          Group address.
+ * @return  True if one of the filter belong to the group. False otherwise.
+ */
+static bool group_query_cb(app_addr_t group_addr)
+{
+    uint8_t idx;
+    bool member;
+
+    if (!IS_MULTICAST_ADDRESS(group_addr))
+    {
+        return is_group_member(group_addr);
+    }
+
+    idx = find_group_entry(group_addr);
+    if (m_group_cache[idx] != 0)
+    {
+        return (m_group_cache[idx] & GROUP_CACHE_NOT_MEMBER_BIT) == 0;
+    }
+
+    member = is_group_member(group_addr);
+
+    /* Keep table at most 3/4 full so that probing stays short. */
+    if (m_group_cache_count >= SHARED_DATA_GROUP_CACHE_SIZE * 3 / 4)
+    {
+        clear_group_cache();
+        idx = find_group_entry(group_addr);
+    }
+    m_group_cache[idx] = member ? group_addr :
+                                  group_addr | GROUP_CACHE_NOT_MEMBER_BIT;
+    m_group_cache_count++;
+
+    return member;
+}
+
 static app_lib_data_receive_res_e received_cb(
                                         const app_lib_data_received_t * data)
 {
@@ -300,12 +406,32 @@ app_res_e Shared_Data_init(void)
         return APP_RES_OK;
     }
 
-    sl_list_init(&m_shared_data_head);
-
-    m_iterating_list = false;
+#ifdef TRACKED_PACKETS_FROM_HEAP
+    /* Stack cannot buffer more tracked packets than this */
+    m_num_tracked_packets = lib_data->getNumBuffers();
+    if (m_num_tracked_packets > SHARED_DATA_MAX_TRACKED_PACKET)
+    {
+        m_num_tracked_packets = SHARED_DATA_MAX_TRACKED_PACKET;
+    }
 
+    /* Zeroed by App_Heap_alloc(), only possible during initialization */
+    m_tracked_packets = App_Heap_alloc(sizeof(tracked_packet_item_t) *
+                                       m_num_tracked_packets);
+    if (m_tracked_packets == NULL)
+    {
+        return APP_RES_RESOURCE_UNAVAILABLE;
+    }
+#else
+    m_num_tracked_packets = SHARED_DATA_MAX_TRACKED_PACKET;
     memset(m_tracked_packets, 0, sizeof(tracked_packet_item_t) *
                                  SHARED_DATA_MAX_TRACKED_PACKET);
+#endif
+
+    sl_list_init(&m_shared_data_head);
+
+    clear_group_cache();
+
+    m_iterating_list = false;
 
     /* Set callback for received unicast and broadcast messages. */
     lib_data->setDataReceivedCb(received_cb);
@@ -323,7 +449,7 @@ app_res_e Shared_Data_init(void)
 
 app_res_e Shared_Data_addDataReceivedCb(shared_data_item_t * item)
 {
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Data_init))
     {
         // It should be a different error code but
         // app_res_e doesn't have UNINITIALIZED error code
@@ -363,6 +489,9 @@ app_res_e Shared_Data_addDataReceivedCb(shared_data_item_t * item)
     }
     lib_system->exitCriticalSection();
 
+    /* New filter may be member of more groups. */
+    clear_group_cache();
+
     item->reserved3 = false;
     LOG(LVL_DEBUG, "Add Rx cb (ep: %d -> %d, m: %u)",
                    item->filter.src_endpoint,
@@ -406,6 +535,7 @@ void Shared_Data_removeDataReceivedCb(shared_data_item_t * item)
             memset(item, 0, sizeof(shared_data_item_t));
         }
         lib_system->exitCriticalSection();
+        clear_group_cache();
     }
     else
     {
@@ -413,13 +543,19 @@ void Shared_Data_removeDataReceivedCb(shared_data_item_t * item)
     }
 }
 
+void Shared_Data_groupsChanged(void)
+{
+    LOG(LVL_DEBUG, "Groups changed");
+    clear_group_cache();
+}
+
 app_lib_data_send_res_e Shared_Data_sendData(
                                         app_lib_data_to_send_t * data,
                                         app_lib_data_data_sent_cb_f sent_cb)
 {
     app_lib_data_send_res_e res;
 
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Data_init))
     {
         return APP_LIB_DATA_SEND_RES_UNINITIALIZED;
     }
@@ -433,7 +569,7 @@ app_lib_data_send_res_e Shared_Data_sendData(
     else
     {
         int free_slot = -1;
-        for (int i = 0; i < SHARED_DATA_MAX_TRACKED_PACKET; i++)
+        for (int i = 0; i < (int) m_num_tracked_packets; i++)
         {
             /* Find the first available tracking Id. */
             if (m_tracked_packets[i].cb == NULL)
@@ -20,6 +20,13 @@
  * SHARED_DATA_MAX_TRACKED_PACKET defines the maximum number of sent packets
  * that can be tracked at the same time. It defaults to 16. It can be redefined
  * in the application makefile with the drawback of using more RAM.
+ *
+ * If app_heap library is enabled, the table of tracked packets is allocated
+ * from it instead, with one entry per tracked buffer of the stack
+ * (lib_data->getNumBuffers()), up to SHARED_DATA_MAX_TRACKED_PACKET. The
+ * library must then be initialized before App_init() returns, which
+ * Libraries_init() does. With LIBRARIES_LAZY_INIT, first use may come later,
+ * so the static table is used instead.
  */
 
 #ifndef _SHARED_DATA_H_
@@ -67,6 +74,8 @@ typedef struct
      *  Otherwise @ref Shared_Data_addDataReceivedCb return
      *  @ref APP_RES_INVALID_VALUE. This callback can be called two times for
      *  each received multicastpacket so its execution time must be kept short.
+     *  Answers are cached: if the groups accepted by this callback change,
+     *  @ref Shared_Data_groupsChanged must be called.
      */
     app_lib_settings_is_group_cb_f multicast_cb;
 } shared_data_filter_t;
@@ -165,6 +174,19 @@ app_res_e Shared_Data_readyToReceive(shared_data_item_t * item);
  */
 void Shared_Data_removeDataReceivedCb(shared_data_item_t * item);
 
+/**
+ * @brief   Tell that the answer of a multicast_cb may have changed.
+ *          Shared_Data caches the membership of all registered items for
+ *          each queried group, so that the stack group queries do not call
+ *          every multicast_cb each time. Adding or removing an item clears
+ *          the cache automatically.
+ * @note    Any application or library whose multicast_cb answer changes
+ *          while its item is registered, e.g. when its list of groups is
+ *          modified, must call this function. Otherwise the stack keeps
+ *          getting the previous answer for groups already queried.
+ */
+void Shared_Data_groupsChanged(void);
+
 /**
  * @brief   Send data. The packet to send is represented as a
  *          @ref app_lib_data_to_send_t struct.
@@ -10,67 +10,291 @@
 #define DEBUG_LOG_MAX_LEVEL LVL_NOLOG
 #endif
 #include "debug_log.h"
+#include <string.h>
 #include "shared_neighbors.h"
+#include "libraries_init.h"
+#ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+#include "app_scheduler.h"
+#endif
+
+#ifndef SHARED_NEIGHBORS_SLOW_CB_US
+/** Callbacks running longer than this are reported as slow consumers */
+#define SHARED_NEIGHBORS_SLOW_CB_US     500
+#endif
 
 /** Internal structure of a callback for state library network beacon cb */
 typedef struct
 {
     /** Function is called when stack neighbor scan is stopped */
     app_lib_state_on_beacon_cb_f     cb_beacon;
+    /** Is the callback called from the deferred beacon task */
+    bool                             deferred;
 } beacon_cb_t;
 
-/**  List of callbacks */
-static beacon_cb_t m_neighbor_cb[SHARED_NEIGHBORS_MAX_CB];
+/**
+ * Lists of callbacks: one is published to beacon reception and never modified
+ * while published, the other one is used to prepare the next list.
+ * Lists are only modified in critical section, by copying the published list,
+ * modifying the copy and publishing it.
+ *
+ * Beacon reception reads the lists without critical section, and may be
+ * preempted by several publishes: the list it reads may then be unpublished
+ * and modified. Invariant: a list is only modified after a publish that
+ * unpublished it, and every publish increments the generation. So each entry
+ * is read from the published list between two reads of the generation, and
+ * read again if generation changed. Callbacks themselves are called outside
+ * of this loop, so a callback removed while reception is ongoing may still
+ * be called once.
+ */
+static beacon_cb_t m_neighbor_cb[2][SHARED_NEIGHBORS_MAX_CB];
+/** Index of the published list of callbacks */
+static volatile uint8_t m_published;
+/** Incremented each time a new list of callbacks is published */
+static volatile uint32_t m_generation;
+
+/** Is library initialized */
+static bool m_initialized = false;
 
-static void received_beacon_cb(const app_lib_state_beacon_rx_t * beacon)
+/** Execution statistics, per callback id */
+static shared_neighbors_cb_stats_t m_cb_stats[SHARED_NEIGHBORS_MAX_CB];
+
+#ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+
+/** Size of deferred beacon ring, must be a power of 2 */
+#define DEFERRED_RING_SIZE      SHARED_NEIGHBORS_DEFERRED_BEACONS
+#if (DEFERRED_RING_SIZE & (DEFERRED_RING_SIZE - 1)) != 0 \
+    || DEFERRED_RING_SIZE > 128
+#error SHARED_NEIGHBORS_DEFERRED_BEACONS must be a power of 2, max 128
+#endif
+
+/** Maximum execution time of deferred beacon task, in us */
+#define DEFERRED_TASK_EXEC_TIME_US      500
+
+/** Ring of beacons waiting for deferred callbacks. Only written from beacon
+ *  reception and only read from deferred task, so free-running indexes are
+ *  enough to share it without critical section */
+static app_lib_state_beacon_rx_t m_deferred_ring[DEFERRED_RING_SIZE];
+static volatile uint8_t m_deferred_head;
+static volatile uint8_t m_deferred_tail;
+/** Number of beacons dropped because ring was full */
+static uint32_t m_deferred_dropped;
+/** Number of deferred callbacks registered */
+static uint8_t m_deferred_cbs;
+
+#endif
+
+/**
+ * @brief   Calls a callback and updates its execution statistics.
+ * @param   id
+ *          Callback id
+ * @param   cb
+ *          Callback to call
+ * @param   beacon
+ *          Received beacon
+ */
+static void call_cb(uint8_t id,
+                    app_lib_state_on_beacon_cb_f cb,
+                    const app_lib_state_beacon_rx_t * beacon)
+{
+    app_lib_time_timestamp_hp_t start = lib_time->getTimestampHp();
+    uint32_t exec_us;
+
+    cb(beacon);
+
+    exec_us = lib_time->getTimeDiffUs(lib_time->getTimestampHp(), start);
+    m_cb_stats[id].calls++;
+    if (exec_us > m_cb_stats[id].max_exec_us)
+    {
+        m_cb_stats[id].max_exec_us = exec_us;
+    }
+    if (exec_us > SHARED_NEIGHBORS_SLOW_CB_US)
+    {
+        m_cb_stats[id].slow_calls++;
+        LOG(LVL_WARNING, "Slow beacon cb (id: %d): %u us", id, exec_us);
+    }
+}
+
+/**
+ * @brief   Calls all callbacks of a given kind from the published list.
+ * @param   deferred
+ *          Call deferred callbacks, or direct ones
+ * @param   beacon
+ *          Received beacon
+ */
+static void call_cbs(bool deferred, const app_lib_state_beacon_rx_t * beacon)
 {
-    Sys_enterCriticalSection();
     for (uint8_t i = 0; i < SHARED_NEIGHBORS_MAX_CB; i++)
     {
-        if (m_neighbor_cb[i].cb_beacon)
+        app_lib_state_on_beacon_cb_f cb;
+        bool cb_deferred;
+        uint32_t generation;
+
+        /* Read entry again if lists changed while reading it */
+        do
+        {
+            const volatile beacon_cb_t * entry;
+
+            generation = m_generation;
+            entry = &m_neighbor_cb[m_published][i];
+            cb = entry->cb_beacon;
+            cb_deferred = entry->deferred;
+        } while (generation != m_generation);
+
+        if (cb == NULL || cb_deferred != deferred)
+        {
+            continue;
+        }
+
+        call_cb(i, cb, beacon);
+        LOG(LVL_DEBUG, "received_beacon_cb (id: %d)", i);
+    }
+}
+
+#ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+static uint32_t deferred_task(void)
+{
+    /* Calls are limited per run, to let other tasks run */
+    for (uint8_t n = 0; n < DEFERRED_RING_SIZE; n++)
+    {
+        uint8_t tail = m_deferred_tail;
+
+        if (tail == m_deferred_head)
         {
-            m_neighbor_cb[i].cb_beacon(beacon);
-            LOG(LVL_DEBUG, "received_beacon_cb (id: %d)", i);
+            return APP_SCHEDULER_STOP_TASK;
         }
+
+        call_cbs(true, &m_deferred_ring[tail & (DEFERRED_RING_SIZE - 1)]);
+        m_deferred_tail = tail + 1;
     }
-    Sys_exitCriticalSection();
+
+    return APP_SCHEDULER_SCHEDULE_ASAP;
+}
+
+/**
+ * @brief   Copies a beacon in deferred ring and wakes up deferred task.
+ * @param   beacon
+ *          Received beacon
+ */
+static void defer_beacon(const app_lib_state_beacon_rx_t * beacon)
+{
+    uint8_t head = m_deferred_head;
+
+    if ((uint8_t)(head - m_deferred_tail) >= DEFERRED_RING_SIZE)
+    {
+        m_deferred_dropped++;
+        return;
+    }
+
+    m_deferred_ring[head & (DEFERRED_RING_SIZE - 1)] = *beacon;
+    m_deferred_head = head + 1;
+
+    App_Scheduler_addTask_execTime(deferred_task,
+                                   APP_SCHEDULER_SCHEDULE_ASAP,
+                                   DEFERRED_TASK_EXEC_TIME_US);
+}
+#endif
+
+static void received_beacon_cb(const app_lib_state_beacon_rx_t * beacon)
+{
+    call_cbs(false, beacon);
+
+#ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+    if (m_deferred_cbs > 0)
+    {
+        defer_beacon(beacon);
+    }
+#endif
+}
+
+/**
+ * @brief   Prepares a copy of the published list of callbacks.
+ *          Must be called in critical section.
+ * @return  Copy to modify, published with @ref publish_cbs
+ */
+static beacon_cb_t * prepare_cbs(void)
+{
+    beacon_cb_t * next = m_neighbor_cb[m_published ^ 1];
+
+    memcpy(next, m_neighbor_cb[m_published], sizeof(m_neighbor_cb[0]));
+    return next;
+}
+
+/**
+ * @brief   Publishes list prepared with @ref prepare_cbs.
+ *          Must be called in critical section.
+ */
+static void publish_cbs(void)
+{
+    m_published ^= 1;
+    m_generation++;
 }
 
 app_res_e Shared_Neighbors_init(void)
 {
-    for (uint8_t i = 0; i < SHARED_NEIGHBORS_MAX_CB; i++)
+    if (m_initialized)
     {
-        m_neighbor_cb[i].cb_beacon = NULL;
+        // Library already initialized
+        return APP_RES_OK;
     }
 
+    memset(m_neighbor_cb, 0, sizeof(m_neighbor_cb));
+    memset(m_cb_stats, 0, sizeof(m_cb_stats));
+    m_published = 0;
+    m_generation = 0;
+
+#ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+    m_deferred_head = 0;
+    m_deferred_tail = 0;
+    m_deferred_dropped = 0;
+    m_deferred_cbs = 0;
+#endif
+
+    m_initialized = true;
     return APP_RES_OK;
 }
 
-app_res_e Shared_Neighbors_addOnBeaconCb(app_lib_state_on_beacon_cb_f cb_beacon,
-                                         uint16_t * cb_id)
+/**
+ * @brief   Adds a callback, direct or deferred.
+ */
+static app_res_e add_cb(app_lib_state_on_beacon_cb_f cb_beacon,
+                        bool deferred,
+                        uint16_t * cb_id)
 {
     app_res_e res = APP_RES_RESOURCE_UNAVAILABLE;
+    beacon_cb_t * cbs;
 
     if (cb_beacon == NULL)
     {
         return APP_RES_INVALID_NULL_POINTER;
     }
 
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Neighbors_init))
+    {
+        return APP_RES_INVALID_CONFIGURATION;
+    }
+
     lib_state->setOnBeaconCb(received_beacon_cb);
 
     Sys_enterCriticalSection();
+    cbs = prepare_cbs();
     for (uint8_t i = 0; i < SHARED_NEIGHBORS_MAX_CB; i++)
     {
-        if (!m_neighbor_cb[i].cb_beacon)
+        if (!cbs[i].cb_beacon)
         {
             /* One callback found */
-            m_neighbor_cb[i].cb_beacon = cb_beacon;
+            cbs[i].cb_beacon = cb_beacon;
+            cbs[i].deferred = deferred;
+            memset(&m_cb_stats[i], 0, sizeof(m_cb_stats[i]));
             /* Set the id */
             *cb_id = i;
             res = APP_RES_OK;
             break;
         }
     }
+    if (res == APP_RES_OK)
+    {
+        publish_cbs();
+    }
     Sys_exitCriticalSection();
 
     if (res == APP_RES_OK)
@@ -86,18 +310,56 @@ app_res_e Shared_Neighbors_addOnBeaconCb(app_lib_state_on_beacon_cb_f cb_beacon,
     return res;
 }
 
+app_res_e Shared_Neighbors_addOnBeaconCb(app_lib_state_on_beacon_cb_f cb_beacon,
+                                         uint16_t * cb_id)
+{
+    return add_cb(cb_beacon, false, cb_id);
+}
+
+#ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+app_res_e Shared_Neighbors_addOnBeaconCbDeferred(
+                                    app_lib_state_on_beacon_cb_f cb_beacon,
+                                    uint16_t * cb_id)
+{
+    app_res_e res = add_cb(cb_beacon, true, cb_id);
+
+    if (res == APP_RES_OK)
+    {
+        Sys_enterCriticalSection();
+        m_deferred_cbs++;
+        Sys_exitCriticalSection();
+    }
+    return res;
+}
+#endif
+
 app_res_e Shared_Neighbors_removeBeaconCb(uint16_t cb_id)
 {
     app_res_e res = APP_RES_OK;
+    beacon_cb_t * cbs;
 
     LOG(LVL_DEBUG,
         "Remove shared state beacon callback (id: %d)",
         cb_id);
 
+    if (cb_id >= SHARED_NEIGHBORS_MAX_CB)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
     Sys_enterCriticalSection();
-    if (m_neighbor_cb[cb_id].cb_beacon)
+    cbs = prepare_cbs();
+    if (cbs[cb_id].cb_beacon)
     {
-        m_neighbor_cb[cb_id].cb_beacon = NULL;
+#ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+        if (cbs[cb_id].deferred)
+        {
+            m_deferred_cbs--;
+        }
+#endif
+        cbs[cb_id].cb_beacon = NULL;
+        cbs[cb_id].deferred = false;
+        publish_cbs();
     }
     else
     {
@@ -111,3 +373,23 @@ app_res_e Shared_Neighbors_removeBeaconCb(uint16_t cb_id)
     }
     return res;
 }
+
+app_res_e Shared_Neighbors_getCbStats(uint16_t cb_id,
+                                      shared_neighbors_cb_stats_t * stats)
+{
+    if (cb_id >= SHARED_NEIGHBORS_MAX_CB || stats == NULL)
+    {
+        return APP_RES_INVALID_VALUE;
+    }
+
+    Sys_enterCriticalSection();
+    *stats = m_cb_stats[cb_id];
+#ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+    stats->deferred_dropped = m_deferred_dropped;
+#else
+    stats->deferred_dropped = 0;
+#endif
+    Sys_exitCriticalSection();
+
+    return APP_RES_OK;
+}
@@ -8,6 +8,22 @@
 
 #include "api.h"
 
+/**
+ * \brief   Execution statistics of a beacon callback
+ */
+typedef struct
+{
+    /** Number of calls */
+    uint32_t calls;
+    /** Longest execution time, in us */
+    uint32_t max_exec_us;
+    /** Number of calls longer than SHARED_NEIGHBORS_SLOW_CB_US */
+    uint32_t slow_calls;
+    /** Beacons dropped because deferred ring was full, all callbacks
+     *  included */
+    uint32_t deferred_dropped;
+} shared_neighbors_cb_stats_t;
+
 /**
  * @brief   Initialize the shared neighbors library.
  * @note    If shared state library is used in application, the
@@ -20,6 +36,8 @@ app_res_e Shared_Neighbors_init(void);
 
 /**
  * @brief   Add a new callback about beacon received.
+ *          Callback is called in beacon reception context, without critical
+ *          section: it must protect its own data if needed and return quickly.
  * @param   cb_scanned_neighbor
  *          New callback to set
  * @param   cb_id
@@ -31,6 +49,26 @@ app_res_e Shared_Neighbors_init(void);
 app_res_e Shared_Neighbors_addOnBeaconCb(app_lib_state_on_beacon_cb_f cb_scanned_neighbor,
                                          uint16_t * cb_id);
 
+#ifdef SHARED_NEIGHBORS_DEFERRED_BEACONS
+/**
+ * @brief   Add a new callback about beacon received, called later from an
+ *          application task.
+ *          Received beacons are copied in a ring of
+ *          SHARED_NEIGHBORS_DEFERRED_BEACONS entries, drained by a task of
+ *          App_Scheduler. Beacons received while ring is full are dropped.
+ * @param   cb_scanned_neighbor
+ *          New callback to set
+ * @param   cb_id
+ *          id to be used with @ref Shared_Neighbors_removeBeaconCb.
+ *          Set only if return code is APP_RES_OK.
+ * @return  APP_RES_OK if ok. See \ref app_res_e for
+ *          other result codes.
+ */
+app_res_e Shared_Neighbors_addOnBeaconCbDeferred(
+                                app_lib_state_on_beacon_cb_f cb_scanned_neighbor,
+                                uint16_t * cb_id);
+#endif
+
 /**
  * @brief   Remove a received beacon item from the list.
  *          Removed item fields are all set to 0.
@@ -39,4 +77,17 @@ app_res_e Shared_Neighbors_addOnBeaconCb(app_lib_state_on_beacon_cb_f cb_scanned
  */
 app_res_e Shared_Neighbors_removeBeaconCb(uint16_t cb_id);
 
+/**
+ * @brief   Get execution statistics of a beacon callback, to find slow
+ *          consumers.
+ * @param   cb_id
+ *          id received when adding the callback
+ * @param   stats
+ *          Pointer to store the statistics
+ * @return  APP_RES_OK if ok, APP_RES_INVALID_VALUE if id is invalid.
+ * @note    Statistics are reset when a callback is added with this id.
+ */
+app_res_e Shared_Neighbors_getCbStats(uint16_t cb_id,
+                                      shared_neighbors_cb_stats_t * stats);
+
 #endif //_SHARED_NEIGHBORS_H_
@@ -17,14 +17,17 @@
 #define DEBUG_LOG_MAX_LEVEL LVL_NOLOG
 #endif
 #include "debug_log.h"
+#include "libraries_init.h"
+
+#if SHARED_OFFLINE_MAX_MODULES > 32
+#error "SHARED_OFFLINE_MAX_MODULES must fit in a 32 bits module mask"
+#endif
 
 /** Structure of a task */
 typedef struct
 {
-    bool                     in_use; /* Is this in use */
     offline_setting_conf_t   cbs; /* Cbs for this module */
     uint32_t                 online_deadline_ts; /* online deadline timestamp */
-    bool                     ready_to_enter_offline;
 } module_t;
 
 typedef enum
@@ -41,6 +44,29 @@ static bool m_delayed_wakeup = false;
 /**  List of registered moduled */
 static module_t m_modules[SHARED_OFFLINE_MAX_MODULES];
 
+/**  Bit n set if module n is registered */
+static uint32_t m_registered_mask;
+
+/**  Bit n set if module n is ready to enter offline. Modules are ready when
+ *   this mask equals m_registered_mask */
+static uint32_t m_ready_mask;
+
+/**  Min-heap of ready modules ids, sorted by online deadline. A module is in
+ *   the heap if and only if its bit is set in m_ready_mask */
+static uint8_t m_heap[SHARED_OFFLINE_MAX_MODULES];
+
+/**  Position of each ready module in m_heap */
+static uint8_t m_heap_pos[SHARED_OFFLINE_MAX_MODULES];
+
+/**  Number of modules in m_heap */
+static uint8_t m_heap_size;
+
+/**  Statistics, time of current state is added when read */
+static shared_offline_stats_t m_stats;
+
+/**  When did we enter current state */
+static uint32_t m_state_ts;
+
 /**  Is library initialized */
 static bool m_initialized = false;
 
@@ -52,8 +78,134 @@ static uint32_t m_next_online_ts;
 /** Arbitrary time to sleep. Stack has a limit of 7 days */
 #define TIME_TO_SLEEP 6*24*3600
 
-/** Delay in ms to check if stack is really entered offline */
-#define POLING_INTERVAL_OFFLINE_MS 1000
+/**
+ * \brief   Get online deadline of a module in the heap
+ */
+static inline uint32_t heap_deadline(uint8_t pos)
+{
+    return m_modules[m_heap[pos]].online_deadline_ts;
+}
+
+/**
+ * \brief   Swap two modules of the heap
+ */
+static void heap_swap(uint8_t pos_a, uint8_t pos_b)
+{
+    uint8_t id = m_heap[pos_a];
+
+    m_heap[pos_a] = m_heap[pos_b];
+    m_heap[pos_b] = id;
+    m_heap_pos[m_heap[pos_a]] = pos_a;
+    m_heap_pos[m_heap[pos_b]] = pos_b;
+}
+
+/**
+ * \brief   Move a module up or down in the heap until heap is sorted again
+ */
+static void heap_fix_locked(uint8_t pos)
+{
+    // Move up while earlier than parent
+    while (pos > 0 && heap_deadline(pos) < heap_deadline((pos - 1) / 2))
+    {
+        heap_swap(pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+
+    // Move down while later than a child
+    while (true)
+    {
+        uint8_t first = pos;
+        uint8_t child = 2 * pos + 1;
+
+        if (child < m_heap_size && heap_deadline(child) < heap_deadline(first))
+        {
+            first = child;
+        }
+        child++;
+        if (child < m_heap_size && heap_deadline(child) < heap_deadline(first))
+        {
+            first = child;
+        }
+        if (first == pos)
+        {
+            break;
+        }
+        heap_swap(pos, first);
+        pos = first;
+    }
+}
+
+/**
+ * \brief   Mark a module ready, or update its deadline if already ready
+ */
+static void set_ready_locked(uint8_t id)
+{
+    if (!(m_ready_mask & (1u << id)))
+    {
+        m_ready_mask |= (1u << id);
+        m_heap[m_heap_size] = id;
+        m_heap_pos[id] = m_heap_size;
+        m_heap_size++;
+    }
+    heap_fix_locked(m_heap_pos[id]);
+}
+
+/**
+ * \brief   Mark a module not ready
+ */
+static void clear_ready_locked(uint8_t id)
+{
+    uint8_t pos;
+
+    if (!(m_ready_mask & (1u << id)))
+    {
+        return;
+    }
+
+    m_ready_mask &= ~(1u << id);
+    pos = m_heap_pos[id];
+    m_heap_size--;
+    if (pos != m_heap_size)
+    {
+        heap_swap(pos, m_heap_size);
+        heap_fix_locked(pos);
+    }
+}
+
+/**
+ * \brief   Add time spent in current state to statistics
+ */
+static void add_state_time_locked(shared_offline_stats_t * stats_p,
+                                  uint32_t now)
+{
+    uint32_t elapsed = now - m_state_ts;
+
+    switch (m_offline_state)
+    {
+        case STATE_ONLINE:
+            stats_p->online_s += elapsed;
+            break;
+        case STATE_ENTERING_OFFLINE:
+            stats_p->entering_offline_s += elapsed;
+            break;
+        default:
+            stats_p->offline_s += elapsed;
+            break;
+    }
+}
+
+/**
+ * \brief   Change state and account time spent in previous one
+ */
+static void set_state_locked(offline_state_e state)
+{
+    uint32_t now = lib_time->getTimestampS();
+
+    add_state_time_locked(&m_stats, now);
+
+    m_offline_state = state;
+    m_state_ts = now;
+}
 
 /**
  * \brief   Callback called when stack enters online
@@ -64,16 +216,18 @@ static void on_stack_online_cb(void)
 
     Sys_enterCriticalSection();
 
-    m_offline_state = STATE_ONLINE;
+    set_state_locked(STATE_ONLINE);
+    m_stats.online_count++;
 
     // Stack entering online state, time to notify all modules
     // But before it, reset every modules readiness to enter offline
     // They will all have to enter it again explicitly
+    m_ready_mask = 0;
+    m_heap_size = 0;
     for (uint8_t i = 0; i < SHARED_OFFLINE_MAX_MODULES; i++)
     {
-        if (m_modules[i].in_use)
+        if (m_registered_mask & (1u << i))
         {
-            m_modules[i].ready_to_enter_offline = false;
             if (m_modules[i].cbs.on_online_event != NULL)
             {
                 uint32_t delay;
@@ -106,9 +260,11 @@ static void on_stack_online_cb(void)
  */
 static uint32_t wakeup_stack_task()
 {
+    m_stats.task_wakeups++;
+
     if (m_offline_state == STATE_ENTERING_OFFLINE)
     {
-        // Wakeup will happen latter from polling task
+        // Wakeup will happen latter from sleep callback
         LOG(LVL_DEBUG, "Wakeup asked when enterring offline");
         m_delayed_wakeup = true;
         return APP_SCHEDULER_STOP_TASK;
@@ -140,7 +296,7 @@ static void call_offline_cbs()
     Sys_enterCriticalSection();
     for (uint8_t i = 0; i < SHARED_OFFLINE_MAX_MODULES; i++)
     {
-        if (m_modules[i].in_use
+        if ((m_registered_mask & (1u << i))
             && m_modules[i].cbs.on_offline_event != NULL)
         {
             m_modules[i].cbs.on_offline_event(delay_s);
@@ -150,32 +306,36 @@ static void call_offline_cbs()
     Sys_exitCriticalSection();
 }
 
-static uint32_t poll_for_offline()
+/**
+ * \brief   Callback called when stack enters offline
+ */
+static void on_stack_offline_cb(void)
 {
-    if (lib_sleep->getSleepState() == APP_LIB_SLEEP_STARTED
-        && m_offline_state == STATE_ENTERING_OFFLINE)
+    if (m_offline_state != STATE_ENTERING_OFFLINE)
     {
-        LOG(LVL_DEBUG, "Polling, in offline");
-        m_offline_state = STATE_OFFLINE;
+        return;
+    }
 
-        // Time to call the offline cbs
-        call_offline_cbs();
+    LOG(LVL_DEBUG, "Stack is offline");
+    Sys_enterCriticalSection();
+    set_state_locked(STATE_OFFLINE);
+    m_stats.offline_count++;
+    Sys_exitCriticalSection();
 
-        if (m_delayed_wakeup)
-        {
-            LOG(LVL_DEBUG, "Execute wakeup asked when entering offline");
-            // A delayed wakeup was asked while we were entering sleep
-            // so it was not executed.
-            // Executing it now as we are really offline now
-            wakeup_stack_task();
-            m_delayed_wakeup = false;
-        }
-        return APP_SCHEDULER_STOP_TASK;
-    }
+    // Time to call the offline cbs
+    call_offline_cbs();
 
-    LOG(LVL_DEBUG, "Polling, still waiting for offline");
-    // Recheck in 1 second
-    return POLING_INTERVAL_OFFLINE_MS;
+    if (m_delayed_wakeup)
+    {
+        LOG(LVL_DEBUG, "Execute wakeup asked when entering offline");
+        // A delayed wakeup was asked while we were entering sleep
+        // so it was not executed.
+        // Executing it now as we are really offline now
+        m_delayed_wakeup = false;
+        App_Scheduler_addTask_execTime(wakeup_stack_task,
+                                       APP_SCHEDULER_SCHEDULE_ASAP,
+                                       100);
+    }
 }
 
 /**
@@ -187,6 +347,13 @@ static bool enter_offline_mode_locked(uint32_t delay_s)
 {
     uint32_t now = lib_time->getTimestampS();
     bool res;
+    if (delay_s > TIME_TO_SLEEP)
+    {
+        // Stack wakes up by itself after this time anyway, and longer delays
+        // do not fit in the scheduler delay
+        delay_s = TIME_TO_SLEEP;
+    }
+
     LOG(LVL_INFO, "Enter offline for %d s", delay_s);
     // Schedule task to wakeup stack
     if (App_Scheduler_addTask_execTime(wakeup_stack_task,
@@ -213,16 +380,11 @@ static bool enter_offline_mode_locked(uint32_t delay_s)
     res = lib_sleep->sleepStackforTime(TIME_TO_SLEEP, 0) == APP_RES_OK;
 
     // Call offline cbs only when we are really in offline,
-    // it will happen from stack cbs in next release but for now,
-    // it requires a polling task
+    // from stack sleep callback
     if (res)
     {
         m_last_enterring_offline_ts = now;
-        m_offline_state = STATE_ENTERING_OFFLINE;
-        LOG(LVL_DEBUG, "Start polling for state");
-        App_Scheduler_addTask_execTime(poll_for_offline,
-                                       POLING_INTERVAL_OFFLINE_MS,
-                                       100);
+        set_state_locked(STATE_ENTERING_OFFLINE);
     }
     else
     {
@@ -241,43 +403,17 @@ static bool enter_online_mode()
                                           100) == APP_SCHEDULER_RES_OK;
 }
 
-static bool is_ready_to_sleep_locked(uint32_t * next_online_deadline_ts)
-{
-    bool res = true;
-    uint32_t deadline = SHARED_OFFLINE_INFINITE_DELAY;
-
-    for (uint8_t i = 0; i < SHARED_OFFLINE_MAX_MODULES; i++)
-    {
-        if (m_modules[i].in_use)
-        {
-            if (!m_modules[i].ready_to_enter_offline)
-            {
-                // Someone is not ready to enter offline
-                res = false;
-                break;
-            }
-
-            // Module is ready to sleep, update next deadline
-            if (m_modules[i].online_deadline_ts < deadline)
-            {
-                deadline = m_modules[i].online_deadline_ts;
-            }
-        }
-    }
-
-    // Value is valid only if res is True
-    *next_online_deadline_ts = deadline;
-    return res;
-}
-
 static void evaluate_sleep()
 {
-    uint32_t next_online_ts;
     uint32_t now = lib_time->getTimestampS();
     Sys_enterCriticalSection();
 
-    if (is_ready_to_sleep_locked(&next_online_ts))
+    if (m_ready_mask == m_registered_mask)
     {
+        // Every module is ready, earliest deadline is on top of heap
+        uint32_t next_online_ts = m_heap_size > 0 ?
+                                        heap_deadline(0) :
+                                        SHARED_OFFLINE_INFINITE_DELAY;
         uint32_t delay;
         if (now > next_online_ts)
         {
@@ -304,15 +440,17 @@ shared_offline_res_e Shared_Offline_init(void)
         return SHARED_OFFLINE_RES_OK;
     }
 
-    for (uint8_t i = 0; i < SHARED_OFFLINE_MAX_MODULES; i++)
-    {
-        m_modules[i].in_use = false;
-    }
+    m_registered_mask = 0;
+    m_ready_mask = 0;
+    m_heap_size = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
 
     lib_sleep->setOnWakeupCb(on_stack_online_cb);
+    lib_sleep->setOnSleepCb(on_stack_offline_cb);
     m_next_online_ts = 0;
     m_last_enterring_offline_ts = 0;
     m_offline_state = STATE_ONLINE;
+    m_state_ts = lib_time->getTimestampS();
     m_initialized = true;
     return SHARED_OFFLINE_RES_OK;
 }
@@ -322,7 +460,7 @@ shared_offline_res_e Shared_Offline_register(uint8_t * id_p,
 {
     app_res_e res;
     bool added = false;
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Offline_init))
     {
         return SHARED_OFFLINE_RES_UNINITIALIZED;
     }
@@ -342,11 +480,10 @@ shared_offline_res_e Shared_Offline_register(uint8_t * id_p,
     Sys_enterCriticalSection();
     for (uint8_t i = 0; i < SHARED_OFFLINE_MAX_MODULES; i++)
     {
-        if (!m_modules[i].in_use)
+        if (!(m_registered_mask & (1u << i)))
         {
-            m_modules[i].in_use = true;
+            m_registered_mask |= (1u << i);
             memcpy(&m_modules[i].cbs, &cbs, sizeof(offline_setting_conf_t));
-            m_modules[i].ready_to_enter_offline = false;
             *id_p = i;
             added = true;
             break;
@@ -373,17 +510,20 @@ shared_offline_res_e Shared_Offline_register(uint8_t * id_p,
 
 shared_offline_res_e Shared_Offline_unregister(uint8_t id)
 {
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Offline_init))
     {
         return SHARED_OFFLINE_RES_UNINITIALIZED;
     }
 
-    if (id >= SHARED_OFFLINE_MAX_MODULES || !m_modules[id].in_use)
+    if (id >= SHARED_OFFLINE_MAX_MODULES || !(m_registered_mask & (1u << id)))
     {
         return SHARED_OFFLINE_RES_WRONG_ID;
     }
 
-    m_modules[id].in_use = false;
+    Sys_enterCriticalSection();
+    clear_ready_locked(id);
+    m_registered_mask &= ~(1u << id);
+    Sys_exitCriticalSection();
 
     // One of the arbitrer was removed, check if we can sleep now
     // or update our target
@@ -397,12 +537,12 @@ shared_offline_res_e Shared_Offline_enter_offline_state(uint8_t id,
 {
     uint32_t now = lib_time->getTimestampS();
 
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Offline_init))
     {
         return SHARED_OFFLINE_RES_UNINITIALIZED;
     }
 
-    if (id >= SHARED_OFFLINE_MAX_MODULES || !m_modules[id].in_use)
+    if (id >= SHARED_OFFLINE_MAX_MODULES || !(m_registered_mask & (1u << id)))
     {
         return SHARED_OFFLINE_RES_WRONG_ID;
     }
@@ -421,7 +561,7 @@ shared_offline_res_e Shared_Offline_enter_offline_state(uint8_t id,
         m_modules[id].online_deadline_ts = now + delay_s;
     }
 
-    m_modules[id].ready_to_enter_offline = true;
+    set_ready_locked(id);
 
     evaluate_sleep();
 
@@ -433,12 +573,12 @@ shared_offline_res_e Shared_Offline_enter_offline_state(uint8_t id,
 
 shared_offline_res_e Shared_Offline_enter_online_state(uint8_t id)
 {
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Offline_init))
     {
         return SHARED_OFFLINE_RES_UNINITIALIZED;
     }
 
-    if (id >= SHARED_OFFLINE_MAX_MODULES || !m_modules[id].in_use)
+    if (id >= SHARED_OFFLINE_MAX_MODULES || !(m_registered_mask & (1u << id)))
     {
         return SHARED_OFFLINE_RES_WRONG_ID;
     }
@@ -453,7 +593,7 @@ shared_offline_status_e Shared_Offline_get_status(uint32_t * elapsed_s_p,
                                                   uint32_t * remaining_s_p)
 {
     uint32_t now = lib_time->getTimestampS();
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Shared_Offline_init))
     {
         return SHARED_OFFLINE_STATUS_UNINITIALIZED;
     }
@@ -467,3 +607,22 @@ shared_offline_status_e Shared_Offline_get_status(uint32_t * elapsed_s_p,
     }
     return SHARED_OFFLINE_STATUS_ONLINE;
 }
+
+void Shared_Offline_get_stats(shared_offline_stats_t * stats_p)
+{
+    Sys_enterCriticalSection();
+    *stats_p = m_stats;
+    if (m_initialized)
+    {
+        add_state_time_locked(stats_p, lib_time->getTimestampS());
+    }
+    Sys_exitCriticalSection();
+}
+
+void Shared_Offline_reset_stats(void)
+{
+    Sys_enterCriticalSection();
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_state_ts = lib_time->getTimestampS();
+    Sys_exitCriticalSection();
+}
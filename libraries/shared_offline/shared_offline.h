@@ -97,6 +97,25 @@ typedef struct {
     online_cb_f on_online_event;
 } offline_setting_conf_t;
 
+/**
+ * \brief   Statistics, to measure energy gained in offline mode
+ */
+typedef struct {
+    /** Number of times stack entered offline state */
+    uint32_t offline_count;
+    /** Number of times stack went back online */
+    uint32_t online_count;
+    /** Number of times a task of this library woke up the application */
+    uint32_t task_wakeups;
+    /** Time spent online, in seconds */
+    uint32_t online_s;
+    /** Time spent between offline request and stack entering offline, in
+     *  seconds */
+    uint32_t entering_offline_s;
+    /** Time spent offline, in seconds */
+    uint32_t offline_s;
+} shared_offline_stats_t;
+
 /**
  * \brief   Initialize shared offline module
  *
@@ -158,5 +177,17 @@ shared_offline_res_e Shared_Offline_enter_online_state(uint8_t id);
 shared_offline_status_e Shared_Offline_get_status(uint32_t * elapsed_s_p,
                                                   uint32_t * remaining_s_p);
 
+/**
+ * \brief   Get statistics since initialization or last reset
+ * \param   stats_p
+ *          Pointer to store the statistics. Time of current state is included
+ */
+void Shared_Offline_get_stats(shared_offline_stats_t * stats_p);
+
+/**
+ * \brief   Reset statistics
+ */
+void Shared_Offline_reset_stats(void);
+
 
 #endif //_SHARED_OFFLINE_H_
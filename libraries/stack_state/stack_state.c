@@ -12,6 +12,10 @@
 #endif
 #include "debug_log.h"
 #include "stack_state.h"
+#include "app_scheduler.h"
+#include "libraries_init.h"
+
+#include <string.h>
 
 
 /* Note: It may happen that CB are not needed even if library is used to start/
@@ -25,29 +29,209 @@ static bool m_initialized = false;
 
 #if STACK_STATE_CB != 0
 
+#if STACK_STATE_CB > 32
+#error "STACK_STATE_CB must fit in a 32 bits subscriber mask"
+#endif
+
+/** Number of events with a subscriber list. Callbacks registered for later
+ *  events, added in future stack releases, get them synchronously */
+#define KNOWN_EVENTS    (APP_LIB_STATE_STACK_EVENT_ROUTE_CHANGED + 1)
+
+/** Bits of events without subscriber list */
+#define UNKNOWN_EVENTS_BITFIELD (~((1u << KNOWN_EVENTS) - 1))
+
+#ifdef STACK_STATE_DEFERRED
+/** Maximum execution time of deferred delivery task */
+#define DEFERRED_TASK_EXEC_TIME_US  500
+
+/** Copy of an event parameter, for deferred delivery */
+typedef union
+{
+    app_lib_state_on_scan_start_info_t scan_start;
+    app_lib_state_neighbor_scan_info_t scan_stop;
+    app_lib_state_route_info_t route;
+} event_param_u;
+#endif
+
 typedef struct
 {
     stack_state_event_cb_f cb;
     uint32_t bitfields;
+    /** Events waiting for deferred delivery */
+    uint32_t pending;
 } stack_state_cbs_t;
 
 /**  List of callbacks */
 static stack_state_cbs_t m_stack_state_cbs[STACK_STATE_CB];
 
+/**  Per event, bit n set if callback n gets it synchronously */
+static uint32_t m_sync_subscribers[KNOWN_EVENTS];
+
+/**  Bit n set if callback n registered for unknown events */
+static uint32_t m_unknown_subscribers;
+
+#ifdef STACK_STATE_DEFERRED
+/**  Per event, bit n set if callback n gets it from deferred task */
+static uint32_t m_deferred_subscribers[KNOWN_EVENTS];
+
+/**  Latest parameter of each event, for deferred delivery */
+static event_param_u m_deferred_params[KNOWN_EVENTS];
+
+/**
+ * \brief   Size of the parameter of an event
+ */
+static size_t param_size(app_lib_stack_event_e event)
+{
+    switch (event)
+    {
+        case APP_LIB_STATE_STACK_EVENT_SCAN_STARTED:
+            return sizeof(app_lib_state_on_scan_start_info_t);
+        case APP_LIB_STATE_STACK_EVENT_SCAN_STOPPED:
+            return sizeof(app_lib_state_neighbor_scan_info_t);
+        case APP_LIB_STATE_STACK_EVENT_ROUTE_CHANGED:
+            return sizeof(app_lib_state_route_info_t);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * \brief   Task delivering deferred events, latest occurrence of each
+ *          event only
+ */
+static uint32_t deferred_task(void)
+{
+    for (uint8_t i = 0; i < STACK_STATE_CB; i++)
+    {
+        while (true)
+        {
+            stack_state_event_cb_f cb;
+            app_lib_stack_event_e event;
+            event_param_u param;
+            size_t size;
+
+            Sys_enterCriticalSection();
+            cb = m_stack_state_cbs[i].cb;
+            if (m_stack_state_cbs[i].pending == 0 || cb == NULL)
+            {
+                Sys_exitCriticalSection();
+                break;
+            }
+            event = __builtin_ctz(m_stack_state_cbs[i].pending);
+            m_stack_state_cbs[i].pending &= ~(1u << event);
+            size = param_size(event);
+            memcpy(&param, &m_deferred_params[event], size);
+            Sys_exitCriticalSection();
+
+            // Called outside of critical section
+            cb(event, size > 0 ? &param : NULL);
+        }
+    }
+
+    return APP_SCHEDULER_STOP_TASK;
+}
+#endif
+
 static void notify_modules(app_lib_stack_event_e event, void * param_p)
 {
+    uint32_t subscribers;
+
     Sys_enterCriticalSection();
-    for (uint8_t i = 0; i < STACK_STATE_CB; i++)
+    if ((uint32_t) event >= KNOWN_EVENTS)
     {
-        if ((m_stack_state_cbs[i].cb != NULL) &&
-            (m_stack_state_cbs[i].bitfields & (1 << event)))
+        // No subscriber list, check bitfields of possible subscribers
+        subscribers = m_unknown_subscribers;
+        while (subscribers != 0)
         {
-            m_stack_state_cbs[i].cb(event, param_p);
+            uint8_t i = __builtin_ctz(subscribers);
+            subscribers &= subscribers - 1;
+            if ((event < 32) && (m_stack_state_cbs[i].bitfields & (1u << event)))
+            {
+                m_stack_state_cbs[i].cb(event, param_p);
+            }
         }
+        Sys_exitCriticalSection();
+        return;
+    }
+
+    subscribers = m_sync_subscribers[event];
+    while (subscribers != 0)
+    {
+        uint8_t i = __builtin_ctz(subscribers);
+        subscribers &= subscribers - 1;
+        m_stack_state_cbs[i].cb(event, param_p);
     }
+
+#ifdef STACK_STATE_DEFERRED
+    subscribers = m_deferred_subscribers[event];
+    if (subscribers != 0)
+    {
+        size_t size = param_size(event);
+
+        // Keep latest occurrence only: a burst of events is delivered once
+        if (size > 0 && param_p != NULL)
+        {
+            memcpy(&m_deferred_params[event], param_p, size);
+        }
+        while (subscribers != 0)
+        {
+            uint8_t i = __builtin_ctz(subscribers);
+            subscribers &= subscribers - 1;
+            m_stack_state_cbs[i].pending |= (1u << event);
+        }
+        App_Scheduler_addTask_execTime(deferred_task,
+                                       APP_SCHEDULER_SCHEDULE_ASAP,
+                                       DEFERRED_TASK_EXEC_TIME_US);
+    }
+#endif
     Sys_exitCriticalSection();
 }
 
+/**
+ * \brief   Remove callback of a slot from the subscriber lists
+ */
+static void unsubscribe_locked(uint8_t slot)
+{
+    for (uint8_t e = 0; e < KNOWN_EVENTS; e++)
+    {
+        m_sync_subscribers[e] &= ~(1u << slot);
+#ifdef STACK_STATE_DEFERRED
+        m_deferred_subscribers[e] &= ~(1u << slot);
+#endif
+    }
+    m_unknown_subscribers &= ~(1u << slot);
+    m_stack_state_cbs[slot].pending = 0;
+}
+
+/**
+ * \brief   Add callback of a slot to the subscriber lists of its events
+ */
+static void subscribe_locked(uint8_t slot,
+                             uint32_t event_bitfield,
+                             stack_state_delivery_e delivery)
+{
+#ifdef STACK_STATE_DEFERRED
+    uint32_t * lists = delivery == STACK_STATE_DELIVERY_DEFERRED ?
+                            m_deferred_subscribers :
+                            m_sync_subscribers;
+#else
+    uint32_t * lists = m_sync_subscribers;
+#endif
+
+    unsubscribe_locked(slot);
+    for (uint8_t e = 0; e < KNOWN_EVENTS; e++)
+    {
+        if (event_bitfield & (1u << e))
+        {
+            lists[e] |= (1u << slot);
+        }
+    }
+    if (event_bitfield & UNKNOWN_EVENTS_BITFIELD)
+    {
+        m_unknown_subscribers |= (1u << slot);
+    }
+}
+
 static void onStackEventCb(app_lib_stack_event_e event, void *param_p)
 {
     // Dispatch event to all registered modules
@@ -68,6 +252,7 @@ app_res_e Stack_State_init(void)
     for (uint8_t i = 0; i < STACK_STATE_CB; i++)
     {
         m_stack_state_cbs[i].cb = NULL;
+        unsubscribe_locked(i);
     }
 
     res = lib_state->setOnStackEventCb(onStackEventCb);
@@ -84,7 +269,7 @@ app_res_e Stack_State_init(void)
 
 app_res_e Stack_State_startStack()
 {
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Stack_State_init))
     {
         return APP_RES_INVALID_VALUE;
     }
@@ -93,7 +278,7 @@ app_res_e Stack_State_startStack()
 
 app_res_e Stack_State_stopStack()
 {
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Stack_State_init))
     {
         return APP_RES_INVALID_VALUE;
     }
@@ -107,7 +292,16 @@ bool Stack_State_isStarted()
 
 app_res_e Stack_State_addEventCb(stack_state_event_cb_f callback, uint32_t event_bitfield)
 {
-    if (!m_initialized)
+    return Stack_State_addEventCbWithDelivery(callback,
+                                              event_bitfield,
+                                              STACK_STATE_DELIVERY_SYNC);
+}
+
+app_res_e Stack_State_addEventCbWithDelivery(stack_state_event_cb_f callback,
+                                             uint32_t event_bitfield,
+                                             stack_state_delivery_e delivery)
+{
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Stack_State_init))
     {
         return APP_RES_INVALID_VALUE;
     }
@@ -120,11 +314,21 @@ app_res_e Stack_State_addEventCb(stack_state_event_cb_f callback, uint32_t event
         return APP_RES_INVALID_NULL_POINTER;
     }
 
-    if (event_bitfield == 0)
+    if (event_bitfield == 0 ||
+        (delivery != STACK_STATE_DELIVERY_SYNC &&
+         delivery != STACK_STATE_DELIVERY_DEFERRED))
     {
         return APP_RES_INVALID_VALUE;
     }
 
+#ifndef STACK_STATE_DEFERRED
+    if (delivery == STACK_STATE_DELIVERY_DEFERRED)
+    {
+        // No task reserved for it, see STACK_STATE_DEFERRED in config.mk
+        return APP_RES_NOT_IMPLEMENTED;
+    }
+#endif
+
     Sys_enterCriticalSection();
     for (uint8_t i = 0; i < STACK_STATE_CB; i++)
     {
@@ -139,6 +343,7 @@ app_res_e Stack_State_addEventCb(stack_state_event_cb_f callback, uint32_t event
             /* Callback already present */
             // Updating bitfields
             m_stack_state_cbs[i].bitfields = event_bitfield;
+            subscribe_locked(i, event_bitfield, delivery);
             res = APP_RES_OK;
             break;
         }
@@ -149,13 +354,16 @@ app_res_e Stack_State_addEventCb(stack_state_event_cb_f callback, uint32_t event
         /* Callback was not already present and a free room was found */
         m_stack_state_cbs[free_slot].cb = callback;
         m_stack_state_cbs[free_slot].bitfields = event_bitfield;
+        subscribe_locked(free_slot, event_bitfield, delivery);
         res = APP_RES_OK;
     }
     Sys_exitCriticalSection();
 
     if (res == APP_RES_OK)
     {
-        LOG(LVL_DEBUG, "Add stack state event cb (0x%x) for events: %x", callback, event_bitfield);
+        LOG(LVL_DEBUG, "Add stack state event cb (0x%x) for events: %x (%s)",
+            callback, event_bitfield,
+            delivery == STACK_STATE_DELIVERY_DEFERRED ? "deferred" : "sync");
     }
     else
     {
@@ -169,7 +377,7 @@ app_res_e Stack_State_addEventCb(stack_state_event_cb_f callback, uint32_t event
 
 app_res_e Stack_State_removeEventCb(stack_state_event_cb_f callback)
 {
-    if (!m_initialized)
+    if (!LIBRARIES_INIT_ON_USE(m_initialized, Stack_State_init))
     {
         return APP_RES_INVALID_VALUE;
     }
@@ -184,6 +392,7 @@ app_res_e Stack_State_removeEventCb(stack_state_event_cb_f callback)
         if (m_stack_state_cbs[i].cb == callback)
         {
             m_stack_state_cbs[i].cb= NULL;
+            unsubscribe_locked(i);
             res = APP_RES_OK;
         }
     }
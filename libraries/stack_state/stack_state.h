@@ -14,6 +14,23 @@
 typedef void
     (*stack_state_event_cb_f)(app_lib_stack_event_e event, void * param);
 
+/**
+ * @brief   How events are delivered to a callback
+ */
+typedef enum
+{
+    /** Called from stack event callback, in critical section. Every event
+     *  is delivered */
+    STACK_STATE_DELIVERY_SYNC = 0,
+    /** Called later from an application task, outside of critical section.
+     *  Events received before the task runs are coalesced: each event is
+     *  delivered once, with the parameter of its latest occurrence. Param
+     *  points to a copy that is valid during the call only. Available if
+     *  application makefile sets STACK_STATE_DEFERRED=yes, that reserves a
+     *  task of App_Scheduler */
+    STACK_STATE_DELIVERY_DEFERRED = 1,
+} stack_state_delivery_e;
+
 /**
  * @brief   Initialize the stack state library.
  * @return  \ref APP_RES_OK.
@@ -52,6 +69,27 @@ bool Stack_State_isStarted();
  */
 app_res_e Stack_State_addEventCb(stack_state_event_cb_f callback, uint32_t event_bitfield);
 
+/**
+ * @brief   Add a new callback about event callback, with its delivery mode.
+ *          Use deferred delivery for handlers that are too long for stack
+ *          context or only need the latest event of a burst, like route
+ *          changes during network formation.
+ * @param   callback
+ *          New callback. If already added, its events and delivery are
+ *          updated
+ * @param   event_bitfield
+ *          Bitfields of event to register, see @ref Stack_State_addEventCb
+ * @param   delivery
+ *          Delivery of the events, see @ref stack_state_delivery_e. Events
+ *          unknown to this library are always delivered synchronously
+ * @return  APP_RES_OK if ok, APP_RES_NOT_IMPLEMENTED for deferred delivery
+ *          without STACK_STATE_DEFERRED=yes. See \ref app_res_e for
+ *          other result codes.
+ */
+app_res_e Stack_State_addEventCbWithDelivery(stack_state_event_cb_f callback,
+                                             uint32_t event_bitfield,
+                                             stack_state_delivery_e delivery);
+
 /**
  * @brief   Remove an event callback from the list.
  *          Removed item fields are all set to 0.
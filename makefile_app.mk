@@ -17,6 +17,8 @@ VERSION_FILE := $(BUILDPREFIX_APP)version.txt
 
 # App different formats
 APP_ELF := $(BUILDPREFIX_APP)$(APP_NAME).elf
+# Dictionary of tokenized debug log format strings
+APP_LOGDICT := $(BUILDPREFIX_APP)$(APP_NAME).logdict
 
 # For backward compatibility as app makefile except SRCS_PATH variable
 SRCS_PATH := $(APP_SRCS_PATH)
@@ -81,7 +83,7 @@ DEPS = $(addprefix $(BUILDPREFIX_APP), $(DEPS_))
 
 
 # Files to be cleaned
-CLEAN := $(OBJS) $(APP_ELF) $(APP_HEX) $(DEPS)
+CLEAN := $(OBJS) $(APP_ELF) $(APP_HEX) $(APP_LOGDICT) $(DEPS)
 
 $(BUILDPREFIX_APP)%.o : %.c $(APP_SRCS_PATH)makefile $(APP_CONFIG) $(BOARD_CONFIG) $(MCU_CONFIG)
 	$(MKDIR) $(@D)
@@ -101,12 +103,19 @@ $(APP_HEX): $(APP_ELF)
 	@echo "Generating $(APP_HEX)"
 	$(OBJCOPY) $< -O ihex $@
 
+$(APP_LOGDICT): $(APP_ELF)
+	@echo "Generating $(APP_LOGDICT)"
+	$(LOG_TOKEN) dict $< $@
+
 .PHONY: $(VERSION_FILE)
 $(VERSION_FILE):
 	@echo "app_version=$(app_major).$(app_minor).$(app_maintenance).$(app_development)" > $(@)
 	@echo "sha1=$(shell git log -1 --pretty=format:"%h")" >> $(@)
 .PHONY: all
 all: $(APP_HEX) $(VERSION_FILE)
+ifeq ($(APP_PRINTING_TOKENIZED), yes)
+all: $(APP_LOGDICT)
+endif
 
 clean:
 	$(RM) -rf $(CLEAN)
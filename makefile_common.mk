@@ -71,12 +71,14 @@ MV          := mv
 CP          := cp
 MKDIR       := mkdir -p
 SCRAT_GEN   := $(python) tools/genscratchpad.py
+DELTA_GEN   := $(python) tools/gendelta.py
 HEX_GEN     := $(python) tools/genhex.py
 HEXTOOL     := $(python) tools/hextool.py
 FMW_SEL     := $(python) tools/firmware_selector.py
 BOOT_CONF   := $(python) tools/bootloader_config.py
 WIZARD      := $(python) tools/sdk_wizard.py
 HEX2ARRAY32 := $(python) tools/hextoarray32.py
+LOG_TOKEN   := $(python) tools/logtoken.py
 MAKE        := make
 
 # Check the toolchain version with GCC
@@ -13,6 +13,7 @@
 #include "api.h"
 #include "board_init.h"
 #include "libraries_init.h"
+#include "startup_profile.h"
 
 /** Addresses determined by the linker */
 extern unsigned int __text_start__;
@@ -26,9 +27,14 @@ extern unsigned int __total_size_bytes__;
 
 // The real used app ram end pointer.
 // NOTE! The value is NOT sometimes equal to &__bss_end__
-// e.g. when dynamic waps items are reserved in dualmcu_app.
+// e.g. when dynamic waps items are reserved in dualmcu_app or when
+// memory is allocated with app_heap library.
 uint32_t * m_used_app_ram_end = (uint32_t *)&__bss_end__;
 
+// Set once the last used RAM address is given to the stack, RAM after
+// m_used_app_ram_end cannot be used anymore.
+bool m_app_ram_top_reported = false;
+
 /** Application initialization function */
 void App_init(const app_global_functions_t * functions);
 
@@ -91,6 +97,8 @@ intptr_t _start(const app_global_functions_t * functions,
 
     unsigned int * src, * dst;
 
+    STARTUP_PROFILE_BEGIN(functions);
+
     /* Copy data from flash to RAM */
     for(src = &__data_src_start__,
         dst = &__data_start__;
@@ -98,32 +106,37 @@ intptr_t _start(const app_global_functions_t * functions,
     {
         *dst++ = *src++;
     }
+    STARTUP_PROFILE_MARK(STARTUP_PHASE_DATA_COPY);
 
     /* Initialize the .bss section */
     for(dst = &__bss_start__; dst != &__bss_end__;)
     {
         *dst++ = 0;
     }
+    STARTUP_PROFILE_MARK(STARTUP_PHASE_BSS_ZERO);
 
     /* Open Wirepas public API (it loads all libs pointer to global variables) */
     API_Open(functions);
-
+    STARTUP_PROFILE_MARK(STARTUP_PHASE_API_OPEN);
 
     /* Call any board specific initialization */
     Board_init();
+    STARTUP_PROFILE_MARK(STARTUP_PHASE_BOARD_INIT);
 
     /* Initialize libraries in use */
     Libraries_init();
 
     /* Call application initialization function */
     App_init(functions);
+    STARTUP_PROFILE_MARK(STARTUP_PHASE_APP_INIT);
 
     /*
      * Set the last RAM address used by the application, in order to give
-     * back any unused RAM to the stack firmware. If heap is implemented
-     * in the SDK, this needs to be updated.
+     * back any unused RAM to the stack firmware. It is the high-water mark
+     * of memory allocated after .bss during initialization.
      */
     *ram_top = (void *) m_used_app_ram_end;
+    m_app_ram_top_reported = true;
 
     /* Nothing to return */
     return 0;
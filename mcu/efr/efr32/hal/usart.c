@@ -12,6 +12,7 @@
 #include "board.h"
 #include "board_usart.h"
 #include "api.h"
+#include "ring.h"
 
 #include "em_cmu.h"
 #include "em_gpio.h"
@@ -21,12 +22,12 @@
 
 static volatile serial_rx_callback_f    m_rx_callback;
 
-// Declare unique ring-buffer size
+// Transmission buffer size, a power of two
 #define BUFFER_SIZE                     512u
-#include "ringbuffer.h"
 
 // Buffer for transmissions
-static volatile ringbuffer_t            m_usart_tx_buffer;
+static uint8_t                          m_usart_tx_buffer[BUFFER_SIZE];
+static ring_t                           m_usart_tx_ring;
 
 /** Indicate if USART is enabled */
 static volatile uint32_t                m_enabled;
@@ -75,7 +76,7 @@ bool Usart_init(uint32_t baudrate, uart_flow_control_e flow_control)
                    BOARD_USART_RX_PIN);
 
     // Module variables
-    Ringbuffer_reset(m_usart_tx_buffer);
+    Ring_init(&m_usart_tx_ring, m_usart_tx_buffer, BUFFER_SIZE);
     m_rx_callback = NULL;
     m_tx_active = false;
     m_enabled = 0;
@@ -185,24 +186,21 @@ uint32_t Usart_sendBuffer(const void * buffer, uint32_t length)
 {
     bool empty = false;
     uint32_t size_in = length;
-    uint8_t * data_out = (uint8_t *)buffer;
+    uint8_t * data_out;
     Sys_enterCriticalSection();
-    if (Ringbuffer_free(m_usart_tx_buffer) < length)
+    if (Ring_free(&m_usart_tx_ring) < length)
     {
         size_in = 0;
         goto buffer_too_large;
     }
-    empty = (Ringbuffer_usage(m_usart_tx_buffer) == 0);
-    while(length--)
-    {
-        Ringbuffer_getHeadByte(m_usart_tx_buffer) = *data_out++;
-        Ringbuffer_incrHead(m_usart_tx_buffer, 1);
-    }
+    empty = Ring_isEmpty(&m_usart_tx_ring);
+    Ring_write(&m_usart_tx_ring, buffer, length);
     if (empty)
     {
         Usart_setEnabled(true);
         BUS_RegBitWrite(&(BOARD_USART->IEN), _USART_IEN_TXC_SHIFT, 1);
-        BOARD_USART->TXDATA = Ringbuffer_getTailByte(m_usart_tx_buffer);
+        Ring_peekRead(&m_usart_tx_ring, &data_out);
+        BOARD_USART->TXDATA = *data_out;
         m_tx_active = true;
     }
 buffer_too_large:
@@ -280,13 +278,14 @@ void __attribute__((__interrupt__)) USART_RX_IRQHandler(void)
 
 void __attribute__((__interrupt__)) USART_TX_IRQHandler(void)
 {
+    uint8_t * data_out;
 //    DBG_ENTER_IRQ_USART();
     BOARD_USART_CLR_IRQ_TXC;
     // byte has been sent -> move tail
-    Ringbuffer_incrTail(m_usart_tx_buffer, 1);
-    if (Ringbuffer_usage(m_usart_tx_buffer) != 0)
+    Ring_commitRead(&m_usart_tx_ring, 1);
+    if (Ring_peekRead(&m_usart_tx_ring, &data_out) != 0)
     {
-        BOARD_USART->TXDATA = Ringbuffer_getTailByte(m_usart_tx_buffer);
+        BOARD_USART->TXDATA = *data_out;
     }
     else
     {
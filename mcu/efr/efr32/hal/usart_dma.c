@@ -30,6 +30,12 @@ static volatile serial_rx_callback_f    m_rx_callback;
 /** Timeout without activity on the line to define the end of frame */
 #define TIMEOUT_INACTIVITY_RX_BAUD_TIME  20 //< Unit is in baud time
 
+/** Size of circular buffer used for reception. It is filled by DMA in two
+ *  halves, and bytes are given to upper level each time a half is full or
+ *  the line is idle */
+#define RX_BUFFER_SIZE                  512u
+#define RX_HALF_SIZE                    (RX_BUFFER_SIZE / 2)
+
 /** Indicate if USART is enabled */
 static volatile uint32_t                m_enabled;
 
@@ -46,6 +52,10 @@ void __attribute__((__interrupt__))     LDMA_IRQHandler(void);
 /** Internal function to start a RX session on dma */
 static void start_dma_rx_lock(void);
 
+/** Internal function to give bytes received since last call to upper level,
+ *  called from interrupt context */
+static void flush_rx(void);
+
 /** Internal function to wait for end of latest Tx transfer */
 static void wait_end_of_tx(void);
 
@@ -55,8 +65,11 @@ static volatile bool m_tx_ongoing;
 // Buffers used for transmission
 static double_buffer_t m_tx_buffers;
 
-// Buffer used for reception
-static double_buffer_t m_rx_buffers;
+// Circular buffer used for reception
+static uint8_t m_rx_buffer[RX_BUFFER_SIZE];
+
+// Index of first received byte not yet given to upper level
+static uint32_t m_rx_read_index;
 
 // DMA descriptor used for reception
 static LDMA_Descriptor_t m_rx_dma_descriptor[2];
@@ -157,9 +170,6 @@ bool Usart_init(uint32_t baudrate, uart_flow_control_e flow_control)
     m_tx_started = false;
     DoubleBuffer_init(m_tx_buffers);
 
-    // Prepare RX buffer
-    DoubleBuffer_init(m_rx_buffers);
-
     return true;
 }
 
@@ -229,9 +239,6 @@ void Usart_receiverOn(void)
     // Clear RX timeout
     BOARD_USART_CLR_IRQ_TCMP1;
 
-    // Prepare RX buffer
-    DoubleBuffer_init(m_rx_buffers);
-
     start_dma_rx_lock();
 
     BUS_RegBitWrite(&(BOARD_USART->CMD), _USART_CMD_RXEN_SHIFT, 1);
@@ -423,68 +430,79 @@ uint32_t Usart_sendBuffer(const void * buffer, uint32_t length)
 
 static void start_dma_rx_lock(void)
 {
-    m_rx_dma_descriptor[0] = (LDMA_Descriptor_t){
-        .xfer = {
-            .structType   = ldmaCtrlStructTypeXfer,
-            .structReq    = 0,
-            .xferCnt      = 0, // Number of bytes to transfer - 1:
-                               // transfer one byte.
-            .byteSwap     = 0,
-            .blockSize    = ldmaCtrlBlockSizeAll,
-            .doneIfs      = 0,
-            .reqMode      = ldmaCtrlReqModeAll,
-            .decLoopCnt   = 1,
-            .ignoreSrec   = 1,
-            .srcInc       = ldmaCtrlSrcIncNone,
-            .size         = ldmaCtrlSizeByte,
-            .dstInc       = ldmaCtrlDstIncOne,
-            .srcAddrMode  = ldmaCtrlSrcAddrModeAbs,
-            .dstAddrMode  = ldmaCtrlDstAddrModeAbs,
-            .srcAddr      = (uint32_t)&(BOARD_USART->RXDATA),
-            .dstAddr      = (uint32_t)DoubleBuffer_getActive(m_rx_buffers),
-            .linkMode     = ldmaLinkModeAbs,
-            .link         = 0,
-            .linkAddr     = ((uint32_t)&m_rx_dma_descriptor[1])>>2
-        }
-    };
-
-    m_rx_dma_descriptor[1] = (LDMA_Descriptor_t){
-        .xfer = {
-            .structType   = ldmaCtrlStructTypeXfer,
-            .structReq    = 0,
-            .xferCnt      = 0, // Number of bytes to transfer - 1:
-                               // transfer one byte.
-            .byteSwap     = 0,
-            .blockSize    = ldmaCtrlBlockSizeAll,
-            .doneIfs      = 0,
-            .reqMode      = ldmaCtrlReqModeAll,
-            .decLoopCnt   = 1,
-            .ignoreSrec   = 1,
-            .srcInc       = ldmaCtrlSrcIncNone,
-            .size         = ldmaCtrlSizeByte,
-            .dstInc       = ldmaCtrlDstIncOne,
-            .srcAddrMode  = ldmaCtrlSrcAddrModeAbs,
-            .dstAddrMode  = ldmaCtrlDstAddrModeRel,
-            .srcAddr      = (uint32_t)&(BOARD_USART->RXDATA),
-            .dstAddr      = 0,
-            .linkMode     = ldmaLinkModeRel,
-            .link         = 0,
-            .linkAddr     = 0 // Point to ourself
-        }
-    };
+    /* DMA reception never stops: two transfers, one per half of the
+     * circular buffer, are linked to each other. Each one generates an
+     * interrupt when done, to give received bytes to upper level before
+     * they are overwritten */
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        m_rx_dma_descriptor[i] = (LDMA_Descriptor_t){
+            .xfer = {
+                .structType   = ldmaCtrlStructTypeXfer,
+                .structReq    = 0,
+                .xferCnt      = RX_HALF_SIZE - 1, // Number of bytes - 1
+                .byteSwap     = 0,
+                .blockSize    = ldmaCtrlBlockSizeUnit1,
+                .doneIfs      = 1, // Interrupt when half is full
+                .reqMode      = ldmaCtrlReqModeBlock,
+                .decLoopCnt   = 0,
+                .ignoreSrec   = 0,
+                .srcInc       = ldmaCtrlSrcIncNone,
+                .size         = ldmaCtrlSizeByte,
+                .dstInc       = ldmaCtrlDstIncOne,
+                .srcAddrMode  = ldmaCtrlSrcAddrModeAbs,
+                .dstAddrMode  = ldmaCtrlDstAddrModeAbs,
+                .srcAddr      = (uint32_t)&(BOARD_USART->RXDATA),
+                .dstAddr      = (uint32_t)&m_rx_buffer[i * RX_HALF_SIZE],
+                .linkMode     = ldmaLinkModeAbs,
+                .link         = 1,
+                .linkAddr     = ((uint32_t)&m_rx_dma_descriptor[1 - i])>>2
+            }
+        };
+    }
 
-    // Loop as much as we can, it will be stopped by uart timeout
-    // (255 max at the moment).
     LDMA_TransferCfg_t ldmaRXConfig =
-        (LDMA_TransferCfg_t)LDMA_TRANSFER_CFG_PERIPHERAL_LOOP(
-                                 BOARD_UART_LDMA_RX,
-                                 0xff);
+        (LDMA_TransferCfg_t)LDMA_TRANSFER_CFG_PERIPHERAL(BOARD_UART_LDMA_RX);
+
+    m_rx_read_index = 0;
 
     LDMA_StartTransfer(DMA_RX_CH,
                        &ldmaRXConfig,
                        &m_rx_dma_descriptor[0]);
 }
 
+static void flush_rx(void)
+{
+    // DMA destination is the next byte to be written
+    uint32_t write_index =
+        (uint8_t *) LDMA->CH[DMA_RX_CH].DST - m_rx_buffer;
+
+    if (write_index >= RX_BUFFER_SIZE)
+    {
+        // End of second half, next byte goes to start of buffer
+        write_index = 0;
+    }
+
+    // Send bytes to upper level, directly from the circular buffer
+    if (m_rx_callback != NULL)
+    {
+        if (write_index < m_rx_read_index)
+        {
+            // Send end of the buffer
+            m_rx_callback(&m_rx_buffer[m_rx_read_index],
+                          RX_BUFFER_SIZE - m_rx_read_index);
+            m_rx_read_index = 0;
+        }
+
+        if (write_index > m_rx_read_index)
+        {
+            m_rx_callback(&m_rx_buffer[m_rx_read_index],
+                          write_index - m_rx_read_index);
+        }
+    }
+    m_rx_read_index = write_index;
+}
+
 void Usart_enableReceiver(serial_rx_callback_f rx_callback)
 {
     Sys_enterCriticalSection();
@@ -549,30 +567,23 @@ void Usart_flush(void)
 void __attribute__((__interrupt__)) USART_RX_IRQHandler(void)
 {
     // RX Timeout
-    if (BOARD_USART->IF && USART_IF_TCMP1)
+    if (BOARD_USART->IF & USART_IF_TCMP1)
     {
         BOARD_USART_CLR_IRQ_TCMP1;
-        if(m_rx_callback != NULL)
-        {
-            uint8_t * end_buffer = (uint8_t *) LDMA->CH[DMA_RX_CH].DST;
-            uint8_t * old_buffer = DoubleBuffer_getActive(m_rx_buffers);
-            // Stop RX DMA
-            BUS_RegBitWrite(&(LDMA->CHEN), DMA_RX_CH, 0);
-
-            // Swipe RX buffers
-            DoubleBuffer_swipe(m_rx_buffers);
-
-            // Restart DMA
-            start_dma_rx_lock();
-
-            // Send bytes to upper level
-            m_rx_callback(old_buffer, end_buffer-old_buffer);
-        }
+        // No activity on RX line: end of message
+        flush_rx();
     }
 }
 
 void __attribute__((__interrupt__)) LDMA_IRQHandler(void)
 {
+    // Check if a half of RX buffer is full
+    if (LDMA->IF & (1 << DMA_RX_CH))
+    {
+        BOARD_USART_LDMA_CLR_IRQ = 1 << DMA_RX_CH;
+        flush_rx();
+    }
+
     // Check if DMA_TX_CHANNEL is done
     if (LDMA->IF & (1 << DMA_TX_CH))
     {
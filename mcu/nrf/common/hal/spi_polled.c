@@ -0,0 +1,269 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/*
+ * SPI master driver without interrupts, for code that runs without the
+ * stack, like the bootloader (HAL_SPI_POLLED=yes). It implements the same
+ * interface as spi.c, but only blocking transfers are supported: transfer
+ * end is polled from the SPIM END event.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "board.h"
+#include "spi.h"
+
+#include "mcu.h"
+
+#if defined(USE_SPI0)
+#define SPI_DEV     NRF_SPIM0
+#elif defined(USE_SPI1)
+#define SPI_DEV     NRF_SPIM1
+#elif defined(USE_SPI2)
+#define SPI_DEV     NRF_SPIM2
+#else
+#error USE_SPI0 or USE_SPI1 or USE_SPI2 must be defined
+#endif
+
+/** Start of data RAM, EasyDMA can only access RAM */
+#define RAM_START       0x20000000UL
+
+/** Bounce buffer size for data in flash, up to max transfer size */
+#define BOUNCE_SIZE     255
+
+/** Is SPI module initialized */
+static bool m_initialized = false;
+
+/** Bytes to write that are not in RAM */
+static uint8_t m_bounce[BOUNCE_SIZE];
+
+/**
+ * \brief   Configure different SPI gpios (SCK, MOSI and MISO)
+ * \param   mode
+ *          SPI mode chosen
+ */
+static void configure_gpios(spi_mode_e mode)
+{
+    // Configure clock pin (depending on mode)
+    if (mode == SPI_MODE_LOW_FIRST || mode == SPI_MODE_LOW_SECOND)
+    {
+        nrf_gpio_pin_set(BOARD_SPI_SCK_PIN);
+    }
+    else
+    {
+        nrf_gpio_pin_clear(BOARD_SPI_SCK_PIN);
+    }
+
+    NRF_GPIO->PIN_CNF[BOARD_SPI_SCK_PIN] =
+        (GPIO_PIN_CNF_DIR_Output        << GPIO_PIN_CNF_DIR_Pos)
+      | (GPIO_PIN_CNF_INPUT_Connect     << GPIO_PIN_CNF_INPUT_Pos)
+      | (GPIO_PIN_CNF_PULL_Disabled     << GPIO_PIN_CNF_PULL_Pos)
+      | (GPIO_PIN_CNF_DRIVE_S0S1        << GPIO_PIN_CNF_DRIVE_Pos)
+      | (GPIO_PIN_CNF_SENSE_Disabled    << GPIO_PIN_CNF_SENSE_Pos);
+
+    // Configure MOSI
+    nrf_gpio_pin_clear(BOARD_SPI_MOSI_PIN);
+    nrf_gpio_cfg_output(BOARD_SPI_MOSI_PIN);
+
+    // Configure MISO
+    nrf_gpio_cfg_input(BOARD_SPI_MISO_PIN,
+                       NRF_GPIO_PIN_NOPULL);
+}
+
+/**
+ * \brief   Release different SPI gpios (SCK, MOSI and MISO)
+ */
+static void release_gpios()
+{
+    nrf_gpio_cfg_default(BOARD_SPI_SCK_PIN);
+    nrf_gpio_cfg_default(BOARD_SPI_MOSI_PIN);
+    nrf_gpio_cfg_default(BOARD_SPI_MISO_PIN);
+}
+
+/**
+ * \brief   Set the frequency of the SPI module
+ * \param   freq
+ *          Frequency requested in Hz
+ * \return  True if successful set, false if not available
+ */
+static bool set_frequency(uint32_t freq)
+{
+    uint32_t reg;
+    switch (freq)
+    {
+        case 125000:
+            reg = SPIM_FREQUENCY_FREQUENCY_K125;
+            break;
+        case 250000:
+            reg = SPIM_FREQUENCY_FREQUENCY_K250;
+            break;
+        case 500000:
+            reg = SPIM_FREQUENCY_FREQUENCY_K500;
+            break;
+        case 1000000:
+            reg = SPIM_FREQUENCY_FREQUENCY_M1;
+            break;
+        case 2000000:
+            reg = SPIM_FREQUENCY_FREQUENCY_M2;
+            break;
+        case 4000000:
+            reg = SPIM_FREQUENCY_FREQUENCY_M4;
+            break;
+        case 8000000:
+            reg = SPIM_FREQUENCY_FREQUENCY_M8;
+            break;
+        default:
+            return false;
+    }
+    SPI_DEV->FREQUENCY = reg;
+    return true;
+}
+
+/**
+ * \brief   Set the SPI Mode of operation
+ * \param   mode
+ *          SPI mode of operation
+ * \param   bit_order
+ *          Bit order of SPI transfers
+ */
+static void set_mode(spi_mode_e mode, spi_bit_order_e bit_order)
+{
+    uint32_t config = 0;
+    if (bit_order == SPI_ORDER_LSB)
+    {
+        config |= (SPIM_CONFIG_ORDER_LsbFirst << SPIM_CONFIG_ORDER_Pos);
+    }
+    else
+    {
+        config |= (SPIM_CONFIG_ORDER_MsbFirst << SPIM_CONFIG_ORDER_Pos);
+    }
+
+    switch(mode)
+    {
+        case SPI_MODE_LOW_FIRST:
+            config |= (SPIM_CONFIG_CPOL_ActiveLow  << SPIM_CONFIG_CPOL_Pos) |
+                      (SPIM_CONFIG_CPHA_Leading    << SPIM_CONFIG_CPHA_Pos);
+            break;
+        case SPI_MODE_LOW_SECOND:
+            config |= (SPIM_CONFIG_CPOL_ActiveLow  << SPIM_CONFIG_CPOL_Pos) |
+                      (SPIM_CONFIG_CPHA_Trailing   << SPIM_CONFIG_CPHA_Pos);
+            break;
+        case SPI_MODE_HIGH_FIRST:
+            config |= (SPIM_CONFIG_CPOL_ActiveHigh << SPIM_CONFIG_CPOL_Pos) |
+                      (SPIM_CONFIG_CPHA_Leading    << SPIM_CONFIG_CPHA_Pos);
+            break;
+        case SPI_MODE_HIGH_SECOND:
+            config |= (SPIM_CONFIG_CPOL_ActiveHigh << SPIM_CONFIG_CPOL_Pos) |
+                      (SPIM_CONFIG_CPHA_Trailing   << SPIM_CONFIG_CPHA_Pos);
+            break;
+    }
+    SPI_DEV->CONFIG = config;
+}
+
+spi_res_e SPI_init(spi_conf_t * conf_p)
+{
+    if (m_initialized)
+    {
+        return SPI_RES_ALREADY_INITIALIZED;
+    }
+
+    // Configure the gpios
+    configure_gpios(conf_p->mode);
+
+    // Configure the SPIM module
+    SPI_DEV->PSEL.SCK  = BOARD_SPI_SCK_PIN;
+    SPI_DEV->PSEL.MOSI = BOARD_SPI_MOSI_PIN;
+    SPI_DEV->PSEL.MISO = BOARD_SPI_MISO_PIN;
+
+    // Configure frequency
+    if (!set_frequency(conf_p->clock))
+    {
+        return SPI_RES_INVALID_CONFIG;
+    }
+
+    set_mode(conf_p->mode, conf_p->bit_order);
+
+    SPI_DEV->ORC = 0xff;
+
+    // No interrupts, END event is polled
+    SPI_DEV->INTENCLR = 0xffffffff;
+
+    SPI_DEV->ENABLE =
+        (SPIM_ENABLE_ENABLE_Enabled << SPIM_ENABLE_ENABLE_Pos);
+
+    m_initialized = true;
+
+    return SPI_RES_OK;
+}
+
+spi_res_e SPI_close()
+{
+    if (!m_initialized)
+    {
+        return SPI_RES_NOT_INITIALIZED;
+    }
+
+    m_initialized = false;
+
+    // Disable SPIM module
+    SPI_DEV->ENABLE =
+        (SPIM_ENABLE_ENABLE_Disabled << SPIM_ENABLE_ENABLE_Pos);
+
+    // Set all gpios as default configuration
+    release_gpios();
+
+    return SPI_RES_OK;
+}
+
+spi_res_e SPI_transfer(spi_xfer_t * xfer_p,
+                       spi_on_transfer_done_cb_f cb)
+{
+    uint8_t * write_ptr = xfer_p->write_ptr;
+
+    if (!m_initialized)
+    {
+        return SPI_RES_NOT_INITIALIZED;
+    }
+
+    if (cb != NULL)
+    {
+        return SPI_RES_ONLY_BLOCKING_AVAILABLE;
+    }
+
+    // Check transfer
+    if (((xfer_p->write_ptr != NULL) && (xfer_p->write_size == 0)) ||
+        ((xfer_p->write_ptr == NULL) && (xfer_p->write_size != 0)) ||
+        ((xfer_p->read_ptr != NULL) && (xfer_p->read_size == 0)) ||
+        ((xfer_p->read_ptr == NULL) && (xfer_p->read_size != 0)))
+    {
+        return SPI_RES_INVALID_XFER;
+    }
+
+    if ((write_ptr != NULL) && ((uint32_t) write_ptr < RAM_START))
+    {
+        // EasyDMA cannot read flash
+        memcpy(m_bounce, write_ptr, xfer_p->write_size);
+        write_ptr = m_bounce;
+    }
+
+    // Setup the transfer, DMA goes directly to and from client buffers
+    SPI_DEV->TXD.PTR = (uint32_t) write_ptr;
+    SPI_DEV->TXD.MAXCNT = xfer_p->write_size;
+    SPI_DEV->RXD.PTR = (uint32_t) xfer_p->read_ptr;
+    SPI_DEV->RXD.MAXCNT = xfer_p->read_size;
+
+    SPI_DEV->EVENTS_END = 0x0;
+    SPI_DEV->TASKS_START = 0x1UL;
+
+    while (SPI_DEV->EVENTS_END == 0)
+    {
+    }
+    SPI_DEV->EVENTS_END = 0x0;
+
+    return SPI_RES_OK;
+}
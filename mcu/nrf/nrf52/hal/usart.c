@@ -11,6 +11,7 @@
 #include "board.h"
 #include "hal_api.h"
 #include "api.h"
+#include "ring.h"
 
 
 #if defined(BOARD_USART_TX_PIN) && defined (BOARD_USART_RX_PIN)
@@ -18,12 +19,12 @@
 /* Only one USART, this is easy */
 static volatile serial_rx_callback_f    m_rx_callback;
 
-// Declare unique ring-buffer size
+// Transmission buffer size, a power of two
 #define BUFFER_SIZE                     512u
-#include "ringbuffer.h"
 
 // Buffer for transmissions
-static volatile ringbuffer_t            m_usart_tx_buffer;
+static uint8_t                          m_usart_tx_buffer[BUFFER_SIZE];
+static ring_t                           m_usart_tx_ring;
 
 /** Indicate if USART is enabled */
 static volatile uint32_t                m_enabled;
@@ -53,7 +54,7 @@ bool Usart_init(uint32_t baudrate, uart_flow_control_e flow_control)
 
     /* Module variables */
     m_enabled = false;
-    Ringbuffer_reset(m_usart_tx_buffer);
+    Ring_init(&m_usart_tx_ring, m_usart_tx_buffer, BUFFER_SIZE);
     m_rx_callback = NULL;
     m_tx_active = false;
 
@@ -180,24 +181,21 @@ uint32_t Usart_sendBuffer(const void * buffer, uint32_t length)
 {
     bool empty = false;
     uint32_t size_in = length;
-    uint8_t * data_out = (uint8_t *)buffer;
+    uint8_t * data_out;
     Sys_enterCriticalSection();
-    if (Ringbuffer_free(m_usart_tx_buffer) < length)
+    if (Ring_free(&m_usart_tx_ring) < length)
     {
         size_in = 0;
         goto buffer_too_large;
     }
-    empty = (Ringbuffer_usage(m_usart_tx_buffer) == 0);
-    while(length--)
-    {
-        Ringbuffer_getHeadByte(m_usart_tx_buffer) = *data_out++;
-        Ringbuffer_incrHead(m_usart_tx_buffer, 1);
-    }
+    empty = Ring_isEmpty(&m_usart_tx_ring);
+    Ring_write(&m_usart_tx_ring, buffer, length);
     if (empty)
     {
         Usart_setEnabled(true);
         NRF_UART0->TASKS_STARTTX = 1;
-        NRF_UART0->TXD = Ringbuffer_getTailByte(m_usart_tx_buffer);
+        Ring_peekRead(&m_usart_tx_ring, &data_out);
+        NRF_UART0->TXD = *data_out;
         m_tx_active = true;
     }
 buffer_too_large:
@@ -271,12 +269,13 @@ void __attribute__((__interrupt__)) UART0_IRQHandler(void)
     /* TX byte complete, start next or disable transmitter */
     if (NRF_UART0->EVENTS_TXDRDY != 0)
     {
+        uint8_t * data_out;
         NRF_UART0->EVENTS_TXDRDY = 0;
         /* byte has been sent -> move tail */
-        Ringbuffer_incrTail(m_usart_tx_buffer, 1);
-        if (Ringbuffer_usage(m_usart_tx_buffer) != 0)
+        Ring_commitRead(&m_usart_tx_ring, 1);
+        if (Ring_peekRead(&m_usart_tx_ring, &data_out) != 0)
         {
-            NRF_UART0->TXD = Ringbuffer_getTailByte(m_usart_tx_buffer);
+            NRF_UART0->TXD = *data_out;
         }
         else
         {
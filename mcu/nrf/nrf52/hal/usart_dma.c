@@ -33,6 +33,11 @@ static volatile bool m_tx_ongoing;
 static uint8_t m_rx_circular_buffer[RX_BUFFER_SIZE];
 static uint8_t m_last_rx_index = 0;
 
+/* Received bytes are also given to upper level each time this many bytes
+ * are received in a burst, so that the DMA never overwrites bytes not yet
+ * handled, whatever the burst length */
+#define RX_THRESHOLD                    (RX_BUFFER_SIZE / 2)
+
 /* Timeout in number of bytes at configured baudrate to declare that
  * a message is received */
 #define TIMEOUT_CHAR_N                  5
@@ -63,6 +68,11 @@ static void                             start_tx_lock(void);
 /** Declare the interrupt handler */
 void __attribute__((__interrupt__))     UARTE0_IRQHandler(void);
 void __attribute__((__interrupt__))     TIMER1_IRQHandler(void);
+void __attribute__((__interrupt__))     TIMER2_IRQHandler(void);
+
+/** Give bytes received since last call to upper level. This function must
+ *  be called from interrupt context */
+static void                             flush_rx(void);
 
 
 bool Usart_init(uint32_t baudrate, uart_flow_control_e flow_control)
@@ -119,6 +129,11 @@ bool Usart_init(uint32_t baudrate, uart_flow_control_e flow_control)
                          APP_LIB_SYSTEM_IRQ_PRIO_HI,
                          TIMER1_IRQHandler);
 
+    Sys_clearFastAppIrq(TIMER2_IRQn);
+    Sys_enableFastAppIrq(TIMER2_IRQn,
+                         APP_LIB_SYSTEM_IRQ_PRIO_HI,
+                         TIMER2_IRQHandler);
+
     return ret;
 }
 
@@ -177,8 +192,9 @@ void Usart_receiverOn(void)
     NRF_UARTE0->EVENTS_ENDRX = 0;
     NRF_UARTE0->EVENTS_RXSTARTED = 0;
 
-    // Reset Timer 1
+    // Reset Timer 1 and Timer 2 events
     NRF_TIMER1->EVENTS_COMPARE[0] = 0;
+    NRF_TIMER2->EVENTS_COMPARE[1] = 0;
 
     // Prepare RX buffer
     NRF_UARTE0->RXD.PTR = (uint32_t) m_rx_circular_buffer;
@@ -331,6 +347,13 @@ void __attribute__((__interrupt__)) UARTE0_IRQHandler(void)
         start_tx_lock();
     }
 
+    /* RX buffer wrapped, give its end to upper level */
+    if (NRF_UARTE0->EVENTS_ENDRX != 0)
+    {
+        NRF_UARTE0->EVENTS_ENDRX = 0;
+        flush_rx();
+    }
+
     /* Handle errors: Nothing to do specific at the moment */
     if (NRF_UARTE0->EVENTS_ERROR != 0)
     {
@@ -343,35 +366,12 @@ void __attribute__((__interrupt__)) UARTE0_IRQHandler(void)
 
 void __attribute__((__interrupt__)) TIMER1_IRQHandler(void)
 {
-    uint8_t index;
     // Handle reception
     if (NRF_TIMER1->EVENTS_COMPARE[0] != 0)
     {
         NRF_TIMER1->EVENTS_COMPARE[0] = 0;
-
-        // Read current index in RX buffer reflected in Timer2 counter
-        NRF_TIMER2->TASKS_CAPTURE[0] = 1;
-        index = NRF_TIMER2->CC[0] & 0xff;
-
-        if (m_last_rx_index != index)
-        {
-            // Time to send received byte to upper level
-            if(m_rx_callback != NULL)
-            {
-                // Check for a wrap of counter
-                if (index < m_last_rx_index)
-                {
-                    // Send end of the buffer
-                    m_rx_callback(m_rx_circular_buffer + m_last_rx_index,
-                                  RX_BUFFER_SIZE - m_last_rx_index);
-                    m_last_rx_index = 0;
-                }
-
-                m_rx_callback(m_rx_circular_buffer + m_last_rx_index,
-                              index - m_last_rx_index);
-                m_last_rx_index = index;
-            }
-        }
+        // No activity on RX line: end of message
+        flush_rx();
         // Do not clear the TIMER1, it will be cleared on next reception by PPI
     }
 
@@ -379,6 +379,54 @@ void __attribute__((__interrupt__)) TIMER1_IRQHandler(void)
     EVENT_READBACK = NRF_TIMER1->EVENTS_COMPARE[0];
 }
 
+void __attribute__((__interrupt__)) TIMER2_IRQHandler(void)
+{
+    // Threshold reached in the middle of a long burst
+    if (NRF_TIMER2->EVENTS_COMPARE[1] != 0)
+    {
+        NRF_TIMER2->EVENTS_COMPARE[1] = 0;
+        flush_rx();
+    }
+
+    // read any event from peripheral to flush the write buffer:
+    EVENT_READBACK = NRF_TIMER2->EVENTS_COMPARE[1];
+}
+
+static void flush_rx(void)
+{
+    uint8_t index;
+
+    // Read current index in RX buffer reflected in Timer2 counter
+    NRF_TIMER2->TASKS_CAPTURE[0] = 1;
+    index = NRF_TIMER2->CC[0] & 0xff;
+
+    if (m_last_rx_index == index)
+    {
+        return;
+    }
+
+    // Time to send received bytes to upper level, directly from the
+    // DMA buffer
+    if(m_rx_callback != NULL)
+    {
+        // Check for a wrap of counter
+        if (index < m_last_rx_index)
+        {
+            // Send end of the buffer
+            m_rx_callback(m_rx_circular_buffer + m_last_rx_index,
+                          RX_BUFFER_SIZE - m_last_rx_index);
+            m_last_rx_index = 0;
+        }
+
+        if (index > m_last_rx_index)
+        {
+            m_rx_callback(m_rx_circular_buffer + m_last_rx_index,
+                          index - m_last_rx_index);
+        }
+    }
+    m_last_rx_index = index;
+}
+
 static void start_tx_lock(void)
 {
     if (m_tx_ongoing)
@@ -479,6 +527,7 @@ static void init_dma(uint32_t baudrate)
     NRF_UARTE0->INTENCLR = 0xffffffffUL;
     NRF_UARTE0->INTENSET =
         (UARTE_INTEN_ENDTX_Enabled << UARTE_INTEN_ENDTX_Pos) |
+        (UARTE_INTEN_ENDRX_Enabled << UARTE_INTEN_ENDRX_Pos) |
         (UARTE_INTEN_ERROR_Enabled << UARTE_INTEN_ERROR_Pos);
 
     /* Configure RX part */
@@ -494,12 +543,14 @@ static void init_dma(uint32_t baudrate)
      * - A second timer is configured to wake-up software each time there
      *   is no activity on the RX line for 5 bytes length (at configured baud)
      *   It is then time to send received bytes to upper level.
+     * - Software is also woken up when the counter reaches half of the
+     *   buffer (compare event of counter) and when the buffer wraps (ENDRX),
+     *   so bytes are given to upper level before the DMA overwrites them,
+     *   even for bursts longer than the buffer.
      *
-     * - It works as long as maximum packet size sent from other side
-     *   is smaller than 255 (it is the case for us). But it could be improved
-     *   also to allow infinite size packets by just waking up the software
-     *   when enough bytes are received in circular buffer before being erased.
-     *   But this improvement is not need at the moment.
+     * - Received bytes are given to upper level directly from the circular
+     *   buffer, without copy. Upper level must handle them in less than
+     *   half of the buffer duration (~1.3ms at 1Mbaud).
      */
 
     /* Add shortcut ENDRX->STARTRX */
@@ -514,6 +565,9 @@ static void init_dma(uint32_t baudrate)
         TIMER_MODE_MODE_LowPowerCounter << TIMER_MODE_MODE_Pos;
     NRF_TIMER2->BITMODE =
         TIMER_BITMODE_BITMODE_16Bit << TIMER_BITMODE_BITMODE_Pos;
+    NRF_TIMER2->CC[1] = RX_THRESHOLD;
+    NRF_TIMER2->INTENSET =
+        TIMER_INTENSET_COMPARE1_Enabled << TIMER_INTENSET_COMPARE1_Pos;
     NRF_TIMER2->TASKS_CLEAR = 1;
     NRF_TIMER2->TASKS_STOP = 1;
 
@@ -24,6 +24,9 @@
 /** \brief  Callback when bytes are received */
 static Usb_wrapper_rx_callback_f m_rx_cb;
 
+/** \brief  Callback when host opens or closes the port */
+static Usb_wrapper_connection_callback_f m_connection_cb;
+
 // Wait up to 1s for VBUS to stabilize
 #define MAX_DELAY_VBUS_READY_MS 1000
 
@@ -139,6 +142,48 @@ uint32_t Usb_wrapper_sendBuffer(const void * buffer, uint32_t length)
     return length;
 }
 
+bool Usb_wrapper_sendFrame(const void * header,
+                           uint32_t header_length,
+                           const void * buffer,
+                           uint32_t length)
+{
+    // All or nothing, a partial frame would desynchronize the host
+    if (tud_cdc_write_available() < header_length + length)
+    {
+        return false;
+    }
+
+    tud_cdc_write(header, header_length);
+    tud_cdc_write(buffer, length);
+    // Start the transfer now, frame is complete
+    tud_cdc_write_flush();
+
+    App_Scheduler_addTask_execTime(usb_task,
+                                   APP_SCHEDULER_SCHEDULE_ASAP,
+                                   USB_TASK_EXEC_TIME_US);
+
+    return true;
+}
+
+void Usb_wrapper_setConnectionCallback(Usb_wrapper_connection_callback_f cb)
+{
+    m_connection_cb = cb;
+}
+
+/**
+ * \brief   Invoked by tinyusb when DTR changes, i.e. when host opens or
+ *          closes the port
+ */
+void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
+{
+    (void) itf;
+    (void) rts;
+
+    if (m_connection_cb != NULL)
+    {
+        m_connection_cb(dtr);
+    }
+}
 
 /**
  * \brief   Initialize the tiny usb wrapper
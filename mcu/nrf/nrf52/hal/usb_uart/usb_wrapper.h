@@ -16,6 +16,11 @@
  */
 typedef void (*Usb_wrapper_rx_callback_f)(uint8_t * ch, size_t n);
 
+/**
+ * \brief   Callback to be called when host opens or closes the port
+ */
+typedef void (*Usb_wrapper_connection_callback_f)(bool connected);
+
 /**
  * \brief   Send a buffer
  * \param   buffer
@@ -25,6 +30,30 @@ typedef void (*Usb_wrapper_rx_callback_f)(uint8_t * ch, size_t n);
  */
 uint32_t Usb_wrapper_sendBuffer(const void * buffer, uint32_t length);
 
+/**
+ * \brief   Send a frame made of a header and a body, entirely or not at all
+ * \param   header
+ *          Header of the frame
+ * \param   header_length
+ *          Size of the header
+ * \param   buffer
+ *          Body of the frame
+ * \param   length
+ *          Size of the body
+ * \return  True if frame was queued, false if TX FIFO has not enough room
+ */
+bool Usb_wrapper_sendFrame(const void * header,
+                           uint32_t header_length,
+                           const void * buffer,
+                           uint32_t length);
+
+/**
+ * \brief   Set the callback to be called when host opens or closes the port
+ * \param   cb
+ *          Callback, NULL to disable
+ */
+void Usb_wrapper_setConnectionCallback(Usb_wrapper_connection_callback_f cb);
+
 /**
  * \brief   Initialize the tiny usb wrapper
  * \param   cb
@@ -259,6 +259,8 @@ static app_lib_data_receive_res_e data_received_cb(
                     "Set new Mcast address : 0x%x",
                     msg->payload.set_multicast_address.multicast_address); 
                 m_mcast_address=msg->payload.set_multicast_address.multicast_address;
+                /* filter_multicast_cb answer changed. */
+                Shared_Data_groupsChanged();
                 app_persistent_res_e res = App_Persistent_write((uint8_t *) &m_mcast_address, sizeof(m_mcast_address));
                 if (res != APP_PERSISTENT_RES_OK)
                 {
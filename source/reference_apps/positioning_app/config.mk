@@ -49,6 +49,14 @@ default_bletx_power=8
 # Default voltage reporting (yes/no) 
 default_voltage_report=yes
 
+# Compact measurement records (yes/no). Fits more anchors per message,
+# positioning engine must support record type 0x08
+default_compact_meas=no
+
+# Adaptive update (yes/no). Stretches static update period and sends
+# measurements only when they change
+default_adaptive_update=no
+
 # Default logging setting
 # LVL_DEBUG 4, LVL_INFO 3,LVL_WARNING ,LVL_ERROR 1, LVL_NOLOG 0
 default_debug_level=3
@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# compression_bench.py - Compare scratchpad compressors on application images
+#
+# For each application image and each compressor of deflate.py, this tool
+# compresses the image, decodes it back with the reference decoder of
+# util/inflate.c (compiled for the host) and reports:
+#   - compression ratio
+#   - decoder RAM: decoder state plus the window needed by the stream
+#   - host decoding time, to compare compressors relatively to each other
+#
+# Images are taken from the build folder, for every application found under
+# source/, or given explicitly on the command line.
+#
+# Requires:
+#   - Python 3 v3.2 or newer
+#   - A host C compiler (cc)
+#   - hextool.py and deflate.py in the same directory as this file
+
+import sys
+import os
+import glob
+import ctypes
+import argparse
+import subprocess
+import tempfile
+import textwrap
+import time
+import hextool
+import deflate
+
+
+# Constants
+
+# Paths relative to SDK root
+SDK_ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+UTIL_PATH = os.path.join(SDK_ROOT, "util")
+SOURCE_PATH = os.path.join(SDK_ROOT, "source")
+
+# Host side glue: decode to a flat buffer, so that timing is only C code
+HARNESS_SOURCE = r'''
+#include <string.h>
+#include "inflate.h"
+
+typedef struct
+{
+    uint8_t * out;
+    size_t cap;
+    size_t len;
+} out_t;
+
+static bool write_out(const uint8_t * bytes, size_t len, void * ctx)
+{
+    out_t * o = ctx;
+    if (o->len + len > o->cap)
+    {
+        return false;
+    }
+    memcpy(&o->out[o->len], bytes, len);
+    o->len += len;
+    return true;
+}
+
+size_t bench_state_size(void)
+{
+    return sizeof(inflate_t);
+}
+
+int bench_inflate(const uint8_t * src, size_t src_len,
+                  uint8_t * window, size_t window_size,
+                  uint8_t * out, size_t out_cap,
+                  size_t * out_len, uint32_t * max_dist)
+{
+    static inflate_t state;
+    out_t o = { out, out_cap, 0 };
+    inflate_res_e res = Inflate_run(&state, src, src_len,
+                                    window, window_size, write_out, &o);
+    *out_len = o.len;
+    *max_dist = state.max_dist;
+    return res;
+}
+'''
+
+# Number of decoding runs, best time is kept
+NUM_RUNS = 5
+
+
+# Functions
+
+def build_decoder(tmpdir):
+    '''Compile util/inflate.c and harness as a shared library.'''
+
+    harness = os.path.join(tmpdir, "harness.c")
+    with open(harness, "w") as f:
+        f.write(HARNESS_SOURCE)
+
+    lib = os.path.join(tmpdir, "libinflate_bench.so")
+    subprocess.check_call(["cc", "-std=gnu99", "-O2", "-shared", "-fPIC",
+                           "-I" + UTIL_PATH, "-o", lib, harness,
+                           os.path.join(UTIL_PATH, "inflate.c")])
+
+    dll = ctypes.CDLL(lib)
+    dll.bench_state_size.restype = ctypes.c_size_t
+    dll.bench_inflate.restype = ctypes.c_int
+    dll.bench_inflate.argtypes = [ctypes.c_char_p, ctypes.c_size_t,
+                                  ctypes.c_void_p, ctypes.c_size_t,
+                                  ctypes.c_void_p, ctypes.c_size_t,
+                                  ctypes.POINTER(ctypes.c_size_t),
+                                  ctypes.POINTER(ctypes.c_uint32)]
+    return dll
+
+def decode(dll, stream, out_cap, window_size):
+    '''Decode a stream, return (result, data, max distance, best time).'''
+
+    window = ctypes.create_string_buffer(window_size)
+    out = ctypes.create_string_buffer(out_cap)
+    out_len = ctypes.c_size_t()
+    max_dist = ctypes.c_uint32()
+    best = None
+
+    for _ in range(NUM_RUNS):
+        start = time.perf_counter()
+        res = dll.bench_inflate(bytes(stream), len(stream),
+                                window, window_size, out, out_cap,
+                                ctypes.byref(out_len), ctypes.byref(max_dist))
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+
+    return res, out.raw[:out_len.value], max_dist.value, best
+
+def window_needed(max_dist):
+    '''Smallest power of two window holding the biggest distance.'''
+    window = 1
+    while window < max_dist:
+        window <<= 1
+    return window
+
+def find_app_images(build_dir, board):
+    '''Find application images built for every application in source/.'''
+
+    images = []
+    for app_makefile in sorted(glob.glob(os.path.join(SOURCE_PATH, "*", "*",
+                                                      "makefile"))):
+        app_name = os.path.basename(os.path.dirname(app_makefile))
+        pattern = os.path.join(build_dir, board, app_name, app_name + ".hex")
+        images.extend(sorted(glob.glob(pattern)))
+    return images
+
+def load_image(filename):
+    memory = hextool.Memory()
+    hextool.load_intel_hex(memory, filename = filename)
+    if memory.num_ranges == 0:
+        raise ValueError("file contains no data: '%s'" % filename)
+    return memory[memory.min_address:memory.max_address]
+
+def create_argument_parser(pgmname):
+    '''Create a parser for parsing the command line.'''
+
+    # Determine help text width.
+    try:
+        help_width = int(os.environ['COLUMNS'])
+    except (KeyError, ValueError):
+        help_width = 80
+    help_width -= 2
+
+    parser = argparse.ArgumentParser(
+        prog = pgmname,
+        formatter_class = argparse.RawDescriptionHelpFormatter,
+        description = textwrap.fill(
+            "A tool to compare scratchpad compressors on application "
+            "images, with the reference decoder of util/inflate.c",
+            help_width))
+    parser.add_argument("--builddir", "-b",
+        metavar = "DIR", default = os.path.join(SDK_ROOT, "build"),
+        help = "build folder to search images in (default: %(default)s)")
+    parser.add_argument("--board", "-t",
+        metavar = "BOARD", default = "*",
+        help = "only use images built for this board (default: all)")
+    parser.add_argument("--compressor", "-z",
+        choices = sorted(deflate.COMPRESSORS), action = "append",
+        help = "compressor to benchmark, can be repeated (default: all)")
+    parser.add_argument("image", nargs = "*", metavar = "IMAGE",
+        help = "image in Intel HEX format, instead of searching build folder")
+
+    return parser
+
+def main():
+    '''Main program'''
+
+    # Determine program name, for error messages.
+    pgmname = os.path.split(sys.argv[0])[-1]
+
+    # Create a parser for parsing the command line and printing error messages.
+    parser = create_argument_parser(pgmname)
+    args = parser.parse_args()
+
+    compressors = args.compressor or sorted(deflate.COMPRESSORS)
+    images = args.image or find_app_images(args.builddir, args.board)
+    if len(images) == 0:
+        sys.stdout.write("%s: no image found, build applications first\n" %
+                         pgmname)
+        return 1
+
+    failed = False
+    with tempfile.TemporaryDirectory() as tmpdir:
+        try:
+            dll = build_decoder(tmpdir)
+        except (OSError, subprocess.CalledProcessError) as exc:
+            sys.stdout.write("%s: cannot build decoder: %s\n" % (pgmname, exc))
+            return 1
+        state_size = dll.bench_state_size()
+
+        sys.stdout.write("%-40s %-12s %8s %8s %7s %9s %10s\n" %
+                         ("image", "compressor", "in", "out", "ratio",
+                          "ram", "decode_us"))
+        for filename in images:
+            try:
+                data = bytes(load_image(filename))
+            except (ValueError, IOError, OSError) as exc:
+                sys.stdout.write("%s: %s\n" % (pgmname, exc))
+                failed = True
+                continue
+
+            name = os.path.relpath(filename, args.builddir)
+            for compressor in compressors:
+                stream = deflate.COMPRESSORS[compressor](data)
+                res, out, max_dist, elapsed = decode(dll, stream, len(data),
+                                                     deflate.MAX_WINDOW)
+                ok = res == 0 and out == data
+
+                # Check decoding really works with the smallest window.
+                window = window_needed(max_dist)
+                if ok and window < deflate.MAX_WINDOW:
+                    res, out, _, _ = decode(dll, stream, len(data), window)
+                    ok = res == 0 and out == data
+
+                if not ok:
+                    sys.stdout.write("%s: round trip failed: %s, %s\n" %
+                                     (pgmname, name, compressor))
+                    failed = True
+                    continue
+
+                sys.stdout.write("%-40s %-12s %8d %8d %6.1f%% %9d %10.0f\n" %
+                                 (name, compressor, len(data), len(stream),
+                                  100.0 * len(stream) / len(data),
+                                  state_size + window, elapsed * 1e6))
+
+    return 1 if failed else 0
+
+# Run main.
+if __name__ == "__main__":
+    sys.exit(main())
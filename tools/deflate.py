@@ -0,0 +1,538 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# deflate.py - Raw deflate (RFC 1951) encoders for scratchpad generation
+#
+# This file is a module used by genscratchpad.py. The bootloader decompresses
+# scratchpad files with a deflate decoder, so all compressors produce a
+# standard raw deflate stream (no zlib header, no Adler-32 checksum):
+#
+#   - zlib:         zlib at maximum compression level, the historical default
+#   - optimal:      optimal parsing in the spirit of zopfli: matches are chosen
+#                   with a shortest path search over the whole image, using
+#                   the bit costs of the Huffman codes of a previous pass
+#   - smallwindow:  same as optimal, but distances are limited to 1 kB so that
+#                   a decoder only needs a 1 kB window (see util/inflate.h)
+#   - stored:       no compression, stored blocks only
+#
+# Requires:
+#   - Python 3 v3.2 or newer
+
+import heapq
+import bisect
+import zlib
+import struct
+
+
+# Constants
+
+# Maximum window size and match length of deflate
+MAX_WINDOW = 32768
+MIN_MATCH = 3
+MAX_MATCH = 258
+
+# Window size used by the smallwindow compressor
+SMALL_WINDOW = 1024
+
+# Maximum number of hash chain entries checked per position
+MAX_CHAIN = 256
+
+# Number of optimal parsing passes, each using costs from the previous one
+NUM_PASSES = 3
+
+# Matches longer than this are not split in the shortest path search, only
+# their full length is considered (long runs, typically padding)
+MAX_SPLIT_LEN = 32
+
+# Number of symbols of the initial blocks, before merging them back
+# when one Huffman code for both is cheaper than two
+SPLIT_BLOCK_SYMBOLS = 1024
+
+# Maximum code lengths
+MAX_CODE_BITS = 15
+MAX_CODE_LENGTH_BITS = 7
+
+# Length codes: base length and number of extra bits, codes 257 .. 285
+LENGTH_BASE = [3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+               35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258]
+LENGTH_EXTRA = [0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0]
+
+# Distance codes: base distance and number of extra bits, codes 0 .. 29
+DIST_BASE = [1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+             257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+             8193, 12289, 16385, 24577]
+DIST_EXTRA = [0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+              7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13]
+
+# Order of code length code lengths in a dynamic block header
+CODE_LENGTH_ORDER = [16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2,
+                     14, 1, 15]
+
+END_OF_BLOCK = 256
+
+# Length to (symbol, extra bits, extra value)
+LENGTH_TABLE = [None] * (MAX_MATCH + 1)
+for _code, _base in enumerate(LENGTH_BASE):
+    for _len in range(_base, _base + (1 << LENGTH_EXTRA[_code])):
+        if _len <= MAX_MATCH and LENGTH_TABLE[_len] is None:
+            LENGTH_TABLE[_len] = (257 + _code, LENGTH_EXTRA[_code],
+                                  _len - _base)
+
+
+# Classes
+
+class BitWriter(object):
+    '''Accumulate bits, least significant bit first, as deflate does'''
+
+    def __init__(self):
+        self.data = bytearray()
+        self.acc = 0
+        self.num_bits = 0
+
+    def put(self, value, num_bits):
+        self.acc |= value << self.num_bits
+        self.num_bits += num_bits
+        while self.num_bits >= 8:
+            self.data.append(self.acc & 0xff)
+            self.acc >>= 8
+            self.num_bits -= 8
+
+    def put_code(self, code, length):
+        '''Huffman codes are sent most significant bit first.'''
+        rev = 0
+        for _ in range(length):
+            rev = (rev << 1) | (code & 1)
+            code >>= 1
+        self.put(rev, length)
+
+    def align(self):
+        if self.num_bits > 0:
+            self.put(0, 8 - self.num_bits)
+
+    def get_bytes(self):
+        self.align()
+        return self.data
+
+
+# Functions
+
+def dist_symbol(dist):
+    '''Return (symbol, extra bits, extra value) of a distance.'''
+    code = bisect.bisect_right(DIST_BASE, dist) - 1
+    return code, DIST_EXTRA[code], dist - DIST_BASE[code]
+
+def huffman_lengths(freqs, max_bits):
+    '''Compute length limited Huffman code lengths from frequencies.'''
+
+    freqs = list(freqs)
+    while True:
+        used = [(f, n) for n, f in enumerate(freqs) if f > 0]
+        lengths = [0] * len(freqs)
+        if len(used) == 0:
+            return lengths
+        if len(used) == 1:
+            # Deflate decoders expect complete codes, give one bit.
+            lengths[used[0][1]] = 1
+            return lengths
+
+        # Build tree with a heap of (frequency, tie breaker, symbols).
+        heap = [(f, n, [n]) for f, n in used]
+        heapq.heapify(heap)
+        tie = len(freqs)
+        while len(heap) > 1:
+            f1, _, s1 = heapq.heappop(heap)
+            f2, _, s2 = heapq.heappop(heap)
+            for n in s1 + s2:
+                lengths[n] += 1
+            heapq.heappush(heap, (f1 + f2, tie, s1 + s2))
+            tie += 1
+
+        if max(lengths) <= max_bits:
+            return lengths
+
+        # Too deep, flatten frequencies and try again.
+        freqs = [(f + 1) // 2 if f > 0 else 0 for f in freqs]
+
+def canonical_codes(lengths):
+    '''Compute canonical Huffman codes from code lengths.'''
+
+    bl_count = [0] * (MAX_CODE_BITS + 1)
+    for length in lengths:
+        if length:
+            bl_count[length] += 1
+
+    next_code = [0] * (MAX_CODE_BITS + 2)
+    code = 0
+    for bits in range(1, MAX_CODE_BITS + 1):
+        code = (code + bl_count[bits - 1]) << 1
+        next_code[bits] = code
+
+    codes = [0] * len(lengths)
+    for n, length in enumerate(lengths):
+        if length:
+            codes[n] = next_code[length]
+            next_code[length] += 1
+    return codes
+
+def find_matches(data, window):
+    '''
+    For every position, find match candidates with hash chains.
+    Return a list of [(length, distance), ...] per position, with increasing
+    lengths and distances: each candidate is the closest one reaching its
+    length.
+    '''
+
+    size = len(data)
+    head = {}
+    prev = [-1] * size
+    matches = [None] * size
+
+    for pos in range(size - MIN_MATCH + 1):
+        key = data[pos:pos + MIN_MATCH]
+        cand = head.get(key, -1)
+        prev[pos] = cand
+        head[key] = pos
+
+        max_len = min(MAX_MATCH, size - pos)
+        best = MIN_MATCH - 1
+        found = []
+        chain = MAX_CHAIN
+        while cand >= 0 and pos - cand <= window and chain > 0:
+            chain -= 1
+            # Only candidates beating current best are interesting.
+            if data[cand:cand + best + 1] == data[pos:pos + best + 1]:
+                # Find match length with slice comparisons (binary search).
+                low, high = best + 1, max_len
+                while low < high:
+                    mid = (low + high + 1) // 2
+                    if data[cand:cand + mid] == data[pos:pos + mid]:
+                        low = mid
+                    else:
+                        high = mid - 1
+                best = low
+                found.append((best, pos - cand))
+                if best == max_len:
+                    break
+            cand = prev[cand]
+
+        if found:
+            matches[pos] = found
+
+    return matches
+
+def symbol_costs(lit_lengths, dist_lengths):
+    '''Bit costs of literals, lengths and distances from code lengths.'''
+
+    # Unused symbols get a pessimistic cost, so they stay usable.
+    lit_cost = [l if l else MAX_CODE_BITS for l in lit_lengths]
+    dist_cost = [l if l else MAX_CODE_BITS for l in dist_lengths]
+
+    len_cost = [0] * (MAX_MATCH + 1)
+    for length in range(MIN_MATCH, MAX_MATCH + 1):
+        sym, extra, _ = LENGTH_TABLE[length]
+        len_cost[length] = lit_cost[sym] + extra
+
+    return lit_cost, len_cost, dist_cost
+
+def fixed_lengths():
+    '''Code lengths of the fixed Huffman codes, used as first cost model.'''
+    lit = [8] * 144 + [9] * 112 + [7] * 24 + [8] * 8
+    return lit, [5] * 30
+
+def optimal_parse(data, matches, costs):
+    '''
+    Shortest path search over the data: choose the literal / match sequence
+    with the smallest cost according to given symbol costs.
+    '''
+
+    lit_cost, len_cost, dist_cost = costs
+    size = len(data)
+    inf = float("inf")
+    cost = [inf] * (size + 1)
+    choice = [None] * (size + 1)
+    cost[0] = 0
+
+    for pos in range(size):
+        c = cost[pos]
+
+        # Literal
+        lc = c + lit_cost[data[pos]]
+        if lc < cost[pos + 1]:
+            cost[pos + 1] = lc
+            choice[pos + 1] = (1, 0)
+
+        found = matches[pos]
+        if not found:
+            continue
+
+        low = MIN_MATCH
+        for length, dist in found:
+            dsym, dextra, _ = dist_symbol(dist)
+            dc = c + dist_cost[dsym] + dextra
+            if length > MAX_SPLIT_LEN:
+                # Long match: try short splits and full length only.
+                lengths = list(range(low, min(length, MAX_SPLIT_LEN) + 1))
+                lengths.append(length)
+            else:
+                lengths = range(low, length + 1)
+            for l in lengths:
+                mc = dc + len_cost[l]
+                if mc < cost[pos + l]:
+                    cost[pos + l] = mc
+                    choice[pos + l] = (l, dist)
+            low = length + 1
+
+    # Walk back the path.
+    symbols = []
+    pos = size
+    while pos > 0:
+        length, dist = choice[pos]
+        pos -= length
+        symbols.append((length, dist) if dist else (data[pos], 0))
+    symbols.reverse()
+    return symbols
+
+def symbol_frequencies(symbols):
+    lit_freq = [0] * 286
+    dist_freq = [0] * 30
+    for value, dist in symbols:
+        if dist:
+            lit_freq[LENGTH_TABLE[value][0]] += 1
+            dist_freq[dist_symbol(dist)[0]] += 1
+        else:
+            lit_freq[value] += 1
+    lit_freq[END_OF_BLOCK] = 1
+    return lit_freq, dist_freq
+
+def encode_code_lengths(lengths):
+    '''Run length encode code lengths with symbols 16, 17 and 18.'''
+
+    out = []
+    pos = 0
+    while pos < len(lengths):
+        value = lengths[pos]
+        run = 1
+        while pos + run < len(lengths) and lengths[pos + run] == value:
+            run += 1
+        pos += run
+
+        if value == 0:
+            while run >= 11:
+                n = min(run, 138)
+                out.append((18, 7, n - 11))
+                run -= n
+            if run >= 3:
+                out.append((17, 3, run - 3))
+                run = 0
+        else:
+            out.append((value, 0, 0))
+            run -= 1
+            while run >= 3:
+                n = min(run, 6)
+                out.append((16, 2, n - 3))
+                run -= n
+        out.extend([(value, 0, 0)] * run)
+    return out
+
+def block_codes(lit_freq, dist_freq):
+    '''
+    Compute code lengths and code length header of a dynamic block.
+    Return literal/length code lengths, distance code lengths, code length
+    code lengths, header symbols, and HLIT, HDIST, HCLEN fields.
+    '''
+
+    lit_lengths = huffman_lengths(lit_freq, MAX_CODE_BITS)
+    dist_lengths = huffman_lengths(dist_freq, MAX_CODE_BITS)
+    if sum(dist_lengths) == 0:
+        # At least one distance code must be described.
+        dist_lengths[0] = 1
+
+    hlit = max(257, max(n for n, l in enumerate(lit_lengths) if l) + 1)
+    hdist = max(1, max(n for n, l in enumerate(dist_lengths) if l) + 1)
+
+    cl_symbols = encode_code_lengths(lit_lengths[:hlit] +
+                                     dist_lengths[:hdist])
+    cl_freq = [0] * 19
+    for sym, _, _ in cl_symbols:
+        cl_freq[sym] += 1
+    cl_lengths = huffman_lengths(cl_freq, MAX_CODE_LENGTH_BITS)
+    hclen = 4
+    for n in range(19):
+        if cl_lengths[CODE_LENGTH_ORDER[n]]:
+            hclen = max(hclen, n + 1)
+
+    return (lit_lengths, dist_lengths, cl_lengths, cl_symbols,
+            hlit, hdist, hclen)
+
+def block_bits(lit_freq, dist_freq):
+    '''
+    Size in bits of a dynamic block, without length and distance extra bits
+    that don't depend on how symbols are split in blocks.
+    '''
+
+    (lit_lengths, dist_lengths, cl_lengths, cl_symbols,
+     _, _, hclen) = block_codes(lit_freq, dist_freq)
+
+    bits = 3 + 5 + 5 + 4 + 3 * hclen
+    for sym, extra, _ in cl_symbols:
+        bits += cl_lengths[sym] + extra
+    bits += sum(f * l for f, l in zip(lit_freq, lit_lengths))
+    bits += sum(f * l for f, l in zip(dist_freq, dist_lengths))
+    return bits
+
+def split_blocks(symbols):
+    '''
+    Split symbols in blocks: start from small blocks and merge neighbours
+    as long as it makes the stream smaller. Return list of (start, end).
+    '''
+
+    blocks = []
+    for start in range(0, len(symbols), SPLIT_BLOCK_SYMBOLS):
+        end = min(start + SPLIT_BLOCK_SYMBOLS, len(symbols))
+        freqs = symbol_frequencies(symbols[start:end])
+        blocks.append([start, end, freqs, block_bits(*freqs)])
+
+    def merged(a, b):
+        freqs = ([x + y for x, y in zip(a[2][0], b[2][0])],
+                 [x + y for x, y in zip(a[2][1], b[2][1])])
+        freqs[0][END_OF_BLOCK] = 1
+        return [a[0], b[1], freqs, block_bits(*freqs)]
+
+    candidates = [merged(blocks[n], blocks[n + 1])
+                  for n in range(len(blocks) - 1)]
+    while candidates:
+        gains = [blocks[n][3] + blocks[n + 1][3] - candidates[n][3]
+                 for n in range(len(candidates))]
+        best = max(range(len(gains)), key = lambda n: gains[n])
+        if gains[best] <= 0:
+            break
+
+        blocks[best:best + 2] = [candidates[best]]
+        del candidates[best]
+        if best > 0:
+            candidates[best - 1] = merged(blocks[best - 1], blocks[best])
+        if best < len(candidates):
+            candidates[best] = merged(blocks[best], blocks[best + 1])
+
+    return [(b[0], b[1]) for b in blocks]
+
+def write_dynamic_block(writer, symbols, final):
+    '''Write symbols as one dynamic Huffman block.'''
+
+    (lit_lengths, dist_lengths, cl_lengths, cl_symbols,
+     hlit, hdist, hclen) = block_codes(*symbol_frequencies(symbols))
+
+    writer.put(1 if final else 0, 1)
+    writer.put(2, 2)  # Dynamic Huffman codes
+    writer.put(hlit - 257, 5)
+    writer.put(hdist - 1, 5)
+    writer.put(hclen - 4, 4)
+    for n in range(hclen):
+        writer.put(cl_lengths[CODE_LENGTH_ORDER[n]], 3)
+
+    cl_codes = canonical_codes(cl_lengths)
+    for sym, extra, value in cl_symbols:
+        writer.put_code(cl_codes[sym], cl_lengths[sym])
+        if extra:
+            writer.put(value, extra)
+
+    lit_codes = canonical_codes(lit_lengths)
+    dist_codes = canonical_codes(dist_lengths)
+    for value, dist in symbols:
+        if dist:
+            sym, extra, evalue = LENGTH_TABLE[value]
+            writer.put_code(lit_codes[sym], lit_lengths[sym])
+            if extra:
+                writer.put(evalue, extra)
+            dsym, dextra, dvalue = dist_symbol(dist)
+            writer.put_code(dist_codes[dsym], dist_lengths[dsym])
+            if dextra:
+                writer.put(dvalue, dextra)
+        else:
+            writer.put_code(lit_codes[value], lit_lengths[value])
+    writer.put_code(lit_codes[END_OF_BLOCK], lit_lengths[END_OF_BLOCK])
+
+def deflate_optimal(data, window = MAX_WINDOW):
+    '''
+    Compress data with optimal parsing, return a raw deflate stream.
+    Distances never exceed window bytes.
+    '''
+
+    if window < 1 or window > MAX_WINDOW:
+        raise ValueError("invalid window size: %d" % window)
+
+    data = bytes(data)
+    if len(data) == 0:
+        return deflate_stored(data)
+
+    matches = find_matches(data, window)
+
+    best = None
+    lengths = fixed_lengths()
+    for _ in range(NUM_PASSES):
+        symbols = optimal_parse(data, matches, symbol_costs(*lengths))
+
+        # Costs of next pass come from the statistics of the whole image.
+        lengths = block_codes(*symbol_frequencies(symbols))[:2]
+
+        writer = BitWriter()
+        blocks = split_blocks(symbols)
+        for start, end in blocks:
+            write_dynamic_block(writer, symbols[start:end],
+                                end == len(symbols))
+        stream = writer.get_bytes()
+        if best is None or len(stream) < len(best):
+            best = stream
+
+    return best
+
+def deflate_small_window(data):
+    '''Optimal parsing with a window small enough for low RAM decoders.'''
+    return deflate_optimal(data, SMALL_WINDOW)
+
+def deflate_zlib(data):
+    '''Compress data with zlib, return a raw deflate stream.'''
+
+    # OPTIMIZE: Avoid extra conversions between bytearrays and bytes.
+    # Compress data. zlib.compress() does not accept
+    # bytearrays, so convert bytearray to bytes.
+    compressed_data = bytearray(zlib.compress(bytes(data), 9))
+
+    # Leave out zlib header and Adler-32 checksum.
+    return compressed_data[2:-4]
+
+def deflate_stored(data, block_len = 0xffff):
+    '''
+    Frame data in deflate stored (uncompressed) blocks, return a raw
+    deflate stream. Used when the stream must be reproducible without a
+    compressor, like when rebuilding a scratchpad on a node.
+    '''
+
+    if block_len < 1 or block_len > 0xffff:
+        raise ValueError("invalid stored block length: %d" % block_len)
+
+    stream = bytearray()
+    offset = 0
+    while True:
+        block = data[offset:offset + block_len]
+        offset += len(block)
+        final = offset >= len(data)
+
+        # BFINAL, BTYPE = 00, padding to byte boundary, LEN and NLEN.
+        stream += struct.pack("<B2H", 1 if final else 0,
+                              len(block), len(block) ^ 0xffff)
+        stream += block
+
+        if final:
+            return stream
+
+# Compressors selectable per file, by name
+COMPRESSORS = {
+    "zlib":         deflate_zlib,
+    "optimal":      deflate_optimal,
+    "smallwindow":  deflate_small_window,
+    "stored":       deflate_stored,
+}
+
+DEFAULT_COMPRESSOR = "zlib"
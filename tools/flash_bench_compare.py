@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# flash_bench_compare.py - Compare flash benchmark runs of bootloader_test
+#
+# Reads logs of bootloader_test runs, captured from its UART, and extracts
+# the BENCH CSV records printed by bootloader_test/tests/test_benchmark.c.
+# The first log is the baseline, next ones are compared against it:
+#   - one table row per area kind (int, ext, scrat), benchmark and parameter
+#   - one column of average time per log, and change from baseline
+#   - results more than --threshold percent slower, missing results and
+#     error records are reported as regressions
+#
+# Areas are matched by kind rather than by id, so that runs from different
+# boards can be compared. Exit code is 1 if there are regressions, so that
+# the tool can be used as a release check.
+#
+# Requires:
+#   - Python 3 v3.4 or newer
+
+import sys
+import os
+import argparse
+import textwrap
+import collections
+
+
+# Constants
+
+# Record prefix
+RECORD_PREFIX = "BENCH"
+
+# Supported record format version
+FORMAT_VERSION = 1
+
+# Default regression threshold, in percent of baseline time
+DEFAULT_THRESHOLD = 10.0
+
+# Times below this are dominated by measurement noise, in microseconds
+MIN_SIGNIFICANT_US = 5
+
+
+# Classes
+
+# Result of a benchmark
+Result = collections.namedtuple("Result", ["count", "min_us", "avg_us",
+                                           "max_us", "rate"])
+
+
+class Run(object):
+    '''Benchmark records of one log'''
+
+    def __init__(self, filename):
+        self.filename = filename
+        self.board = None
+        self.bl_version = None
+        self.results = collections.OrderedDict()
+        self.errors = collections.OrderedDict()
+
+    def name(self):
+        '''Short name for table headers'''
+
+        return self.board or os.path.basename(self.filename)
+
+
+# Functions
+
+def parse_log(filename):
+    '''Parse BENCH records of a log file, return a Run'''
+
+    run = Run(filename)
+    area_kinds = {"scrat": "scrat"}
+
+    with open(filename, "r", errors = "replace") as f:
+        for line_num, line in enumerate(f, 1):
+            # Records may follow other output on the same line
+            pos = line.find(RECORD_PREFIX + ",")
+            if pos < 0:
+                continue
+            fields = line[pos:].strip().split(",")
+            try:
+                parse_record(run, area_kinds, fields)
+            except (IndexError, ValueError) as exc:
+                raise ValueError("%s:%d: invalid record: %s" %
+                                 (filename, line_num, exc))
+
+    if run.bl_version is None:
+        raise ValueError("%s: no benchmark header found" % filename)
+
+    return run
+
+def parse_record(run, area_kinds, fields):
+    '''Add a record to a Run'''
+
+    rtype = fields[1]
+
+    if rtype == "hdr":
+        version = int(fields[2])
+        if version != FORMAT_VERSION:
+            raise ValueError("unsupported format version %d" % version)
+        run.board = fields[3]
+        run.bl_version = int(fields[4])
+    elif rtype == "area":
+        area_kinds[fields[2]] = fields[3]
+    elif rtype == "res":
+        key = (area_kinds[fields[2]], fields[3], int(fields[4]))
+        run.results[key] = Result(*map(int, fields[5:10]))
+    elif rtype == "err":
+        key = (area_kinds[fields[2]], fields[3], int(fields[4]))
+        run.errors[key] = int(fields[5])
+    else:
+        raise ValueError("unknown record type '%s'" % rtype)
+
+def compare(runs, threshold):
+    '''Print a comparison table, return list of regression messages'''
+
+    baseline = runs[0]
+    regressions = []
+
+    keys = list(baseline.results.keys())
+    for run in runs[1:]:
+        keys.extend(k for k in run.results.keys() if k not in keys)
+
+    header = "%-5s %-16s %6s" % ("area", "bench", "param")
+    for n, run in enumerate(runs):
+        header += " %12s" % run.name()[:12]
+        if n > 0:
+            header += " %7s" % "change"
+    sys.stdout.write(header + "\n")
+
+    for key in keys:
+        line = "%-5s %-16s %6d" % key
+        base = baseline.results.get(key)
+        for n, run in enumerate(runs):
+            result = run.results.get(key)
+            line += " %12s" % ("-" if result is None else
+                               "%d us" % result.avg_us)
+            if n == 0:
+                continue
+            if base is None or result is None:
+                line += " %7s" % "-"
+                if base is not None:
+                    regressions.append("%s: %s %s %d missing" %
+                                       ((run.filename,) + key))
+                continue
+            if base.avg_us == 0:
+                line += " %7s" % "-"
+                continue
+            change = 100.0 * (result.avg_us - base.avg_us) / base.avg_us
+            line += " %+6.1f%%" % change
+            if (change > threshold and
+                    result.avg_us - base.avg_us >= MIN_SIGNIFICANT_US):
+                regressions.append("%s: %s %s %d: %d us -> %d us (%+.1f%%)" %
+                                   ((run.filename,) + key +
+                                    (base.avg_us, result.avg_us, change)))
+        sys.stdout.write(line + "\n")
+
+    for run in runs:
+        for key, code in run.errors.items():
+            regressions.append("%s: %s %s %d failed with result %d" %
+                               ((run.filename,) + key + (code,)))
+
+    return regressions
+
+def create_argument_parser(pgmname):
+    '''Create a parser for parsing the command line.'''
+
+    # Determine help text width.
+    try:
+        help_width = int(os.environ['COLUMNS'])
+    except (KeyError, ValueError):
+        help_width = 80
+    help_width -= 2
+
+    parser = argparse.ArgumentParser(
+        prog = pgmname,
+        formatter_class = argparse.RawDescriptionHelpFormatter,
+        description = textwrap.fill(
+            "A tool to compare flash benchmark results of bootloader_test "
+            "runs. The first log is the baseline.", help_width))
+    parser.add_argument("logs",
+        nargs = "+", metavar = "LOG",
+        help = "bootloader_test UART log")
+    parser.add_argument("--threshold", "-t",
+        type = float, default = DEFAULT_THRESHOLD,
+        help = "regression threshold, in percent of baseline time "
+               "(default: %.0f)" % DEFAULT_THRESHOLD)
+
+    return parser
+
+def main():
+    '''Main program'''
+
+    # Determine program name, for error messages.
+    pgmname = os.path.split(sys.argv[0])[-1]
+
+    # Create a parser for parsing the command line and printing error messages.
+    parser = create_argument_parser(pgmname)
+    args = parser.parse_args()
+
+    try:
+        runs = [parse_log(filename) for filename in args.logs]
+    except (IOError, ValueError) as exc:
+        sys.stdout.write("%s: %s\n" % (pgmname, exc))
+        return 1
+
+    regressions = compare(runs, args.threshold)
+
+    if regressions:
+        sys.stdout.write("\n%d regression(s):\n" % len(regressions))
+        for message in regressions:
+            sys.stdout.write("  %s\n" % message)
+        return 1
+
+    return 0
+
+# Run main.
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,361 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# gendelta.py - A tool to generate delta scratchpads
+#
+# A delta scratchpad carries only the differences between the application
+# running on nodes (the base) and a new application. Nodes rebuild the full
+# scratchpad from it with libraries/otap_delta, so the bootloader processes
+# a normal scratchpad.
+#
+# Requires:
+#   - Python 3 v3.2 or newer
+#   - PyCryptodome v3.0 or newer
+#   - hextool.py, genscratchpad.py, deflate.py and bootloader_config.py in
+#     the same directory as this file
+
+import sys
+import os
+import struct
+import argparse
+import textwrap
+import hextool
+
+from Crypto.Cipher import AES
+from Crypto.Util import Counter
+
+from bootloader_config import BootloaderConfig
+from genscratchpad import InFile, Scratchpad
+from deflate import deflate_stored
+
+# Python 2 and Python 3 support
+
+try:
+    # Python 3
+    import configparser
+except ImportError:
+    # Python 2
+    import ConfigParser as configparser
+
+try:
+    # Python 2
+    xrange
+except NameError:
+    # Python 3
+    xrange = range
+
+
+# Constants
+
+# Delta file format, must match libraries/otap_delta/otap_delta.c
+DELTA_MAGIC = 0x31445057            # "WPD1"
+DELTA_VERSION = 1
+DELTA_HEADER_FORMAT = "<LBBHL2H4L"   # 32 bytes
+DELTA_PREFIX_SIZE = 80
+DELTA_OP_COPY = 0
+DELTA_OP_INSERT = 1
+
+# Scratchpad layout, relatively to the beginning of .otap data
+SCRATCHPAD_CRC_OFFSET = 20
+SCRATCHPAD_CRC_START = 32
+SCRATCHPAD_IV_OFFSET = 48
+
+# Default maximum length of a deflate stored block
+DEFAULT_STORED_BLOCK_LEN = 0xffff
+
+# Minimum length of a copy operation. Shorter matches cost more
+# in operation headers and flash reads than they save.
+MIN_MATCH_LEN = 32
+
+# Base image is indexed every INDEX_STEP bytes. Any match longer than
+# MIN_MATCH_LEN + INDEX_STEP - 1 bytes is guaranteed to be found.
+INDEX_STEP = 4
+
+
+# Classes
+
+class Delta(object):
+    '''A delta between a base image and a new scratchpad'''
+
+    def __init__(self, base, target, otap, block_len):
+        self.base = bytes(base)
+        self.target = bytes(target)
+        self.otap = bytes(otap)
+        self.block_len = block_len
+        self.ops = self.diff(self.base, self.target)
+
+    @staticmethod
+    def diff(base, target):
+        '''
+        Compute a list of ("copy", src, length) and ("insert", data)
+        operations to build target from base.
+        '''
+
+        # Index base image chunks, first occurrence wins.
+        index = {}
+        for pos in xrange(0, len(base) - MIN_MATCH_LEN + 1, INDEX_STEP):
+            index.setdefault(base[pos:pos + MIN_MATCH_LEN], pos)
+
+        ops = []
+        literal_start = 0
+        pos = 0
+        while pos + MIN_MATCH_LEN <= len(target):
+            src = index.get(target[pos:pos + MIN_MATCH_LEN])
+            if src is None:
+                pos += 1
+                continue
+
+            # Extend match backward, into pending literal bytes.
+            while (pos > literal_start and src > 0 and
+                   base[src - 1] == target[pos - 1]):
+                pos -= 1
+                src -= 1
+
+            # Extend match forward.
+            length = MIN_MATCH_LEN
+            while (pos + length < len(target) and src + length < len(base) and
+                   base[src + length] == target[pos + length]):
+                length += 1
+
+            if pos > literal_start:
+                ops.append(("insert", target[literal_start:pos]))
+            ops.append(("copy", src, length))
+
+            pos += length
+            literal_start = pos
+
+        if literal_start < len(target):
+            ops.append(("insert", target[literal_start:]))
+
+        return ops
+
+    def to_bytes(self):
+        '''Serialize delta file.'''
+
+        op_bytes = bytearray()
+        for op in self.ops:
+            if op[0] == "copy":
+                op_bytes += struct.pack("<B2L", DELTA_OP_COPY, op[1], op[2])
+            else:
+                op_bytes += struct.pack("<BL", DELTA_OP_INSERT, len(op[1]))
+                op_bytes += op[1]
+
+        header = struct.pack(DELTA_HEADER_FORMAT,
+                             DELTA_MAGIC, DELTA_VERSION, 0, self.block_len,
+                             len(self.base),
+                             Scratchpad.crc16_ccitt(self.base), 0,
+                             len(self.target), len(self.otap),
+                             len(self.ops), len(op_bytes))
+
+        return header + self.otap[:DELTA_PREFIX_SIZE] + op_bytes
+
+
+# Functions
+
+def apply_delta(delta, base, enc_key):
+    '''
+    Rebuild a scratchpad from a delta, the same way
+    libraries/otap_delta does it on a node.
+    '''
+
+    delta = bytes(delta)
+    header_size = struct.calcsize(DELTA_HEADER_FORMAT)
+    (magic, version, _, block_len, base_len, base_crc, _, target_len, out_len,
+     num_ops, _) = struct.unpack(DELTA_HEADER_FORMAT, delta[:header_size])
+
+    if magic != DELTA_MAGIC or version != DELTA_VERSION:
+        raise ValueError("not a supported delta")
+
+    if base_len > len(base) or \
+       Scratchpad.crc16_ccitt(base[:base_len]) != base_crc:
+        raise ValueError("delta does not apply to this base image")
+
+    offset = header_size
+    prefix = delta[offset:offset + DELTA_PREFIX_SIZE]
+    offset += DELTA_PREFIX_SIZE
+
+    target = bytearray()
+    for _ in xrange(num_ops):
+        op = delta[offset]
+        if op == DELTA_OP_COPY:
+            src, length = struct.unpack("<2L", delta[offset + 1:offset + 9])
+            target += base[src:src + length]
+            offset += 9
+        elif op == DELTA_OP_INSERT:
+            length, = struct.unpack("<L", delta[offset + 1:offset + 5])
+            target += delta[offset + 5:offset + 5 + length]
+            offset += 5 + length
+        else:
+            raise ValueError("invalid delta operation: %d" % op)
+
+    if len(target) != target_len:
+        raise ValueError("invalid delta target length")
+
+    data = deflate_stored(target, block_len)
+    data += bytearray(out_len - DELTA_PREFIX_SIZE - len(data))
+
+    # Same AES-CTR counter layout as aessw.c (little endian).
+    iv = prefix[SCRATCHPAD_IV_OFFSET:SCRATCHPAD_IV_OFFSET + 16]
+    ctr = Counter.new(128, little_endian = True, allow_wraparound = True,
+                      initial_value = int.from_bytes(iv, "little"))
+    cipher = AES.new(bytes(enc_key), AES.MODE_CTR, counter = ctr)
+    otap = prefix + cipher.encrypt(bytes(data))
+
+    crc, = struct.unpack("<H", prefix[SCRATCHPAD_CRC_OFFSET:
+                                      SCRATCHPAD_CRC_OFFSET + 2])
+    if Scratchpad.crc16_ccitt(otap[SCRATCHPAD_CRC_START:]) != crc:
+        raise ValueError("rebuilt scratchpad crc mismatch")
+
+    return otap
+
+def load_base(filename, app_area):
+    '''Load base image, as seen from the start of application area.'''
+
+    memory = hextool.Memory()
+    hextool.load_intel_hex(memory, filename = filename)
+
+    if memory.num_ranges == 0:
+        raise ValueError("file contains no data: '%s'" % filename)
+    elif memory.min_address != app_area.address:
+        raise ValueError("base image does not start at application area "
+                         "address 0x%08x: '%s'" % (app_area.address, filename))
+
+    return memory[memory.min_address:memory.max_address]
+
+def ini_file(string_file):
+    if not string_file.endswith(".ini"):
+        raise argparse.ArgumentTypeError("invalid ini file extension %s" % string_file)
+    return string_file
+
+def create_argument_parser(pgmname):
+    '''Create a parser for parsing the command line.'''
+
+    # Determine help text width.
+    try:
+        help_width = int(os.environ['COLUMNS'])
+    except (KeyError, ValueError):
+        help_width = 80
+    help_width -= 2
+
+    parser = argparse.ArgumentParser(
+        prog = pgmname,
+        formatter_class = argparse.RawDescriptionHelpFormatter,
+        description = textwrap.fill(
+            "A tool to generate a delta scratchpad between the application "
+            "running on nodes and a new application", help_width),
+        epilog =
+            "values:\n"
+            "  infilespec    [version|file.conf]:area_id:filename\n"
+            "  area_id       0x00000000 .. 0xffffffff\n"
+            "  version       major.minor.maintenance.developer, "
+            "each 0 .. 255,\n"
+            "  file.conf     a configuration file containing metadatas"
+            " associated to the filename")
+    parser.add_argument("--configfile", "-c",
+        type=ini_file, action='append', metavar = "FILE", required=True,
+        help = "a configuration file with keys")
+    parser.add_argument("--keyname", "-k",
+        metavar = "NAME", default = "default",
+        help = "name of key to use for encryption and authentication "
+               "(default: \"%(default)s\")")
+    parser.add_argument("--blocklen", "-b",
+        type = int, metavar = "BYTES", default = DEFAULT_STORED_BLOCK_LEN,
+        help = "maximum deflate stored block length "
+               "(default: %(default)s)")
+    parser.add_argument("--otapfile", "-o",
+        metavar = "FILE",
+        help = "also write the scratchpad rebuilt from the delta, "
+               "as a node would do")
+    parser.add_argument("base", metavar = "BASE",
+        help = "application running on nodes, in Intel HEX format")
+    parser.add_argument("outfile", metavar = "OUTFILE",
+        help = "delta output file")
+    parser.add_argument("infilespec", metavar = "INFILESPEC",
+        help = "new application in Intel HEX format, see below")
+
+    return parser
+
+def main():
+    '''Main program'''
+
+    # Determine program name, for error messages.
+    pgmname = os.path.split(sys.argv[0])[-1]
+
+    # Create a parser for parsing the command line and printing error messages.
+    parser = create_argument_parser(pgmname)
+
+    try:
+        # Parse command line arguments.
+        args = parser.parse_args()
+
+        # Parse configuration file.
+        config = BootloaderConfig.from_ini_files(args.configfile)
+
+        # Check the key chosen is declared
+        try:
+            chosenkey = config.keys[args.keyname]
+        except KeyError:
+            raise ValueError("key not found: '%s'" % args.keyname)
+
+        if not config.platform.aes_little_endian:
+            raise ValueError("delta scratchpads need a little endian "
+                             "AES counter platform")
+
+        app_area = config.get_app_area()
+        if app_area is None:
+            raise ValueError("no application area found")
+
+    except (ValueError, IOError, OSError, configparser.Error) as exc:
+        sys.stdout.write("%s: %s\n" % (pgmname, exc))
+        return 1
+
+    try:
+        base = load_base(args.base, app_area)
+
+        # Full scratchpad, for comparison.
+        full = Scratchpad(chosenkey, config.platform)
+        full.append(InFile(file_spec = args.infilespec))
+        full_otap = full.get_otap()
+
+        # Scratchpad as it will be rebuilt by nodes.
+        in_file = InFile(file_spec = args.infilespec)
+        scratchpad = Scratchpad(chosenkey, config.platform)
+        scratchpad.append(in_file,
+                          lambda data: deflate_stored(data, args.blocklen))
+        otap = scratchpad.get_otap()
+
+        delta = Delta(base, in_file.raw_data, otap, args.blocklen)
+        delta_bytes = delta.to_bytes()
+
+        # Round trip, to check delta before distributing it.
+        rebuilt = apply_delta(delta_bytes, base, chosenkey.encryption)
+        if rebuilt != bytes(otap):
+            raise ValueError("rebuilt scratchpad differs from expected one")
+
+        with open(args.outfile, "wb") as f:
+            f.write(delta_bytes)
+
+        if args.otapfile:
+            with open(args.otapfile, "wb") as f:
+                f.write(rebuilt)
+
+        num_copied = sum(op[2] for op in delta.ops if op[0] == "copy")
+        sys.stdout.write("%s: %d operations, %d of %d bytes copied from base\n"
+                         % (pgmname, len(delta.ops), num_copied,
+                            len(delta.target)))
+        sys.stdout.write("%s: full scratchpad %d bytes, delta %d bytes "
+                         "(%.1f %% smaller), rebuilt scratchpad %d bytes\n"
+                         % (pgmname, len(full_otap), len(delta_bytes),
+                            100.0 * (1 - len(delta_bytes) /
+                                     float(len(full_otap))),
+                            len(rebuilt)))
+
+    except (ValueError, IOError, OSError) as exc:
+        sys.stdout.write("%s: %s\n" % (pgmname, exc))
+        return 1
+
+    return 0
+
+# Run main.
+if __name__ == "__main__":
+    sys.exit(main())
@@ -7,7 +7,8 @@
 #   - Python 2 v2.7 or newer (uses argparse, hextool.py)
 #     or Python 3 v3.2 or newer
 #   - PyCryptodome v3.0 or newer
-#   - hextool.py and bootloader_config.py in the same directory as this file
+#   - hextool.py, deflate.py and bootloader_config.py in the same directory
+#     as this file
 
 import sys
 import os
@@ -17,6 +18,7 @@ import struct
 import argparse
 import textwrap
 import hextool
+import deflate
 
 from Crypto.Hash import CMAC
 from Crypto.Cipher import AES
@@ -59,7 +61,8 @@ class InFile(object):
     BLOCK_LENGTH = 16
 
     def __init__(self, file_spec = None, data = None,
-                 version = (0, 0, 0, 0)):
+                 version = (0, 0, 0, 0),
+                 compressor = deflate.DEFAULT_COMPRESSOR):
         if file_spec == None and data == None:
             raise ValueError("no data given")
         elif file_spec != None and data != None:
@@ -70,6 +73,7 @@ class InFile(object):
         self.version = version
         self.compressed = False
         self.encrypted = False
+        self.compressor = compressor
 
         if data:
             # Data given, make a copy of it.
@@ -77,7 +81,8 @@ class InFile(object):
             self.raw_data = bytearray(data)
         else:
             # File specification given, parse it.
-            version, self.area_id, filename = self.parse_file_spec(file_spec)
+            (self.compressor, version, self.area_id,
+             filename) = self.parse_file_spec(file_spec, compressor)
             self.version = self.parse_version(version)
 
             # Read data from file.
@@ -99,18 +104,22 @@ class InFile(object):
         self.header = self.make_file_header(self.area_id, len(self.data),
                                             *self.version)
 
-    def compress(self):
+    def compress(self, compressor = None):
+        '''
+        Compress data to a raw deflate stream.
+
+        compressor  optional function returning raw deflate data (without
+                    zlib header and Adler-32 checksum) for given bytes,
+                    compressor selected for the file is used by default
+        '''
         if self.compressed:
             raise ValueError("data already compressed")
 
-        # OPTIMIZE: Avoid extra conversions between bytearrays and bytes.
-        # Compress data. zlib.compress() does not accept
-        # bytearrays, so convert bytearray to bytes.
-        compressed_data = bytearray(zlib.compress(bytes(self.data), 9))
+        if compressor is None:
+            compressor = deflate.COMPRESSORS[self.compressor]
 
-        # Determine compressed data length without
-        # zlib header and Adler-32 checksum.
-        comp_data_len = len(compressed_data) - 2 - 4
+        compressed_data = compressor(self.data)
+        comp_data_len = len(compressed_data)
 
         # Pad size to a multiple of block length.
         num_blocks = (comp_data_len + self.BLOCK_LENGTH - 1) // \
@@ -122,9 +131,8 @@ class InFile(object):
         # Create a bytearray object for compressed data.
         self.data = bytearray(num_blocks * InFile.BLOCK_LENGTH)
 
-        # Copy compressed data to bytearray, but leave
-        # out zlib header and Adler-32 checksum.
-        self.data[:comp_data_len] = compressed_data[2:-4]
+        # Copy compressed data to bytearray.
+        self.data[:comp_data_len] = compressed_data
 
         # Update the file header now that data length has changed.
         self.header = self.make_file_header(self.area_id, len(self.data),
@@ -142,14 +150,21 @@ class InFile(object):
         self.encrypted = True
 
     @staticmethod
-    def parse_file_spec(file_spec):
+    def parse_file_spec(file_spec, compressor = deflate.DEFAULT_COMPRESSOR):
         '''
         Parse input file specification.
 
-        file_spec   version:area_id:filename or file.conf:area_id:filename
+        file_spec   version:area_id:filename or file.conf:area_id:filename,
+                    optionally prefixed with compressor:
+        compressor  compressor to use if not given in file_spec
         '''
 
         try:
+            # Read optional compressor name.
+            fields = file_spec.split(":", 1)
+            if fields[0] in deflate.COMPRESSORS:
+                compressor, file_spec = fields
+
             # Read version, memory area ID and file name.
             fields = file_spec.split(":", 2)
             if fields.__len__() == 3:
@@ -188,7 +203,10 @@ class InFile(object):
             raise ValueError("invalid input file specification: "
                              "'%s'" % file_spec)
 
-        return version, area_id, filename
+        if compressor not in deflate.COMPRESSORS:
+            raise ValueError("unknown compressor: '%s'" % compressor)
+
+        return compressor, version, area_id, filename
 
     @staticmethod
     def parse_version(version):
@@ -266,13 +284,14 @@ class Scratchpad(object):
         self.data.append(self.secure_header)
         self.cipher = self.create_cipher()
 
-    def append(self, infile):
-        infile.compress()
+    def append(self, infile, compressor = None):
+        infile.compress(compressor)
         infile.encrypt(self.cipher)
         self.data.append(infile.header)
         self.data.append(infile.data)
 
-    def crc16_ccitt(self, data, initial = 0xffff):
+    @staticmethod
+    def crc16_ccitt(data, initial = 0xffff):
         '''Simple and slow version of CRC16-CCITT'''
 
         # OPTIMIZE: Avoid extra conversions between bytearrays and bytes.
@@ -426,12 +445,14 @@ def create_argument_parser(pgmname):
             "encrypted scratchpad contents", help_width),
         epilog =
             "values:\n"
-            "  infilespec    [version|file.conf]:area_id:filename\n"
+            "  infilespec    [compressor:][version|file.conf]:area_id:filename\n"
+            "  compressor    %s\n"
             "  area_id       0x00000000 .. 0xffffffff\n"
             "  version       major.minor.maintenance.developer, "
             "each 0 .. 255,\n"
             "  file.conf     a configuration file containing metadatas"
-            " associated to the filename")
+            " associated to the filename"
+            % ", ".join(sorted(deflate.COMPRESSORS)))
     parser.add_argument("--configfile", "-c",
         type=ini_file, action='append', metavar = "FILE", required=True,
         help = "a configuration file with keys")
@@ -439,6 +460,11 @@ def create_argument_parser(pgmname):
         metavar = "NAME", default = "default",
         help = "name of key to use for encryption and authentication "
                "(default: \"%(default)s\")")
+    parser.add_argument("--compressor", "-z",
+        choices = sorted(deflate.COMPRESSORS),
+        default = deflate.DEFAULT_COMPRESSOR,
+        help = "compressor for files not selecting one in INFILESPEC "
+               "(default: \"%(default)s\")")
     parser.add_argument("outfile", metavar = "OUTFILE",
         help = "compressed, encrypted output scratchpad file")
     parser.add_argument("infilespec", nargs = "+", metavar = "INFILESPEC",
@@ -480,7 +506,8 @@ def main():
         # Read input files.
         for file_spec in args.infilespec:
             # Create an InFile object.
-            in_file = InFile(file_spec = file_spec)
+            in_file = InFile(file_spec = file_spec,
+                             compressor = args.compressor)
             scratchpad.append(in_file)
 
         # Write output file.
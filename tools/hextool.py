@@ -15,6 +15,9 @@
 import sys
 import os
 import math
+import bisect
+import binascii
+import itertools
 import argparse
 import textwrap
 
@@ -24,8 +27,8 @@ import textwrap
 # Block size for reading and writing binary data
 BINARY_BLOCK_NUM_BYTES = (64 * 1024)  # 64 kilobytes
 
-# Maximum Intel HEX line length
-MAX_LINE_LENGTH = 256
+# Number of Intel HEX lines written to file at a time
+WRITE_BATCH_NUM_LINES = 1024
 
 # Default maximum file size allowed when writing binary
 # files and not specifying end address explicitly
@@ -172,7 +175,9 @@ class MemoryRange(object):
 
     def trim(self):
         '''Free preallocated bytes'''
-        del self.__bytearray[self.__end:]
+        if len(self.__bytearray) > self.__num_bytes:
+            # Copy instead of resizing, in case views of data exist.
+            self.__bytearray = self.__bytearray[:self.__num_bytes]
 
 
 class Memory(object):
@@ -180,6 +185,11 @@ class Memory(object):
 
     An object to store discontinuous memory contents
 
+    Memory ranges are kept sorted and coalesced: adjoining or overlapping
+    data is always merged into a single MemoryRange object. A list of start
+    addresses, parallel to the list of ranges, is searched with bisect, so
+    that accessing an address does not need to walk all ranges.
+
     address_space   Size of address space (i.e. one past last address), in bytes
     overlap_ok      Allow or disallow overwriting existing data
     gap_fill_byte   Fill byte value for gaps, when iterating or slicing'''
@@ -189,6 +199,7 @@ class Memory(object):
         # Initialize private attributes.
         self.__top_address = address_space
         self.__memory_ranges = []   # Ordered list of MemoryRange objects
+        self.__starts = []          # Start address of each MemoryRange object
         self.__gap_fill_byte = gap_fill_byte
 
         # Initialize cursor.
@@ -203,17 +214,23 @@ class Memory(object):
         # Invalidate cached value of num_bytes.
         self.__num_bytes = None
 
-    def __getitem__(self, item):
-        '''Return data in a given address or range as a bytearray object'''
+    def __parse_index(self, item, default_start, default_end):
+        '''Convert an index or a slice to a start and an end address'''
 
-        # Check parameters.
         if isinstance(item, slice):
             # Index is a slice.
             if item.step != None:
                 raise TypeError("step not supported")
 
-            start = item.start
-            end = item.stop
+            if item.start != None:
+                start = item.start
+            else:
+                start = default_start
+
+            if item.stop != None:
+                end = item.stop
+            else:
+                end = default_end
 
             if not isinstance(start, int) or not isinstance(end, int):
                 raise TypeError("index must be a nonnegative integer")
@@ -228,20 +245,54 @@ class Memory(object):
         else:
             raise TypeError("index must be int or slice")
 
+        return start, end
+
+    def __find(self, address):
+        '''Return index of the first range ending after given address'''
+
+        # Ranges are sorted and do not overlap, so only the
+        # range starting last at or before address may contain it.
+        n = bisect.bisect_right(self.__starts, address) - 1
+        if n < 0 or self.__memory_ranges[n].end <= address:
+            n += 1
+        return n
+
+    def __replace(self, first, last, new_ranges):
+        '''Replace ranges first .. last - 1 with given ranges'''
+
+        self.__memory_ranges[first:last] = new_ranges
+        self.__starts[first:last] = [mr.start for mr in new_ranges]
+
+        # Invalidate cached value of max_gap.
+        self.__max_gap = None
+
+        # Invalidate cached value of num_bytes.
+        self.__num_bytes = None
+
+    def __getitem__(self, item):
+        '''Return data in a given address or range as a bytearray object'''
+
+        # Check parameters.
+        start, end = self.__parse_index(item, None, None)
+
         if (start < 0 or end < 0 or
             start > self.__top_address or end > self.__top_address):
             raise IndexError("range outside of address space")
 
+        n = self.__find(start)
+        if n < len(self.__memory_ranges):
+            mr = self.__memory_ranges[n]
+            if mr.start <= start and end <= mr.end:
+                # Whole range is stored in a single memory range, copy it.
+                return bytearray(mr[start:end])
+
         # Create a new, preallocated, prefilled bytearray object for data.
         num_bytes = end - start
         bytes_ = bytearray([self.__gap_fill_byte]) * num_bytes
 
         # Copy data from memory ranges to the bytearray.
-        for mr in self.__memory_ranges:
-            if start >= mr.end:
-                # This range is before the range requested, skip it.
-                continue
-            elif end <= mr.start:
+        for mr in self.__memory_ranges[n:]:
+            if end <= mr.start:
                 # No more ranges to consider, stop.
                 break
 
@@ -262,33 +313,7 @@ class Memory(object):
         '''Add a block of data to a given range, or a byte to a given address'''
 
         # Check parameters.
-        if isinstance(item, slice):
-            # Index is a slice.
-            if item.step != None:
-                raise TypeError("step not supported")
-
-            if item.start != None:
-                start = item.start
-            else:
-                start = 0
-
-            if item.stop != None:
-                end = item.stop
-            else:
-                end = self.__top_address
-
-            if not isinstance(start, int) or not isinstance(end, int):
-                raise TypeError("index must be a nonnegative integer")
-
-            if start > end:
-                # Zero-length range
-                end = start
-        elif isinstance(item, int):
-            # Index is an integer.
-            start = item
-            end = item + 1
-        else:
-            raise TypeError("index must be int or slice")
+        start, end = self.__parse_index(item, 0, self.__top_address)
 
         if isinstance(value, int):
             # Convert single int to a bytearray.
@@ -307,81 +332,46 @@ class Memory(object):
             # No data, nothing to do.
             return
 
-        # Create a new MemoryRange object for data.
-        new_mr = MemoryRange(start, value)
+        # Find ranges overlapping or adjoining new data: first range
+        # ending at or after start, up to last range starting at or
+        # before end.
+        first = self.__find(start - 1) if start > 0 else 0
+        last = bisect.bisect_right(self.__starts, end)
 
-        new_ranges = []
-
-        # Find a spot where to add new data.
-        n = 0
-        while True:
-            if n == len(self.__memory_ranges):
-                # No more ranges, append new range and stop.
-                new_ranges.append(new_mr)
-                break
-
-            this_mr = self.__memory_ranges[n]
-
-            if new_mr.end < this_mr.start:
-                # New range is completely before this range, append it and stop.
-                new_ranges.append(new_mr)
-                break
-            elif new_mr.end == this_mr.start:
-                # New range adjoins in front of this range. Join ranges.
-                new_mr.extend(this_mr.bytes)
-            elif new_mr.start == this_mr.end:
-                # New range adjoins at the end of this range. Join ranges.
-                this_mr.extend(new_mr.bytes)
-                new_mr = this_mr
-            elif new_mr.start > this_mr.end:
-                # New range is completely after this
-                # range, use this range as-is.
-                new_ranges.append(this_mr)
-            else:
-                # New range overlaps this range.
-                if not self.__overlap_ok:
+        if not self.__overlap_ok:
+            for mr in self.__memory_ranges[first:last]:
+                if mr.start < end and mr.end > start:
                     raise ValueError("overlapping data not allowed")
 
-                left = new_mr.start - this_mr.start
-                right = this_mr.end - new_mr.end
-
-                if left <= 0 and right <= 0:
-                    # New range covers this range completely. Forget this range.
-                    pass
-                elif left <= 0 and right > 0:
-                    # New range starts before or at the same position as
-                    # this range. Add tail of this range to the new range.
-                    new_mr.extend(this_mr.bytes[(this_mr.num_bytes - right):])
-                elif left > 0 and right <= 0:
-                    # New range starts after this range and runs past the
-                    # end of this range. First, replace tail of this range
-                    # with data from the new range and then add remaining
-                    # data from the new range to this range.
-                    this_mr.bytes[left:] = (
-                        new_mr.bytes[:(this_mr.num_bytes - left)])
-                    this_mr.extend(new_mr.bytes[(this_mr.num_bytes - left):])
-                    new_mr = this_mr
-                else:
-                    # New range is completely within this range. Replace
-                    # data in this range with data from the new range.
-                    this_mr.bytes[left:(this_mr.num_bytes - right)] = (
-                        new_mr.bytes)
-                    new_mr = this_mr
-
-            # Process next range.
-            n += 1
-
-        # Copy remaining ranges as is.
-        new_ranges.extend(self.__memory_ranges[n:])
-
-        # Invalidate cached value of max_gap.
-        self.__max_gap = None
-
-        # Invalidate cached value of num_bytes.
-        self.__num_bytes = None
-
-        # Update ranges.
-        self.__memory_ranges = new_ranges
+        if first == last:
+            # Nothing adjoins new data, insert a new range.
+            self.__replace(first, first, [MemoryRange(start, value)])
+        elif last - first == 1 and self.__memory_ranges[first].start <= start:
+            # New data starts in or right after a single range. This is the
+            # usual case when loading files, so update it in place: replace
+            # overlapping data and add the rest at the end of the range.
+            mr = self.__memory_ranges[first]
+            num_overlap = max(0, min(end, mr.end) - start)
+            if num_overlap > 0:
+                mr[start:(start + num_overlap)] = value[:num_overlap]
+            if num_overlap < len(value):
+                mr.extend(memoryview(value)[num_overlap:])
+
+            # Invalidate cached values of max_gap and num_bytes.
+            self.__max_gap = None
+            self.__num_bytes = None
+        else:
+            # Join touching ranges and new data into a single range.
+            first_mr = self.__memory_ranges[first]
+            last_mr = self.__memory_ranges[last - 1]
+            data = bytearray()
+            if first_mr.start < start:
+                data += first_mr[first_mr.start:start]
+            data += value
+            if last_mr.end > end:
+                data += last_mr[end:last_mr.end]
+            new_mr = MemoryRange(min(start, first_mr.start), data)
+            self.__replace(first, last, [new_mr])
 
         # Update cursor position, for __add__().
         self.cursor = end
@@ -394,26 +384,13 @@ class Memory(object):
             if item.step != None:
                 raise TypeError("step not supported in del")
 
-            if item.start != None:
-                if not isinstance(item.start, int) or item.start < 0:
+            for index in (item.start, item.stop):
+                if index != None and (not isinstance(index, int) or
+                                      index < 0):
                     raise TypeError(
                         "slice indices must be nonnegative integers")
-                start = item.start
-            else:
-                start = 0
 
-            if item.stop != None:
-                if not isinstance(item.stop, int) or item.stop < 0:
-                    raise TypeError(
-                        "slice indices must be nonnegative integers")
-                end = item.stop
-            else:
-                end = self.__top_address
-        elif isinstance(item, int):
-            start = item
-            end = item + 1
-        else:
-            raise TypeError("index must be int or slice")
+        start, end = self.__parse_index(item, 0, self.__top_address)
 
         # Check parameters.
         if start >= end:
@@ -422,56 +399,28 @@ class Memory(object):
         elif start >= self.__top_address or end > self.__top_address:
             raise ValueError("slice indice outside of address space")
 
-        new_ranges = []
-
-        # Delete given range from all ranges.
-        n = 0
-        while True:
-            if n == len(self.__memory_ranges):
-                # No more ranges, stop.
-                break
-
-            this_mr = self.__memory_ranges[n]
+        # Find ranges overlapping the range to be deleted.
+        first = self.__find(start)
+        last = bisect.bisect_left(self.__starts, end)
 
-            if  end <= this_mr.start:
-                # Range to be deleted is completely before this range, stop.
-                break
-            elif start >= this_mr.end:
-                # Range to be deleted is completely after
-                # this range, use this range as-is.
-                new_ranges.append(this_mr)
-            elif start <= this_mr.start and end >= this_mr.end:
-                # This range is completely inside the range
-                # to be deleted. Forget this range.
-                pass
-            else:
-                # This range may need to be split in two.
-                if start > this_mr.start:
-                    # Keep data in the beginning of this range.
-                    left = start - this_mr.start
-                    new_ranges.append(MemoryRange(this_mr.start,
-                                                  this_mr.bytes[:left]))
-
-                if end < this_mr.end:
-                    # Keep data at the end of this range.
-                    right = this_mr.num_bytes - (this_mr.end - end)
-                    new_ranges.append(MemoryRange(end,
-                                                  this_mr.bytes[right:]))
-
-            # Process next range.
-            n += 1
+        if first >= last:
+            # No data in range, nothing to do.
+            return
 
-        # Copy remaining ranges as is.
-        new_ranges.extend(self.__memory_ranges[n:])
+        new_ranges = []
 
-        # Invalidate cached value of max_gap.
-        self.__max_gap = None
+        first_mr = self.__memory_ranges[first]
+        if start > first_mr.start:
+            # Keep data in the beginning of first range.
+            new_ranges.append(MemoryRange(first_mr.start,
+                                          first_mr[first_mr.start:start]))
 
-        # Invalidate cached value of num_bytes.
-        self.__num_bytes = None
+        last_mr = self.__memory_ranges[last - 1]
+        if end < last_mr.end:
+            # Keep data at the end of last range.
+            new_ranges.append(MemoryRange(end, last_mr[end:last_mr.end]))
 
-        # Update ranges.
-        self.__memory_ranges = new_ranges
+        self.__replace(first, last, new_ranges)
 
     def __add__(self, value):
         '''Add bytes, bytearray or another Memory object to this object'''
@@ -512,6 +461,25 @@ class Memory(object):
         return "%s() # %d ranges, %d bytes\n" % (
             type(self).__name__, len(self.__memory_ranges), self.num_bytes)
 
+    def view(self, start, end):
+        '''Return data in a given range as a memoryview object
+
+        Data is not copied when the range is stored in a single memory
+        range. The view is only valid until memory contents change and
+        must not be written to. Gaps return the value of gap_fill_byte.'''
+
+        if start < 0 or end > self.__top_address or start > end:
+            raise IndexError("range outside of address space")
+
+        n = self.__find(start)
+        if n < len(self.__memory_ranges):
+            mr = self.__memory_ranges[n]
+            if mr.start <= start and end <= mr.end:
+                return mr[start:end]
+
+        # Range has gaps or spans several memory ranges, make a copy.
+        return memoryview(self[start:end])
+
     def memory_ranges(self):
         '''Return an iterator of MemoryRange objects'''
         return iter(self.__memory_ranges)
@@ -625,22 +593,26 @@ def _calc_intel_hex_checksum(bytes_):
     return ((sum(bytes_) ^ 0xff) + 1) & 0xff
 
 
-def _parse_intel_hex_record(memory, offset, address_base, line):
-    '''Parse an Intel HEX record, i.e. a line of text'''
+def _parse_intel_hex_record(line):
+    '''Parse an Intel HEX record, i.e. a line of text
 
-    if len(line) == 0 or line[0] != ":":
-        return ValueError("invalid record start code")
+    Return record type, 16-bit address and data bytes,
+    or None for an empty line'''
 
-    # Remove start code, trailing whitespace and newline.
-    line = line[1:].rstrip()
+    # Remove leading and trailing whitespace and newline.
+    line = line.strip()
+
+    if len(line) == 0:
+        return None
+    elif line[:1] not in (":", b":"):
+        raise ValueError("invalid record start code")
 
     try:
-        # Convert hexadecimal character to bytes. Could also use
+        # Convert hexadecimal characters to bytes. Could also use
         # bytearray.fromhex() here, but it permits spaces between
         # numbers, which is not correct for proper Intel HEX records.
-        data = bytearray([int(line[n:(n+2)], 16) for n
-                          in range(0, len(line), 2)])
-    except ValueError:
+        data = bytearray(binascii.unhexlify(line[1:]))
+    except (TypeError, ValueError):
         raise ValueError("invalid characters in record data")
 
     # Verify length.
@@ -651,38 +623,7 @@ def _parse_intel_hex_record(memory, offset, address_base, line):
     if _calc_intel_hex_checksum(data) != 0x00:
         raise ValueError("invalid record checksum")
 
-    record_type = data[3]
-    address = address_base | (data[1] << 8) | data[2]
-    data = data[4:-1]
-
-    # Apply address offset to read data.
-    address += offset
-
-    # Hande various record types.
-    if record_type == 0x00:
-        # Data record
-        memory[address:(address + len(data))] = data
-    elif record_type == 0x01:
-        # End Of File record, let the caller know that there is no more records.
-        address_base = None
-    elif record_type == 0x02:
-        # Extended Segment Address record (i.e. address bits 20:4)
-        if len(data) != 2:
-            raise ValueError("invalid extended segment address record")
-        address_base = ((data[0] << 8) | data[1]) << 4
-    elif record_type == 0x04:
-        # Extended Linear Address record (i.e. address bits 32:16)
-        if len(data) != 2:
-            raise ValueError("invalid linear segment address record")
-        address_base = ((data[0] << 8) | data[1]) << 16
-    elif record_type in (0x03, 0x05):
-        # Start Segment Address or Start Linear Address record, ignore.
-        pass
-    else:
-        # Unknown record type
-        raise ValueError("unknown record type 0x%02x" % record_type)
-
-    return address_base
+    return data[3], (data[1] << 8) | data[2], data[4:-1]
 
 
 def _generate_intel_hex_record(address, record_type, data):
@@ -696,22 +637,22 @@ def _generate_intel_hex_record(address, record_type, data):
     record[4:(4 + len(data))] = data                # Data bytes
     record[-1] = _calc_intel_hex_checksum(record)   # Checksum
 
-    # Convert record to a line of text. Use a carriage return,
-    # line feed pair explicitly, for maximum compatiblity.
-    line = ":%s\r\n" % "".join(["%02x" % b for b in record])
+    # Convert record to a line of text, as bytes, to be able to write
+    # record to a binary file on Python 3. A binary file is used to keep
+    # explicit carriage return, line feed pair intact, for maximum
+    # compatibility.
+    return b":" + binascii.hexlify(record) + b"\r\n"
 
-    # Convert to bytes, to be able to write record to a binary file on
-    # Python 3. A binary file is used to keep explicit carriage return,
-    # line feed pair intact.
-    return line.encode("iso-8859-1", "ignore")  # No-op in Python 2
 
-
-def _write_memory_range_records(fileobj, mr, address_bits, max_record_len):
-    '''Write memory range as Intel HEX records'''
+def _generate_memory_range_records(mr, address_bits, max_record_len):
+    '''Generate Intel HEX records of a memory range'''
 
     address = mr.start
     write_address = True
 
+    # View to memory range data, to get record data without copying.
+    view = mr.bytes
+
     while address < mr.end:
         if write_address:
             # Write an address record.
@@ -723,8 +664,7 @@ def _write_memory_range_records(fileobj, mr, address_bits, max_record_len):
                 # 32-bit addresses, write an
                 # Extended Linear Address record (0x04).
                 data = [(address >> 24) & 0xff, (address >> 16) & 0xff]
-                record = _generate_intel_hex_record(0x0000, 0x04, data)
-                fileobj.write(record)
+                yield _generate_intel_hex_record(0x0000, 0x04, data)
             else:
                 raise ValueError("invalid address_bits")
 
@@ -740,9 +680,8 @@ def _write_memory_range_records(fileobj, mr, address_bits, max_record_len):
             write_address = True
 
         # Write a Data record (0x00).
-        data = mr[address:(address + record_len)]
-        record = _generate_intel_hex_record(address & 0xffff, 0x00, data)
-        fileobj.write(record)
+        data = view[(address - mr.start):(address - mr.start + record_len)]
+        yield _generate_intel_hex_record(address & 0xffff, 0x00, data)
 
         # Move to next address.
         address += record_len
@@ -790,8 +729,11 @@ def load_intel_hex(memory, fileobj = None, filename = None,
     '''Load contents of an Intel MCS-86 Object ("Intel HEX") format file
     to a Memory object
 
-    Either an open file object (opened for reading in text mode
-    or universal newlines mode) or a filename can be given.
+    Either an open file object (opened for reading in binary mode,
+    text mode or universal newlines mode) or a filename can be given.
+
+    The file is read one record at a time. Consecutive data records
+    are collected in a block and added to the Memory object in one go.
 
     This function modifies the cursor position and overlap_ok
     attributes of the Memory object.
@@ -802,7 +744,8 @@ def load_intel_hex(memory, fileobj = None, filename = None,
     offset      Offset to add to all addresses in file
     overlap_ok  Allow or disallow overwriting existing data'''
 
-    fileobj, close = _open_file(fileobj, filename, "rU")  # Universal newlines
+    # Open file as binary, line endings are removed by the record parser.
+    fileobj, close = _open_file(fileobj, filename, "rb")
 
     memory.overlap_ok = overlap_ok
 
@@ -811,13 +754,54 @@ def load_intel_hex(memory, fileobj = None, filename = None,
         # for 20-bit and 32-bit Intel HEX files
         address_base = 0
 
+        # Block of consecutive data not yet added to memory
+        block_start = 0
+        block = bytearray()
+
         # Read Intel HEX records.
-        while address_base != None:
-            line = fileobj.readline(MAX_LINE_LENGTH)
-            if line == "":
+        for line in fileobj:
+            record = _parse_intel_hex_record(line)
+            if record == None:
+                # Empty line, ignore.
+                continue
+
+            record_type, address, data = record
+
+            # Hande various record types.
+            if record_type == 0x00:
+                # Data record, apply address offset to read data.
+                address = (address_base | address) + offset
+
+                if (address != block_start + len(block) or
+                    len(block) >= BINARY_BLOCK_NUM_BYTES):
+                    # Data does not continue the block, add block to memory.
+                    memory[block_start:(block_start + len(block))] = block
+                    block_start = address
+                    del block[:]
+
+                block += data
+            elif record_type == 0x01:
+                # End Of File record, there is no more records.
                 break
-            address_base = _parse_intel_hex_record(memory, offset,
-                                                   address_base, line)
+            elif record_type == 0x02:
+                # Extended Segment Address record (i.e. address bits 20:4)
+                if len(data) != 2:
+                    raise ValueError("invalid extended segment address record")
+                address_base = ((data[0] << 8) | data[1]) << 4
+            elif record_type == 0x04:
+                # Extended Linear Address record (i.e. address bits 32:16)
+                if len(data) != 2:
+                    raise ValueError("invalid linear segment address record")
+                address_base = ((data[0] << 8) | data[1]) << 16
+            elif record_type in (0x03, 0x05):
+                # Start Segment Address or Start Linear Address record, ignore.
+                pass
+            else:
+                # Unknown record type
+                raise ValueError("unknown record type 0x%02x" % record_type)
+
+        # Add last block to memory.
+        memory[block_start:(block_start + len(block))] = block
 
         # Get rid of preallocated memory in internal buffers.
         memory.trim()
@@ -826,6 +810,7 @@ def load_intel_hex(memory, fileobj = None, filename = None,
             fileobj.close()
 
 
+
 def save_binary(memory, fileobj = None, filename = None,
                 start_address = None, end_address = None,
                 fill_byte = "\xff",
@@ -880,7 +865,7 @@ def save_binary(memory, fileobj = None, filename = None,
         for write_start in xrange(start_address, end_address,
                                   BINARY_BLOCK_NUM_BYTES):
             write_end = min(end_address, write_start + BINARY_BLOCK_NUM_BYTES)
-            fileobj.write(memory[write_start:write_end])
+            fileobj.write(memory.view(write_start, write_end))
     finally:
         if close:
             fileobj.close()
@@ -910,13 +895,15 @@ def save_intel_hex(memory, fileobj = None, filename = None,
         address_bits = 32   # 32-bit addresses
 
     try:
-        # No previous records, force writing an address record.
-        last_end = None
-
-        # Write memory ranges as Intel HEX records.
+        # Write memory ranges as Intel HEX records, in batches of lines.
         for mr in memory.memory_ranges():
-            _write_memory_range_records(fileobj, mr, address_bits,
-                                        max_record_len)
+            records = _generate_memory_range_records(mr, address_bits,
+                                                     max_record_len)
+            while True:
+                lines = list(itertools.islice(records, WRITE_BATCH_NUM_LINES))
+                if len(lines) == 0:
+                    break
+                fileobj.write(b"".join(lines))
 
         # Write an End Of File record (0x01).
         record = _generate_intel_hex_record(0x0000, 0x01, [])
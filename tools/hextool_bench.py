@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# hextool_bench.py - Measure hextool.py performance on large images
+#
+# Generates multi-megabyte images, made of several memory ranges like
+# combined bootloader, stack and application images, and measures the
+# operations done by genhex.py and genscratchpad.py on them:
+#   - loading and saving Intel HEX files
+#   - saving binary files
+#   - merging Memory objects and adding data at cursor position
+#   - writing many small scattered blocks
+#   - reading and deleting address ranges
+#
+# Another version of hextool.py can be given for comparison, e.g. one
+# extracted from version control with "git show <rev>:tools/hextool.py".
+#
+# Requires:
+#   - Python 3 v3.4 or newer
+#   - hextool.py in the same directory as this file
+
+import sys
+import os
+import io
+import random
+import argparse
+import importlib.util
+import textwrap
+import time
+import hextool
+
+
+# Constants
+
+# Default image sizes, in megabytes
+DEFAULT_SIZES = [1, 4, 16]
+
+# Number of memory ranges per image
+NUM_RANGES = 4
+
+# Start address of images, 32-bit addresses are needed above 64 kB
+IMAGE_ADDRESS = 0x00000000
+
+# Gap between memory ranges of an image, in bytes
+RANGE_GAP = 0x1000
+
+# Block size of data added at cursor position, like genhex.py does
+ADD_BLOCK_NUM_BYTES = 16
+
+# Number of random reads
+NUM_READS = 10000
+
+# Number of scattered blocks, written in random order
+NUM_SCATTERED = 2000
+
+# Number of timing runs, best time is kept
+NUM_RUNS = 3
+
+
+# Functions
+
+def load_module(filename):
+    '''Load another version of hextool.py, for comparison.'''
+
+    spec = importlib.util.spec_from_file_location("hextool_reference",
+                                                  filename)
+    module = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(module)
+    return module
+
+def make_image(module, num_bytes):
+    '''Create an image of given size, split in memory ranges.'''
+
+    rnd = random.Random(num_bytes)
+    range_num_bytes = num_bytes // NUM_RANGES
+
+    memory = module.Memory()
+    address = IMAGE_ADDRESS
+    for _ in range(NUM_RANGES):
+        # Mostly compressible data, like firmware images.
+        data = bytearray(rnd.getrandbits(8) & 0x0f
+                         for _ in range(range_num_bytes))
+        memory[address:(address + range_num_bytes)] = data
+        address += range_num_bytes + RANGE_GAP
+
+    return memory
+
+def best_time(func):
+    '''Run a function a few times, return best time in seconds.'''
+
+    best = None
+    for _ in range(NUM_RUNS):
+        start = time.perf_counter()
+        func()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+def run_benchmarks(module, hex_text):
+    '''Run all benchmarks on an Intel HEX file, return megabytes of data
+    and a list of (name, time) pairs.'''
+
+    results = []
+
+    def load():
+        # Older versions of hextool.py need a file object in text mode.
+        memory = module.Memory()
+        module.load_intel_hex(memory, fileobj = io.StringIO(hex_text))
+        return memory
+
+    memory = load()
+    results.append(("load_intel_hex", best_time(load)))
+
+    results.append(("save_intel_hex", best_time(
+        lambda: module.save_intel_hex(memory, fileobj = io.BytesIO()))))
+
+    results.append(("save_binary", best_time(
+        lambda: module.save_binary(memory, fileobj = io.BytesIO(),
+                                   fill_byte = b"\xff",
+                                   max_num_bytes = 2 ** 32))))
+
+    def merge():
+        # Like genhex.py: add an image to an empty one.
+        merged = module.Memory()
+        merged += memory
+
+    results.append(("merge", best_time(merge)))
+
+    def add_at_cursor():
+        # Like genhex.py: add small blocks of data at cursor position.
+        added = module.Memory()
+        added.cursor = memory.min_address
+        block = bytes(ADD_BLOCK_NUM_BYTES)
+        for _ in range(memory.num_bytes // NUM_RANGES //
+                       ADD_BLOCK_NUM_BYTES):
+            added += block
+
+    results.append(("add_at_cursor", best_time(add_at_cursor)))
+
+    rnd = random.Random(0)
+    reads = [rnd.randrange(memory.min_address, memory.max_address - 256)
+             for _ in range(NUM_READS)]
+
+    def read_random():
+        for address in reads:
+            memory[address:(address + 256)]
+
+    results.append(("read_random", best_time(read_random)))
+
+    def write_scattered():
+        # Many memory ranges, e.g. when merging many small hex files.
+        scattered = module.Memory()
+        block = bytes(ADD_BLOCK_NUM_BYTES)
+        for address in scattered_addresses:
+            scattered[address:(address + ADD_BLOCK_NUM_BYTES)] = block
+
+    scattered_addresses = [memory.min_address + n * ADD_BLOCK_NUM_BYTES * 2
+                           for n in range(NUM_SCATTERED)]
+    rnd.shuffle(scattered_addresses)
+    results.append(("write_scattered", best_time(write_scattered)))
+
+    results.append(("read_all", best_time(
+        lambda: memory[memory.min_address:memory.max_address])))
+
+    def delete():
+        # Like genhex.py: delete bootloader settings from an image.
+        copy = module.Memory()
+        copy += memory
+        for address in reads[:100]:
+            del copy[address:(address + 16)]
+
+    results.append(("delete", best_time(delete)))
+
+    return memory.num_bytes / (1024.0 * 1024.0), results
+
+def create_argument_parser(pgmname):
+    '''Create a parser for parsing the command line.'''
+
+    # Determine help text width.
+    try:
+        help_width = int(os.environ['COLUMNS'])
+    except (KeyError, ValueError):
+        help_width = 80
+    help_width -= 2
+
+    parser = argparse.ArgumentParser(
+        prog = pgmname,
+        formatter_class = argparse.RawDescriptionHelpFormatter,
+        description = textwrap.fill(
+            "A tool to measure hextool.py performance on large images",
+            help_width))
+    parser.add_argument("--size", "-s",
+        type = int, metavar = "MB", action = "append",
+        help = "generated image size in megabytes, can be repeated "
+               "(default: %s)" % ", ".join(map(str, DEFAULT_SIZES)))
+    parser.add_argument("--reference", "-r",
+        metavar = "FILE",
+        help = "another hextool.py to compare with")
+    parser.add_argument("image", nargs = "*", metavar = "IMAGE",
+        help = "image in Intel HEX format, instead of generated images")
+
+    return parser
+
+def main():
+    '''Main program'''
+
+    # Determine program name, for error messages.
+    pgmname = os.path.split(sys.argv[0])[-1]
+
+    # Create a parser for parsing the command line and printing error messages.
+    parser = create_argument_parser(pgmname)
+    args = parser.parse_args()
+
+    try:
+        modules = [("hextool", hextool)]
+        if args.reference:
+            modules.append(("reference", load_module(args.reference)))
+
+        # Images as Intel HEX files, generated or loaded.
+        images = []
+        if args.image:
+            for filename in args.image:
+                with open(filename, "r") as f:
+                    images.append((os.path.basename(filename), f.read()))
+        else:
+            for size in args.size or DEFAULT_SIZES:
+                memory = make_image(hextool, size * 1024 * 1024)
+                hex_file = io.BytesIO()
+                hextool.save_intel_hex(memory, fileobj = hex_file)
+                images.append(("%d MB" % size,
+                               hex_file.getvalue().decode("ascii")))
+    except (ValueError, IOError, OSError, ImportError) as exc:
+        sys.stdout.write("%s: %s\n" % (pgmname, exc))
+        return 1
+
+    sys.stdout.write("%-16s %-10s %-16s %10s %10s\n" %
+                     ("image", "module", "benchmark", "time_ms", "MB/s"))
+    for name, hex_text in images:
+        for module_name, module in modules:
+            num_mbytes, results = run_benchmarks(module, hex_text)
+            for benchmark, elapsed in results:
+                sys.stdout.write("%-16s %-10s %-16s %10.1f %10.1f\n" %
+                                 (name, module_name, benchmark,
+                                  elapsed * 1e3, num_mbytes / elapsed))
+
+    return 0
+
+# Run main.
+if __name__ == "__main__":
+    sys.exit(main())
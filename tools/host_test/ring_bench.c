@@ -0,0 +1,129 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * \file ring_bench.c
+ *
+ * Host benchmark of util/ring.c against the byte by byte copy done with the
+ * deprecated ringbuffer.h, for several chunk sizes. Absolute numbers are for
+ * the host only; the ratio between the methods is what carries to the MCU.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "ring.h"
+
+#define BUFFER_SIZE 512
+#include "ringbuffer.h"
+
+/** Bytes moved through the ring per measurement */
+#define BENCH_BYTES     (64 * 1024 * 1024)
+
+static uint8_t m_data[BUFFER_SIZE];
+static uint8_t m_out[BUFFER_SIZE];
+static volatile uint32_t m_sink;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_legacy(uint32_t chunk)
+{
+    static ringbuffer_t buffer;
+    double start = now_s();
+
+    Ringbuffer_reset(buffer);
+    for (uint32_t moved = 0; moved < BENCH_BYTES; moved += chunk)
+    {
+        // What drivers did before: one byte and one index update at a time
+        for (uint32_t i = 0; i < chunk && Ringbuffer_free(buffer) > 0; i++)
+        {
+            Ringbuffer_getHeadByte(buffer) = m_data[i];
+            Ringbuffer_incrHead(buffer, 1);
+        }
+        for (uint32_t i = 0; i < chunk && Ringbuffer_usage(buffer) > 0; i++)
+        {
+            m_out[i] = Ringbuffer_getTailByte(buffer);
+            Ringbuffer_incrTail(buffer, 1);
+        }
+        m_sink += m_out[0];
+    }
+    return BENCH_BYTES / (now_s() - start) / 1e6;
+}
+
+static double bench_bulk(uint32_t chunk)
+{
+    static uint8_t storage[BUFFER_SIZE];
+    ring_t ring;
+    double start = now_s();
+
+    Ring_init(&ring, storage, sizeof(storage));
+    for (uint32_t moved = 0; moved < BENCH_BYTES; moved += chunk)
+    {
+        Ring_write(&ring, m_data, chunk);
+        Ring_read(&ring, m_out, chunk);
+        m_sink += m_out[0];
+    }
+    return BENCH_BYTES / (now_s() - start) / 1e6;
+}
+
+static double bench_span(uint32_t chunk)
+{
+    static uint8_t storage[BUFFER_SIZE];
+    ring_t ring;
+    double start = now_s();
+
+    Ring_init(&ring, storage, sizeof(storage));
+    for (uint32_t moved = 0; moved < BENCH_BYTES; moved += chunk)
+    {
+        uint8_t * span;
+        uint32_t length;
+        uint32_t done = 0;
+
+        // Two spans at most when the chunk wraps
+        while (done < chunk)
+        {
+            length = Ring_peekWrite(&ring, &span);
+            length = length < chunk - done ? length : chunk - done;
+            memcpy(span, &m_data[done], length);
+            Ring_commitWrite(&ring, length);
+            done += length;
+        }
+        while ((length = Ring_peekRead(&ring, &span)) > 0)
+        {
+            m_sink += span[0];
+            Ring_commitRead(&ring, length);
+        }
+    }
+    return BENCH_BYTES / (now_s() - start) / 1e6;
+}
+
+int main(void)
+{
+    static const uint32_t chunks[] = {1, 16, 64, 256};
+
+    for (uint32_t i = 0; i < sizeof(m_data); i++)
+    {
+        m_data[i] = (uint8_t) i;
+    }
+
+    printf("%8s %14s %14s %14s\n", "chunk", "legacy MB/s", "bulk MB/s",
+           "span MB/s");
+    for (uint32_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+    {
+        printf("%8u %14.1f %14.1f %14.1f\n",
+               (unsigned) chunks[i],
+               bench_legacy(chunks[i]),
+               bench_bulk(chunks[i]),
+               bench_span(chunks[i]));
+    }
+    return 0;
+}
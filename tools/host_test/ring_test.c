@@ -0,0 +1,370 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * \file ring_test.c
+ *
+ * Host test of util/ring.c: parameter checks, full and empty ring, wrap of
+ * the storage, wrap of the 32-bit indexes, contiguous spans and a producer
+ * thread racing a consumer thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+
+/** Bytes transferred between the threads of the concurrent test */
+#define CONCURRENT_BYTES    (8 * 1024 * 1024)
+
+static int m_failures;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            m_failures++;                                                   \
+        }                                                                   \
+    } while (0)
+
+static void test_init(void)
+{
+    ring_t ring;
+    uint8_t buffer[16];
+
+    CHECK(Ring_init(&ring, NULL, 16) == RING_RES_INVALID_PARAM);
+    CHECK(Ring_init(&ring, buffer, 0) == RING_RES_INVALID_PARAM);
+    CHECK(Ring_init(&ring, buffer, 1) == RING_RES_INVALID_PARAM);
+    CHECK(Ring_init(&ring, buffer, 12) == RING_RES_INVALID_PARAM);
+    CHECK(Ring_init(&ring, buffer, 16) == RING_RES_OK);
+    CHECK(Ring_size(&ring) == 16);
+    CHECK(Ring_isEmpty(&ring));
+    CHECK(Ring_usage(&ring) == 0);
+    CHECK(Ring_free(&ring) == 16);
+}
+
+static void test_full_empty(void)
+{
+    ring_t ring;
+    uint8_t buffer[8];
+    uint8_t data[12];
+    uint8_t out[12];
+
+    for (uint32_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t) i;
+    }
+    Ring_init(&ring, buffer, sizeof(buffer));
+
+    // Reading an empty ring gives nothing
+    CHECK(Ring_read(&ring, out, sizeof(out)) == 0);
+
+    // Writing more than capacity is truncated
+    CHECK(Ring_write(&ring, data, sizeof(data)) == 8);
+    CHECK(Ring_usage(&ring) == 8);
+    CHECK(Ring_free(&ring) == 0);
+    CHECK(!Ring_isEmpty(&ring));
+    CHECK(Ring_write(&ring, data, 1) == 0);
+
+    uint8_t * span;
+    CHECK(Ring_peekWrite(&ring, &span) == 0);
+
+    CHECK(Ring_read(&ring, out, sizeof(out)) == 8);
+    CHECK(memcmp(out, data, 8) == 0);
+    CHECK(Ring_isEmpty(&ring));
+    CHECK(Ring_peekRead(&ring, &span) == 0);
+
+    // Reset empties a full ring
+    Ring_write(&ring, data, 8);
+    Ring_reset(&ring);
+    CHECK(Ring_isEmpty(&ring));
+    CHECK(Ring_free(&ring) == 8);
+}
+
+static void test_storage_wrap(void)
+{
+    ring_t ring;
+    uint8_t buffer[8];
+    uint8_t out[8];
+    uint8_t * span;
+
+    Ring_init(&ring, buffer, sizeof(buffer));
+
+    // Move indexes to 5 so next 6 bytes wrap
+    Ring_write(&ring, "abcde", 5);
+    Ring_read(&ring, out, 5);
+
+    CHECK(Ring_write(&ring, "012345", 6) == 6);
+    CHECK(memcmp(&buffer[5], "012", 3) == 0);
+    CHECK(memcmp(&buffer[0], "345", 3) == 0);
+
+    // Spans stop at end of storage
+    CHECK(Ring_peekRead(&ring, &span) == 3);
+    CHECK(span == &buffer[5]);
+    CHECK(Ring_peekWrite(&ring, &span) == 2);
+    CHECK(span == &buffer[3]);
+
+    CHECK(Ring_read(&ring, out, sizeof(out)) == 6);
+    CHECK(memcmp(out, "012345", 6) == 0);
+
+    // Same through spans only
+    CHECK(Ring_peekWrite(&ring, &span) == 5);
+    memcpy(span, "ABCDE", 5);
+    Ring_commitWrite(&ring, 5);
+    CHECK(Ring_peekWrite(&ring, &span) == 3);
+    CHECK(span == &buffer[0]);
+    memcpy(span, "FGH", 3);
+    Ring_commitWrite(&ring, 3);
+    CHECK(Ring_free(&ring) == 0);
+
+    uint32_t length = Ring_peekRead(&ring, &span);
+    CHECK(length == 5);
+    CHECK(memcmp(span, "ABCDE", 5) == 0);
+    Ring_commitRead(&ring, 2);
+    length = Ring_peekRead(&ring, &span);
+    CHECK(length == 3);
+    CHECK(memcmp(span, "CDE", 3) == 0);
+    Ring_commitRead(&ring, length);
+    length = Ring_peekRead(&ring, &span);
+    CHECK(length == 3);
+    CHECK(memcmp(span, "FGH", 3) == 0);
+    Ring_commitRead(&ring, length);
+    CHECK(Ring_isEmpty(&ring));
+}
+
+static void test_index_wrap(void)
+{
+    ring_t ring;
+    uint8_t buffer[16];
+    uint8_t data[16];
+    uint8_t out[16];
+
+    for (uint32_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t) (0xa0 + i);
+    }
+    Ring_init(&ring, buffer, sizeof(buffer));
+
+    // Indexes are free running: start close to their 32-bit overflow
+    ring.head = UINT32_MAX - 5;
+    ring.tail = UINT32_MAX - 5;
+    CHECK(Ring_isEmpty(&ring));
+    CHECK(Ring_free(&ring) == 16);
+
+    CHECK(Ring_write(&ring, data, 16) == 16);
+    CHECK(ring.head < ring.tail);
+    CHECK(Ring_usage(&ring) == 16);
+    CHECK(Ring_free(&ring) == 0);
+    CHECK(Ring_write(&ring, data, 1) == 0);
+
+    CHECK(Ring_read(&ring, out, 10) == 10);
+    CHECK(Ring_usage(&ring) == 6);
+    CHECK(Ring_read(&ring, out + 10, 10) == 6);
+    CHECK(memcmp(out, data, 16) == 0);
+    CHECK(Ring_isEmpty(&ring));
+}
+
+static void test_random(void)
+{
+    ring_t ring;
+    uint8_t buffer[32];
+    uint8_t data[40];
+    uint8_t next_write = 0;
+    uint8_t next_read = 0;
+    uint32_t expected_usage = 0;
+
+    Ring_init(&ring, buffer, sizeof(buffer));
+    srand(1);
+
+    // Mix of bulk and span accesses against a byte counter model
+    for (uint32_t iter = 0; iter < 100000; iter++)
+    {
+        uint32_t length = (uint32_t) rand() % sizeof(data);
+        uint32_t done;
+        uint8_t * span;
+
+        if (rand() & 1)
+        {
+            for (uint32_t i = 0; i < length; i++)
+            {
+                data[i] = (uint8_t) (next_write + i);
+            }
+            uint32_t free = sizeof(buffer) - expected_usage;
+            if (rand() & 1)
+            {
+                done = Ring_write(&ring, data, length);
+                CHECK(done == (length < free ? length : free));
+            }
+            else
+            {
+                done = Ring_peekWrite(&ring, &span);
+                CHECK(done <= free);
+                done = done < length ? done : length;
+                memcpy(span, data, done);
+                Ring_commitWrite(&ring, done);
+            }
+            next_write = (uint8_t) (next_write + done);
+            expected_usage += done;
+        }
+        else
+        {
+            if (rand() & 1)
+            {
+                done = Ring_read(&ring, data, length);
+            }
+            else
+            {
+                done = Ring_peekRead(&ring, &span);
+                done = done < length ? done : length;
+                memcpy(data, span, done);
+                Ring_commitRead(&ring, done);
+            }
+            for (uint32_t i = 0; i < done; i++)
+            {
+                CHECK(data[i] == next_read);
+                next_read++;
+            }
+            expected_usage -= done;
+        }
+        CHECK(Ring_usage(&ring) == expected_usage);
+        CHECK(Ring_usage(&ring) <= Ring_size(&ring));
+    }
+}
+
+static ring_t m_concurrent_ring;
+
+static void * producer(void * arg)
+{
+    uint8_t data[61];
+    uint32_t sent = 0;
+    uint32_t iter = 0;
+
+    while (sent < CONCURRENT_BYTES)
+    {
+        uint32_t length = sizeof(data);
+        uint8_t * span;
+
+        if (length > CONCURRENT_BYTES - sent)
+        {
+            length = CONCURRENT_BYTES - sent;
+        }
+        // Alternate bulk copies and spans, like a driver mixing both
+        if (iter++ & 1)
+        {
+            for (uint32_t i = 0; i < length; i++)
+            {
+                data[i] = (uint8_t) ((sent + i) * 7);
+            }
+            sent += Ring_write(&m_concurrent_ring, data, length);
+        }
+        else
+        {
+            uint32_t free = Ring_peekWrite(&m_concurrent_ring, &span);
+            free = free < length ? free : length;
+            for (uint32_t i = 0; i < free; i++)
+            {
+                span[i] = (uint8_t) ((sent + i) * 7);
+            }
+            Ring_commitWrite(&m_concurrent_ring, free);
+            sent += free;
+        }
+        if (Ring_free(&m_concurrent_ring) == 0)
+        {
+            // Let the consumer run on a single core host
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void * consumer(void * arg)
+{
+    uint8_t data[47];
+    uint32_t received = 0;
+    uint32_t iter = 0;
+    int * errors = arg;
+
+    while (received < CONCURRENT_BYTES)
+    {
+        uint32_t length;
+        uint8_t * span;
+
+        if (iter++ & 1)
+        {
+            length = Ring_read(&m_concurrent_ring, data, sizeof(data));
+            span = data;
+        }
+        else
+        {
+            length = Ring_peekRead(&m_concurrent_ring, &span);
+        }
+        // Usage seen by the consumer never exceeds capacity
+        if (Ring_usage(&m_concurrent_ring) > Ring_size(&m_concurrent_ring))
+        {
+            (*errors)++;
+        }
+        for (uint32_t i = 0; i < length; i++)
+        {
+            if (span[i] != (uint8_t) ((received + i) * 7))
+            {
+                (*errors)++;
+            }
+        }
+        if (span != data)
+        {
+            Ring_commitRead(&m_concurrent_ring, length);
+        }
+        received += length;
+        if (length == 0)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void test_concurrent(void)
+{
+    static uint8_t buffer[64];
+    pthread_t prod;
+    pthread_t cons;
+    int errors = 0;
+
+    Ring_init(&m_concurrent_ring, buffer, sizeof(buffer));
+    // Cross the 32-bit index overflow during the run
+    m_concurrent_ring.head = UINT32_MAX - CONCURRENT_BYTES / 2;
+    m_concurrent_ring.tail = m_concurrent_ring.head;
+
+    pthread_create(&cons, NULL, consumer, &errors);
+    pthread_create(&prod, NULL, producer, NULL);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    CHECK(errors == 0);
+    CHECK(Ring_isEmpty(&m_concurrent_ring));
+}
+
+int main(void)
+{
+    test_init();
+    test_full_empty();
+    test_storage_wrap();
+    test_index_wrap();
+    test_random();
+    test_concurrent();
+
+    if (m_failures != 0)
+    {
+        printf("ring_test: %d failure(s)\n", m_failures);
+        return 1;
+    }
+    printf("ring_test: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,637 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * \file spi_nor_test.c
+ *
+ * Host test of bootloader/external_flash_spi_nor.c against a simulated SPI
+ * NOR flash. The model decodes the commands sent through SPI_transfer()
+ * between chip select edges and behaves like a real part:
+ * - page programs wrap inside the page, only clear bits and need WEL
+ * - erases need WEL, an aligned address, and take a number of status polls
+ * - nothing but status, suspend and resume is accepted while busy
+ * - reads are only valid while idle or while an erase is suspended
+ * Any command the part would reject or mishandle is counted as a violation.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "external_flash.h"
+#include "spi.h"
+#include "mcu.h"
+
+/** Simulated flash: 1 MB, 256 bytes pages, 4k/32k/64k erases */
+#define SIM_SIZE            (1024 * 1024)
+#define SIM_PAGE_SIZE       256
+#define SIM_JEDEC_ID        {0xef, 0x40, 0x14}
+
+/** Busy time of operations, in status polls */
+#define SIM_PROGRAM_POLLS   3
+#define SIM_ERASE_POLLS     50
+
+/** Largest command kept: opcode, address, dummy byte */
+#define SIM_CMD_MAX         5
+
+#define MAX_LOG             64
+
+static int m_failures;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            m_failures++;                                                   \
+        }                                                                   \
+    } while (0)
+
+/** An erase seen by the flash */
+typedef struct
+{
+    uint8_t     opcode;
+    uint32_t    addr;
+} sim_erase_t;
+
+static struct
+{
+    uint8_t     mem[SIM_SIZE];
+    uint8_t     sfdp[256];
+    bool        has_sfdp;
+    bool        has_suspend;
+
+    /** Current transaction */
+    bool        selected;
+    uint8_t     cmd[SIM_CMD_MAX];
+    uint32_t    cmd_len;
+    uint32_t    data_idx;
+
+    /** Flash state */
+    bool        wel;
+    uint32_t    busy_polls;
+    bool        erasing;
+    bool        suspended;
+    uint32_t    erase_addr;
+    uint32_t    erase_size;
+
+    /** What happened */
+    sim_erase_t erases[MAX_LOG];
+    uint32_t    num_erases;
+    uint32_t    num_programs;
+    uint32_t    num_suspends;
+    uint32_t    num_suspended_reads;
+    uint32_t    violations;
+} m_sim;
+
+static void violation(const char * what)
+{
+    printf("  flash violation: %s\n", what);
+    m_sim.violations++;
+}
+
+static void put32(uint8_t * p, uint32_t value)
+{
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+    p[2] = (uint8_t) (value >> 16);
+    p[3] = (uint8_t) (value >> 24);
+}
+
+/** Build SFDP header, parameter header and Basic Flash Parameter Table */
+static void build_sfdp(bool has_suspend)
+{
+    uint8_t * bfpt = &m_sim.sfdp[0x30];
+
+    memset(m_sim.sfdp, 0xff, sizeof(m_sim.sfdp));
+    put32(&m_sim.sfdp[0], 0x50444653);
+    m_sim.sfdp[4] = 6;              // Minor revision
+    m_sim.sfdp[5] = 1;              // Major revision
+    m_sim.sfdp[6] = 0;              // One parameter header
+    m_sim.sfdp[7] = 0xff;
+    m_sim.sfdp[8] = 0x00;           // BFPT ID LSB
+    m_sim.sfdp[9] = 6;
+    m_sim.sfdp[10] = 1;
+    m_sim.sfdp[11] = 16;            // Length in DWORDs
+    m_sim.sfdp[12] = 0x30;          // Pointer to table
+    m_sim.sfdp[13] = 0;
+    m_sim.sfdp[14] = 0;
+    m_sim.sfdp[15] = 0xff;          // BFPT ID MSB
+
+    memset(bfpt, 0, 16 * 4);
+    // 2nd DWORD: density in bits minus one
+    put32(&bfpt[1 * 4], SIM_SIZE * 8 - 1);
+    // 8th and 9th DWORDs: erase types 4k, 32k and 64k
+    put32(&bfpt[7 * 4], (0x52 << 24) | (15 << 16) | (0x20 << 8) | 12);
+    put32(&bfpt[8 * 4], (0xd8 << 8) | 16);
+    // 10th DWORD: typical erase times: 3, 8 and 10 x 16 ms
+    put32(&bfpt[9 * 4], ((2 | (1 << 5)) << 4) | ((7 | (1 << 5)) << 11) |
+                        ((9 | (1 << 5)) << 18));
+    // 11th DWORD: 256 bytes pages, page program 11 x 64 us, byte 4 x 8 us
+    put32(&bfpt[10 * 4], (8 << 4) | (10 << 8) | (1 << 13) |
+                         (3 << 14) | (1 << 18));
+    // 12th and 13th DWORDs: suspend/resume support and opcodes
+    put32(&bfpt[11 * 4], has_suspend ? 0 : 0x80000000);
+    put32(&bfpt[12 * 4], (0x75 << 24) | (0x7a << 16));
+}
+
+static void sim_reset(bool has_sfdp, bool has_suspend)
+{
+    memset(&m_sim, 0, sizeof(m_sim));
+    memset(m_sim.mem, 0xff, sizeof(m_sim.mem));
+    m_sim.has_sfdp = has_sfdp;
+    m_sim.has_suspend = has_suspend && has_sfdp;
+    build_sfdp(has_suspend);
+}
+
+static bool sim_busy(void)
+{
+    return m_sim.busy_polls > 0 && !m_sim.suspended;
+}
+
+static uint32_t sim_addr(void)
+{
+    return (m_sim.cmd[1] << 16) | (m_sim.cmd[2] << 8) | m_sim.cmd[3];
+}
+
+static uint32_t erase_size(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case 0x20:
+            return 4096;
+        case 0x52:
+            return m_sim.has_sfdp ? 32768 : 0;
+        case 0xd8:
+            return m_sim.has_sfdp ? 65536 : 0;
+        default:
+            return 0;
+    }
+}
+
+/** Number of command bytes before data, for an opcode */
+static uint32_t header_length(uint8_t opcode)
+{
+    if (opcode == 0x0b || opcode == 0x5a)
+    {
+        return 5;
+    }
+    if (opcode == 0x02 || erase_size(opcode) != 0)
+    {
+        return 4;
+    }
+    return 1;
+}
+
+/** Byte written by the host in the current transaction */
+static void sim_write_byte(uint8_t byte)
+{
+    if (m_sim.cmd_len == 0 || m_sim.cmd_len < header_length(m_sim.cmd[0]))
+    {
+        m_sim.cmd[m_sim.cmd_len++] = byte;
+        if (m_sim.cmd_len > 1 || !sim_busy())
+        {
+            return;
+        }
+        // Only these are accepted while busy
+        if (byte != 0x05 && byte != 0x75 && byte != 0x7a && byte != 0x06)
+        {
+            violation("command while busy");
+        }
+        return;
+    }
+    if (m_sim.cmd[0] != 0x02)
+    {
+        violation("unexpected data");
+        return;
+    }
+
+    // Page program data: address wraps inside the page
+    uint32_t start = sim_addr();
+    uint32_t offset = (start % SIM_PAGE_SIZE) + m_sim.data_idx;
+    if (offset >= SIM_PAGE_SIZE)
+    {
+        violation("page program crosses page boundary");
+    }
+    uint32_t addr = (start - start % SIM_PAGE_SIZE) + offset % SIM_PAGE_SIZE;
+    m_sim.mem[addr % SIM_SIZE] &= byte;
+    m_sim.data_idx++;
+}
+
+/** Byte read by the host in the current transaction */
+static uint8_t sim_read_byte(void)
+{
+    static const uint8_t jedec_id[] = SIM_JEDEC_ID;
+    uint32_t idx = m_sim.data_idx++;
+
+    switch (m_sim.cmd[0])
+    {
+        case 0x05:
+        {
+            uint8_t status = sim_busy() ? 0x01 : 0x00;
+            if (sim_busy() && --m_sim.busy_polls == 0 && m_sim.erasing)
+            {
+                memset(&m_sim.mem[m_sim.erase_addr], 0xff, m_sim.erase_size);
+                m_sim.erasing = false;
+            }
+            return status | (m_sim.wel ? 0x02 : 0x00);
+        }
+        case 0x9f:
+            return idx < sizeof(jedec_id) ? jedec_id[idx] : 0;
+        case 0x5a:
+            if (!m_sim.has_sfdp)
+            {
+                return 0xff;
+            }
+            return m_sim.sfdp[(sim_addr() + idx) % sizeof(m_sim.sfdp)];
+        case 0x0b:
+            if (m_sim.cmd_len < 5)
+            {
+                violation("fast read without dummy byte");
+            }
+            if (sim_busy())
+            {
+                violation("read while busy");
+                return 0x5a;
+            }
+            if (m_sim.suspended && idx == 0)
+            {
+                m_sim.num_suspended_reads++;
+            }
+            return m_sim.mem[(sim_addr() + idx) % SIM_SIZE];
+        default:
+            violation("read after unexpected command");
+            return 0;
+    }
+}
+
+/** Chip select released: execute command */
+static void sim_end_transaction(void)
+{
+    uint8_t opcode = m_sim.cmd[0];
+
+    if (m_sim.cmd_len == 0)
+    {
+        return;
+    }
+
+    if (opcode == 0x06)
+    {
+        m_sim.wel = true;
+    }
+    else if (opcode == 0x02)
+    {
+        if (!m_sim.wel || m_sim.busy_polls > 0)
+        {
+            violation("page program refused");
+        }
+        m_sim.num_programs++;
+        m_sim.wel = false;
+        m_sim.busy_polls = SIM_PROGRAM_POLLS;
+    }
+    else if (erase_size(opcode) != 0)
+    {
+        uint32_t size = erase_size(opcode);
+        uint32_t addr = sim_addr();
+
+        if (!m_sim.wel || m_sim.busy_polls > 0)
+        {
+            violation("erase refused");
+        }
+        if (addr % size != 0)
+        {
+            violation("unaligned erase");
+        }
+        if (m_sim.num_erases < MAX_LOG)
+        {
+            m_sim.erases[m_sim.num_erases].opcode = opcode;
+            m_sim.erases[m_sim.num_erases].addr = addr;
+        }
+        m_sim.num_erases++;
+        m_sim.wel = false;
+        m_sim.busy_polls = SIM_ERASE_POLLS;
+        m_sim.erasing = true;
+        m_sim.erase_addr = addr - addr % size;
+        m_sim.erase_size = size;
+    }
+    else if (opcode == 0x75 && m_sim.has_suspend)
+    {
+        if (m_sim.erasing && !m_sim.suspended)
+        {
+            m_sim.suspended = true;
+            m_sim.num_suspends++;
+        }
+    }
+    else if (opcode == 0x7a && m_sim.has_suspend)
+    {
+        m_sim.suspended = false;
+    }
+}
+
+/* Stubs of the HAL used by the driver */
+
+void nrf_gpio_pin_set(uint32_t pin)
+{
+    if (m_sim.selected)
+    {
+        sim_end_transaction();
+    }
+    m_sim.selected = false;
+}
+
+void nrf_gpio_pin_clear(uint32_t pin)
+{
+    m_sim.selected = true;
+    m_sim.cmd_len = 0;
+    m_sim.data_idx = 0;
+}
+
+void nrf_gpio_cfg_output(uint32_t pin)
+{
+}
+
+spi_res_e SPI_init(spi_conf_t * conf_p)
+{
+    return SPI_RES_OK;
+}
+
+spi_res_e SPI_transfer(spi_xfer_t * xfer_p, spi_on_transfer_done_cb_f cb)
+{
+    if (!m_sim.selected)
+    {
+        violation("transfer without chip select");
+    }
+    for (uint32_t i = 0; i < xfer_p->write_size; i++)
+    {
+        sim_write_byte(xfer_p->write_ptr[i]);
+    }
+    for (uint32_t i = 0; i < xfer_p->read_size; i++)
+    {
+        xfer_p->read_ptr[i] = sim_read_byte();
+    }
+    return SPI_RES_OK;
+}
+
+/* Tests */
+
+/** Flash addresses are passed as pointers */
+#define FLASH_PTR(addr)     ((void *) (uintptr_t) (addr))
+
+static bool wait_idle(void)
+{
+    for (uint32_t i = 0; i < 100000; i++)
+    {
+        if (!externalFlash_isBusy())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Erase a range as the bootloader does, one startErase() at a time */
+static extFlash_res_e erase(size_t base, size_t number_of_sector)
+{
+    while (number_of_sector > 0)
+    {
+        extFlash_res_e res = externalFlash_startErase(&base,
+                                                      &number_of_sector);
+        if (res != EXTFLASH_RES_OK)
+        {
+            return res;
+        }
+        if (!wait_idle())
+        {
+            return EXTFLASH_RES_ERROR;
+        }
+    }
+    return EXTFLASH_RES_OK;
+}
+
+static void test_init(void)
+{
+    flash_info_t info;
+
+    sim_reset(true, true);
+    CHECK(externalFlash_init() == EXTFLASH_RES_OK);
+    CHECK(externalFlash_getInfo(&info) == EXTFLASH_RES_OK);
+    CHECK(info.flash_size == SIM_SIZE);
+    CHECK(info.write_page_size == SIM_PAGE_SIZE);
+    CHECK(info.erase_sector_size == 4096);
+    CHECK(info.sector_erase_time == 3 * 16000);
+    CHECK(info.page_write_time == 11 * 64);
+    CHECK(info.byte_write_time == 4 * 8);
+    CHECK(info.write_alignment == 1);
+    CHECK(m_sim.violations == 0);
+
+    // Without SFDP: size from JEDEC ID, 4k sectors
+    sim_reset(false, false);
+    CHECK(externalFlash_init() == EXTFLASH_RES_OK);
+    CHECK(externalFlash_getInfo(&info) == EXTFLASH_RES_OK);
+    CHECK(info.flash_size == SIM_SIZE);
+    CHECK(info.write_page_size == SIM_PAGE_SIZE);
+    CHECK(info.erase_sector_size == 4096);
+    CHECK(m_sim.violations == 0);
+}
+
+static void test_write_page_crossing(void)
+{
+    static uint8_t data[700];
+    static const struct
+    {
+        uint32_t addr;
+        uint32_t length;
+        uint32_t programs;
+    } cases[] =
+    {
+        // Inside a page
+        {0x1010, 16, 1},
+        // Exactly one page
+        {0x2000, 256, 1},
+        // One byte across a boundary
+        {0x30ff, 2, 2},
+        // Unaligned start, several pages, unaligned end
+        {0x40c8, 700, 4},
+        // Last bytes of the flash
+        {SIM_SIZE - 300, 300, 2},
+    };
+
+    for (uint32_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t) (i * 31 + 7);
+    }
+
+    sim_reset(true, true);
+    CHECK(externalFlash_init() == EXTFLASH_RES_OK);
+
+    for (uint32_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        uint32_t addr = cases[c].addr;
+        uint32_t length = cases[c].length;
+
+        m_sim.num_programs = 0;
+        CHECK(externalFlash_startWrite(FLASH_PTR(addr), data, length) ==
+              EXTFLASH_RES_OK);
+        CHECK(wait_idle());
+        CHECK(m_sim.num_programs == cases[c].programs);
+        CHECK(memcmp(&m_sim.mem[addr], data, length) == 0);
+        // Bytes around the write are untouched
+        CHECK(m_sim.mem[addr - 1] == 0xff);
+        CHECK(addr + length == SIM_SIZE || m_sim.mem[addr + length] == 0xff);
+    }
+
+    // Out of flash
+    CHECK(externalFlash_startWrite(FLASH_PTR(SIM_SIZE - 1), data, 2) ==
+          EXTFLASH_RES_PARAM);
+    CHECK(m_sim.violations == 0);
+}
+
+static void check_erases(const sim_erase_t * expected, uint32_t num)
+{
+    CHECK(m_sim.num_erases == num);
+    for (uint32_t i = 0; i < num && i < m_sim.num_erases; i++)
+    {
+        CHECK(m_sim.erases[i].opcode == expected[i].opcode);
+        CHECK(m_sim.erases[i].addr == expected[i].addr);
+    }
+}
+
+static void test_erase_block_choice(void)
+{
+    sim_reset(true, true);
+    CHECK(externalFlash_init() == EXTFLASH_RES_OK);
+
+    // 64k aligned and requested: one block erase
+    {
+        static const sim_erase_t expected[] = {{0xd8, 0}};
+        memset(m_sim.mem, 0, 0x20000);
+        m_sim.num_erases = 0;
+        CHECK(erase(0, 16) == EXTFLASH_RES_OK);
+        check_erases(expected, 1);
+        CHECK(m_sim.mem[0] == 0xff && m_sim.mem[0xffff] == 0xff);
+        CHECK(m_sim.mem[0x10000] == 0x00);
+    }
+
+    // Unaligned start: sectors up to 32k alignment, then 32k, then sector
+    {
+        static const sim_erase_t expected[] =
+        {
+            {0x20, 0x1000}, {0x20, 0x2000}, {0x20, 0x3000}, {0x20, 0x4000},
+            {0x20, 0x5000}, {0x20, 0x6000}, {0x20, 0x7000}, {0x52, 0x8000},
+            {0x20, 0x10000},
+        };
+        memset(m_sim.mem, 0, 0x20000);
+        m_sim.num_erases = 0;
+        CHECK(erase(0x1000, 16) == EXTFLASH_RES_OK);
+        check_erases(expected, sizeof(expected) / sizeof(expected[0]));
+        CHECK(m_sim.mem[0xfff] == 0x00);
+        CHECK(m_sim.mem[0x1000] == 0xff && m_sim.mem[0x10fff] == 0xff);
+        CHECK(m_sim.mem[0x11000] == 0x00);
+    }
+
+    // 96k from 0: 64k block, then 32k block
+    {
+        static const sim_erase_t expected[] = {{0xd8, 0}, {0x52, 0x10000}};
+        m_sim.num_erases = 0;
+        CHECK(erase(0, 24) == EXTFLASH_RES_OK);
+        check_erases(expected, 2);
+    }
+
+    // Invalid requests
+    {
+        size_t base = 0x800;
+        size_t number = 1;
+        CHECK(externalFlash_startErase(&base, &number) == EXTFLASH_RES_PARAM);
+        base = SIM_SIZE - 4096;
+        number = 2;
+        CHECK(externalFlash_startErase(&base, &number) == EXTFLASH_RES_PARAM);
+        number = 1;
+        CHECK(externalFlash_startErase(&base, &number) == EXTFLASH_RES_OK);
+        CHECK(base == SIM_SIZE && number == 0);
+        CHECK(wait_idle());
+    }
+
+    // Without SFDP, only 4k erases
+    {
+        static const sim_erase_t expected[] =
+        {
+            {0x20, 0}, {0x20, 0x1000}, {0x20, 0x2000}, {0x20, 0x3000},
+        };
+        sim_reset(false, false);
+        CHECK(externalFlash_init() == EXTFLASH_RES_OK);
+        CHECK(erase(0, 4) == EXTFLASH_RES_OK);
+        check_erases(expected, 4);
+    }
+    CHECK(m_sim.violations == 0);
+}
+
+static void test_read_during_erase(void)
+{
+    uint8_t buffer[300];
+    size_t base = 0;
+    size_t number = 16;
+
+    sim_reset(true, true);
+    CHECK(externalFlash_init() == EXTFLASH_RES_OK);
+    for (uint32_t i = 0; i < sizeof(buffer); i++)
+    {
+        m_sim.mem[0x20000 + i] = (uint8_t) (i ^ 0x5a);
+    }
+
+    // Read elsewhere while a 64k erase is ongoing: erase is suspended
+    CHECK(externalFlash_startErase(&base, &number) == EXTFLASH_RES_OK);
+    CHECK(externalFlash_isBusy());
+    memset(buffer, 0, sizeof(buffer));
+    CHECK(externalFlash_startRead(buffer, FLASH_PTR(0x20000), sizeof(buffer))
+          == EXTFLASH_RES_OK);
+    CHECK(memcmp(buffer, &m_sim.mem[0x20000], sizeof(buffer)) == 0);
+    CHECK(m_sim.num_suspends == 1);
+    CHECK(m_sim.num_suspended_reads == 1);
+    // Resumed and completes
+    CHECK(!m_sim.suspended);
+    CHECK(externalFlash_isBusy());
+    CHECK(wait_idle());
+    CHECK(m_sim.mem[0] == 0xff && m_sim.mem[0xffff] == 0xff);
+
+    // Read while programming: not possible
+    CHECK(externalFlash_startWrite(FLASH_PTR(0x30000), buffer, 2 * 256) ==
+          EXTFLASH_RES_OK);
+    CHECK(externalFlash_startRead(buffer, FLASH_PTR(0x20000), 16) ==
+          EXTFLASH_RES_BUSY);
+    CHECK(wait_idle());
+
+    // Flash without suspend: reads wait for the end of erase
+    sim_reset(true, false);
+    CHECK(externalFlash_init() == EXTFLASH_RES_OK);
+    base = 0;
+    number = 1;
+    CHECK(externalFlash_startErase(&base, &number) == EXTFLASH_RES_OK);
+    CHECK(externalFlash_startRead(buffer, FLASH_PTR(0x20000), 16) ==
+          EXTFLASH_RES_BUSY);
+    CHECK(m_sim.num_suspends == 0);
+    CHECK(wait_idle());
+    CHECK(externalFlash_startRead(buffer, FLASH_PTR(0x20000), 16) ==
+          EXTFLASH_RES_OK);
+
+    CHECK(m_sim.violations == 0);
+}
+
+int main(void)
+{
+    test_init();
+    test_write_page_crossing();
+    test_erase_block_choice();
+    test_read_during_erase();
+
+    if (m_failures != 0)
+    {
+        printf("spi_nor_test: %d failure(s)\n", m_failures);
+        return 1;
+    }
+    printf("spi_nor_test: all tests passed\n");
+    return 0;
+}
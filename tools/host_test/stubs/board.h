@@ -0,0 +1,20 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * @file
+ *
+ * Board definitions for host builds of drivers
+ */
+
+#ifndef _BOARD_HOST_TEST_BOARD_H_
+#define _BOARD_HOST_TEST_BOARD_H_
+
+/** Chip select of the simulated SPI NOR flash */
+#define BOARD_EXT_FLASH_CS_PIN          1
+#define BOARD_EXT_FLASH_SPI_CLOCK       8000000
+
+#endif /* _BOARD_HOST_TEST_BOARD_H_ */
@@ -0,0 +1,22 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * @file
+ *
+ * MCU functions used by drivers, implemented by host tests
+ */
+
+#ifndef _MCU_HOST_TEST_MCU_H_
+#define _MCU_HOST_TEST_MCU_H_
+
+#include <stdint.h>
+
+void nrf_gpio_pin_set(uint32_t pin);
+void nrf_gpio_pin_clear(uint32_t pin);
+void nrf_gpio_cfg_output(uint32_t pin);
+
+#endif /* _MCU_HOST_TEST_MCU_H_ */
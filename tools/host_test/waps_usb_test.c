@@ -0,0 +1,335 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * \file waps_usb_test.c
+ *
+ * Host loopback test of the WAPS USB framing (waps_usb.c, built with
+ * waps_usb_framing=yes). The USB stack is replaced by a pseudo terminal:
+ * the test writes frames as a host would to the master side, and the
+ * receiver is fed with what is read from the slave side in random sized
+ * chunks, as USB transfers. Frames sent by the node are written to the slave
+ * side and decoded from the master side.
+ *
+ * Streams include garbage and invalid headers between frames, and a host
+ * disconnection in the middle of a frame, to check resynchronization.
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "waps/comm/usb/waps_usb.h"
+#include "waps/waps_frames.h"
+#include "usart.h"
+#include "io.h"
+#include "usb_wrapper.h"
+
+/** Number of frames in each direction */
+#define NUM_FRAMES      2000
+
+/** Maximum size of a USB full speed bulk transfer */
+#define MAX_TRANSFER    64
+
+static int m_failures;
+
+#define CHECK(cond)                                                         \
+    do                                                                      \
+    {                                                                       \
+        if (!(cond))                                                        \
+        {                                                                   \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            m_failures++;                                                   \
+        }                                                                   \
+    } while (0)
+
+/** Pseudo terminal: master is the host, slave is the node */
+static int m_master;
+static int m_slave;
+
+static serial_rx_callback_f m_rx_cb;
+static Usb_wrapper_connection_callback_f m_connection_cb;
+
+static uint8_t m_rx_buffer[WAPS_MAX_FRAME_LENGTH];
+
+/** Next frame expected by the node */
+static uint32_t m_expected_frame;
+
+/* Stubs of the HAL used by waps_usb.c */
+
+bool Usart_init(uint32_t baudrate, uart_flow_control_e flow_control)
+{
+    return true;
+}
+
+void Usart_setEnabled(bool enabled)
+{
+}
+
+void Usart_receiverOn(void)
+{
+}
+
+void Usart_enableReceiver(serial_rx_callback_f callback)
+{
+    m_rx_cb = callback;
+}
+
+void Usart_flush(void)
+{
+}
+
+void Io_enableUartIrq(void)
+{
+}
+
+void Io_setUartIrq(void)
+{
+}
+
+void Io_clearUartIrq(void)
+{
+}
+
+bool Usb_wrapper_sendFrame(const void * header,
+                           uint32_t header_length,
+                           const void * buffer,
+                           uint32_t length)
+{
+    uint8_t frame[WAPS_USB_HEADER_SIZE + WAPS_MAX_FRAME_LENGTH];
+
+    // Single write, all or nothing like the tinyusb FIFO
+    memcpy(frame, header, header_length);
+    memcpy(&frame[header_length], buffer, length);
+    return write(m_slave, frame, header_length + length) ==
+           (ssize_t) (header_length + length);
+}
+
+void Usb_wrapper_setConnectionCallback(Usb_wrapper_connection_callback_f cb)
+{
+    m_connection_cb = cb;
+}
+
+/* Test helpers */
+
+static uint32_t frame_length(uint32_t index)
+{
+    return WAPS_MIN_FRAME_LENGTH +
+           (index * 37) % (WAPS_MAX_FRAME_LENGTH - WAPS_MIN_FRAME_LENGTH + 1);
+}
+
+static void fill_frame(uint8_t * frame, uint32_t index)
+{
+    for (uint32_t i = 0; i < frame_length(index); i++)
+    {
+        frame[i] = (uint8_t) (index * 13 + i);
+    }
+}
+
+static bool check_frame(const uint8_t * frame, uint32_t length, uint32_t index)
+{
+    uint8_t expected[WAPS_MAX_FRAME_LENGTH];
+
+    fill_frame(expected, index);
+    return length == frame_length(index) &&
+           memcmp(frame, expected, length) == 0;
+}
+
+static bool frame_received(void * frame, uint32_t length)
+{
+    CHECK(check_frame(frame, length, m_expected_frame));
+    m_expected_frame++;
+    return true;
+}
+
+static uint32_t encode(uint8_t * out, uint32_t index)
+{
+    uint32_t length = frame_length(index);
+
+    out[0] = WAPS_USB_SYNC;
+    out[1] = (uint8_t) length;
+    out[2] = (uint8_t) (length >> 8);
+    fill_frame(&out[WAPS_USB_HEADER_SIZE], index);
+    return WAPS_USB_HEADER_SIZE + length;
+}
+
+/** Invalid bytes a host could leave between frames */
+static uint32_t garbage(uint8_t * out)
+{
+    static const uint8_t patterns[][4] =
+    {
+        // Length too large
+        {WAPS_USB_SYNC, 0xff, 0xff},
+        // Length too small
+        {WAPS_USB_SYNC, 0x01, 0x00},
+        // Sync byte repeated: length read as 0x00a5, too large
+        {WAPS_USB_SYNC, WAPS_USB_SYNC, 0x00},
+        // No sync byte
+        {0x00, 0x11, 0x7e, 0xc0},
+        // Truncated header, completed by the next frame header
+        {WAPS_USB_SYNC, 0xff},
+    };
+    static const uint8_t pattern_lengths[] = {3, 3, 3, 4, 2};
+    uint32_t p = (uint32_t) rand() % (sizeof(patterns) / sizeof(patterns[0]));
+
+    memcpy(out, patterns[p], pattern_lengths[p]);
+    return pattern_lengths[p];
+}
+
+/** Read what is available on one side of the pty, waiting up to 1s */
+static ssize_t pty_read(int fd, uint8_t * buffer, size_t length)
+{
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+    if (poll(&pfd, 1, 1000) <= 0)
+    {
+        return 0;
+    }
+    return read(fd, buffer, length);
+}
+
+/** Give written bytes to the receiver in random sized USB transfers */
+static void node_receive(uint32_t length)
+{
+    uint8_t transfer[MAX_TRANSFER];
+
+    while (length > 0)
+    {
+        size_t size = 1 + (size_t) rand() % MAX_TRANSFER;
+        ssize_t n;
+
+        n = pty_read(m_slave, transfer, size < length ? size : length);
+        if (n <= 0)
+        {
+            CHECK(false);
+            return;
+        }
+        m_rx_cb(transfer, (size_t) n);
+        length -= (uint32_t) n;
+    }
+}
+
+static void test_host_to_node(void)
+{
+    uint8_t stream[64 + WAPS_USB_HEADER_SIZE + WAPS_MAX_FRAME_LENGTH];
+    uint32_t index = 0;
+
+    m_expected_frame = 0;
+    while (index < NUM_FRAMES)
+    {
+        uint32_t length = 0;
+
+        if (rand() % 4 == 0)
+        {
+            length += garbage(&stream[length]);
+        }
+        if (rand() % 50 == 0)
+        {
+            // Host stops in the middle of a frame and reopens the port
+            length += encode(&stream[length], 0) / 2;
+            CHECK(write(m_master, stream, length) == (ssize_t) length);
+            node_receive(length);
+            m_connection_cb(false);
+            m_connection_cb(true);
+            continue;
+        }
+        length += encode(&stream[length], index++);
+
+        CHECK(write(m_master, stream, length) == (ssize_t) length);
+        node_receive(length);
+        CHECK(m_expected_frame == index);
+    }
+    CHECK(m_expected_frame == NUM_FRAMES);
+}
+
+static void test_node_to_host(void)
+{
+    uint8_t frame[WAPS_MAX_FRAME_LENGTH + 1];
+    uint8_t header[WAPS_USB_HEADER_SIZE];
+
+    memset(frame, 0, sizeof(frame));
+    CHECK(!Waps_usb_send(frame, WAPS_MAX_FRAME_LENGTH + 1));
+
+    for (uint32_t index = 0; index < NUM_FRAMES; index++)
+    {
+        uint32_t length = frame_length(index);
+        uint32_t received = 0;
+
+        fill_frame(frame, index);
+        CHECK(Waps_usb_send(frame, length));
+
+        // Host reads header then frame, possibly in several reads
+        while (received < sizeof(header))
+        {
+            ssize_t n = pty_read(m_master, &header[received],
+                                 sizeof(header) - received);
+            if (n <= 0)
+            {
+                CHECK(false);
+                return;
+            }
+            received += (uint32_t) n;
+        }
+        CHECK(header[0] == WAPS_USB_SYNC);
+        CHECK((uint32_t) (header[1] | (header[2] << 8)) == length);
+
+        memset(frame, 0, sizeof(frame));
+        received = 0;
+        while (received < length)
+        {
+            ssize_t n = pty_read(m_master, &frame[received], length - received);
+            if (n <= 0)
+            {
+                CHECK(false);
+                return;
+            }
+            received += (uint32_t) n;
+        }
+        CHECK(check_frame(frame, length, index));
+    }
+}
+
+int main(void)
+{
+    struct termios tio;
+
+    if (openpty(&m_master, &m_slave, NULL, NULL, NULL) != 0)
+    {
+        perror("openpty");
+        return 1;
+    }
+    // Binary data: no line discipline processing on either side
+    tcgetattr(m_slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(m_slave, TCSANOW, &tio);
+    tcgetattr(m_master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(m_master, TCSANOW, &tio);
+
+    srand(1);
+    CHECK(Waps_usb_init(frame_received, m_rx_buffer));
+    CHECK(m_rx_cb != NULL);
+    CHECK(m_connection_cb != NULL);
+
+    test_host_to_node();
+    test_node_to_host();
+
+    close(m_slave);
+    close(m_master);
+
+    if (m_failures != 0)
+    {
+        printf("waps_usb_test: %d failure(s)\n", m_failures);
+        return 1;
+    }
+    printf("waps_usb_test: all tests passed\n");
+    return 0;
+}
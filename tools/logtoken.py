@@ -0,0 +1,414 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# logtoken.py - A tool to decode tokenized debug logs
+#
+# With APP_PRINTING_TOKENIZED=yes, applications send binary log records
+# instead of formatted text (see util/log_token.h). Format strings are kept
+# in the .log_strings section of the application ELF file and identified
+# by their address in that section.
+#
+# Commands:
+#   dict    Build a log dictionary from the application ELF file. This is
+#           done at build time, as <app_name>.logdict
+#   decode  Decode binary records, from a file, a serial port device or
+#           standard input, to text
+#
+# Requires:
+#   - Python 3 v3.4 or newer
+
+import sys
+import os
+import struct
+import bisect
+import json
+import re
+import argparse
+import textwrap
+
+
+# Constants
+
+# Dictionary file format
+DICT_FORMAT = "wirepas-logdict"
+DICT_VERSION = 1
+
+# Section holding log format strings, see linker scripts
+LOG_STRINGS_SECTION = ".log_strings"
+
+# Separator of fields in format strings, see LOG_TOKEN_SEPARATOR
+FIELD_SEPARATOR = "\x1f"
+
+# Info byte flag: a dropped record count follows
+INFO_DROPPED_FLAG = 0x80
+INFO_NUM_ARGS_MASK = 0x7f
+
+# ELF constants
+ELF_MAGIC = b"\x7fELF"
+ELF_CLASS_32 = 1
+ELF_DATA_LSB = 1
+ELF_HEADER_FORMAT = "<HHIIIIIHHHHHH"
+ELF_SECTION_FORMAT = "<IIIIIIIIII"
+SHT_PROGBITS = 1
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+
+# Shortest string kept from flash sections, for %s arguments
+MIN_FLASH_STRING_LENGTH = 2
+
+# printf() conversion specification
+FORMAT_SPEC_RE = re.compile(
+    r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|z|j|t)?([diouxXcspn%])")
+
+
+# Classes
+
+class ElfFile(object):
+    '''A minimal 32-bit little endian ELF file section reader'''
+
+    def __init__(self, data):
+        if (data[:4] != ELF_MAGIC or data[4] != ELF_CLASS_32 or
+                data[5] != ELF_DATA_LSB):
+            raise ValueError("not a 32-bit little endian ELF file")
+
+        fields = struct.unpack_from(ELF_HEADER_FORMAT, data, 16)
+        shoff, shentsize, shnum, shstrndx = (fields[5], fields[10],
+                                             fields[11], fields[12])
+
+        headers = []
+        for n in range(shnum):
+            headers.append(struct.unpack_from(ELF_SECTION_FORMAT, data,
+                                              shoff + n * shentsize))
+
+        # Section names are in the section name string table.
+        names = headers[shstrndx]
+        names = data[names[4]:(names[4] + names[5])]
+
+        self.sections = []
+        for (name, sh_type, flags, addr, offset, size,
+             _link, _info, _align, _entsize) in headers:
+            name = names[name:names.index(b"\0", name)].decode("ascii")
+            contents = data[offset:(offset + size)]
+            self.sections.append((name, sh_type, flags, addr, contents))
+
+    def get_section(self, name):
+        '''Get address and contents of a section, or None'''
+        for section in self.sections:
+            if section[0] == name:
+                return section[3], section[4]
+        return None
+
+    def get_flash_sections(self):
+        '''Get address and contents of read-only sections loaded to
+        target'''
+        return [(addr, contents) for
+                (_name, sh_type, flags, addr, contents) in self.sections
+                if sh_type == SHT_PROGBITS and (flags & SHF_ALLOC) and
+                not (flags & SHF_WRITE)]
+
+
+class LogDict(object):
+    '''Log format strings by id, and strings in flash by address'''
+
+    def __init__(self, strings = None, flash = None):
+        self.strings = strings or {}
+        self.flash = sorted(flash or [])
+        self.flash_addresses = [addr for addr, _ in self.flash]
+
+    @classmethod
+    def from_elf(cls, data):
+        '''Build dictionary from an ELF file'''
+        elf = ElfFile(data)
+
+        section = elf.get_section(LOG_STRINGS_SECTION)
+        if section is None:
+            raise ValueError("no %s section, is APP_PRINTING_TOKENIZED=yes?"
+                             % LOG_STRINGS_SECTION)
+
+        strings = {}
+        for addr, string in cls.split_strings(*section):
+            strings[addr] = string
+
+        flash = []
+        for start, contents in elf.get_flash_sections():
+            for addr, string in cls.split_strings(start, contents):
+                if (len(string) >= MIN_FLASH_STRING_LENGTH and
+                        string.isprintable()):
+                    flash.append((addr, string))
+
+        return cls(strings, flash)
+
+    @classmethod
+    def from_json(cls, text):
+        '''Load dictionary from a .logdict file'''
+        obj = json.loads(text)
+        if obj.get("format") != DICT_FORMAT:
+            raise ValueError("not a log dictionary")
+        if obj.get("version") != DICT_VERSION:
+            raise ValueError("unsupported log dictionary version %s" %
+                             obj.get("version"))
+
+        strings = dict((int(addr), string) for addr, string in
+                       obj["strings"].items())
+        flash = [(addr, string) for addr, string in obj["flash"]]
+        return cls(strings, flash)
+
+    def to_json(self):
+        '''Save dictionary to .logdict file format'''
+        obj = {
+            "format": DICT_FORMAT,
+            "version": DICT_VERSION,
+            "strings": dict((str(addr), string) for addr, string in
+                            sorted(self.strings.items())),
+            "flash": [[addr, string] for addr, string in self.flash]
+        }
+        return json.dumps(obj, indent = 1, sort_keys = True)
+
+    @staticmethod
+    def split_strings(addr, contents):
+        '''Split section contents to NUL-terminated strings. Strings may be
+        separated by alignment padding'''
+        start = 0
+        while start < len(contents):
+            if contents[start] == 0:
+                start += 1
+                continue
+            end = contents.find(b"\0", start)
+            if end < 0:
+                end = len(contents)
+            yield addr + start, contents[start:end].decode("utf-8",
+                                                           "replace")
+            start = end + 1
+
+    def get_flash_string(self, addr):
+        '''Get string located at an address in flash, or None'''
+        n = bisect.bisect_right(self.flash_addresses, addr) - 1
+        if n < 0:
+            return None
+        start, string = self.flash[n]
+        if addr - start >= len(string):
+            return None
+        return string[(addr - start):]
+
+
+class Decoder(object):
+    '''Decode COBS-framed tokenized log records to text'''
+
+    def __init__(self, log_dict):
+        self.log_dict = log_dict
+        self.time_us = 0
+        self.pending = b""
+
+    def feed(self, data):
+        '''Decode received bytes, return decoded text'''
+        frames = (self.pending + data).split(b"\0")
+        self.pending = frames.pop()
+        return "".join(self.decode_frame(frame) for frame in frames if frame)
+
+    def decode_frame(self, frame):
+        '''Decode one frame, without its 0x00 delimiter'''
+        try:
+            return self.decode_record(cobs_decode(frame))
+        except (ValueError, IndexError) as exc:
+            return "<corrupted record: %s>\n" % exc
+
+    def decode_record(self, record):
+        '''Decode one record'''
+        token, pos = decode_varint(record, 0)
+        elapsed_us, pos = decode_varint(record, pos)
+        info = record[pos]
+        pos += 1
+
+        text = ""
+        if info & INFO_DROPPED_FLAG:
+            dropped, pos = decode_varint(record, pos)
+            text += "<%d records dropped>\n" % dropped
+
+        args = []
+        for _ in range(info & INFO_NUM_ARGS_MASK):
+            value, pos = decode_varint(record, pos)
+            args.append(value)
+        if pos != len(record):
+            raise ValueError("%d extra bytes" % (len(record) - pos))
+
+        self.time_us += elapsed_us
+
+        string = self.log_dict.strings.get(token)
+        if string is None:
+            return text + "<unknown log 0x%x: %s>\n" % (
+                token, ", ".join("0x%x" % arg for arg in args))
+
+        level, module, fmt = string.split(FIELD_SEPARATOR, 2)
+        if level:
+            # LOG(): same prefix as text logs, time in seconds
+            text += "[%s][%d.%06d] %s: " % (module,
+                                            self.time_us // 1000000,
+                                            self.time_us % 1000000,
+                                            level)
+        return text + self.format(fmt, args)
+
+    def format(self, fmt, args):
+        '''Format arguments like printf() on the device'''
+        args = list(args)
+
+        def next_arg():
+            if not args:
+                raise ValueError("not enough arguments")
+            return args.pop(0)
+
+        def convert(match):
+            flags, width, precision, _length, conv = match.groups()
+            if conv == "%":
+                return "%"
+            if width == "*":
+                width = str(to_signed(next_arg()))
+            if precision == "*":
+                precision = str(to_signed(next_arg()))
+            spec = "%" + flags + (width or "")
+            if precision is not None:
+                spec += "." + precision
+
+            value = next_arg()
+            if conv in "di":
+                return (spec + "d") % to_signed(value)
+            elif conv == "c":
+                return (spec + "c") % chr(value & 0xff)
+            elif conv == "s":
+                string = self.log_dict.get_flash_string(value)
+                if string is None:
+                    string = "<0x%08x>" % value
+                return (spec + "s") % string
+            elif conv == "p":
+                return (spec + "s") % ("0x%x" % value)
+            elif conv == "n":
+                return ""
+            return (spec + conv) % value
+
+        return FORMAT_SPEC_RE.sub(convert, fmt)
+
+
+# Functions
+
+def decode_varint(data, pos):
+    '''Decode an unsigned LEB128 integer, return value and next position'''
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, pos
+        if shift > 28:
+            raise ValueError("varint too long")
+
+def cobs_decode(frame):
+    '''Decode a COBS frame'''
+    data = bytearray()
+    pos = 0
+    while pos < len(frame):
+        code = frame[pos]
+        if pos + code > len(frame) + 1:
+            raise ValueError("truncated frame")
+        data += frame[(pos + 1):(pos + code)]
+        pos += code
+        if pos < len(frame):
+            data.append(0)
+    return bytes(data)
+
+def to_signed(value):
+    '''Convert a 32-bit argument to a signed integer'''
+    value &= 0xffffffff
+    return value - 0x100000000 if value & 0x80000000 else value
+
+def load_dict(filename):
+    '''Load dictionary from a .logdict or ELF file'''
+    with open(filename, "rb") as f:
+        data = f.read()
+    if data[:4] == ELF_MAGIC:
+        return LogDict.from_elf(data)
+    return LogDict.from_json(data.decode("utf-8"))
+
+def create_argument_parser(pgmname):
+    '''Create a parser for parsing the command line.'''
+
+    # Determine help text width.
+    try:
+        help_width = int(os.environ['COLUMNS'])
+    except (KeyError, ValueError):
+        help_width = 80
+    help_width -= 2
+
+    parser = argparse.ArgumentParser(
+        prog = pgmname,
+        formatter_class = argparse.RawDescriptionHelpFormatter,
+        description = textwrap.fill(
+            "A tool to decode tokenized debug logs of applications built "
+            "with APP_PRINTING_TOKENIZED=yes", help_width))
+    subparsers = parser.add_subparsers(dest = "command")
+
+    dict_parser = subparsers.add_parser("dict",
+        help = "build a log dictionary from an application ELF file")
+    dict_parser.add_argument("elf", metavar = "ELF",
+        help = "application ELF file")
+    dict_parser.add_argument("output", metavar = "OUTPUT",
+        help = "log dictionary file to write")
+
+    decode_parser = subparsers.add_parser("decode",
+        help = "decode binary log records to text")
+    decode_parser.add_argument("dict", metavar = "DICT",
+        help = "log dictionary, or application ELF file")
+    decode_parser.add_argument("input", nargs = "?", metavar = "INPUT",
+        help = "binary log records, file or serial port device "
+               "(default: standard input)")
+
+    return parser
+
+def main():
+    '''Main program'''
+
+    # Determine program name, for error messages.
+    pgmname = os.path.split(sys.argv[0])[-1]
+
+    # Create a parser for parsing the command line and printing error messages.
+    parser = create_argument_parser(pgmname)
+    args = parser.parse_args()
+
+    if args.command is None:
+        parser.print_usage()
+        return 1
+
+    try:
+        if args.command == "dict":
+            with open(args.elf, "rb") as f:
+                log_dict = LogDict.from_elf(f.read())
+            with open(args.output, "w") as f:
+                f.write(log_dict.to_json())
+            return 0
+
+        decoder = Decoder(load_dict(args.dict))
+        if args.input:
+            input_file = open(args.input, "rb", buffering = 0)
+        else:
+            input_file = sys.stdin.buffer
+        read = getattr(input_file, "read1", input_file.read)
+
+        with input_file:
+            while True:
+                data = read(4096)
+                if not data:
+                    break
+                sys.stdout.write(decoder.feed(data))
+                sys.stdout.flush()
+    except (ValueError, KeyError, IOError, OSError) as exc:
+        sys.stdout.write("%s: %s\n" % (pgmname, exc))
+        return 1
+    except KeyboardInterrupt:
+        pass
+
+    return 0
+
+# Run main.
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,424 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# poslib_adaptive_sim.py - Simulate PosLib adaptive update on a tag
+#
+# Moves a tag on a site of anchors, alternating static periods and walks,
+# and runs PosLib periodic updates on it, with and without motion support
+# and adaptive update (POSLIB_ADAPTIVE_UPDATE, see
+# libraries/positioning/poslib/poslib_adaptive.h). For each variant, reports:
+#   - scans and position fixes (measurement messages sent) per hour
+#   - energy per hour and per position fix, from the energy of a scan, of
+#     sending a message and of sleeping
+#   - tracking error: distance between the tag and its position when the
+#     last fix was measured, sampled every second
+#
+# Adaptive class does what poslib_adaptive.c does, with the same defaults.
+# The energy model is rough: give measured values of the target board with
+# the command line options.
+#
+# Requires:
+#   - Python 3 v3.4 or newer
+
+import sys
+import os
+import math
+import random
+import argparse
+import textwrap
+import collections
+
+
+# Constants
+
+# Adaptive update defaults, from poslib_adaptive.h
+ADAPT_MAX_SHIFT = 2
+ADAPT_MAX_SHIFT_STATIC = 3
+ADAPT_MAX_PERIOD_S = 600
+ADAPT_MAX_SILENCE_S = 900
+ADAPT_NUM_ANCHORS = 6
+ADAPT_MAX_SET_CHANGES = 1
+ADAPT_RSS_THRESHOLD_DB = 4
+
+# Measurement table size, MAX_BEACONS of poslib_measurement.h
+MAX_BEACONS = 14
+
+# Update periods, from positioning app config.mk
+DEFAULT_PERIOD_STATIC_S = 60
+DEFAULT_PERIOD_DYNAMIC_S = 30
+
+# Motion is reported static after this long without motion
+MOTION_HOLD_S = 30
+
+# Site: anchor grid spacing and size, in meters
+ANCHOR_SPACING_M = 10
+SITE_SIZE_M = (60, 40)
+
+# Radio: path loss at 1 m, exponent, shadowing and sensitivity of
+# normalized RSS (0 dBm TX power)
+PATH_LOSS_1M_DB = 40
+PATH_LOSS_EXPONENT = 2.5
+SHADOWING_DB = 3
+SENSITIVITY_DBM = -95
+
+# Tag movements: average static time, walk speed and walk time range
+DEFAULT_STATIC_S = 1800
+WALK_SPEED_MPS = 1.0
+WALK_S = (30, 300)
+
+# Default energy model
+DEFAULT_SCAN_MJ = 1.5
+DEFAULT_SEND_MJ = 2.0
+DEFAULT_SLEEP_UW = 10.0
+
+# Default simulated time
+DEFAULT_HOURS = 24
+
+# Variants: name, motion enabled, adaptive update
+VARIANTS = [("fixed", False, False),
+            ("motion", True, False),
+            ("adaptive", False, True),
+            ("adapt+motion", True, True)]
+
+
+# Classes
+
+# Measurement, RSS in RSS record unit (-0.5 dBm)
+Measurement = collections.namedtuple("Measurement", ["address", "rss"])
+
+# Result of a variant
+Result = collections.namedtuple("Result", ["scans", "fixes", "energy_mj",
+                                           "errors"])
+
+
+class Adaptive(object):
+    '''Adaptive update, as in poslib_adaptive.c'''
+
+    snapshot_size = 2 * ADAPT_NUM_ANCHORS
+    max_shift = max(ADAPT_MAX_SHIFT, ADAPT_MAX_SHIFT_STATIC)
+
+    def __init__(self):
+        self.sent_s = 0
+        self.reset()
+
+    def reset(self):
+        '''Forget measurements of previous scans'''
+
+        self.last = []
+        self.prev = []
+        self.sent = []
+        self.shift = 0
+
+    @staticmethod
+    def is_similar(ref, snap):
+        '''Compare strongest anchors of two scans'''
+
+        if not ref or not snap:
+            return False
+
+        ref_rss = dict(ref)
+        snap_rss = dict(snap)
+        changes = 0
+        common = 0
+        rss_diff = 0
+
+        for m in snap[:ADAPT_NUM_ANCHORS]:
+            if m.address in ref_rss:
+                rss_diff += abs(m.rss - ref_rss[m.address])
+                common += 1
+            else:
+                changes += 1
+        changes += sum(1 for m in ref[:ADAPT_NUM_ANCHORS]
+                       if m.address not in snap_rss)
+
+        return (changes <= ADAPT_MAX_SET_CHANGES and common > 0 and
+                rss_diff <= common * ADAPT_RSS_THRESHOLD_DB * 2)
+
+    def scan_end(self, meas, now_s, force):
+        '''Process measurements of a scan, return True if to be sent'''
+
+        self.prev = self.last
+        # Stable sort: equal RSS keep table order, like the node
+        self.last = sorted(meas, key = lambda m: m.rss)[:self.snapshot_size]
+
+        if self.is_similar(self.prev, self.last):
+            self.shift = min(self.shift + 1, self.max_shift)
+        else:
+            self.shift = 0
+
+        return (force or not self.is_similar(self.sent, self.last) or
+                now_s - self.sent_s >= ADAPT_MAX_SILENCE_S)
+
+    def set_sent(self, now_s):
+        '''Measurements of last scan were sent'''
+
+        self.sent = self.last
+        self.sent_s = now_s
+
+    def get_period(self, period_s, is_static):
+        '''Adapted update period'''
+
+        max_shift = ADAPT_MAX_SHIFT_STATIC if is_static else ADAPT_MAX_SHIFT
+        shift = min(self.shift, max_shift)
+        if period_s >= ADAPT_MAX_PERIOD_S:
+            return period_s
+        if period_s > (ADAPT_MAX_PERIOD_S >> shift):
+            return ADAPT_MAX_PERIOD_S
+        return period_s << shift
+
+
+class Tag(object):
+    '''Tag position and motion state over time'''
+
+    def __init__(self, rnd, duration_s, static_s):
+        # Segments of (start time, start position, end position, duration)
+        self.segments = []
+        pos = self.random_position(rnd)
+        now = 0.0
+        while now < duration_s:
+            dwell = rnd.expovariate(1.0 / static_s)
+            self.segments.append((now, pos, pos, dwell))
+            now += dwell
+            walk = rnd.uniform(*WALK_S)
+            end = self.random_position(rnd)
+            # Walk around until time is up, ending on a random point
+            walk = max(walk, math.hypot(end[0] - pos[0], end[1] - pos[1]) /
+                       WALK_SPEED_MPS)
+            self.segments.append((now, pos, end, walk))
+            now += walk
+            pos = end
+
+    @staticmethod
+    def random_position(rnd):
+        return (rnd.uniform(0, SITE_SIZE_M[0]), rnd.uniform(0, SITE_SIZE_M[1]))
+
+    def segment(self, t):
+        '''Segment at time t'''
+
+        low, high = 0, len(self.segments) - 1
+        while low < high:
+            mid = (low + high + 1) // 2
+            if self.segments[mid][0] <= t:
+                low = mid
+            else:
+                high = mid - 1
+        return self.segments[low]
+
+    def position(self, t):
+        start, pos, end, duration = self.segment(t)
+        ratio = min((t - start) / duration, 1.0) if duration > 0 else 1.0
+        return (pos[0] + (end[0] - pos[0]) * ratio,
+                pos[1] + (end[1] - pos[1]) * ratio)
+
+    def is_moving(self, t):
+        '''Motion sensor state: moving, or moved less than MOTION_HOLD_S
+        ago'''
+
+        start, pos, end, duration = self.segment(t)
+        if pos != end:
+            return True
+        return t - start < MOTION_HOLD_S and start > 0
+
+    def motion_changes(self):
+        '''Times motion sensor state changes'''
+
+        times = []
+        for start, pos, end, duration in self.segments:
+            if pos != end:
+                times.append(start)
+                times.append(start + duration + MOTION_HOLD_S)
+        return times
+
+
+# Functions
+
+def make_anchors():
+    '''Anchor addresses and positions, on a grid'''
+
+    anchors = []
+    address = 0x10000
+    for x in range(0, SITE_SIZE_M[0] + 1, ANCHOR_SPACING_M):
+        for y in range(0, SITE_SIZE_M[1] + 1, ANCHOR_SPACING_M):
+            anchors.append((address, (x, y)))
+            address += 1
+    return anchors
+
+def scan(rnd, anchors, position):
+    '''Measurement table after a scan: strongest MAX_BEACONS anchors, in
+    hearing order'''
+
+    heard = []
+    for address, (x, y) in anchors:
+        distance = max(math.hypot(x - position[0], y - position[1]), 1.0)
+        rss = (-PATH_LOSS_1M_DB -
+               10 * PATH_LOSS_EXPONENT * math.log10(distance) +
+               rnd.gauss(0, SHADOWING_DB))
+        if rss >= SENSITIVITY_DBM:
+            heard.append((int(round(rss)), address))
+    rnd.shuffle(heard)
+    if len(heard) > MAX_BEACONS:
+        weakest = sorted(rss for rss, _ in heard)[len(heard) - MAX_BEACONS]
+        heard = [h for h in heard if h[0] >= weakest][:MAX_BEACONS]
+    return [Measurement(address, min(max(-2 * rss, 0), 0xff))
+            for rss, address in heard]
+
+def run_variant(seed, tag, anchors, duration_s, motion, adaptive, args):
+    '''Run periodic updates of a tag, return a Result'''
+
+    rnd = random.Random(seed)
+    adapt = Adaptive() if adaptive else None
+    changes = tag.motion_changes()
+    change_idx = 0
+    dynamic = False
+
+    now = 0
+    next_update = 0
+    scans = 0
+    fixes = 0
+    fix_position = None
+    errors = []
+    energy = args.sleep_uw * duration_s / 1000.0
+
+    def update_period():
+        if motion and dynamic:
+            return args.period_dynamic
+        if adapt is not None:
+            return adapt.get_period(args.period_static, motion)
+        return args.period_static
+
+    for t in range(duration_s):
+        # Motion events
+        while change_idx < len(changes) and changes[change_idx] <= t:
+            change_idx += 1
+            if not motion:
+                continue
+            moving = tag.is_moving(t)
+            if moving != dynamic:
+                dynamic = moving
+                if dynamic and adapt is not None:
+                    adapt.reset()
+                # Keep the previous update time if earlier
+                next_update = min(next_update, t + update_period())
+
+        if t >= next_update:
+            scans += 1
+            energy += args.scan_mj
+            meas = scan(rnd, anchors, tag.position(t))
+            send = bool(meas)
+            if adapt is not None:
+                if meas:
+                    send = adapt.scan_end(meas, t, motion and dynamic)
+                else:
+                    adapt.reset()
+            if send:
+                fixes += 1
+                energy += args.send_mj
+                fix_position = tag.position(t)
+                if adapt is not None:
+                    adapt.set_sent(t)
+            next_update = t + update_period()
+
+        if fix_position is not None:
+            pos = tag.position(t)
+            errors.append(math.hypot(pos[0] - fix_position[0],
+                                     pos[1] - fix_position[1]))
+
+    return Result(scans, fixes, energy, errors)
+
+def percentile(values, pct):
+    values = sorted(values)
+    return values[min(int(len(values) * pct / 100.0), len(values) - 1)]
+
+def create_argument_parser(pgmname):
+    '''Create a parser for parsing the command line.'''
+
+    # Determine help text width.
+    try:
+        help_width = int(os.environ['COLUMNS'])
+    except (KeyError, ValueError):
+        help_width = 80
+    help_width -= 2
+
+    parser = argparse.ArgumentParser(
+        prog = pgmname,
+        formatter_class = argparse.RawDescriptionHelpFormatter,
+        description = textwrap.fill(
+            "A tool to simulate PosLib adaptive update on a tag and report "
+            "energy per position fix", help_width))
+    parser.add_argument("--hours",
+        type = float, default = DEFAULT_HOURS,
+        help = "simulated time (default: %d)" % DEFAULT_HOURS)
+    parser.add_argument("--static-s",
+        type = float, default = DEFAULT_STATIC_S,
+        help = "average time tag stays static, in seconds "
+               "(default: %d)" % DEFAULT_STATIC_S)
+    parser.add_argument("--period-static",
+        type = int, default = DEFAULT_PERIOD_STATIC_S,
+        help = "static update period, in seconds "
+               "(default: %d)" % DEFAULT_PERIOD_STATIC_S)
+    parser.add_argument("--period-dynamic",
+        type = int, default = DEFAULT_PERIOD_DYNAMIC_S,
+        help = "dynamic update period, in seconds "
+               "(default: %d)" % DEFAULT_PERIOD_DYNAMIC_S)
+    parser.add_argument("--scan-mj",
+        type = float, default = DEFAULT_SCAN_MJ,
+        help = "energy of a scan, with stack wakeup, in mJ "
+               "(default: %.1f)" % DEFAULT_SCAN_MJ)
+    parser.add_argument("--send-mj",
+        type = float, default = DEFAULT_SEND_MJ,
+        help = "energy of sending a measurement message, in mJ "
+               "(default: %.1f)" % DEFAULT_SEND_MJ)
+    parser.add_argument("--sleep-uw",
+        type = float, default = DEFAULT_SLEEP_UW,
+        help = "sleep power, in uW (default: %.1f)" % DEFAULT_SLEEP_UW)
+    parser.add_argument("--seed", "-s",
+        type = int, default = 1,
+        help = "random seed (default: 1)")
+
+    return parser
+
+def main():
+    '''Main program'''
+
+    # Determine program name, for error messages.
+    pgmname = os.path.split(sys.argv[0])[-1]
+
+    # Create a parser for parsing the command line and printing error messages.
+    parser = create_argument_parser(pgmname)
+    args = parser.parse_args()
+
+    if (args.hours <= 0 or args.static_s <= 0 or args.period_static <= 0 or
+            args.period_dynamic <= 0):
+        parser.error("times and periods must be positive")
+
+    duration_s = int(args.hours * 3600)
+    rnd = random.Random(args.seed)
+    tag = Tag(rnd, duration_s, args.static_s)
+    anchors = make_anchors()
+    hours = duration_s / 3600.0
+    moving_s = sum(1 for t in range(0, duration_s, 10)
+                   if tag.is_moving(t)) * 10
+
+    sys.stdout.write("%d anchors, %.1f h, tag moving %.0f%% of time\n\n" %
+                     (len(anchors), hours, 100.0 * moving_s / duration_s))
+    sys.stdout.write("%-13s %8s %8s %10s %10s %11s %11s\n" %
+                     ("variant", "scans/h", "fixes/h", "mJ/h", "mJ/fix",
+                      "err_avg_m", "err_p95_m"))
+
+    for name, motion, adaptive in VARIANTS:
+        # Same radio conditions for all variants
+        result = run_variant(args.seed, tag, anchors, duration_s, motion,
+                             adaptive, args)
+        sys.stdout.write("%-13s %8.1f %8.1f %10.1f %10.2f %11.1f %11.1f\n" %
+                         (name, result.scans / hours, result.fixes / hours,
+                          result.energy_mj / hours,
+                          result.energy_mj / max(result.fixes, 1),
+                          sum(result.errors) / max(len(result.errors), 1),
+                          percentile(result.errors, 95)
+                          if result.errors else 0.0))
+
+    return 0
+
+# Run main.
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,318 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# poslib_compact.py - Host side codec for PosLib measurement messages
+#
+# Encodes and decodes PosLib measurement messages, sent on endpoints
+# 238/238, see libraries/positioning/poslib/poslib_measurement.h:
+#   - RSS records with 4-byte addresses (types 0x05 and 0xF5)
+#   - compact RSS records (type 0x08), sent when PosLib is built with
+#     POSLIB_COMPACT_MEAS
+#   - voltage and node info records
+#
+# encode_rss() does what the node does, see add_compact_rss_record() in
+# poslib_measurement.c. It is used by poslib_compact_bench.py and can be
+# used to simulate a node.
+#
+# RSS values are in RSS record unit: -0.5 dBm, 0 to 255.
+#
+# Requires:
+#   - Python 3 v3.4 or newer
+
+import struct
+import collections
+
+
+# Constants
+
+# Record types
+MEAS_RSS_SR_4BYTE_ADDR = 0x05
+MEAS_RSS_SR_ANCHOR_4BYTE_ADDR = 0xF5
+MEAS_VOLTAGE = 0x04
+MEAS_NODE_INFO = 0x06
+MEAS_RSS_COMPACT = 0x08
+
+# Compact record info byte
+COMPACT_VERSION = 1
+COMPACT_VERSION_MASK = 0x07
+COMPACT_ANCHOR = 0x08
+COMPACT_FIELDS_OFFSET = 4
+
+# Compact record optional fields, in encoding order
+FIELD_TYPE = 0x01
+FIELD_SAMPLES = 0x02
+FIELD_TXPOWER = 0x04
+
+# Compact RSS quantization
+COMPACT_MIN_STEP = 2
+COMPACT_MAX_STEP = 8
+COMPACT_MAX_VALUE = 15
+
+# Beacon types
+BEACON_TYPE_CB = 0
+BEACON_TYPE_NB = 1
+BEACON_TYPE_MBCN = 2
+BEACON_TYPE_FLT = 3
+
+# Maximum payload of a measurement message
+MAX_PAYLOAD = 102
+
+# Record header: type and length
+RECORD_HEADER_FORMAT = "<BB"
+
+# Message header: sequence
+MESSAGE_HEADER_FORMAT = "<H"
+
+# Legacy RSS record entry: address and RSS
+RSS_ENTRY_FORMAT = "<IB"
+
+# Node info record: next update, features, mode and class
+NODE_INFO_FORMAT = "<IIBB"
+
+
+# Classes
+
+# A measurement, as stored in the node measurement table. Optional fields
+# are None when not known.
+Measurement = collections.namedtuple("Measurement",
+                                     ["address", "rss", "type", "samples",
+                                      "txpower"])
+Measurement.__new__.__defaults__ = (None, None, None)
+
+# Decoded compact record. Step is the quantization step: decoded RSS values
+# are within step / 2 of the measured ones, except for clamped values.
+CompactRecord = collections.namedtuple("CompactRecord",
+                                       ["anchor", "fields", "base", "step",
+                                        "measurements"])
+
+# Decoded measurement message. Records are (type, value) tuples, value is
+# decoded for known types and bytes for other ones.
+Message = collections.namedtuple("Message", ["sequence", "records"])
+
+
+# Functions
+
+def encode_varint(value):
+    '''Encode an unsigned value, 7 bits per byte, least significant
+    first'''
+
+    data = bytearray()
+    while value >= 0x80:
+        data.append((value & 0x7f) | 0x80)
+        value >>= 7
+    data.append(value)
+    return data
+
+def decode_varint(data, pos):
+    '''Decode a varint at pos, return value and position after it'''
+
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(data):
+            raise ValueError("truncated varint")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+def pack_bits(values, bits):
+    '''Pack small values, lowest bits first'''
+
+    per_byte = 8 // bits
+    data = bytearray((len(values) + per_byte - 1) // per_byte)
+    for n, value in enumerate(values):
+        data[n // per_byte] |= value << ((n % per_byte) * bits)
+    return data
+
+def unpack_bits(data, pos, count, bits):
+    '''Unpack count small values at pos, return values and position after
+    them'''
+
+    per_byte = 8 // bits
+    size = (count + per_byte - 1) // per_byte
+    if pos + size > len(data):
+        raise ValueError("truncated compact record")
+    mask = (1 << bits) - 1
+    values = [(data[pos + n // per_byte] >> ((n % per_byte) * bits)) & mask
+              for n in range(count)]
+    return values, pos + size
+
+def encode_compact_value(measurements, anchor = False, fields = 0):
+    '''Encode all measurements as compact record payload, without record
+    header'''
+
+    meas = sorted(measurements, key = lambda m: m.address)
+    base = min(m.rss for m in meas)
+    step = -(-(max(m.rss for m in meas) - base) // COMPACT_MAX_VALUE)
+    step = min(max(step, COMPACT_MIN_STEP), COMPACT_MAX_STEP)
+
+    data = bytearray([COMPACT_VERSION |
+                      (COMPACT_ANCHOR if anchor else 0) |
+                      ((fields & 0x0f) << COMPACT_FIELDS_OFFSET)])
+    data += encode_varint(len(meas))
+    data += bytes([base, step])
+
+    prev = 0
+    for m in meas:
+        data += encode_varint(m.address - prev)
+        prev = m.address
+
+    data += pack_bits([min((m.rss - base + step // 2) // step,
+                           COMPACT_MAX_VALUE) for m in meas], 4)
+    if fields & FIELD_TYPE:
+        data += pack_bits([min(m.type, BEACON_TYPE_FLT) for m in meas], 2)
+    if fields & FIELD_SAMPLES:
+        data += pack_bits([min(m.samples, 0x0f) for m in meas], 4)
+    if fields & FIELD_TXPOWER:
+        data += bytes(m.txpower & 0xff for m in meas)
+
+    return bytes(data)
+
+def encode_compact(measurements, anchor = False, fields = 0,
+                   max_len = MAX_PAYLOAD):
+    '''Encode a compact record, with record header, in at most max_len
+    bytes. Weakest measurements are left out if all do not fit. Return
+    record bytes and number of measurements encoded, or None and 0 if
+    nothing fits.'''
+
+    # Strongest first, in table order for equal RSS
+    by_rss = sorted(measurements, key = lambda m: m.rss)
+    header_size = struct.calcsize(RECORD_HEADER_FORMAT)
+
+    for count in range(len(by_rss), 0, -1):
+        value = encode_compact_value(by_rss[:count], anchor, fields)
+        if header_size + len(value) <= max_len:
+            return (struct.pack(RECORD_HEADER_FORMAT, MEAS_RSS_COMPACT,
+                                len(value)) + value, count)
+
+    return None, 0
+
+def encode_rss(measurements, anchor = False, fields = 0,
+               max_len = MAX_PAYLOAD):
+    '''Encode measurements like a node built with POSLIB_COMPACT_MEAS:
+    compact record, or RSS record with 4-byte addresses if it holds all
+    measurements and is not longer. Return record bytes and number of
+    measurements encoded, or None and 0 if nothing fits.'''
+
+    record, count = encode_compact(measurements, anchor, fields, max_len)
+    legacy = encode_rss_record(measurements, anchor)
+    if count == len(measurements) and len(legacy) <= len(record):
+        return legacy, count
+    return record, count
+
+def decode_compact(value):
+    '''Decode a compact record payload, return a CompactRecord'''
+
+    if len(value) < 4:
+        raise ValueError("compact record too short")
+
+    info = value[0]
+    if info & COMPACT_VERSION_MASK != COMPACT_VERSION:
+        raise ValueError("unsupported compact record version %d" %
+                         (info & COMPACT_VERSION_MASK))
+    fields = info >> COMPACT_FIELDS_OFFSET
+
+    count, pos = decode_varint(value, 1)
+    if pos + 2 > len(value):
+        raise ValueError("truncated compact record")
+    base, step = value[pos], value[pos + 1]
+    pos += 2
+
+    addresses = []
+    address = 0
+    for _ in range(count):
+        delta, pos = decode_varint(value, pos)
+        address += delta
+        addresses.append(address)
+
+    rss, pos = unpack_bits(value, pos, count, 4)
+    types = samples = txpowers = [None] * count
+    if fields & FIELD_TYPE:
+        types, pos = unpack_bits(value, pos, count, 2)
+    if fields & FIELD_SAMPLES:
+        samples, pos = unpack_bits(value, pos, count, 4)
+    if fields & FIELD_TXPOWER:
+        if pos + count > len(value):
+            raise ValueError("truncated compact record")
+        txpowers = list(struct.unpack_from("<%db" % count, value, pos))
+        pos += count
+    # Fields unknown to this decoder, if any, follow
+
+    meas = [Measurement(addresses[n], min(base + rss[n] * step, 0xff),
+                        types[n], samples[n], txpowers[n])
+            for n in range(count)]
+
+    return CompactRecord(bool(info & COMPACT_ANCHOR), fields, base, step,
+                         meas)
+
+def encode_rss_record(measurements, anchor = False):
+    '''Encode an RSS record with 4-byte addresses, with record header'''
+
+    data = b"".join(struct.pack(RSS_ENTRY_FORMAT, m.address, m.rss)
+                    for m in measurements)
+    rtype = MEAS_RSS_SR_ANCHOR_4BYTE_ADDR if anchor else MEAS_RSS_SR_4BYTE_ADDR
+    return struct.pack(RECORD_HEADER_FORMAT, rtype, len(data)) + data
+
+def decode_rss_record(value):
+    '''Decode an RSS record payload with 4-byte addresses, return a list of
+    Measurements'''
+
+    size = struct.calcsize(RSS_ENTRY_FORMAT)
+    if len(value) % size:
+        raise ValueError("invalid RSS record length %d" % len(value))
+    return [Measurement(*struct.unpack_from(RSS_ENTRY_FORMAT, value, pos))
+            for pos in range(0, len(value), size)]
+
+def encode_voltage_record(voltage):
+    '''Encode a voltage record, voltage in mV'''
+
+    return struct.pack(RECORD_HEADER_FORMAT + "H", MEAS_VOLTAGE, 2, voltage)
+
+def encode_node_info_record(update_s, features, mode, node_class):
+    '''Encode a node info record'''
+
+    return (struct.pack(RECORD_HEADER_FORMAT, MEAS_NODE_INFO,
+                        struct.calcsize(NODE_INFO_FORMAT)) +
+            struct.pack(NODE_INFO_FORMAT, update_s, features, mode,
+                        node_class))
+
+def encode_message(sequence, records):
+    '''Encode a measurement message from encoded records'''
+
+    return struct.pack(MESSAGE_HEADER_FORMAT, sequence) + b"".join(records)
+
+def decode_message(payload):
+    '''Decode a measurement message, return a Message'''
+
+    header_size = struct.calcsize(MESSAGE_HEADER_FORMAT)
+    if len(payload) < header_size:
+        raise ValueError("message too short")
+
+    sequence = struct.unpack_from(MESSAGE_HEADER_FORMAT, payload)[0]
+    pos = header_size
+    records = []
+    while pos < len(payload):
+        if pos + 2 > len(payload):
+            raise ValueError("truncated record header")
+        rtype, length = struct.unpack_from(RECORD_HEADER_FORMAT, payload, pos)
+        pos += 2
+        value = bytes(payload[pos:(pos + length)])
+        if len(value) != length:
+            raise ValueError("truncated record 0x%02x" % rtype)
+        pos += length
+
+        if rtype in (MEAS_RSS_SR_4BYTE_ADDR, MEAS_RSS_SR_ANCHOR_4BYTE_ADDR):
+            value = decode_rss_record(value)
+        elif rtype == MEAS_RSS_COMPACT:
+            value = decode_compact(value)
+        elif rtype == MEAS_VOLTAGE and length == 2:
+            value = struct.unpack("<H", value)[0]
+        elif (rtype == MEAS_NODE_INFO and
+              length == struct.calcsize(NODE_INFO_FORMAT)):
+            value = struct.unpack(NODE_INFO_FORMAT, value)
+        records.append((rtype, value))
+
+    return Message(sequence, records)
@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# poslib_compact_bench.py - Measure compact PosLib measurement records
+#
+# Generates anchor sets like a tag sees them, on sites of various address
+# layouts, and compares RSS records with 4-byte addresses and compact RSS
+# records:
+#   - bytes per measurement message, with voltage and node info records
+#   - maximum number of anchors fitting in one message
+#   - RSS quantization error of compact records
+#
+# Every decoded message is checked against the generated measurements.
+#
+# Requires:
+#   - Python 3 v3.4 or newer
+#   - poslib_compact.py in the same directory as this file
+
+import sys
+import os
+import random
+import argparse
+import textwrap
+import poslib_compact
+
+
+# Constants
+
+# Default numbers of anchors heard
+DEFAULT_ANCHORS = [4, 8, 14, 20, 32]
+
+# Default number of messages per test
+DEFAULT_COUNT = 2000
+
+# Site address layouts: name, number of anchors on site and address stride
+SITES = [("dense", 200, 1), ("sparse", 200, 37), ("random", 200, None)]
+
+# Range of normalized RSS, in dBm
+RSS_RANGE_DBM = (-95, -40)
+
+
+# Functions
+
+def make_site(rnd, num_anchors, stride):
+    '''Create addresses of anchors of a site. Stride None means random
+    32-bit addresses.'''
+
+    if stride is None:
+        return [rnd.getrandbits(32) for _ in range(num_anchors)]
+    first = rnd.randint(1, 0x00ffffff)
+    return [first + n * stride for n in range(num_anchors)]
+
+def make_measurements(rnd, site, num_anchors):
+    '''Create measurements of num_anchors anchors of a site'''
+
+    meas = []
+    for address in rnd.sample(site, num_anchors):
+        rss = min(-2 * rnd.randint(*RSS_RANGE_DBM), 0xff)
+        meas.append(poslib_compact.Measurement(
+            address, rss, rnd.choice([0, 1, 3]), rnd.randint(1, 8),
+            rnd.choice([0, 4, 8])))
+    return meas
+
+def other_records():
+    '''Voltage and node info records, as sent by the positioning app'''
+
+    return [poslib_compact.encode_voltage_record(3000),
+            poslib_compact.encode_node_info_record(60, 0x11, 2, 0xfa)]
+
+def check_compact(meas, count, message):
+    '''Check a decoded message of a node using compact records, return
+    list of RSS errors in dB'''
+
+    rtype, record = message.records[0]
+    if rtype == poslib_compact.MEAS_RSS_SR_4BYTE_ADDR:
+        # Sent when compact record is not shorter
+        if record != [poslib_compact.Measurement(m.address, m.rss)
+                      for m in meas]:
+            raise ValueError("RSS record round trip failed")
+        return [0.0] * len(meas)
+    if rtype != poslib_compact.MEAS_RSS_COMPACT:
+        raise ValueError("RSS record not found")
+
+    # Strongest measurements are kept when all do not fit
+    expected = sorted(sorted(meas, key = lambda m: m.rss)[:count],
+                      key = lambda m: m.address)
+    if [m.address for m in record.measurements] != \
+            [m.address for m in expected]:
+        raise ValueError("compact record addresses differ")
+
+    errors = []
+    for got, exp in zip(record.measurements, expected):
+        error = abs(got.rss - exp.rss)
+        clamped = got.rss == min(record.base +
+                                 poslib_compact.COMPACT_MAX_VALUE *
+                                 record.step, 0xff)
+        if error > record.step // 2 and not (clamped and exp.rss > got.rss):
+            raise ValueError("compact RSS error %d too large" % error)
+        errors.append(error / 2.0)
+    return errors
+
+def fit_count(rnd, site, max_payload, compact):
+    '''Largest number of anchors whose measurements all fit in a message'''
+
+    header = 2
+    others = sum(len(r) for r in other_records())
+    count = 0
+    for num_anchors in range(1, len(site) + 1):
+        meas = make_measurements(rnd, site, num_anchors)
+        available = max_payload - header - others
+        if compact:
+            _, encoded = poslib_compact.encode_rss(meas,
+                                                   max_len = available)
+        else:
+            encoded = num_anchors
+            if len(poslib_compact.encode_rss_record(meas)) > available:
+                encoded = 0
+        if encoded < num_anchors:
+            break
+        count = num_anchors
+    return count
+
+def run_benchmark(rnd, site, num_anchors, count, max_payload):
+    '''Compare formats for num_anchors anchors, return average legacy
+    bytes, average compact bytes, number of legacy messages that did not
+    fit and list of compact RSS errors in dB'''
+
+    legacy_bytes = 0
+    compact_bytes = 0
+    legacy_too_long = 0
+    errors = []
+
+    for sequence in range(count):
+        meas = make_measurements(rnd, site, num_anchors)
+        others = other_records()
+        available = max_payload - 2 - sum(len(r) for r in others)
+
+        payload = poslib_compact.encode_message(
+            sequence, [poslib_compact.encode_rss_record(meas)] + others)
+        legacy_bytes += len(payload)
+        if len(payload) > max_payload:
+            legacy_too_long += 1
+        message = poslib_compact.decode_message(payload)
+        if message.records[0][1] != [poslib_compact.Measurement(m.address,
+                                                                 m.rss)
+                                     for m in meas]:
+            raise ValueError("RSS record round trip failed")
+
+        record, encoded = poslib_compact.encode_rss(meas,
+                                                    max_len = available)
+        if record is None:
+            raise ValueError("compact record does not fit")
+        payload = poslib_compact.encode_message(sequence, [record] + others)
+        compact_bytes += len(payload)
+        errors.extend(check_compact(meas, encoded,
+                                    poslib_compact.decode_message(payload)))
+
+    return (legacy_bytes / count, compact_bytes / count, legacy_too_long,
+            errors)
+
+def create_argument_parser(pgmname):
+    '''Create a parser for parsing the command line.'''
+
+    # Determine help text width.
+    try:
+        help_width = int(os.environ['COLUMNS'])
+    except (KeyError, ValueError):
+        help_width = 80
+    help_width -= 2
+
+    parser = argparse.ArgumentParser(
+        prog = pgmname,
+        formatter_class = argparse.RawDescriptionHelpFormatter,
+        description = textwrap.fill(
+            "A tool to measure compact PosLib measurement records",
+            help_width))
+    parser.add_argument("--anchors", "-a",
+        type = int, action = "append",
+        help = "number of anchors heard, can be repeated "
+               "(default: %s)" % ", ".join(map(str, DEFAULT_ANCHORS)))
+    parser.add_argument("--count", "-c",
+        type = int, default = DEFAULT_COUNT,
+        help = "messages per test (default: %d)" % DEFAULT_COUNT)
+    parser.add_argument("--max-payload", "-m",
+        type = int, default = poslib_compact.MAX_PAYLOAD,
+        help = "maximum message size (default: %d)" %
+               poslib_compact.MAX_PAYLOAD)
+    parser.add_argument("--seed", "-s",
+        type = int, default = 1,
+        help = "random seed (default: 1)")
+
+    return parser
+
+def main():
+    '''Main program'''
+
+    # Determine program name, for error messages.
+    pgmname = os.path.split(sys.argv[0])[-1]
+
+    # Create a parser for parsing the command line and printing error messages.
+    parser = create_argument_parser(pgmname)
+    args = parser.parse_args()
+
+    if args.count <= 0 or args.max_payload <= 0:
+        parser.error("count and maximum payload must be positive")
+
+    rnd = random.Random(args.seed)
+
+    sys.stdout.write("%-7s %7s %10s %10s %7s %8s %10s %10s\n" %
+                     ("site", "anchors", "legacy_B", "compact_B", "ratio",
+                      "too_long", "err_avg_dB", "err_max_dB"))
+    try:
+        for name, size, stride in SITES:
+            site = make_site(rnd, size, stride)
+            for num_anchors in args.anchors or DEFAULT_ANCHORS:
+                if num_anchors <= 0 or num_anchors > size:
+                    parser.error("number of anchors must be 1 to %d" % size)
+                legacy, compact, too_long, errors = run_benchmark(
+                    rnd, site, num_anchors, args.count, args.max_payload)
+                sys.stdout.write("%-7s %7d %10.1f %10.1f %7.2f %8d "
+                                 "%10.2f %10.1f\n" %
+                                 (name, num_anchors, legacy, compact,
+                                  legacy / compact, too_long,
+                                  sum(errors) / len(errors), max(errors)))
+
+        sys.stdout.write("\nAnchors per %d-byte message:\n" %
+                         args.max_payload)
+        for name, size, stride in SITES:
+            site = make_site(rnd, size, stride)
+            legacy = fit_count(rnd, site, args.max_payload, False)
+            compact = fit_count(rnd, site, args.max_payload, True)
+            sys.stdout.write("  %-7s legacy %3d  compact %3d  (x%.1f)\n" %
+                             (name, legacy, compact, compact / legacy))
+    except ValueError as exc:
+        sys.stdout.write("%s: %s\n" % (pgmname, exc))
+        return 1
+
+    return 0
+
+# Run main.
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# waps_compact.py - Host side codec for WAPS data indications
+#
+# Encodes and decodes payloads of DSAP-DATA_RX.indication (0x03) and
+# DSAP-DATA_RX_COMPACT.indication (0x11), see DualMcuAPI.md. Compact
+# indications are sent by dual-MCU nodes after the host writes 1 to CSAP
+# attribute cCompactIndications (26). The host then keeps a CompactDecoder
+# for the session, and creates a new one each time it writes the attribute.
+#
+# CompactEncoder does what the node does, see
+# libraries/dualmcu/waps/sap/dsap_compact.c. It is used by
+# waps_compact_bench.py and can be used to simulate a node.
+#
+# Full WAPS frames, with frame header, CRC and SLIP encoding, can be built
+# with make_frame(), for measuring bytes on the serial link.
+#
+# Requires:
+#   - Python 3 v3.4 or newer
+
+import struct
+import collections
+
+
+# Constants
+
+# Primitive IDs
+DSAP_DATA_RX_IND = 0x03
+DSAP_DATA_RX_COMPACT_IND = 0x11
+
+# Broadcast address
+ADDR_BROADCAST = 0xffffffff
+
+# DSAP-DATA_RX.indication header, before APDU
+RX_IND_FORMAT = "<BIBIBBIB"
+
+# DSAP-DATA_RX_COMPACT.indication flags
+SLOT_MASK = 0x07
+NEW_ADDR_FLAG = 0x08
+DST_MASK = 0x30
+DST_OFFSET = 4
+ENDPOINTS_FLAG = 0x40
+INFO_FLAG = 0x80
+
+# Destination address modes
+DST_OWN = 0
+DST_BCAST = 1
+DST_EXPLICIT = 2
+
+# Number of slots in context table
+CONTEXT_SIZE = SLOT_MASK + 1
+
+# SLIP special characters
+SLIP_END = 0xc0
+SLIP_ESC = 0xdb
+SLIP_ESC_END = 0xdc
+SLIP_ESC_ESC = 0xdd
+
+
+# Classes
+
+# A received packet, as given by both indications. Info holds QoS and hop
+# count, delay is in 1/128 seconds.
+Indication = collections.namedtuple("Indication",
+                                    ["queued", "src_addr", "src_ep",
+                                     "dst_addr", "dst_ep", "info", "delay",
+                                     "apdu"])
+
+
+class Slot(object):
+    '''Context of a source address'''
+
+    __slots__ = ["addr", "src_ep", "dst_ep", "info"]
+
+    def __init__(self):
+        self.addr = None
+        self.src_ep = None
+        self.dst_ep = None
+        self.info = None
+
+
+class CompactEncoder(object):
+    '''Encoder of compact indications, like the node does'''
+
+    def __init__(self, node_addr):
+        self.node_addr = node_addr
+        self.slots = [Slot() for _ in range(CONTEXT_SIZE)]
+        self.next_slot = 0
+
+    def encode(self, ind):
+        '''Encode an Indication, return payload bytes'''
+
+        for index, slot in enumerate(self.slots):
+            if slot.addr == ind.src_addr:
+                new_addr = False
+                break
+        else:
+            index = self.next_slot
+            self.next_slot = (self.next_slot + 1) % CONTEXT_SIZE
+            slot = self.slots[index]
+            slot.addr = ind.src_addr
+            new_addr = True
+
+        flags = index
+        fields = bytearray()
+
+        if new_addr:
+            flags |= NEW_ADDR_FLAG
+            fields += struct.pack("<I", ind.src_addr)
+
+        if ind.dst_addr == self.node_addr:
+            flags |= DST_OWN << DST_OFFSET
+        elif ind.dst_addr == ADDR_BROADCAST:
+            flags |= DST_BCAST << DST_OFFSET
+        else:
+            flags |= DST_EXPLICIT << DST_OFFSET
+            fields += struct.pack("<I", ind.dst_addr)
+
+        if new_addr or (ind.src_ep, ind.dst_ep) != (slot.src_ep, slot.dst_ep):
+            flags |= ENDPOINTS_FLAG
+            fields.append(ind.src_ep)
+            fields.append(ind.dst_ep)
+            slot.src_ep, slot.dst_ep = ind.src_ep, ind.dst_ep
+
+        if new_addr or ind.info != slot.info:
+            flags |= INFO_FLAG
+            fields.append(ind.info)
+            slot.info = ind.info
+
+        fields += encode_varint(ind.delay)
+
+        return bytes([ind.queued, flags]) + bytes(fields) + ind.apdu
+
+
+class CompactDecoder(object):
+    '''Decoder of compact indications, one per session'''
+
+    def __init__(self, node_addr):
+        self.node_addr = node_addr
+        self.slots = [Slot() for _ in range(CONTEXT_SIZE)]
+
+    def decode(self, payload):
+        '''Decode payload bytes, return an Indication'''
+
+        if len(payload) < 3:
+            raise ValueError("compact indication too short")
+
+        queued, flags = payload[0], payload[1]
+        slot = self.slots[flags & SLOT_MASK]
+        pos = 2
+
+        if flags & NEW_ADDR_FLAG:
+            slot.addr = struct.unpack_from("<I", payload, pos)[0]
+            pos += 4
+
+        dst_mode = (flags & DST_MASK) >> DST_OFFSET
+        if dst_mode == DST_OWN:
+            dst_addr = self.node_addr
+        elif dst_mode == DST_BCAST:
+            dst_addr = ADDR_BROADCAST
+        elif dst_mode == DST_EXPLICIT:
+            dst_addr = struct.unpack_from("<I", payload, pos)[0]
+            pos += 4
+        else:
+            raise ValueError("invalid destination mode %d" % dst_mode)
+
+        if flags & ENDPOINTS_FLAG:
+            slot.src_ep, slot.dst_ep = payload[pos], payload[pos + 1]
+            pos += 2
+
+        if flags & INFO_FLAG:
+            slot.info = payload[pos]
+            pos += 1
+
+        if slot.addr is None or slot.src_ep is None or slot.info is None:
+            # Indication sent before the host cleared its table
+            raise ValueError("slot %d not set" % (flags & SLOT_MASK))
+
+        delay, pos = decode_varint(payload, pos)
+
+        return Indication(queued, slot.addr, slot.src_ep, dst_addr,
+                          slot.dst_ep, slot.info, delay, bytes(payload[pos:]))
+
+
+# Functions
+
+def encode_varint(value):
+    '''Encode an unsigned value, 7 bits per byte, least significant
+    first'''
+
+    data = bytearray()
+    while value >= 0x80:
+        data.append((value & 0x7f) | 0x80)
+        value >>= 7
+    data.append(value)
+    return data
+
+def decode_varint(data, pos):
+    '''Decode a varint at pos, return value and position after it'''
+
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(data):
+            raise ValueError("truncated varint")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+def encode_rx_ind(ind):
+    '''Encode an Indication as DSAP-DATA_RX.indication payload'''
+
+    return struct.pack(RX_IND_FORMAT, ind.queued, ind.src_addr, ind.src_ep,
+                       ind.dst_addr, ind.dst_ep, ind.info, ind.delay,
+                       len(ind.apdu)) + ind.apdu
+
+def decode_rx_ind(payload):
+    '''Decode DSAP-DATA_RX.indication payload, return an Indication'''
+
+    header_size = struct.calcsize(RX_IND_FORMAT)
+    if len(payload) < header_size:
+        raise ValueError("indication too short")
+
+    (queued, src_addr, src_ep, dst_addr, dst_ep, info, delay,
+     apdu_len) = struct.unpack_from(RX_IND_FORMAT, payload)
+    apdu = bytes(payload[header_size:(header_size + apdu_len)])
+    if len(apdu) != apdu_len:
+        raise ValueError("truncated APDU")
+
+    return Indication(queued, src_addr, src_ep, dst_addr, dst_ep, info,
+                      delay, apdu)
+
+def crc16_ccitt(data, crc = 0xffff):
+    '''CRC-16-CCITT of WAPS frames'''
+
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xffff
+            else:
+                crc = (crc << 1) & 0xffff
+    return crc
+
+def slip_encode(frame):
+    '''SLIP encode a frame, with END characters on both sides'''
+
+    data = bytearray([SLIP_END])
+    for byte in frame:
+        if byte == SLIP_END:
+            data += bytes([SLIP_ESC, SLIP_ESC_END])
+        elif byte == SLIP_ESC:
+            data += bytes([SLIP_ESC, SLIP_ESC_ESC])
+        else:
+            data.append(byte)
+    data.append(SLIP_END)
+    return bytes(data)
+
+def make_frame(primitive_id, frame_id, payload):
+    '''Build a WAPS frame as sent on UART: header, payload, CRC and SLIP
+    encoding'''
+
+    frame = bytes([primitive_id, frame_id, len(payload)]) + payload
+    return slip_encode(frame + struct.pack("<H", crc16_ccitt(frame)))
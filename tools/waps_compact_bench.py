@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# waps_compact_bench.py - Measure compact WAPS data indications
+#
+# Generates indication streams like a sink sees them, from networks of
+# various sizes, and compares DSAP-DATA_RX.indication and
+# DSAP-DATA_RX_COMPACT.indication:
+#   - bytes on UART per indication, with frame header, CRC and SLIP
+#   - indications per second at a given baud rate
+#   - encoding and decoding speed of waps_compact.py
+#
+# Every decoded indication is checked against the generated one.
+#
+# Requires:
+#   - Python 3 v3.4 or newer
+#   - waps_compact.py in the same directory as this file
+
+import sys
+import os
+import random
+import argparse
+import textwrap
+import time
+import waps_compact
+
+
+# Constants
+
+# Default number of nodes sending to the sink
+DEFAULT_NODES = [4, 8, 50, 500]
+
+# Default number of indications per stream
+DEFAULT_COUNT = 20000
+
+# Default UART baud rate, bits per second
+DEFAULT_BAUD_RATE = 125000
+
+# UART bits per byte: start, 8 data and stop bits
+BITS_PER_BYTE = 10
+
+# Sink address
+SINK_ADDR = 0x00a1b2c3
+
+# APDU sizes, and how often they appear
+APDU_SIZES = [(8, 40), (20, 30), (50, 20), (102, 10)]
+
+# Part of packets that are broadcast
+BROADCAST_RATIO = 0.02
+
+# Part of packets sent to another endpoint pair than the usual one
+OTHER_ENDPOINT_RATIO = 0.05
+
+# Number of timing runs, best time is kept
+NUM_RUNS = 3
+
+
+# Functions
+
+def make_stream(num_nodes, count, seed):
+    '''Create a list of indications from num_nodes nodes'''
+
+    rnd = random.Random(seed)
+    sizes = [size for size, weight in APDU_SIZES for _ in range(weight)]
+
+    # Each node has its usual endpoints, QoS and hop count.
+    nodes = []
+    for n in range(num_nodes):
+        nodes.append((0x00100000 + n,
+                      rnd.choice([1, 10, 20]),
+                      rnd.choice([1, 10, 20]),
+                      (rnd.randint(1, 6) << 2) | rnd.choice([0, 0, 0, 1])))
+
+    stream = []
+    for _ in range(count):
+        addr, src_ep, dst_ep, info = rnd.choice(nodes)
+        dst_addr = SINK_ADDR
+        if rnd.random() < BROADCAST_RATIO:
+            dst_addr = waps_compact.ADDR_BROADCAST
+        if rnd.random() < OTHER_ENDPOINT_RATIO:
+            src_ep, dst_ep = 240, 255
+        if rnd.random() < 0.1:
+            # Route changed
+            info ^= 1 << 2
+        delay = int(rnd.expovariate(1.0 / 300))
+        apdu = bytes(rnd.getrandbits(8) for _ in range(rnd.choice(sizes)))
+        stream.append(waps_compact.Indication(0, addr, src_ep, dst_addr,
+                                              dst_ep, info, delay, apdu))
+    return stream
+
+def best_time(func):
+    '''Run a function a few times, return best time in seconds and last
+    result.'''
+
+    best = None
+    for _ in range(NUM_RUNS):
+        start = time.perf_counter()
+        result = func()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best, result
+
+def wire_bytes(primitive_id, payloads):
+    '''Bytes on UART for a list of payloads'''
+
+    return sum(len(waps_compact.make_frame(primitive_id, n & 0xff, payload))
+               for n, payload in enumerate(payloads))
+
+def run_benchmarks(stream):
+    '''Run benchmarks on a stream, return a list of (format, bytes per
+    indication, encode time, decode time) tuples.'''
+
+    results = []
+
+    enc_time, payloads = best_time(
+        lambda: [waps_compact.encode_rx_ind(ind) for ind in stream])
+    dec_time, decoded = best_time(
+        lambda: [waps_compact.decode_rx_ind(p) for p in payloads])
+    if decoded != stream:
+        raise ValueError("DSAP-DATA_RX.indication round trip failed")
+    results.append(("rx_ind",
+                    wire_bytes(waps_compact.DSAP_DATA_RX_IND, payloads) /
+                    len(stream), enc_time, dec_time))
+
+    def encode():
+        encoder = waps_compact.CompactEncoder(SINK_ADDR)
+        return [encoder.encode(ind) for ind in stream]
+
+    def decode():
+        decoder = waps_compact.CompactDecoder(SINK_ADDR)
+        return [decoder.decode(p) for p in payloads]
+
+    enc_time, payloads = best_time(encode)
+    dec_time, decoded = best_time(decode)
+    if decoded != stream:
+        raise ValueError("DSAP-DATA_RX_COMPACT.indication round trip failed")
+    results.append(("compact",
+                    wire_bytes(waps_compact.DSAP_DATA_RX_COMPACT_IND,
+                               payloads) / len(stream), enc_time, dec_time))
+
+    return results
+
+def create_argument_parser(pgmname):
+    '''Create a parser for parsing the command line.'''
+
+    # Determine help text width.
+    try:
+        help_width = int(os.environ['COLUMNS'])
+    except (KeyError, ValueError):
+        help_width = 80
+    help_width -= 2
+
+    parser = argparse.ArgumentParser(
+        prog = pgmname,
+        formatter_class = argparse.RawDescriptionHelpFormatter,
+        description = textwrap.fill(
+            "A tool to measure compact WAPS data indications", help_width))
+    parser.add_argument("--nodes", "-n",
+        type = int, action = "append",
+        help = "number of nodes sending to the sink, can be repeated "
+               "(default: %s)" % ", ".join(map(str, DEFAULT_NODES)))
+    parser.add_argument("--count", "-c",
+        type = int, default = DEFAULT_COUNT,
+        help = "indications per stream (default: %d)" % DEFAULT_COUNT)
+    parser.add_argument("--baud", "-b",
+        type = int, default = DEFAULT_BAUD_RATE,
+        help = "UART baud rate (default: %d)" % DEFAULT_BAUD_RATE)
+
+    return parser
+
+def main():
+    '''Main program'''
+
+    # Determine program name, for error messages.
+    pgmname = os.path.split(sys.argv[0])[-1]
+
+    # Create a parser for parsing the command line and printing error messages.
+    parser = create_argument_parser(pgmname)
+    args = parser.parse_args()
+
+    if args.count <= 0 or args.baud <= 0:
+        parser.error("count and baud rate must be positive")
+
+    sys.stdout.write("%-6s %-8s %10s %10s %12s %12s\n" %
+                     ("nodes", "format", "bytes/ind", "ind/s_uart",
+                      "enc_ind/s", "dec_ind/s"))
+    for num_nodes in args.nodes or DEFAULT_NODES:
+        stream = make_stream(num_nodes, args.count, num_nodes)
+        try:
+            results = run_benchmarks(stream)
+        except ValueError as exc:
+            sys.stdout.write("%s: %s\n" % (pgmname, exc))
+            return 1
+        for name, num_bytes, enc_time, dec_time in results:
+            sys.stdout.write("%-6d %-8s %10.1f %10.0f %12.0f %12.0f\n" %
+                             (num_nodes, name, num_bytes,
+                              args.baud / BITS_PER_BYTE / num_bytes,
+                              len(stream) / enc_time,
+                              len(stream) / dec_time))
+
+    return 0
+
+# Run main.
+if __name__ == "__main__":
+    sys.exit(main())
@@ -14,6 +14,7 @@
 #include <stdarg.h>
 #include "api.h"
 #include "uart_print.h"
+#include "log_token.h"
 
 /**
  * Simple library to print only relevant log messages.
@@ -53,13 +54,26 @@
  *    LOG(LVL_INFO, "This is an info message printed"\
  *                  "with current DEBUG_LOG_MAX_LEVEL = LVL_INFO);
  * @endcode
+ *
+ * With APP_PRINTING_TOKENIZED=yes also defined in the makefile, logs are
+ * sent as binary records and formatted on host by tools/logtoken.py, see
+ * log_token.h. Log prefix is then always module name, time and level.
  */
 
-#ifdef APP_PRINTING
-#define Print_Log(fmt, ...) UartPrint_printf(fmt, ##__VA_ARGS__)
 #ifndef DEBUG_LOG_UART_BAUDRATE
 #define DEBUG_LOG_UART_BAUDRATE 115200
 #endif
+
+#ifdef APP_PRINTING_TOKENIZED
+#ifdef DEBUG_LOG_MODULE_NAME
+#define Print_Log(fmt, ...) \
+    LOG_TOKEN("", DEBUG_LOG_MODULE_NAME, fmt, ##__VA_ARGS__)
+#else
+#define Print_Log(fmt, ...) LOG_TOKEN("", "", fmt, ##__VA_ARGS__)
+#endif
+#define LOG_INIT() LogToken_init(DEBUG_LOG_UART_BAUDRATE)
+#elif defined(APP_PRINTING)
+#define Print_Log(fmt, ...) UartPrint_printf(fmt, ##__VA_ARGS__)
 #define LOG_INIT() UartPrint_init(DEBUG_LOG_UART_BAUDRATE)
 #else
 #define Print_Log(fmt, ...)
@@ -169,6 +183,19 @@
  * \param   ...
  *          The list of parameters
  */
+#ifdef APP_PRINTING_TOKENIZED
+#ifdef DEBUG_LOG_MODULE_NAME
+#    define S_TOKEN_MODULE DEBUG_LOG_MODULE_NAME
+#else
+#    define S_TOKEN_MODULE ""
+#endif
+#define LOG(level, fmt, ...) \
+{ \
+    if(((uint8_t) level) <= ((uint8_t) DEBUG_LOG_MAX_LEVEL)) \
+    LOG_TOKEN(DEBUG_LVL_TO_STRING(level), S_TOKEN_MODULE, \
+              fmt"\n", ##__VA_ARGS__) \
+}
+#else
 #define LOG(level, fmt, ...) \
 { \
     ((uint8_t) level) <= ((uint8_t) DEBUG_LOG_MAX_LEVEL) ? \
@@ -179,6 +206,7 @@
         , ##__VA_ARGS__) : \
     (void)NULL; \
 }
+#endif
 
 /**
  * \brief   Print a buffer if its severity is lower or
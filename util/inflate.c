@@ -0,0 +1,422 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#include <string.h>
+#include "inflate.h"
+
+/** Maximum number of literal/length and distance codes */
+#define NUM_LIT_CODES       288
+#define NUM_DIST_CODES      30
+/** Number of length symbols (257 .. 285) */
+#define NUM_LENGTH_CODES    29
+/** Number of code length codes */
+#define NUM_CL_CODES        19
+/** Maximum code length in bits */
+#define MAX_BITS            15
+
+/** Base lengths and extra bits of length symbols 257 .. 285 */
+static const uint16_t m_length_base[NUM_LENGTH_CODES] =
+{
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t m_length_extra[NUM_LENGTH_CODES] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+/** Base distances and extra bits of distance symbols 0 .. 29 */
+static const uint16_t m_dist_base[NUM_DIST_CODES] =
+{
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const uint8_t m_dist_extra[NUM_DIST_CODES] =
+{
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/** Order of code length codes in dynamic block header */
+static const uint8_t m_cl_order[NUM_CL_CODES] =
+{
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/**
+ * \brief   Read bits, least significant bit first
+ * \return  -1 if stream is truncated
+ */
+static int32_t get_bits(inflate_t * s, uint8_t count)
+{
+    uint32_t value;
+
+    while (s->num_bits < count)
+    {
+        if (s->src_pos >= s->src_len)
+        {
+            return -1;
+        }
+        s->bits |= (uint32_t) s->src[s->src_pos++] << s->num_bits;
+        s->num_bits += 8;
+    }
+
+    value = s->bits & ((1ul << count) - 1);
+    s->bits >>= count;
+    s->num_bits -= count;
+    return value;
+}
+
+static bool build_tree(inflate_tree_t * tree,
+                       const uint8_t * lengths,
+                       uint16_t num)
+{
+    uint16_t offsets[MAX_BITS + 1];
+    uint16_t sum = 0;
+    int32_t left = 1;
+
+    memset(tree->counts, 0, sizeof(tree->counts));
+    for (uint16_t i = 0; i < num; i++)
+    {
+        tree->counts[lengths[i]]++;
+    }
+    tree->counts[0] = 0;
+
+    // Check code is not over-subscribed
+    for (uint8_t len = 1; len <= MAX_BITS; len++)
+    {
+        offsets[len] = sum;
+        sum += tree->counts[len];
+        left = (left << 1) - tree->counts[len];
+        if (left < 0)
+        {
+            return false;
+        }
+    }
+
+    for (uint16_t i = 0; i < num; i++)
+    {
+        if (lengths[i])
+        {
+            tree->symbols[offsets[lengths[i]]++] = i;
+        }
+    }
+    return true;
+}
+
+/**
+ * \brief   Decode a symbol with a canonical Huffman tree
+ * \return  -1 if stream is invalid or truncated
+ */
+static int32_t decode_symbol(inflate_t * s, const inflate_tree_t * tree)
+{
+    int32_t code = 0;
+    int32_t first = 0;
+    int32_t index = 0;
+
+    for (uint8_t len = 1; len <= MAX_BITS; len++)
+    {
+        int32_t bit = get_bits(s, 1);
+        if (bit < 0)
+        {
+            return -1;
+        }
+        code |= bit;
+
+        if (code - first < tree->counts[len])
+        {
+            return tree->symbols[index + code - first];
+        }
+        index += tree->counts[len];
+        first = (first + tree->counts[len]) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static bool put_byte(inflate_t * s, uint8_t byte)
+{
+    s->window[s->window_pos++] = byte;
+    s->out_len++;
+
+    if (s->window_pos == s->window_size)
+    {
+        s->window_pos = 0;
+        return s->write(s->window, s->window_size, s->write_ctx);
+    }
+    return true;
+}
+
+static inflate_res_e stored_block(inflate_t * s)
+{
+    uint16_t len, nlen;
+
+    // Skip to byte boundary
+    s->bits = 0;
+    s->num_bits = 0;
+
+    if (s->src_pos + 4 > s->src_len)
+    {
+        return INFLATE_RES_INVALID_DATA;
+    }
+    len = s->src[s->src_pos] | (s->src[s->src_pos + 1] << 8);
+    nlen = s->src[s->src_pos + 2] | (s->src[s->src_pos + 3] << 8);
+    s->src_pos += 4;
+
+    if ((uint16_t) (len ^ nlen) != 0xffff || s->src_pos + len > s->src_len)
+    {
+        return INFLATE_RES_INVALID_DATA;
+    }
+
+    while (len--)
+    {
+        if (!put_byte(s, s->src[s->src_pos++]))
+        {
+            return INFLATE_RES_WRITE_ERROR;
+        }
+    }
+    return INFLATE_RES_OK;
+}
+
+static void fixed_trees(inflate_t * s)
+{
+    uint8_t lengths[NUM_LIT_CODES];
+
+    memset(&lengths[0], 8, 144);
+    memset(&lengths[144], 9, 112);
+    memset(&lengths[256], 7, 24);
+    memset(&lengths[280], 8, 8);
+    build_tree(&s->lit_tree, lengths, NUM_LIT_CODES);
+
+    memset(lengths, 5, NUM_DIST_CODES);
+    build_tree(&s->dist_tree, lengths, NUM_DIST_CODES);
+}
+
+static inflate_res_e dynamic_trees(inflate_t * s)
+{
+    uint8_t lengths[NUM_LIT_CODES + NUM_DIST_CODES + 2];
+    int32_t hlit, hdist, hclen;
+    uint16_t num = 0;
+
+    hlit = get_bits(s, 5);
+    hdist = get_bits(s, 5);
+    hclen = get_bits(s, 4);
+    if (hlit < 0 || hdist < 0 || hclen < 0)
+    {
+        return INFLATE_RES_INVALID_DATA;
+    }
+    hlit += 257;
+    hdist += 1;
+    hclen += 4;
+
+    // Code length codes, decoded with distance tree as temporary storage
+    memset(lengths, 0, NUM_CL_CODES);
+    for (uint8_t i = 0; i < hclen; i++)
+    {
+        int32_t len = get_bits(s, 3);
+        if (len < 0)
+        {
+            return INFLATE_RES_INVALID_DATA;
+        }
+        lengths[m_cl_order[i]] = len;
+    }
+    if (!build_tree(&s->dist_tree, lengths, NUM_CL_CODES))
+    {
+        return INFLATE_RES_INVALID_DATA;
+    }
+
+    while (num < hlit + hdist)
+    {
+        int32_t sym = decode_symbol(s, &s->dist_tree);
+        int32_t repeat, extra;
+        uint8_t value = 0;
+
+        if (sym < 0)
+        {
+            return INFLATE_RES_INVALID_DATA;
+        }
+        else if (sym < 16)
+        {
+            lengths[num++] = sym;
+            continue;
+        }
+        else if (sym == 16)
+        {
+            if (num == 0)
+            {
+                return INFLATE_RES_INVALID_DATA;
+            }
+            value = lengths[num - 1];
+            extra = get_bits(s, 2);
+            repeat = extra + 3;
+        }
+        else if (sym == 17)
+        {
+            extra = get_bits(s, 3);
+            repeat = extra + 3;
+        }
+        else
+        {
+            extra = get_bits(s, 7);
+            repeat = extra + 11;
+        }
+
+        if (extra < 0 || num + repeat > hlit + hdist)
+        {
+            return INFLATE_RES_INVALID_DATA;
+        }
+        while (repeat--)
+        {
+            lengths[num++] = value;
+        }
+    }
+
+    if (!build_tree(&s->lit_tree, lengths, hlit)
+        || !build_tree(&s->dist_tree, &lengths[hlit], hdist))
+    {
+        return INFLATE_RES_INVALID_DATA;
+    }
+    return INFLATE_RES_OK;
+}
+
+static inflate_res_e huffman_block(inflate_t * s)
+{
+    while (true)
+    {
+        int32_t sym = decode_symbol(s, &s->lit_tree);
+        int32_t len, dist, extra;
+        size_t from;
+
+        if (sym < 0)
+        {
+            return INFLATE_RES_INVALID_DATA;
+        }
+        else if (sym < 256)
+        {
+            if (!put_byte(s, sym))
+            {
+                return INFLATE_RES_WRITE_ERROR;
+            }
+            continue;
+        }
+        else if (sym == 256)
+        {
+            return INFLATE_RES_OK;
+        }
+
+        sym -= 257;
+        if (sym >= NUM_LENGTH_CODES)
+        {
+            return INFLATE_RES_INVALID_DATA;
+        }
+        extra = get_bits(s, m_length_extra[sym]);
+        len = m_length_base[sym] + extra;
+
+        sym = decode_symbol(s, &s->dist_tree);
+        if (extra < 0 || sym < 0 || sym >= NUM_DIST_CODES)
+        {
+            return INFLATE_RES_INVALID_DATA;
+        }
+        extra = get_bits(s, m_dist_extra[sym]);
+        dist = m_dist_base[sym] + extra;
+        if (extra < 0 || (uint32_t) dist > s->out_len)
+        {
+            return INFLATE_RES_INVALID_DATA;
+        }
+        if ((size_t) dist > s->window_size)
+        {
+            return INFLATE_RES_WINDOW_TOO_SMALL;
+        }
+        if ((uint32_t) dist > s->max_dist)
+        {
+            s->max_dist = dist;
+        }
+
+        from = (s->window_pos + s->window_size - dist) % s->window_size;
+        while (len--)
+        {
+            uint8_t byte = s->window[from];
+            if (++from == s->window_size)
+            {
+                from = 0;
+            }
+            if (!put_byte(s, byte))
+            {
+                return INFLATE_RES_WRITE_ERROR;
+            }
+        }
+    }
+}
+
+inflate_res_e Inflate_run(inflate_t * state,
+                          const uint8_t * src,
+                          size_t src_len,
+                          uint8_t * window,
+                          size_t window_size,
+                          inflate_write_f write,
+                          void * ctx)
+{
+    inflate_res_e res = INFLATE_RES_OK;
+    int32_t final;
+
+    if (window_size == 0)
+    {
+        return INFLATE_RES_WINDOW_TOO_SMALL;
+    }
+
+    memset(state, 0, sizeof(inflate_t));
+    state->src = src;
+    state->src_len = src_len;
+    state->window = window;
+    state->window_size = window_size;
+    state->write = write;
+    state->write_ctx = ctx;
+
+    do
+    {
+        int32_t type;
+
+        final = get_bits(state, 1);
+        type = get_bits(state, 2);
+
+        if (final < 0 || type < 0)
+        {
+            return INFLATE_RES_INVALID_DATA;
+        }
+
+        switch (type)
+        {
+            case 0:
+                res = stored_block(state);
+                break;
+            case 1:
+                fixed_trees(state);
+                res = huffman_block(state);
+                break;
+            case 2:
+                res = dynamic_trees(state);
+                if (res == INFLATE_RES_OK)
+                {
+                    res = huffman_block(state);
+                }
+                break;
+            default:
+                res = INFLATE_RES_INVALID_DATA;
+                break;
+        }
+    } while (!final && res == INFLATE_RES_OK);
+
+    // Flush what is left in window
+    if (res == INFLATE_RES_OK && state->window_pos > 0
+        && !write(window, state->window_pos, ctx))
+    {
+        res = INFLATE_RES_WRITE_ERROR;
+    }
+
+    return res;
+}
@@ -0,0 +1,129 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * \file inflate.h
+ *
+ * Reference raw deflate (RFC 1951) decoder with a caller provided window.
+ *
+ * Scratchpad files are raw deflate streams (see tools/deflate.py). This
+ * decoder shows what a low RAM decompressor costs: its RAM usage is
+ * sizeof(\ref inflate_t) plus the window, and the window only needs to be as
+ * big as the largest distance used by the stream. Streams generated with the
+ * "smallwindow" compressor can be decoded with a 1 kB window.
+ *
+ * Decoded bytes are accumulated in the window and handed to a write callback
+ * each time the window is full and at the end of the stream.
+ */
+
+#ifndef INFLATE_H_
+#define INFLATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * \brief   List of return codes
+ */
+typedef enum
+{
+    /** Stream successfully decoded */
+    INFLATE_RES_OK = 0,
+    /** Stream is malformed or truncated */
+    INFLATE_RES_INVALID_DATA = 1,
+    /** Stream uses a distance bigger than the window */
+    INFLATE_RES_WINDOW_TOO_SMALL = 2,
+    /** Write callback reported an error */
+    INFLATE_RES_WRITE_ERROR = 3,
+} inflate_res_e;
+
+/**
+ * \brief   Callback to write decoded bytes
+ * \param   bytes
+ *          Decoded bytes
+ * \param   len
+ *          Number of decoded bytes
+ * \param   ctx
+ *          Context given to \ref Inflate_run
+ * \return  False to stop decoding
+ */
+typedef bool (*inflate_write_f)(const uint8_t * bytes, size_t len, void * ctx);
+
+/**
+ * \brief   Huffman decoding tree, in canonical form
+ */
+typedef struct
+{
+    /** Number of codes of each length */
+    uint16_t counts[16];
+    /** Symbols ordered by code */
+    uint16_t symbols[288];
+} inflate_tree_t;
+
+/**
+ * \brief   Decoder state
+ */
+typedef struct
+{
+    /** Compressed stream */
+    const uint8_t * src;
+    /** Compressed stream length */
+    size_t src_len;
+    /** Next byte to read in compressed stream */
+    size_t src_pos;
+    /** Bit accumulator */
+    uint32_t bits;
+    /** Number of bits in accumulator */
+    uint8_t num_bits;
+    /** Window (ring buffer of last decoded bytes) */
+    uint8_t * window;
+    /** Window size in bytes */
+    size_t window_size;
+    /** Next write position in window */
+    size_t window_pos;
+    /** Total number of decoded bytes */
+    uint32_t out_len;
+    /** Biggest distance met in stream */
+    uint32_t max_dist;
+    /** Write callback */
+    inflate_write_f write;
+    /** Write callback context */
+    void * write_ctx;
+    /** Literal/length tree of current block */
+    inflate_tree_t lit_tree;
+    /** Distance tree of current block */
+    inflate_tree_t dist_tree;
+} inflate_t;
+
+/**
+ * \brief   Decode a raw deflate stream
+ * \param   state
+ *          Decoder state, no initialization needed
+ * \param   src
+ *          Compressed stream
+ * \param   src_len
+ *          Compressed stream length in bytes, trailing padding is ignored
+ * \param   window
+ *          Buffer for the window
+ * \param   window_size
+ *          Window size in bytes
+ * \param   write
+ *          Callback to write decoded bytes
+ * \param   ctx
+ *          Context for write callback
+ * \return  Result code, \ref INFLATE_RES_OK if successful
+ * \note    state->out_len and state->max_dist can be read once finished
+ */
+inflate_res_e Inflate_run(inflate_t * state,
+                          const uint8_t * src,
+                          size_t src_len,
+                          uint8_t * window,
+                          size_t window_size,
+                          inflate_write_f write,
+                          void * ctx);
+
+#endif /* INFLATE_H_ */
@@ -0,0 +1,208 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+#include "log_token.h"
+#include "api.h"
+#include "hal_api.h"
+
+/** Longest record: id, time, info, dropped count and arguments */
+#define MAX_RECORD_SIZE     (1 + 5 * (3 + LOG_TOKEN_MAX_ARGS))
+
+/** COBS adds one byte per 254 bytes, plus the 0x00 delimiter */
+#define MAX_FRAME_SIZE      (MAX_RECORD_SIZE + 2)
+
+/** Info byte flag: a dropped record count follows */
+#define INFO_DROPPED_FLAG   0x80
+
+/** Duration of a coarse timestamp tick in us (1 / 128 s) */
+#define COARSE_TICK_US      7812
+
+/** Maximum time between records measured with HP timestamps, in coarse
+ *  ticks: longer delays may not fit in HP timestamps */
+#define MAX_HP_COARSE_TICKS 128
+
+/** Time of last sent record */
+static app_lib_time_timestamp_hp_t      m_last_hp;
+static app_lib_time_timestamp_coarse_t  m_last_coarse;
+
+/** Above this many coarse ticks since last record, use coarse timestamps */
+static uint32_t                         m_hp_limit_ticks;
+
+/** Records dropped since last sent record */
+static uint32_t                         m_dropped;
+
+/** Records dropped since initialization */
+static uint32_t                         m_dropped_total;
+
+/**
+ * \brief   Encode an unsigned LEB128 integer
+ * \param   p
+ *          Where to write, 5 bytes max
+ * \param   value
+ *          Value to encode
+ * \return  Pointer after encoded value
+ */
+static uint8_t * encode_varint(uint8_t * p, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+/**
+ * \brief   Encode a record with COBS and append 0x00 delimiter, so that a
+ *          decoder can resynchronize after lost bytes
+ * \param   frame
+ *          Where to write, \ref MAX_FRAME_SIZE bytes max
+ * \param   record
+ *          Record to encode
+ * \param   length
+ *          Record length, less than 254 bytes
+ * \return  Frame length
+ */
+static uint32_t encode_frame(uint8_t * frame, const uint8_t * record,
+                             uint32_t length)
+{
+    uint8_t * code = frame;
+    uint8_t * p = frame + 1;
+
+    *code = 1;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        if (record[i] == 0)
+        {
+            code = p++;
+            *code = 1;
+        }
+        else
+        {
+            *p++ = record[i];
+            (*code)++;
+        }
+    }
+    *p++ = 0;
+
+    return (uint32_t)(p - frame);
+}
+
+/**
+ * \brief   Get time elapsed since last sent record
+ * \param   now_hp
+ *          Current HP timestamp
+ * \param   now_coarse
+ *          Current coarse timestamp
+ * \return  Elapsed time in us, saturated to UINT32_MAX
+ */
+static uint32_t get_elapsed_us(app_lib_time_timestamp_hp_t now_hp,
+                               app_lib_time_timestamp_coarse_t now_coarse)
+{
+    uint32_t ticks = now_coarse - m_last_coarse;
+
+    if (ticks <= m_hp_limit_ticks)
+    {
+        return lib_time->getTimeDiffUs(now_hp, m_last_hp);
+    }
+
+    if (ticks > UINT32_MAX / (COARSE_TICK_US + 1))
+    {
+        return UINT32_MAX;
+    }
+    return ticks * COARSE_TICK_US + ticks / 2;
+}
+
+void LogToken_init(uint32_t baudrate)
+{
+    // Open HAL
+    HAL_Open();
+    // Initialize the hardware module
+    Usart_init(baudrate, false);
+    // And set power on (do not power down UART between writing frames)
+    Usart_setEnabled(true);
+
+    // HP timestamps are only valid for a limited time
+    m_hp_limit_ticks = lib_time->getMaxHpDelay() / 2 / COARSE_TICK_US;
+    if (m_hp_limit_ticks > MAX_HP_COARSE_TICKS)
+    {
+        m_hp_limit_ticks = MAX_HP_COARSE_TICKS;
+    }
+
+    m_last_hp = lib_time->getTimestampHp();
+    m_last_coarse = lib_time->getTimestampCoarse();
+    m_dropped = 0;
+    m_dropped_total = 0;
+}
+
+void LogToken_log(const char * token, uint8_t num_args, ...)
+{
+    uint8_t record[MAX_RECORD_SIZE];
+    uint8_t frame[MAX_FRAME_SIZE];
+    uint8_t * p = record;
+    app_lib_time_timestamp_hp_t now_hp;
+    app_lib_time_timestamp_coarse_t now_coarse;
+    uint32_t length;
+    va_list args;
+
+    if (num_args > LOG_TOKEN_MAX_ARGS)
+    {
+        num_args = LOG_TOKEN_MAX_ARGS;
+    }
+
+    // Records must be sent in the order their elapsed time is computed
+    Sys_enterCriticalSection();
+
+    now_hp = lib_time->getTimestampHp();
+    now_coarse = lib_time->getTimestampCoarse();
+
+    p = encode_varint(p, (uint32_t)(uintptr_t)token);
+    p = encode_varint(p, get_elapsed_us(now_hp, now_coarse));
+    if (m_dropped > 0)
+    {
+        *p++ = num_args | INFO_DROPPED_FLAG;
+        p = encode_varint(p, m_dropped);
+    }
+    else
+    {
+        *p++ = num_args;
+    }
+
+    va_start(args, num_args);
+    for (uint8_t i = 0; i < num_args; i++)
+    {
+        p = encode_varint(p, va_arg(args, uint32_t));
+    }
+    va_end(args);
+
+    length = encode_frame(frame, record, (uint32_t)(p - record));
+
+    if (Usart_sendBuffer(frame, length) == length)
+    {
+        // Next record time is relative to this one
+        m_last_hp = now_hp;
+        m_last_coarse = now_coarse;
+        m_dropped = 0;
+    }
+    else
+    {
+        // Uart buffer full: time of next record will include this one
+        m_dropped++;
+        m_dropped_total++;
+    }
+
+    Sys_exitCriticalSection();
+}
+
+uint32_t LogToken_getDropped(void)
+{
+    return m_dropped_total;
+}
@@ -0,0 +1,111 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * \file log_token.h
+ *
+ * Tokenized debug logs: binary log records with deferred formatting.
+ *
+ * Enabled with APP_PRINTING_TOKENIZED=yes, in addition to APP_PRINTING=yes,
+ * in application makefile. \ref LOG macro of debug_log.h then sends compact
+ * binary records instead of formatted text:
+ *  - Format strings are placed in the .log_strings section of the ELF file
+ *    and are never loaded to the target. The address of a format string in
+ *    that section is its id.
+ *  - The device only sends the id, the time elapsed since previous record
+ *    and the raw arguments, as variable length integers. Nothing is
+ *    formatted on the device.
+ *  - tools/logtoken.py builds a dictionary from the ELF file at build time
+ *    (\<app_name\>.logdict) and decodes the records back to text on host.
+ *
+ * Record format, before COBS encoding and 0x00 delimiter:
+ *  - varint: format string id
+ *  - varint: time since previous record, in us
+ *  - uint8:  number of arguments, bit 7 set if a dropped count follows
+ *  - varint: number of records dropped since previous record (optional)
+ *  - varint: each argument, as an unsigned 32-bit value
+ *
+ * Limitations:
+ *  - At most \ref LOG_TOKEN_MAX_ARGS arguments per log
+ *  - Arguments must be 32-bit values (integers, chars, pointers), floating
+ *    point values are not supported
+ *  - %s arguments are sent as addresses. The decoder can only print strings
+ *    located in flash (string literals, __FUNCTION__)
+ */
+
+#ifndef LOG_TOKEN_H_
+#define LOG_TOKEN_H_
+
+#include <stdint.h>
+
+/** Maximum number of arguments of a tokenized log */
+#define LOG_TOKEN_MAX_ARGS      8
+
+#ifdef APP_PRINTING_TOKENIZED
+
+/**
+ * \brief   Initialize the tokenized log module
+ * \param   baudrate
+ *          Baudrate to be used; min 115200 bits/s
+ * \note    Uart pins are define in board.h
+ */
+void LogToken_init(uint32_t baudrate);
+
+/**
+ * \brief   Send a tokenized log record
+ * \param   token
+ *          Format string, in .log_strings section
+ * \param   num_args
+ *          Number of arguments, max \ref LOG_TOKEN_MAX_ARGS
+ * \param   ...
+ *          Arguments, 32-bit values
+ * \note    Use \ref LOG_TOKEN macro instead of calling this function
+ */
+void LogToken_log(const char * token, uint8_t num_args, ...);
+
+/**
+ * \brief   Get the number of records dropped because Uart buffer was full
+ * \return  Number of dropped records since initialization
+ */
+uint32_t LogToken_getDropped(void);
+
+/**
+ * \brief   Count the arguments of a variadic macro, 0 to 8
+ */
+#define LOG_TOKEN_NARGS(...) \
+    LOG_TOKEN_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_TOKEN_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+
+/**
+ * \brief   Separator between fields of a format string in .log_strings
+ */
+#define LOG_TOKEN_SEPARATOR     "\x1f"
+
+/**
+ * \brief   Send a tokenized log record
+ * \param   level_string
+ *          Log level string, as in \ref DEBUG_LVL_TO_STRING
+ * \param   module_string
+ *          Module name string
+ * \param   fmt
+ *          Format of the log, a string literal
+ * \param   ...
+ *          The list of parameters
+ */
+#define LOG_TOKEN(level_string, module_string, fmt, ...) \
+{ \
+    static const char _log_token[] __attribute__((section(".log_strings"))) \
+        = level_string LOG_TOKEN_SEPARATOR module_string \
+          LOG_TOKEN_SEPARATOR fmt; \
+    LogToken_log(_log_token, LOG_TOKEN_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+}
+
+#else
+#define LogToken_init(baudrate)
+#define LOG_TOKEN(level_string, module_string, fmt, ...)
+#endif
+
+#endif /* LOG_TOKEN_H_ */
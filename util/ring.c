@@ -0,0 +1,133 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#include <string.h>
+#include "ring.h"
+
+/**
+ * Data must be in memory before the other side sees the index moving, and
+ * the index must be read before the data. Also prevents the compiler from
+ * reordering memory accesses around it.
+ */
+#define MEMORY_BARRIER()    __sync_synchronize()
+
+ring_res_e Ring_init(ring_t * ring, uint8_t * buffer, uint32_t size)
+{
+    if (buffer == NULL || size < 2 || (size & (size - 1)) != 0)
+    {
+        return RING_RES_INVALID_PARAM;
+    }
+
+    ring->buffer = buffer;
+    ring->mask = size - 1;
+    Ring_reset(ring);
+
+    return RING_RES_OK;
+}
+
+void Ring_reset(ring_t * ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+uint32_t Ring_write(ring_t * ring, const void * data, uint32_t length)
+{
+    const uint8_t * src = data;
+    uint32_t head = ring->head;
+    uint32_t index = head & ring->mask;
+    uint32_t free = Ring_free(ring);
+    uint32_t first;
+
+    // Single snapshot: tail may move while writing
+    if (length > free)
+    {
+        length = free;
+    }
+
+    // Up to end of storage, then from its beginning
+    first = Ring_size(ring) - index;
+    if (first > length)
+    {
+        first = length;
+    }
+    memcpy(&ring->buffer[index], src, first);
+    memcpy(&ring->buffer[0], src + first, length - first);
+
+    MEMORY_BARRIER();
+    ring->head = head + length;
+
+    return length;
+}
+
+uint32_t Ring_read(ring_t * ring, void * data, uint32_t length)
+{
+    uint8_t * dst = data;
+    uint32_t tail = ring->tail;
+    uint32_t index = tail & ring->mask;
+    uint32_t usage = Ring_usage(ring);
+    uint32_t first;
+
+    if (length > usage)
+    {
+        length = usage;
+    }
+    MEMORY_BARRIER();
+
+    first = Ring_size(ring) - index;
+    if (first > length)
+    {
+        first = length;
+    }
+    memcpy(dst, &ring->buffer[index], first);
+    memcpy(dst + first, &ring->buffer[0], length - first);
+
+    MEMORY_BARRIER();
+    ring->tail = tail + length;
+
+    return length;
+}
+
+uint32_t Ring_peekWrite(ring_t * ring, uint8_t ** span)
+{
+    uint32_t index = ring->head & ring->mask;
+    uint32_t length = Ring_free(ring);
+
+    if (length > Ring_size(ring) - index)
+    {
+        length = Ring_size(ring) - index;
+    }
+
+    *span = &ring->buffer[index];
+    return length;
+}
+
+void Ring_commitWrite(ring_t * ring, uint32_t length)
+{
+    MEMORY_BARRIER();
+    ring->head += length;
+}
+
+uint32_t Ring_peekRead(ring_t * ring, uint8_t ** span)
+{
+    uint32_t index = ring->tail & ring->mask;
+    uint32_t length = Ring_usage(ring);
+
+    if (length > Ring_size(ring) - index)
+    {
+        length = Ring_size(ring) - index;
+    }
+    MEMORY_BARRIER();
+
+    *span = &ring->buffer[index];
+    return length;
+}
+
+void Ring_commitRead(ring_t * ring, uint32_t length)
+{
+    MEMORY_BARRIER();
+    ring->tail += length;
+}
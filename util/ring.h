@@ -0,0 +1,206 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * \file ring.h
+ *
+ * Single producer, single consumer byte ring buffer.
+ *
+ * One context writes to the ring and another one reads from it, e.g. the
+ * application writes and an interrupt handler reads, without critical
+ * section: the producer only moves the head and the consumer only moves
+ * the tail. Several producers or several consumers must be serialized by
+ * the caller.
+ *
+ * Capacity is given at runtime and must be a power of two. Each ring has its
+ * own storage, so rings of different sizes can be used in a single file.
+ *
+ * Data can be copied in bulk with \ref Ring_write and \ref Ring_read, or
+ * accessed in place, e.g. by DMA, with contiguous spans:
+ * \code
+ * uint8_t * span;
+ * uint32_t length = Ring_peekRead(&ring, &span);
+ * // Send length bytes from span
+ * Ring_commitRead(&ring, length);
+ * \endcode
+ *
+ * Example:
+ * \code
+ * static uint8_t m_buffer[256];
+ * static ring_t m_ring;
+ *
+ * Ring_init(&m_ring, m_buffer, sizeof(m_buffer));
+ * Ring_write(&m_ring, data, data_length);
+ * \endcode
+ */
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * \brief   List of return codes
+ */
+typedef enum
+{
+    /** Operation is successful */
+    RING_RES_OK = 0,
+    /** Size is not a power of two or buffer is NULL */
+    RING_RES_INVALID_PARAM = 1,
+} ring_res_e;
+
+/**
+ * \brief   Ring buffer, initialized with \ref Ring_init
+ * \note    Fields are private to the library
+ */
+typedef struct
+{
+    /** Storage */
+    uint8_t *           buffer;
+    /** Capacity minus one */
+    uint32_t            mask;
+    /** Bytes written since reset, only modified by producer */
+    volatile uint32_t   head;
+    /** Bytes read since reset, only modified by consumer */
+    volatile uint32_t   tail;
+} ring_t;
+
+/**
+ * \brief   Initialize a ring buffer
+ * \param   ring
+ *          Ring to initialize
+ * \param   buffer
+ *          Storage for the ring, must stay valid while the ring is used
+ * \param   size
+ *          Size of buffer in bytes, a power of two
+ * \return  Result code, \ref RING_RES_OK if successful
+ */
+ring_res_e Ring_init(ring_t * ring, uint8_t * buffer, uint32_t size);
+
+/**
+ * \brief   Empty a ring buffer
+ * \param   ring
+ *          Ring to empty
+ * \note    Not safe while the producer or the consumer uses the ring
+ */
+void Ring_reset(ring_t * ring);
+
+/**
+ * \brief   Get the capacity of a ring buffer
+ * \param   ring
+ *          Ring buffer
+ * \return  Capacity in bytes
+ */
+static inline uint32_t Ring_size(const ring_t * ring)
+{
+    return ring->mask + 1;
+}
+
+/**
+ * \brief   Get the number of bytes that can be read
+ * \param   ring
+ *          Ring buffer
+ * \return  Number of bytes. Only grows until the consumer reads
+ */
+static inline uint32_t Ring_usage(const ring_t * ring)
+{
+    return ring->head - ring->tail;
+}
+
+/**
+ * \brief   Get the number of bytes that can be written
+ * \param   ring
+ *          Ring buffer
+ * \return  Number of bytes. Only grows until the producer writes
+ */
+static inline uint32_t Ring_free(const ring_t * ring)
+{
+    return Ring_size(ring) - Ring_usage(ring);
+}
+
+/**
+ * \brief   Check if a ring buffer is empty
+ * \param   ring
+ *          Ring buffer
+ * \return  True if there is nothing to read
+ */
+static inline bool Ring_isEmpty(const ring_t * ring)
+{
+    return ring->head == ring->tail;
+}
+
+/**
+ * \brief   Copy data to a ring buffer, from producer
+ * \param   ring
+ *          Ring buffer
+ * \param   data
+ *          Data to write
+ * \param   length
+ *          Number of bytes to write
+ * \return  Number of bytes written, less than length if ring is full
+ */
+uint32_t Ring_write(ring_t * ring, const void * data, uint32_t length);
+
+/**
+ * \brief   Copy data from a ring buffer, from consumer
+ * \param   ring
+ *          Ring buffer
+ * \param   data
+ *          Where to copy data
+ * \param   length
+ *          Maximum number of bytes to read
+ * \return  Number of bytes read, less than length if ring is empty
+ */
+uint32_t Ring_read(ring_t * ring, void * data, uint32_t length);
+
+/**
+ * \brief   Get the contiguous free space at head, from producer
+ * \param   ring
+ *          Ring buffer
+ * \param   span
+ *          Pointer to store the address of the free space
+ * \return  Number of contiguous bytes that can be written at span, 0 if
+ *          ring is full. When free space wraps, only its first part is given
+ * \note    Written bytes are given to the consumer with \ref Ring_commitWrite
+ */
+uint32_t Ring_peekWrite(ring_t * ring, uint8_t ** span);
+
+/**
+ * \brief   Give bytes written in place to the consumer
+ * \param   ring
+ *          Ring buffer
+ * \param   length
+ *          Number of bytes written, at most the length given by
+ *          \ref Ring_peekWrite
+ */
+void Ring_commitWrite(ring_t * ring, uint32_t length);
+
+/**
+ * \brief   Get the contiguous data at tail, from consumer
+ * \param   ring
+ *          Ring buffer
+ * \param   span
+ *          Pointer to store the address of the data
+ * \return  Number of contiguous bytes that can be read at span, 0 if ring is
+ *          empty. When data wraps, only its first part is given
+ * \note    Read bytes are given back to the producer with
+ *          \ref Ring_commitRead
+ */
+uint32_t Ring_peekRead(ring_t * ring, uint8_t ** span);
+
+/**
+ * \brief   Give bytes read in place back to the producer
+ * \param   ring
+ *          Ring buffer
+ * \param   length
+ *          Number of bytes read, at most the length given by
+ *          \ref Ring_peekRead
+ */
+void Ring_commitRead(ring_t * ring, uint32_t length);
+
+#endif /* RING_H_ */
@@ -69,6 +69,9 @@ typedef struct
 
 /**
  * \file ringbuffer.h
+ * \deprecated Kept for existing applications, use \ref ring.h instead: it
+ * supports several buffer sizes per file, bulk copies and contiguous spans.
+ *
  * Example:
  \code
     #define BUFFER_SIZE 128
@@ -0,0 +1,73 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+#include "startup_profile.h"
+
+/**
+ * Profile in .noinit section: not initialized at startup, so it can be
+ * written before .data is copied and .bss is zeroed.
+ * It must not have an initializer.
+ */
+static startup_profile_t m_profile __attribute__((section(".noinit")));
+
+void Startup_profile_begin(const app_global_functions_t * functions)
+{
+    const app_lib_time_t * time;
+
+    // lib_time global is not usable yet, open the library directly
+    time = functions->openLibrary(APP_LIB_TIME_NAME, APP_LIB_TIME_VERSION);
+    if (time == NULL)
+    {
+        m_profile.magic = 0;
+        return;
+    }
+
+    if (m_profile.magic == STARTUP_PROFILE_MAGIC)
+    {
+        m_profile.boot_count++;
+    }
+    else
+    {
+        m_profile.boot_count = 1;
+    }
+
+    for (uint8_t i = 0; i < STARTUP_PHASE_COUNT; i++)
+    {
+        m_profile.phase_us[i] = 0;
+    }
+    m_profile.time = time;
+    m_profile.total_us = 0;
+    m_profile.start_hp = time->getTimestampHp();
+    m_profile.last_hp = m_profile.start_hp;
+    m_profile.magic = STARTUP_PROFILE_MAGIC;
+}
+
+void Startup_profile_mark(startup_profile_phase_e phase)
+{
+    app_lib_time_timestamp_hp_t now;
+
+    if (m_profile.magic != STARTUP_PROFILE_MAGIC
+        || phase >= STARTUP_PHASE_COUNT)
+    {
+        return;
+    }
+
+    now = m_profile.time->getTimestampHp();
+    m_profile.phase_us[phase] += m_profile.time->getTimeDiffUs(now,
+                                                         m_profile.last_hp);
+    m_profile.total_us = m_profile.time->getTimeDiffUs(now,
+                                                       m_profile.start_hp);
+    m_profile.last_hp = now;
+}
+
+const startup_profile_t * Startup_profile_get(void)
+{
+    if (m_profile.magic != STARTUP_PROFILE_MAGIC)
+    {
+        return NULL;
+    }
+    return &m_profile;
+}
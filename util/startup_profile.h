@@ -0,0 +1,109 @@
+/* Copyright 2023 Wirepas Ltd. All Rights Reserved.
+ *
+ * See file LICENSE.txt for full license details.
+ *
+ */
+
+/**
+ * \file startup_profile.h
+ *
+ * Measures the time spent in each phase of application startup, from
+ * _start() to the end of App_init(): data copy, bss zeroing, board
+ * initialization, each library initialization and App_init().
+ *
+ * Enabled with STARTUP_PROFILE=yes in application makefile. Otherwise the
+ * \ref STARTUP_PROFILE_BEGIN and \ref STARTUP_PROFILE_MARK macros expand to
+ * nothing.
+ *
+ * Results are kept in a .noinit RAM section: they are written before .data
+ * and .bss are initialized and can be read by the application at any time
+ * after startup, e.g. to send them to the backend.
+ */
+
+#ifndef STARTUP_PROFILE_H_
+#define STARTUP_PROFILE_H_
+
+#include <stdint.h>
+#include "api.h"
+
+/**
+ * \brief   Startup phases, recorded at the end of each phase
+ */
+typedef enum
+{
+    STARTUP_PHASE_DATA_COPY = 0,
+    STARTUP_PHASE_BSS_ZERO,
+    STARTUP_PHASE_API_OPEN,
+    STARTUP_PHASE_BOARD_INIT,
+    STARTUP_PHASE_APP_SCHEDULER_INIT,
+    STARTUP_PHASE_SHARED_APPCONFIG_INIT,
+    STARTUP_PHASE_SHARED_DATA_INIT,
+    STARTUP_PHASE_STACK_STATE_INIT,
+    STARTUP_PHASE_APP_PERSISTENT_INIT,
+    STARTUP_PHASE_SHARED_BEACON_INIT,
+    STARTUP_PHASE_SHARED_NEIGHBORS_INIT,
+    STARTUP_PHASE_SHARED_OFFLINE_INIT,
+    STARTUP_PHASE_NEIGHBOR_CACHE_INIT,
+    STARTUP_PHASE_APP_INIT,
+    STARTUP_PHASE_COUNT
+} startup_profile_phase_e;
+
+/**
+ * \brief   Startup profile of last boot
+ */
+typedef struct
+{
+    /** \ref STARTUP_PROFILE_MAGIC when content is valid */
+    uint32_t magic;
+    /** Number of boots profiled since RAM content was lost */
+    uint32_t boot_count;
+    /** Timestamp of _start() */
+    app_lib_time_timestamp_hp_t start_hp;
+    /** Timestamp of last recorded phase end */
+    app_lib_time_timestamp_hp_t last_hp;
+    /** Time library, opened before .data is initialized */
+    const app_lib_time_t * time;
+    /** Duration of each phase in us, 0 if phase not executed */
+    uint32_t phase_us[STARTUP_PHASE_COUNT];
+    /** Total time from _start() to last recorded phase, in us */
+    uint32_t total_us;
+} startup_profile_t;
+
+/** Value of \ref startup_profile_t.magic when profile is valid */
+#define STARTUP_PROFILE_MAGIC   0x50525346
+
+#ifdef STARTUP_PROFILE
+
+/**
+ * \brief   Start profiling, first thing in _start()
+ * \param   functions
+ *          Global functions given to _start(), to open time library
+ * \note    Called before .data and .bss are initialized: only uses the
+ *          .noinit profile
+ */
+void Startup_profile_begin(const app_global_functions_t * functions);
+
+/**
+ * \brief   Record end of a startup phase
+ * \param   phase
+ *          Phase that just ended
+ */
+void Startup_profile_mark(startup_profile_phase_e phase);
+
+/**
+ * \brief   Get startup profile of current boot
+ * \return  Profile, or NULL if profiling did not start
+ */
+const startup_profile_t * Startup_profile_get(void);
+
+#define STARTUP_PROFILE_BEGIN(functions)    Startup_profile_begin(functions)
+#define STARTUP_PROFILE_MARK(phase)         Startup_profile_mark(phase)
+
+#else
+
+#define STARTUP_PROFILE_BEGIN(functions)
+#define STARTUP_PROFILE_MARK(phase)
+
+#endif
+
+#endif /* STARTUP_PROFILE_H_ */